@@ -6,23 +6,13 @@
 #include <linux/crypto.h>
 #include <crypto/aes.h>
 
-#define AES_MAXNR 14
-
-typedef struct {
-	unsigned int rd_key[4 *(AES_MAXNR + 1)];
-	int rounds;
-} AES_KEY;
+#include "aes_glue.h"
 
 struct AES_CTX {
 	AES_KEY enc_key;
 	AES_KEY dec_key;
 };
 
-asmlinkage void AES_encrypt(const u8 *in, u8 *out, AES_KEY *ctx);
-asmlinkage void AES_decrypt(const u8 *in, u8 *out, AES_KEY *ctx);
-asmlinkage int private_AES_set_decrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
-asmlinkage int private_AES_set_encrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
-
 static void aes_encrypt(struct crypto_tfm *tfm, u8 *dst, const u8 *src)
 {
 	struct AES_CTX *ctx = crypto_tfm_ctx(tfm);
@@ -88,6 +78,12 @@ static struct crypto_alg aes_alg = {
 	}
 };
 
+/* for the bit sliced modes in aesbs-glue.c */
+EXPORT_SYMBOL(AES_encrypt);
+EXPORT_SYMBOL(AES_decrypt);
+EXPORT_SYMBOL(private_AES_set_encrypt_key);
+EXPORT_SYMBOL(private_AES_set_decrypt_key);
+
 static int __init aes_init(void)
 {
 	return crypto_register_alg(&aes_alg);
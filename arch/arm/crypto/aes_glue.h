@@ -0,0 +1,22 @@
+/*
+ * The scalar AES routines of aes-armv4.S, shared by aes_glue.c and
+ * the CBC, CTR and XTS code in aesbs-glue.c.
+ */
+#ifndef _ARM_CRYPTO_AES_GLUE_H
+#define _ARM_CRYPTO_AES_GLUE_H
+
+#include <linux/linkage.h>
+
+#define AES_MAXNR 14
+
+typedef struct {
+	unsigned int rd_key[4 *(AES_MAXNR + 1)];
+	int rounds;
+} AES_KEY;
+
+asmlinkage void AES_encrypt(const u8 *in, u8 *out, AES_KEY *ctx);
+asmlinkage void AES_decrypt(const u8 *in, u8 *out, AES_KEY *ctx);
+asmlinkage int private_AES_set_decrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
+asmlinkage int private_AES_set_encrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
+
+#endif /* _ARM_CRYPTO_AES_GLUE_H */
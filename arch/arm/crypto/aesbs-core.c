@@ -0,0 +1,473 @@
+/*
+ * linux/arch/arm/crypto/aesbs-core.c
+ *
+ * Bit sliced AES for NEON, after Kasper and Schwabe, "Faster and
+ * Timing-Attack Resistant AES-GCM", CHES 2009, with the S-box circuit
+ * of Boyar and Peralta, "A depth-16 circuit for the AES S-box", 2011.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Eight blocks are processed at once, as eight 128 bit slices: byte p
+ * of slice b holds bit 7 - b of byte p of all eight blocks. SubBytes is
+ * then a boolean circuit over the slices, without table lookups, and
+ * ShiftRows and the column rotations of MixColumns are byte
+ * permutations of each slice. Round keys are kept in the same form,
+ * each key bit spread over a whole byte, see aesbs_convert_key().
+ *
+ * Built with -mfpu=neon and only entered from aesbs-glue.c with the
+ * NEON unit held; like lib/raid6/neon.uc it includes arm_neon.h and not
+ * the kernel headers.
+ */
+
+#include <arm_neon.h>
+
+/* byte p of the result is byte idx[p] of x */
+static const uint8x16_t shift_rows = {
+	0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11,
+};
+
+static const uint8x16_t inv_shift_rows = {
+	0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3,
+};
+
+/* row r of each column takes row r + 1, and row r + 2 */
+static const uint8x16_t rot_rows1 = {
+	1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+};
+
+static const uint8x16_t rot_rows2 = {
+	2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+};
+
+/* shift_rows followed by rot_rows1 */
+static const uint8x16_t shift_rot_rows1 = {
+	5, 10, 15, 0, 9, 14, 3, 4, 13, 2, 7, 8, 1, 6, 11, 12,
+};
+
+/* ARMv7 only has the 8 byte wide vtbl */
+static inline uint8x16_t perm(uint8x16_t x, uint8x16_t idx)
+{
+	uint8x8x2_t t;
+
+	t.val[0] = vget_low_u8(x);
+	t.val[1] = vget_high_u8(x);
+	return vcombine_u8(vtbl2_u8(t, vget_low_u8(idx)),
+			   vtbl2_u8(t, vget_high_u8(idx)));
+}
+
+#define swapmove(a, b, n, m)					\
+do {								\
+	uint8x16_t t = vandq_u8(veorq_u8(vshrq_n_u8(b, n), a), m); \
+	a = veorq_u8(a, t);					\
+	b = veorq_u8(b, vshlq_n_u8(t, n));			\
+} while (0)
+
+/*
+ * Eight blocks to slices and back: an 8x8 bit transpose in each byte
+ * position, which is its own inverse. Bit b of the bytes of block k
+ * ends up in bit 7 - k of x[7 - b].
+ */
+static inline void transpose(uint8x16_t x[8])
+{
+	const uint8x16_t m1 = vdupq_n_u8(0x55);
+	const uint8x16_t m2 = vdupq_n_u8(0x33);
+	const uint8x16_t m4 = vdupq_n_u8(0x0f);
+
+	swapmove(x[0], x[1], 1, m1);
+	swapmove(x[2], x[3], 1, m1);
+	swapmove(x[4], x[5], 1, m1);
+	swapmove(x[6], x[7], 1, m1);
+
+	swapmove(x[0], x[2], 2, m2);
+	swapmove(x[1], x[3], 2, m2);
+	swapmove(x[4], x[6], 2, m2);
+	swapmove(x[5], x[7], 2, m2);
+
+	swapmove(x[0], x[4], 4, m4);
+	swapmove(x[1], x[5], 4, m4);
+	swapmove(x[2], x[6], 4, m4);
+	swapmove(x[3], x[7], 4, m4);
+}
+
+static inline void load8(uint8x16_t x[8], const uint8_t *in)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x[i] = vld1q_u8(in + 16 * i);
+}
+
+static inline void store8(uint8_t *out, const uint8x16_t x[8])
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		vst1q_u8(out + 16 * i, x[i]);
+}
+
+/*
+ * Slices are indexed from the most significant bit, so that s[0] is the
+ * U0 of the S-box circuit, and the same in the key schedule.
+ */
+static inline void add_round_key(uint8x16_t s[8], const uint8_t *rk)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		s[i] = veorq_u8(s[i], vld1q_u8(rk + 16 * i));
+}
+
+/* multiply by x modulo x^8 + x^4 + x^3 + x + 1, s[0] most significant */
+static inline void xtime(uint8x16_t o[8], const uint8x16_t s[8])
+{
+	o[7] = s[0];
+	o[6] = veorq_u8(s[7], s[0]);
+	o[5] = s[6];
+	o[4] = veorq_u8(s[5], s[0]);
+	o[3] = veorq_u8(s[4], s[0]);
+	o[2] = s[3];
+	o[1] = s[2];
+	o[0] = s[1];
+}
+
+/* Boyar and Peralta's 113 gate circuit, U0 and S0 most significant */
+static inline void sub_bytes(uint8x16_t s[8])
+{
+	uint8x16_t T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13;
+	uint8x16_t T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24;
+	uint8x16_t T25, T26, T27;
+	uint8x16_t M1, M2, M3, M4, M5, M6, M7, M8, M9, M10, M11, M12, M13;
+	uint8x16_t M14, M15, M16, M17, M18, M19, M20, M21, M22, M23, M24;
+	uint8x16_t M25, M26, M27, M28, M29, M30, M31, M32, M33, M34, M35;
+	uint8x16_t M36, M37, M38, M39, M40, M41, M42, M43, M44, M45, M46;
+	uint8x16_t M47, M48, M49, M50, M51, M52, M53, M54, M55, M56, M57;
+	uint8x16_t M58, M59, M60, M61, M62, M63;
+	uint8x16_t L0, L1, L2, L3, L4, L5, L6, L7, L8, L9, L10, L11, L12;
+	uint8x16_t L13, L14, L15, L16, L17, L18, L19, L20, L21, L22, L23;
+	uint8x16_t L24, L25, L26, L27, L28, L29;
+	const uint8x16_t U0 = s[0], U1 = s[1], U2 = s[2], U3 = s[3];
+	const uint8x16_t U4 = s[4], U5 = s[5], U6 = s[6], U7 = s[7];
+
+	/* top linear transform */
+	T1 = veorq_u8(U0, U3);
+	T2 = veorq_u8(U0, U5);
+	T3 = veorq_u8(U0, U6);
+	T4 = veorq_u8(U3, U5);
+	T5 = veorq_u8(U4, U6);
+	T6 = veorq_u8(T1, T5);
+	T7 = veorq_u8(U1, U2);
+	T8 = veorq_u8(U7, T6);
+	T9 = veorq_u8(U7, T7);
+	T10 = veorq_u8(T6, T7);
+	T11 = veorq_u8(U1, U5);
+	T12 = veorq_u8(U2, U5);
+	T13 = veorq_u8(T3, T4);
+	T14 = veorq_u8(T6, T11);
+	T15 = veorq_u8(T5, T11);
+	T16 = veorq_u8(T5, T12);
+	T17 = veorq_u8(T9, T16);
+	T18 = veorq_u8(U3, U7);
+	T19 = veorq_u8(T7, T18);
+	T20 = veorq_u8(T1, T19);
+	T21 = veorq_u8(U6, U7);
+	T22 = veorq_u8(T7, T21);
+	T23 = veorq_u8(T2, T22);
+	T24 = veorq_u8(T2, T10);
+	T25 = veorq_u8(T20, T17);
+	T26 = veorq_u8(T3, T16);
+	T27 = veorq_u8(T1, T12);
+
+	/* shared non-linear middle */
+	M1 = vandq_u8(T13, T6);
+	M2 = vandq_u8(T23, T8);
+	M3 = veorq_u8(T14, M1);
+	M4 = vandq_u8(T19, U7);
+	M5 = veorq_u8(M4, M1);
+	M6 = vandq_u8(T3, T16);
+	M7 = vandq_u8(T22, T9);
+	M8 = veorq_u8(T26, M6);
+	M9 = vandq_u8(T20, T17);
+	M10 = veorq_u8(M9, M6);
+	M11 = vandq_u8(T1, T15);
+	M12 = vandq_u8(T4, T27);
+	M13 = veorq_u8(M12, M11);
+	M14 = vandq_u8(T2, T10);
+	M15 = veorq_u8(M14, M11);
+	M16 = veorq_u8(M3, M2);
+	M17 = veorq_u8(M5, T24);
+	M18 = veorq_u8(M8, M7);
+	M19 = veorq_u8(M10, M15);
+	M20 = veorq_u8(M16, M13);
+	M21 = veorq_u8(M17, M15);
+	M22 = veorq_u8(M18, M13);
+	M23 = veorq_u8(M19, T25);
+	M24 = veorq_u8(M22, M23);
+	M25 = vandq_u8(M22, M20);
+	M26 = veorq_u8(M21, M25);
+	M27 = veorq_u8(M20, M21);
+	M28 = veorq_u8(M23, M25);
+	M29 = vandq_u8(M28, M27);
+	M30 = vandq_u8(M26, M24);
+	M31 = vandq_u8(M20, M23);
+	M32 = vandq_u8(M27, M31);
+	M33 = veorq_u8(M27, M25);
+	M34 = vandq_u8(M21, M22);
+	M35 = vandq_u8(M24, M34);
+	M36 = veorq_u8(M24, M25);
+	M37 = veorq_u8(M21, M29);
+	M38 = veorq_u8(M32, M33);
+	M39 = veorq_u8(M23, M30);
+	M40 = veorq_u8(M35, M36);
+	M41 = veorq_u8(M38, M40);
+	M42 = veorq_u8(M37, M39);
+	M43 = veorq_u8(M37, M38);
+	M44 = veorq_u8(M39, M40);
+	M45 = veorq_u8(M42, M41);
+	M46 = vandq_u8(M44, T6);
+	M47 = vandq_u8(M40, T8);
+	M48 = vandq_u8(M39, U7);
+	M49 = vandq_u8(M43, T16);
+	M50 = vandq_u8(M38, T9);
+	M51 = vandq_u8(M37, T17);
+	M52 = vandq_u8(M42, T15);
+	M53 = vandq_u8(M45, T27);
+	M54 = vandq_u8(M41, T10);
+	M55 = vandq_u8(M44, T13);
+	M56 = vandq_u8(M40, T23);
+	M57 = vandq_u8(M39, T19);
+	M58 = vandq_u8(M43, T3);
+	M59 = vandq_u8(M38, T22);
+	M60 = vandq_u8(M37, T20);
+	M61 = vandq_u8(M42, T1);
+	M62 = vandq_u8(M45, T4);
+	M63 = vandq_u8(M41, T2);
+
+	/* bottom linear transform */
+	L0 = veorq_u8(M61, M62);
+	L1 = veorq_u8(M50, M56);
+	L2 = veorq_u8(M46, M48);
+	L3 = veorq_u8(M47, M55);
+	L4 = veorq_u8(M54, M58);
+	L5 = veorq_u8(M49, M61);
+	L6 = veorq_u8(M62, L5);
+	L7 = veorq_u8(M46, L3);
+	L8 = veorq_u8(M51, M59);
+	L9 = veorq_u8(M52, M53);
+	L10 = veorq_u8(M53, L4);
+	L11 = veorq_u8(M60, L2);
+	L12 = veorq_u8(M48, M51);
+	L13 = veorq_u8(M50, L0);
+	L14 = veorq_u8(M52, M61);
+	L15 = veorq_u8(M55, L1);
+	L16 = veorq_u8(M56, L0);
+	L17 = veorq_u8(M57, L1);
+	L18 = veorq_u8(M58, L8);
+	L19 = veorq_u8(M63, L4);
+	L20 = veorq_u8(L0, L1);
+	L21 = veorq_u8(L1, L7);
+	L22 = veorq_u8(L3, L12);
+	L23 = veorq_u8(L18, L2);
+	L24 = veorq_u8(L15, L9);
+	L25 = veorq_u8(L6, L10);
+	L26 = veorq_u8(L7, L9);
+	L27 = veorq_u8(L8, L10);
+	L28 = veorq_u8(L11, L14);
+	L29 = veorq_u8(L11, L17);
+
+	s[0] = veorq_u8(L6, L24);
+	s[1] = vmvnq_u8(veorq_u8(L16, L26));
+	s[2] = vmvnq_u8(veorq_u8(L19, L28));
+	s[3] = veorq_u8(L6, L21);
+	s[4] = veorq_u8(L20, L22);
+	s[5] = veorq_u8(L25, L29);
+	s[6] = vmvnq_u8(veorq_u8(L13, L27));
+	s[7] = vmvnq_u8(veorq_u8(L6, L23));
+}
+
+/*
+ * The inverse affine map of the S-box, y -> L^-1(y ^ 0x63): bit i of
+ * the result is y[i + 2] ^ y[i + 5] ^ y[i + 7] ^ (0x05 >> i & 1),
+ * counting bits from the least significant one.
+ */
+static inline void inv_affine(uint8x16_t s[8])
+{
+	uint8x16_t y[8];
+	int i;
+
+	/* y[7 - i] is bit i */
+	for (i = 0; i < 8; i++)
+		y[i] = s[i];
+	for (i = 0; i < 8; i++)
+		s[7 - i] = veorq_u8(veorq_u8(y[7 - ((i + 2) & 7)],
+					     y[7 - ((i + 5) & 7)]),
+				    y[7 - ((i + 7) & 7)]);
+	s[7] = vmvnq_u8(s[7]);
+	s[5] = vmvnq_u8(s[5]);
+}
+
+/* S^-1(y) = A^-1(S(A^-1(y))), the circuit being S(x) = A(x^-1) */
+static inline void inv_sub_bytes(uint8x16_t s[8])
+{
+	inv_affine(s);
+	sub_bytes(s);
+	inv_affine(s);
+}
+
+static inline void mix_columns(uint8x16_t s[8], const uint8x16_t r1[8])
+{
+	uint8x16_t t[8], x[8];
+	int i;
+
+	/*
+	 * 2 a[r] ^ 3 a[r+1] ^ a[r+2] ^ a[r+3]
+	 *	= 2 (a[r] ^ a[r+1]) ^ a[r+1] ^ (a[r+2] ^ a[r+3])
+	 */
+	for (i = 0; i < 8; i++)
+		t[i] = veorq_u8(s[i], r1[i]);
+	xtime(x, t);
+	for (i = 0; i < 8; i++)
+		s[i] = veorq_u8(veorq_u8(x[i], r1[i]),
+				perm(t[i], rot_rows2));
+}
+
+static inline void inv_mix_columns(uint8x16_t s[8])
+{
+	uint8x16_t r1[8], t[8], x[8];
+	int i;
+
+	/* {0b,0d,09,0e} = {03,01,01,02} * {04,00,05,00} */
+	for (i = 0; i < 8; i++)
+		t[i] = veorq_u8(s[i], perm(s[i], rot_rows2));
+	xtime(x, t);
+	xtime(t, x);
+	for (i = 0; i < 8; i++) {
+		s[i] = veorq_u8(s[i], t[i]);
+		r1[i] = perm(s[i], rot_rows1);
+	}
+	mix_columns(s, r1);
+}
+
+static void encrypt_slices(uint8x16_t s[8], const uint8_t *rk, int rounds)
+{
+	uint8x16_t r1[8];
+	int i;
+
+	add_round_key(s, rk);
+	while (--rounds) {
+		rk += 128;
+		sub_bytes(s);
+		for (i = 0; i < 8; i++) {
+			r1[i] = perm(s[i], shift_rot_rows1);
+			s[i] = perm(s[i], shift_rows);
+		}
+		mix_columns(s, r1);
+		add_round_key(s, rk);
+	}
+	sub_bytes(s);
+	for (i = 0; i < 8; i++)
+		s[i] = perm(s[i], shift_rows);
+	add_round_key(s, rk + 128);
+}
+
+static void decrypt_slices(uint8x16_t s[8], const uint8_t *rk, int rounds)
+{
+	int i;
+
+	rk += 128 * rounds;
+	add_round_key(s, rk);
+	while (--rounds) {
+		rk -= 128;
+		inv_sub_bytes(s);
+		for (i = 0; i < 8; i++)
+			s[i] = perm(s[i], inv_shift_rows);
+		add_round_key(s, rk);
+		inv_mix_columns(s);
+	}
+	inv_sub_bytes(s);
+	for (i = 0; i < 8; i++)
+		s[i] = perm(s[i], inv_shift_rows);
+	add_round_key(s, rk - 128);
+}
+
+static inline void xor8(uint8x16_t x[8], const uint8_t *p)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x[i] = veorq_u8(x[i], vld1q_u8(p + 16 * i));
+}
+
+/*
+ * out = E(in ^ tweak) ^ tweak for eight blocks, or E(in) without a
+ * tweak; in and out may be the same
+ */
+void aesbs_encrypt8(uint8_t *out, const uint8_t *in, const uint8_t *tweak,
+		    const uint8_t *rk, int rounds)
+{
+	uint8x16_t s[8];
+
+	load8(s, in);
+	if (tweak)
+		xor8(s, tweak);
+	transpose(s);
+	encrypt_slices(s, rk, rounds);
+	transpose(s);
+	if (tweak)
+		xor8(s, tweak);
+	store8(out, s);
+}
+
+void aesbs_decrypt8(uint8_t *out, const uint8_t *in, const uint8_t *tweak,
+		    const uint8_t *rk, int rounds)
+{
+	uint8x16_t s[8];
+
+	load8(s, in);
+	if (tweak)
+		xor8(s, tweak);
+	transpose(s);
+	decrypt_slices(s, rk, rounds);
+	transpose(s);
+	if (tweak)
+		xor8(s, tweak);
+	store8(out, s);
+}
+
+/*
+ * CBC decryption of eight blocks, chained from iv, which is left
+ * holding the last ciphertext block; in and out may be the same
+ */
+void aesbs_cbc_decrypt8(uint8_t *out, const uint8_t *in, uint8_t *iv,
+			const uint8_t *rk, int rounds)
+{
+	uint8x16_t s[8], c[8];
+	int i;
+
+	load8(c, in);
+	for (i = 0; i < 8; i++)
+		s[i] = c[i];
+	transpose(s);
+	decrypt_slices(s, rk, rounds);
+	transpose(s);
+	s[0] = veorq_u8(s[0], vld1q_u8(iv));
+	for (i = 1; i < 8; i++)
+		s[i] = veorq_u8(s[i], c[i - 1]);
+	vst1q_u8(iv, c[7]);
+	store8(out, s);
+}
+
+/* out = in ^ E(ctr) for eight blocks of counter values */
+void aesbs_ctr_encrypt8(uint8_t *out, const uint8_t *in, const uint8_t *ctr,
+			const uint8_t *rk, int rounds)
+{
+	uint8x16_t s[8];
+
+	load8(s, ctr);
+	transpose(s);
+	encrypt_slices(s, rk, rounds);
+	transpose(s);
+	xor8(s, in);
+	store8(out, s);
+}
@@ -0,0 +1,491 @@
+/*
+ * linux/arch/arm/crypto/aesbs-glue.c - glue code for NEON bit sliced AES
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * CBC decryption, CTR and XTS, the modes dm-crypt and ecryptfs spend
+ * their time in, eight blocks at a time through aesbs-core.c. CBC
+ * encryption is serial and stays with the scalar aes-armv4.S code,
+ * which also covers short tails and callers that cannot use NEON.
+ */
+
+#include <asm/neon.h>
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/gf128mul.h>
+#include <linux/crypto.h>
+#include <linux/hardirq.h>
+#include <linux/module.h>
+
+#include "aes_glue.h"
+
+#define BS_BLOCKS	8
+#define BS_BYTES	(BS_BLOCKS * AES_BLOCK_SIZE)
+
+/* aesbs-core.c */
+void aesbs_encrypt8(u8 *out, const u8 *in, const u8 *tweak,
+		    const u8 *rk, int rounds);
+void aesbs_decrypt8(u8 *out, const u8 *in, const u8 *tweak,
+		    const u8 *rk, int rounds);
+void aesbs_cbc_decrypt8(u8 *out, const u8 *in, u8 *iv,
+			const u8 *rk, int rounds);
+void aesbs_ctr_encrypt8(u8 *out, const u8 *in, const u8 *ctr,
+			const u8 *rk, int rounds);
+
+struct aesbs_ctx {
+	/* bit sliced round keys, used for both directions */
+	u8		rk[(AES_MAXNR + 1) * BS_BYTES];
+	int		rounds;
+	AES_KEY		enc;
+	AES_KEY		dec;
+};
+
+struct aesbs_xts_ctx {
+	struct aesbs_ctx	key;
+	AES_KEY			twkey;
+};
+
+static bool aesbs_may_use_neon(void)
+{
+	return !in_interrupt() && !kernel_neon_busy();
+}
+
+/*
+ * Spread round key bit b of byte p over byte p of slice 7 - b, to match
+ * the layout of the state in aesbs-core.c. The crypto_aes_ctx words are
+ * little endian, byte p of a round key is byte p % 4 of word p / 4.
+ */
+static void aesbs_convert_key(u8 *rk, const u32 *key_enc, int rounds)
+{
+	int r, p, i;
+
+	for (r = 0; r <= rounds; r++, rk += BS_BYTES, key_enc += 4)
+		for (p = 0; p < AES_BLOCK_SIZE; p++) {
+			u8 k = key_enc[p / 4] >> (8 * (p % 4));
+
+			for (i = 0; i < 8; i++)
+				rk[AES_BLOCK_SIZE * i + p] =
+					(k >> (7 - i)) & 1 ? 0xff : 0;
+		}
+}
+
+static int aesbs_expand_key(struct crypto_tfm *tfm, struct aesbs_ctx *ctx,
+			    const u8 *in_key, unsigned int key_len)
+{
+	struct crypto_aes_ctx rk;
+	int bits = key_len * 8;
+
+	if (crypto_aes_expand_key(&rk, in_key, key_len)) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+	ctx->rounds = 6 + key_len / 4;
+	aesbs_convert_key(ctx->rk, rk.key_enc, ctx->rounds);
+	memset(&rk, 0, sizeof(rk));
+
+	private_AES_set_encrypt_key(in_key, bits, &ctx->enc);
+	/* private_AES_set_decrypt_key expects an encryption key as input */
+	ctx->dec = ctx->enc;
+	private_AES_set_decrypt_key(in_key, bits, &ctx->dec);
+	return 0;
+}
+
+static int aesbs_set_key(struct crypto_tfm *tfm, const u8 *in_key,
+			 unsigned int key_len)
+{
+	return aesbs_expand_key(tfm, crypto_tfm_ctx(tfm), in_key, key_len);
+}
+
+static int aesbs_xts_set_key(struct crypto_tfm *tfm, const u8 *in_key,
+			     unsigned int key_len)
+{
+	struct aesbs_xts_ctx *ctx = crypto_tfm_ctx(tfm);
+	int err;
+
+	if (key_len % 2) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+	key_len /= 2;
+
+	err = aesbs_expand_key(tfm, &ctx->key, in_key, key_len);
+	if (err)
+		return err;
+	private_AES_set_encrypt_key(in_key + key_len, key_len * 8,
+				    &ctx->twkey);
+	return 0;
+}
+
+/*
+ * The NEON helpers below take any number of blocks; a final group of
+ * less than eight goes through a buffer on the stack.
+ */
+static void cbc_decrypt_neon(struct aesbs_ctx *ctx, u8 *dst, const u8 *src,
+			     unsigned int blocks, u8 *iv)
+{
+	u8 buf[BS_BYTES];
+	u8 last[AES_BLOCK_SIZE];
+
+	for (; blocks >= BS_BLOCKS; blocks -= BS_BLOCKS) {
+		aesbs_cbc_decrypt8(dst, src, iv, ctx->rk, ctx->rounds);
+		src += BS_BYTES;
+		dst += BS_BYTES;
+	}
+	if (blocks) {
+		memcpy(buf, src, blocks * AES_BLOCK_SIZE);
+		memcpy(last, buf + (blocks - 1) * AES_BLOCK_SIZE,
+		       AES_BLOCK_SIZE);
+		aesbs_cbc_decrypt8(buf, buf, iv, ctx->rk, ctx->rounds);
+		memcpy(dst, buf, blocks * AES_BLOCK_SIZE);
+		memcpy(iv, last, AES_BLOCK_SIZE);
+	}
+}
+
+static void cbc_decrypt_arm(struct aesbs_ctx *ctx, u8 *dst, const u8 *src,
+			    unsigned int blocks, u8 *iv)
+{
+	u8 prev[AES_BLOCK_SIZE];
+
+	for (; blocks; blocks--) {
+		memcpy(prev, src, AES_BLOCK_SIZE);
+		AES_decrypt(src, dst, &ctx->dec);
+		crypto_xor(dst, iv, AES_BLOCK_SIZE);
+		memcpy(iv, prev, AES_BLOCK_SIZE);
+		src += AES_BLOCK_SIZE;
+		dst += AES_BLOCK_SIZE;
+	}
+}
+
+static void ctr_crypt_neon(struct aesbs_ctx *ctx, u8 *dst, const u8 *src,
+			   unsigned int blocks, u8 *ctr)
+{
+	u8 ctrblk[BS_BYTES];
+	u8 buf[BS_BYTES];
+	unsigned int i, n;
+
+	for (; blocks; blocks -= n) {
+		n = min_t(unsigned int, blocks, BS_BLOCKS);
+		for (i = 0; i < n; i++) {
+			memcpy(ctrblk + i * AES_BLOCK_SIZE, ctr, AES_BLOCK_SIZE);
+			crypto_inc(ctr, AES_BLOCK_SIZE);
+		}
+		if (n == BS_BLOCKS) {
+			aesbs_ctr_encrypt8(dst, src, ctrblk, ctx->rk,
+					   ctx->rounds);
+		} else {
+			memcpy(buf, src, n * AES_BLOCK_SIZE);
+			aesbs_ctr_encrypt8(buf, buf, ctrblk, ctx->rk,
+					   ctx->rounds);
+			memcpy(dst, buf, n * AES_BLOCK_SIZE);
+		}
+		src += n * AES_BLOCK_SIZE;
+		dst += n * AES_BLOCK_SIZE;
+	}
+}
+
+static void ctr_crypt_arm(struct aesbs_ctx *ctx, u8 *dst, const u8 *src,
+			  unsigned int nbytes, u8 *ctr)
+{
+	u8 ks[AES_BLOCK_SIZE];
+	unsigned int n;
+
+	for (; nbytes; nbytes -= n) {
+		n = min_t(unsigned int, nbytes, AES_BLOCK_SIZE);
+		AES_encrypt(ctr, ks, &ctx->enc);
+		crypto_inc(ctr, AES_BLOCK_SIZE);
+		if (dst != src)
+			memcpy(dst, src, n);
+		crypto_xor(dst, ks, n);
+		src += n;
+		dst += n;
+	}
+}
+
+static void xts_crypt_neon(struct aesbs_ctx *ctx, u8 *dst, const u8 *src,
+			   unsigned int blocks, be128 *t, bool enc)
+{
+	u8 tweaks[BS_BYTES];
+	u8 buf[BS_BYTES];
+	unsigned int i, n;
+	const u8 *in;
+	u8 *out;
+
+	for (; blocks; blocks -= n) {
+		n = min_t(unsigned int, blocks, BS_BLOCKS);
+		for (i = 0; i < n; i++) {
+			memcpy(tweaks + i * AES_BLOCK_SIZE, t, AES_BLOCK_SIZE);
+			gf128mul_x_ble(t, t);
+		}
+		in = src;
+		out = dst;
+		if (n < BS_BLOCKS) {
+			memcpy(buf, src, n * AES_BLOCK_SIZE);
+			in = out = buf;
+		}
+		if (enc)
+			aesbs_encrypt8(out, in, tweaks, ctx->rk, ctx->rounds);
+		else
+			aesbs_decrypt8(out, in, tweaks, ctx->rk, ctx->rounds);
+		if (out == buf)
+			memcpy(dst, buf, n * AES_BLOCK_SIZE);
+		src += n * AES_BLOCK_SIZE;
+		dst += n * AES_BLOCK_SIZE;
+	}
+}
+
+static void xts_crypt_arm(struct aesbs_ctx *ctx, u8 *dst, const u8 *src,
+			  unsigned int blocks, be128 *t, bool enc)
+{
+	for (; blocks; blocks--) {
+		if (dst != src)
+			memcpy(dst, src, AES_BLOCK_SIZE);
+		crypto_xor(dst, (u8 *)t, AES_BLOCK_SIZE);
+		if (enc)
+			AES_encrypt(dst, dst, &ctx->enc);
+		else
+			AES_decrypt(dst, dst, &ctx->dec);
+		crypto_xor(dst, (u8 *)t, AES_BLOCK_SIZE);
+		gf128mul_x_ble(t, t);
+		src += AES_BLOCK_SIZE;
+		dst += AES_BLOCK_SIZE;
+	}
+}
+
+static int aesbs_cbc_encrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+
+	while ((nbytes = walk.nbytes)) {
+		u8 *s = walk.src.virt.addr;
+		u8 *d = walk.dst.virt.addr;
+
+		for (; nbytes >= AES_BLOCK_SIZE; nbytes -= AES_BLOCK_SIZE) {
+			crypto_xor(walk.iv, s, AES_BLOCK_SIZE);
+			AES_encrypt(walk.iv, d, &ctx->enc);
+			memcpy(walk.iv, d, AES_BLOCK_SIZE);
+			s += AES_BLOCK_SIZE;
+			d += AES_BLOCK_SIZE;
+		}
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+	return err;
+}
+
+static int aesbs_cbc_decrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+
+	while ((nbytes = walk.nbytes)) {
+		unsigned int blocks = nbytes / AES_BLOCK_SIZE;
+
+		if (aesbs_may_use_neon()) {
+			kernel_neon_begin();
+			cbc_decrypt_neon(ctx, walk.dst.virt.addr,
+					 walk.src.virt.addr, blocks, walk.iv);
+			kernel_neon_end();
+		} else {
+			cbc_decrypt_arm(ctx, walk.dst.virt.addr,
+					walk.src.virt.addr, blocks, walk.iv);
+		}
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+	return err;
+}
+
+static int aesbs_ctr_crypt(struct blkcipher_desc *desc,
+			   struct scatterlist *dst, struct scatterlist *src,
+			   unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt_block(desc, &walk, AES_BLOCK_SIZE);
+
+	while ((nbytes = walk.nbytes) >= AES_BLOCK_SIZE) {
+		unsigned int blocks = nbytes / AES_BLOCK_SIZE;
+
+		if (aesbs_may_use_neon()) {
+			kernel_neon_begin();
+			ctr_crypt_neon(ctx, walk.dst.virt.addr,
+				       walk.src.virt.addr, blocks, walk.iv);
+			kernel_neon_end();
+		} else {
+			ctr_crypt_arm(ctx, walk.dst.virt.addr,
+				      walk.src.virt.addr,
+				      blocks * AES_BLOCK_SIZE, walk.iv);
+		}
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+	/* the partial block at the end of the request */
+	if (walk.nbytes) {
+		ctr_crypt_arm(ctx, walk.dst.virt.addr, walk.src.virt.addr,
+			      walk.nbytes, walk.iv);
+		err = blkcipher_walk_done(desc, &walk, 0);
+	}
+	return err;
+}
+
+static int aesbs_xts_crypt(struct blkcipher_desc *desc,
+			   struct scatterlist *dst, struct scatterlist *src,
+			   unsigned int nbytes, bool enc)
+{
+	struct aesbs_xts_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	be128 t;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+	if (!walk.nbytes)
+		return err;
+
+	AES_encrypt(walk.iv, (u8 *)&t, &ctx->twkey);
+
+	while ((nbytes = walk.nbytes)) {
+		unsigned int blocks = nbytes / AES_BLOCK_SIZE;
+
+		if (aesbs_may_use_neon()) {
+			kernel_neon_begin();
+			xts_crypt_neon(&ctx->key, walk.dst.virt.addr,
+				       walk.src.virt.addr, blocks, &t, enc);
+			kernel_neon_end();
+		} else {
+			xts_crypt_arm(&ctx->key, walk.dst.virt.addr,
+				      walk.src.virt.addr, blocks, &t, enc);
+		}
+		err = blkcipher_walk_done(desc, &walk,
+					  nbytes % AES_BLOCK_SIZE);
+	}
+	return err;
+}
+
+static int aesbs_xts_encrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_xts_crypt(desc, dst, src, nbytes, true);
+}
+
+static int aesbs_xts_decrypt(struct blkcipher_desc *desc,
+			     struct scatterlist *dst, struct scatterlist *src,
+			     unsigned int nbytes)
+{
+	return aesbs_xts_crypt(desc, dst, src, nbytes, false);
+}
+
+/* above the cbc/ctr/xts templates over aes-asm, which get 200 */
+static struct crypto_alg aesbs_algs[] = { {
+	.cra_name		= "cbc(aes)",
+	.cra_driver_name	= "cbc-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_u	= {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_set_key,
+			.encrypt	= aesbs_cbc_encrypt,
+			.decrypt	= aesbs_cbc_decrypt,
+		}
+	}
+}, {
+	.cra_name		= "ctr(aes)",
+	.cra_driver_name	= "ctr-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_u	= {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_set_key,
+			.encrypt	= aesbs_ctr_crypt,
+			.decrypt	= aesbs_ctr_crypt,
+		}
+	}
+}, {
+	.cra_name		= "xts(aes)",
+	.cra_driver_name	= "xts-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_xts_ctx),
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_u	= {
+		.blkcipher = {
+			.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+			.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_xts_set_key,
+			.encrypt	= aesbs_xts_encrypt,
+			.decrypt	= aesbs_xts_decrypt,
+		}
+	}
+} };
+
+static int __init aesbs_mod_init(void)
+{
+	int i, err;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	for (i = 0; i < ARRAY_SIZE(aesbs_algs); i++) {
+		err = crypto_register_alg(&aesbs_algs[i]);
+		if (err)
+			goto unregister;
+	}
+	return 0;
+
+unregister:
+	while (--i >= 0)
+		crypto_unregister_alg(&aesbs_algs[i]);
+	return err;
+}
+
+static void __exit aesbs_mod_exit(void)
+{
+	int i;
+
+	for (i = ARRAY_SIZE(aesbs_algs) - 1; i >= 0; i--)
+		crypto_unregister_alg(&aesbs_algs[i]);
+}
+
+module_init(aesbs_mod_init);
+module_exit(aesbs_mod_exit);
+
+MODULE_DESCRIPTION("Bit sliced AES in CBC/CTR/XTS modes using NEON");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("cbc(aes)");
+MODULE_ALIAS("ctr(aes)");
+MODULE_ALIAS("xts(aes)");
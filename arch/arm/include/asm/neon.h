@@ -0,0 +1,53 @@
+/*
+ * linux/arch/arm/include/asm/neon.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+#include <linux/types.h>
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+
+/*
+ * Claim the NEON unit for kernel use. The section runs with preemption
+ * disabled and must not be entered from interrupt context or nested;
+ * the NEON registers are not preserved across kernel_neon_end().
+ */
+void kernel_neon_begin(void);
+void kernel_neon_end(void);
+bool kernel_neon_busy(void);
+
+#endif
+
+#ifdef CONFIG_ARM_NEON_STRING
+
+/*
+ * NEON paths behind memcpy, memset and copy_page, taken above the
+ * string_neon thresholds. They fall back to the LDM/STM versions when
+ * NEON cannot be used in the calling context.
+ */
+void *neon_memcpy(void *dest, const void *src, size_t n);
+void *neon_memset(void *s, int c, size_t n);
+void neon_memzero(void *s, size_t n);
+void neon_copy_page(void *to, const void *from);
+
+/* the NEON loops, n >= 64, called inside kernel_neon_begin() */
+void __memcpy_neon(void *dest, const void *src, size_t n, size_t pld);
+void __memset_neon(void *s, int c, size_t n);
+void __copy_page_neon(void *to, const void *from, size_t pld);
+
+/* the LDM/STM bodies, entered past the threshold test */
+void *__memcpy_arm(void *dest, const void *src, size_t n);
+void *__memset_arm(void *s, int c, size_t n);
+void __copy_page_arm(void *to, const void *from);
+
+#endif
+
+#endif
@@ -7,7 +7,9 @@
  * it under the terms of the GNU General Public License version 2 as
  * published by the Free Software Foundation.
  */
+#include <linux/hardirq.h>
 #include <asm-generic/xor.h>
+#include <asm/neon.h>
 
 #define __XOR(a1, a2) a1 ^= a2
 
@@ -132,10 +134,96 @@ static struct xor_block_template xor_block_arm4regs = {
 	.do_5	= xor_arm4regs_5,
 };
 
+#ifdef CONFIG_KERNEL_MODE_NEON
+
+/* arch/arm/lib/xor-neon.S */
+void xor_neon_2(unsigned long, unsigned long *, unsigned long *);
+void xor_neon_3(unsigned long, unsigned long *, unsigned long *,
+		unsigned long *);
+void xor_neon_4(unsigned long, unsigned long *, unsigned long *,
+		unsigned long *, unsigned long *);
+void xor_neon_5(unsigned long, unsigned long *, unsigned long *,
+		unsigned long *, unsigned long *, unsigned long *);
+
+/*
+ * The NEON unit cannot be used from interrupt context or inside another
+ * kernel_neon_begin() section; fall back to the integer loops there.
+ */
+#define NEON_XOR_USABLE()	(!in_interrupt() && !kernel_neon_busy())
+
+static void
+xor_neon_glue_2(unsigned long bytes, unsigned long *p1, unsigned long *p2)
+{
+	if (!NEON_XOR_USABLE()) {
+		xor_arm4regs_2(bytes, p1, p2);
+		return;
+	}
+	kernel_neon_begin();
+	xor_neon_2(bytes, p1, p2);
+	kernel_neon_end();
+}
+
+static void
+xor_neon_glue_3(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+		unsigned long *p3)
+{
+	if (!NEON_XOR_USABLE()) {
+		xor_arm4regs_3(bytes, p1, p2, p3);
+		return;
+	}
+	kernel_neon_begin();
+	xor_neon_3(bytes, p1, p2, p3);
+	kernel_neon_end();
+}
+
+static void
+xor_neon_glue_4(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+		unsigned long *p3, unsigned long *p4)
+{
+	if (!NEON_XOR_USABLE()) {
+		xor_arm4regs_4(bytes, p1, p2, p3, p4);
+		return;
+	}
+	kernel_neon_begin();
+	xor_neon_4(bytes, p1, p2, p3, p4);
+	kernel_neon_end();
+}
+
+static void
+xor_neon_glue_5(unsigned long bytes, unsigned long *p1, unsigned long *p2,
+		unsigned long *p3, unsigned long *p4, unsigned long *p5)
+{
+	if (!NEON_XOR_USABLE()) {
+		xor_arm4regs_5(bytes, p1, p2, p3, p4, p5);
+		return;
+	}
+	kernel_neon_begin();
+	xor_neon_5(bytes, p1, p2, p3, p4, p5);
+	kernel_neon_end();
+}
+
+static struct xor_block_template xor_block_neon = {
+	.name	= "neon",
+	.do_2	= xor_neon_glue_2,
+	.do_3	= xor_neon_glue_3,
+	.do_4	= xor_neon_glue_4,
+	.do_5	= xor_neon_glue_5,
+};
+
+#define NEON_TEMPLATES				\
+	do {					\
+		if (cpu_has_neon())		\
+			xor_speed(&xor_block_neon); \
+	} while (0)
+#else
+#define NEON_TEMPLATES	do { } while (0)
+#endif
+
 #undef XOR_TRY_TEMPLATES
 #define XOR_TRY_TEMPLATES			\
 	do {					\
 		xor_speed(&xor_block_arm4regs);	\
 		xor_speed(&xor_block_8regs);	\
 		xor_speed(&xor_block_32regs);	\
+		NEON_TEMPLATES;			\
 	} while (0)
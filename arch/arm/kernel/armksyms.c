@@ -87,6 +87,19 @@ EXPORT_SYMBOL(memmove);
 EXPORT_SYMBOL(memchr);
 EXPORT_SYMBOL(__memzero);
 
+#ifdef CONFIG_KERNEL_MODE_NEON
+/* NEON xor_blocks loops, prototypes in asm/xor.h */
+extern void xor_neon_2(void);
+extern void xor_neon_3(void);
+extern void xor_neon_4(void);
+extern void xor_neon_5(void);
+
+EXPORT_SYMBOL_GPL(xor_neon_2);
+EXPORT_SYMBOL_GPL(xor_neon_3);
+EXPORT_SYMBOL_GPL(xor_neon_4);
+EXPORT_SYMBOL_GPL(xor_neon_5);
+#endif
+
 #ifdef CONFIG_MMU
 EXPORT_SYMBOL(copy_page);
 
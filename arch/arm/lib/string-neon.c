@@ -0,0 +1,213 @@
+/*
+ *  linux/arch/arm/lib/string-neon.c
+ *
+ *  Run time selection of the NEON memcpy, memset and copy_page.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * memcpy, memset, __memzero and copy_page test the variables below on
+ * entry and branch here for blocks at or above the threshold. Those
+ * stay at "never" until NEON has been detected, so nothing changes on
+ * CPUs without it or before the VFP support code is up.
+ *
+ * The NEON path is skipped in interrupt context and inside another
+ * kernel_neon_begin() section, where the LDM/STM code is used as
+ * before. Long copies are split so that preemption is not held off
+ * for more than NEON_STRING_CHUNK bytes at a time.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/hardirq.h>
+#include <linux/moduleparam.h>
+
+#include <asm/cputype.h>
+#include <asm/neon.h>
+#include <asm/page.h>
+
+#define NEON_STRING_MIN		64
+#define NEON_STRING_CHUNK	(64 * 1024)
+#define NEON_STRING_NEVER	UINT_MAX
+
+/* read by the assembler entry points */
+unsigned int neon_memcpy_min = NEON_STRING_NEVER;
+unsigned int neon_memset_min = NEON_STRING_NEVER;
+unsigned int neon_copy_page_on;
+
+static unsigned int neon_pld_dist;
+static bool neon_string_ready;
+
+/*
+ * Settings. A threshold of 0 turns that path off, a preload distance of
+ * 0 picks one for the CPU from the cache line size.
+ */
+static int enable = 1;
+static unsigned int memcpy_min = 1024;
+static unsigned int memset_min = 1024;
+static int copy_page_on = 1;
+static unsigned int pld_dist;
+
+EXPORT_SYMBOL_GPL(__memcpy_neon);
+EXPORT_SYMBOL_GPL(__memcpy_arm);
+EXPORT_SYMBOL_GPL(__memset_arm);
+EXPORT_SYMBOL_GPL(__copy_page_arm);
+
+static inline bool neon_string_usable(void)
+{
+	return !in_interrupt() && !kernel_neon_busy();
+}
+
+void *neon_memcpy(void *dest, const void *src, size_t n)
+{
+	void *d = dest;
+	size_t chunk;
+
+	if (n < NEON_STRING_MIN || !neon_string_usable())
+		return __memcpy_arm(dest, src, n);
+
+	do {
+		chunk = n >= 2 * NEON_STRING_CHUNK ? NEON_STRING_CHUNK : n;
+		kernel_neon_begin();
+		__memcpy_neon(d, src, chunk, neon_pld_dist);
+		kernel_neon_end();
+		d += chunk;
+		src += chunk;
+		n -= chunk;
+	} while (n);
+
+	return dest;
+}
+EXPORT_SYMBOL_GPL(neon_memcpy);
+
+void *neon_memset(void *s, int c, size_t n)
+{
+	void *d = s;
+	size_t chunk;
+
+	if (n < NEON_STRING_MIN || !neon_string_usable())
+		return __memset_arm(s, c, n);
+
+	do {
+		chunk = n >= 2 * NEON_STRING_CHUNK ? NEON_STRING_CHUNK : n;
+		kernel_neon_begin();
+		__memset_neon(d, c, chunk);
+		kernel_neon_end();
+		d += chunk;
+		n -= chunk;
+	} while (n);
+
+	return s;
+}
+EXPORT_SYMBOL_GPL(neon_memset);
+
+void neon_memzero(void *s, size_t n)
+{
+	neon_memset(s, 0, n);
+}
+
+void neon_copy_page(void *to, const void *from)
+{
+	if (!neon_string_usable()) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	__copy_page_neon(to, from, neon_pld_dist);
+	kernel_neon_end();
+}
+EXPORT_SYMBOL_GPL(neon_copy_page);
+
+/*
+ * Default preload distance: Scorpion wants about eight lines ahead to
+ * cover its memory latency, other cores four.
+ */
+static unsigned int neon_string_pld_default(void)
+{
+	unsigned int ctr = read_cpuid_cachetype();
+	unsigned int line = 4 << ((ctr >> 16) & 0xf);
+	unsigned int id = read_cpuid_id();
+
+	if ((ctr >> 29) != 4)
+		line = L1_CACHE_BYTES;
+	/* Scorpion, QSD8x50 and MSM8x60 parts */
+	if ((id & 0xff00fff0) == 0x510000f0 || (id & 0xff00fff0) == 0x510002d0)
+		return 8 * line;
+	return 4 * line;
+}
+
+static unsigned int neon_string_min(unsigned int min)
+{
+	if (!enable || !min)
+		return NEON_STRING_NEVER;
+	return max_t(unsigned int, min, NEON_STRING_MIN);
+}
+
+static void neon_string_update(void)
+{
+	if (!neon_string_ready)
+		return;
+
+	neon_pld_dist = pld_dist ? pld_dist : neon_string_pld_default();
+	neon_memcpy_min = neon_string_min(memcpy_min);
+	neon_memset_min = neon_string_min(memset_min);
+	neon_copy_page_on = enable && copy_page_on;
+}
+
+static int neon_string_set_uint(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_uint(val, kp);
+
+	if (!ret)
+		neon_string_update();
+	return ret;
+}
+
+static int neon_string_set_bool(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_bool(val, kp);
+
+	if (!ret)
+		neon_string_update();
+	return ret;
+}
+
+static struct kernel_param_ops neon_string_uint_ops = {
+	.set = neon_string_set_uint,
+	.get = param_get_uint,
+};
+
+static struct kernel_param_ops neon_string_bool_ops = {
+	.set = neon_string_set_bool,
+	.get = param_get_bool,
+};
+
+module_param_cb(enable, &neon_string_bool_ops, &enable, 0644);
+MODULE_PARM_DESC(enable, "Use the NEON string routines");
+module_param_cb(memcpy_min, &neon_string_uint_ops, &memcpy_min, 0644);
+MODULE_PARM_DESC(memcpy_min, "Smallest memcpy done with NEON, 0 for none");
+module_param_cb(memset_min, &neon_string_uint_ops, &memset_min, 0644);
+MODULE_PARM_DESC(memset_min, "Smallest memset done with NEON, 0 for none");
+module_param_cb(copy_page, &neon_string_bool_ops, &copy_page_on, 0644);
+MODULE_PARM_DESC(copy_page, "Use NEON for copy_page");
+module_param_cb(pld_dist, &neon_string_uint_ops, &pld_dist, 0644);
+MODULE_PARM_DESC(pld_dist, "Preload distance in bytes, 0 for the CPU default");
+
+/* after vfp_init(), which reports NEON in elf_hwcap */
+static int __init neon_string_init(void)
+{
+	if (!cpu_has_neon())
+		return 0;
+
+	neon_string_ready = true;
+	neon_string_update();
+	if (enable)
+		pr_info("NEON string routines: memcpy >= %u, memset >= %u, "
+			"copy_page %s, preload %u bytes\n",
+			neon_memcpy_min, neon_memset_min,
+			neon_copy_page_on ? "on" : "off", neon_pld_dist);
+	return 0;
+}
+late_initcall_sync(neon_string_init);
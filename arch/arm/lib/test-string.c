@@ -0,0 +1,366 @@
+/*
+ *  linux/arch/arm/lib/test-string.c
+ *
+ *  Self-test and benchmark for the NEON memcpy, memset and copy_page.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * On load the NEON paths are checked against the source buffer over a
+ * range of sizes and source/destination alignments, including the guard
+ * bytes on both sides, as is memmove() between overlapping buffers. Then
+ * the bandwidth of the LDM/STM and NEON versions is printed for each
+ * size, followed by the NEON copy at a range of preload distances. The
+ * thresholds and preload distance the kernel uses are the string_neon
+ * module parameters.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+
+#include <asm/neon.h>
+#include <asm/page.h>
+
+#define BUF_SIZE	(1024 * 1024)
+#define GUARD		64
+#define GUARD_BYTE	0xa5
+#define BENCH_BYTES	(32 * 1024 * 1024)
+#define BENCH_CHUNK	(64 * 1024)
+
+static int bench = 1;
+module_param(bench, int, 0444);
+MODULE_PARM_DESC(bench, "Run the benchmark after the self-test");
+
+static u8 *src, *dst;
+
+/* odd sizes around the 64 byte loop, and two spanning several chunks */
+static const size_t check_sizes[] = {
+	64, 65, 79, 127, 128, 129, 255, 1000, 4096, 4099, 65536 + 13,
+	3 * 65536 + 5,
+};
+
+static const size_t bench_sizes[] = {
+	64, 256, 1024, 4096, 16384, 65536, 262144, BUF_SIZE,
+};
+
+static const struct {
+	unsigned int src, dst;
+} bench_align[] = {
+	{ 0, 0 }, { 1, 0 }, { 0, 3 }, { 5, 11 },
+};
+
+static const unsigned int bench_pld[] = {
+	64, 128, 192, 256, 384, 512, 768,
+};
+
+static void fill(u8 *p, size_t n, u32 seed)
+{
+	while (n--) {
+		seed = seed * 1103515245 + 12345;
+		*p++ = seed >> 16;
+	}
+}
+
+static bool check_guard(const u8 *p, size_t n)
+{
+	while (n--)
+		if (*p++ != GUARD_BYTE)
+			return false;
+	return true;
+}
+
+static bool check_fill(const u8 *p, size_t n, u8 c)
+{
+	while (n--)
+		if (*p++ != c)
+			return false;
+	return true;
+}
+
+static int __init check_memcpy(void)
+{
+	unsigned int sa, da, i;
+	size_t n;
+	u8 *d;
+
+	for (i = 0; i < ARRAY_SIZE(check_sizes); i++) {
+		n = check_sizes[i];
+		for (sa = 0; sa < 16; sa++) {
+			for (da = 0; da < 16; da++) {
+				__memset_arm(dst, GUARD_BYTE, n + 2 * GUARD + 16);
+				d = dst + GUARD + da;
+				neon_memcpy(d, src + sa, n);
+				if (memcmp(d, src + sa, n) ||
+				    !check_guard(dst, GUARD + da) ||
+				    !check_guard(d + n, GUARD)) {
+					pr_err("memcpy size %zu src +%u dst +%u "
+					       "failed\n", n, sa, da);
+					return -EINVAL;
+				}
+			}
+		}
+		cond_resched();
+	}
+	return 0;
+}
+
+/* distances between overlapping source and destination */
+static const unsigned int overlap_shifts[] = {
+	1, 2, 3, 4, 7, 8, 15, 16, 17, 31, 32, 63, 64, 65, 127, 200,
+};
+
+/*
+ * memmove() over overlapping buffers in both directions; moves with
+ * dest below src are handed to memcpy when they don't overlap, so this
+ * also covers the NEON copy not being asked to move forward in place.
+ */
+static int __init check_memmove(void)
+{
+	unsigned int i, j, k;
+	size_t n;
+	u8 *d;
+
+	for (i = 0; i < ARRAY_SIZE(check_sizes); i++) {
+		n = check_sizes[i];
+		for (j = 0; j < ARRAY_SIZE(overlap_shifts); j++) {
+			k = overlap_shifts[j];
+			d = dst + GUARD;
+
+			__memset_arm(dst, GUARD_BYTE, n + k + 2 * GUARD);
+			__memcpy_arm(d, src, n + k);
+			memmove(d, d + k, n);
+			if (memcmp(d, src + k, n) ||
+			    memcmp(d + n, src + n, k) ||
+			    !check_guard(dst, GUARD) ||
+			    !check_guard(d + n + k, GUARD)) {
+				pr_err("memmove size %zu down by %u failed\n",
+				       n, k);
+				return -EINVAL;
+			}
+
+			__memset_arm(dst, GUARD_BYTE, n + k + 2 * GUARD);
+			__memcpy_arm(d, src, n + k);
+			memmove(d + k, d, n);
+			if (memcmp(d + k, src, n) ||
+			    memcmp(d, src, k) ||
+			    !check_guard(dst, GUARD) ||
+			    !check_guard(d + n + k, GUARD)) {
+				pr_err("memmove size %zu up by %u failed\n",
+				       n, k);
+				return -EINVAL;
+			}
+		}
+		cond_resched();
+	}
+	return 0;
+}
+
+static int __init check_memset(void)
+{
+	unsigned int da, i;
+	size_t n;
+	u8 *d;
+
+	for (i = 0; i < ARRAY_SIZE(check_sizes); i++) {
+		n = check_sizes[i];
+		for (da = 0; da < 16; da++) {
+			__memset_arm(dst, GUARD_BYTE, n + 2 * GUARD + 16);
+			d = dst + GUARD + da;
+			neon_memset(d, 0x3c + da, n);
+			if (!check_fill(d, n, 0x3c + da) ||
+			    !check_guard(dst, GUARD + da) ||
+			    !check_guard(d + n, GUARD)) {
+				pr_err("memset size %zu dst +%u failed\n",
+				       n, da);
+				return -EINVAL;
+			}
+		}
+	}
+	return 0;
+}
+
+static int __init check_copy_page(void)
+{
+	__memset_arm(dst, GUARD_BYTE, 3 * PAGE_SIZE);
+	neon_copy_page(dst + PAGE_SIZE, src);
+	if (memcmp(dst + PAGE_SIZE, src, PAGE_SIZE) ||
+	    !check_guard(dst, PAGE_SIZE) ||
+	    !check_guard(dst + 2 * PAGE_SIZE, PAGE_SIZE)) {
+		pr_err("copy_page failed\n");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static void bench_memcpy_arm(void *d, const void *s, size_t n)
+{
+	__memcpy_arm(d, s, n);
+}
+
+static void bench_memcpy_neon(void *d, const void *s, size_t n)
+{
+	neon_memcpy(d, s, n);
+}
+
+static void bench_memset_arm(void *d, const void *s, size_t n)
+{
+	__memset_arm(d, 0, n);
+}
+
+static void bench_memset_neon(void *d, const void *s, size_t n)
+{
+	neon_memset(d, 0, n);
+}
+
+static unsigned int bench_pld_dist;
+
+static void bench_memcpy_pld(void *d, const void *s, size_t n)
+{
+	size_t chunk;
+
+	while (n) {
+		chunk = min_t(size_t, n, BENCH_CHUNK);
+		kernel_neon_begin();
+		__memcpy_neon(d, s, chunk, bench_pld_dist);
+		kernel_neon_end();
+		d += chunk;
+		s += chunk;
+		n -= chunk;
+	}
+}
+
+/* copy_page over successive pages of the buffers; n is the span */
+static void bench_copy_page_arm(void *d, const void *s, size_t n)
+{
+	size_t off;
+
+	for (off = 0; off < n; off += PAGE_SIZE)
+		__copy_page_arm(d + off, s + off);
+}
+
+static void bench_copy_page_neon(void *d, const void *s, size_t n)
+{
+	size_t off;
+
+	for (off = 0; off < n; off += PAGE_SIZE)
+		neon_copy_page(d + off, s + off);
+}
+
+/* MB/s of fn over at least BENCH_BYTES */
+static unsigned int __init bench_run(void (*fn)(void *, const void *, size_t),
+				     void *d, const void *s, size_t n)
+{
+	unsigned int loops = max_t(unsigned int, BENCH_BYTES / n, 4);
+	unsigned int i;
+	ktime_t start;
+	u64 ns;
+
+	/* warm up caches and TLB */
+	fn(d, s, n);
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++)
+		fn(d, s, n);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	cond_resched();
+
+	return ns ? div64_u64((u64)loops * n * 1000, ns) : 0;
+}
+
+static void __init bench_pair(const char *name,
+			      void (*arm)(void *, const void *, size_t),
+			      void (*neon)(void *, const void *, size_t))
+{
+	unsigned int i, a;
+	size_t n;
+
+	pr_info("%s: size src+ dst+ arm_MBps neon_MBps\n", name);
+	for (i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+		n = bench_sizes[i];
+		if (n > BUF_SIZE - 16)
+			n = BUF_SIZE - 16;
+		for (a = 0; a < ARRAY_SIZE(bench_align); a++) {
+			u8 *d = dst + bench_align[a].dst;
+			u8 *s = src + bench_align[a].src;
+
+			pr_info("%s: %zu %u %u %u %u\n", name, n,
+				bench_align[a].src, bench_align[a].dst,
+				bench_run(arm, d, s, n),
+				bench_run(neon, d, s, n));
+		}
+	}
+}
+
+static void __init bench_all(void)
+{
+	unsigned int i;
+
+	bench_pair("memcpy", bench_memcpy_arm, bench_memcpy_neon);
+	bench_pair("memset", bench_memset_arm, bench_memset_neon);
+
+	pr_info("copy_page: span arm_MBps neon_MBps\n");
+	pr_info("copy_page: %lu %u %u\n", PAGE_SIZE,
+		bench_run(bench_copy_page_arm, dst, src, PAGE_SIZE),
+		bench_run(bench_copy_page_neon, dst, src, PAGE_SIZE));
+	pr_info("copy_page: %u %u %u\n", BUF_SIZE,
+		bench_run(bench_copy_page_arm, dst, src, BUF_SIZE),
+		bench_run(bench_copy_page_neon, dst, src, BUF_SIZE));
+
+	pr_info("memcpy preload: pld 16384_MBps %u_MBps\n", BUF_SIZE);
+	for (i = 0; i < ARRAY_SIZE(bench_pld); i++) {
+		bench_pld_dist = bench_pld[i];
+		pr_info("memcpy preload: %u %u %u\n", bench_pld_dist,
+			bench_run(bench_memcpy_pld, dst, src, 16384),
+			bench_run(bench_memcpy_pld, dst, src, BUF_SIZE));
+	}
+}
+
+static int __init test_string_init(void)
+{
+	int ret;
+
+	if (!cpu_has_neon())
+		return -ENODEV;
+
+	src = vmalloc(BUF_SIZE);
+	dst = vmalloc(BUF_SIZE);
+	if (!src || !dst) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	fill(src, BUF_SIZE, 1);
+
+	ret = check_memcpy();
+	if (!ret)
+		ret = check_memmove();
+	if (!ret)
+		ret = check_memset();
+	if (!ret)
+		ret = check_copy_page();
+	if (ret)
+		goto out;
+	pr_info("self-test passed\n");
+
+	if (bench)
+		bench_all();
+out:
+	vfree(src);
+	vfree(dst);
+	return ret;
+}
+
+static void __exit test_string_exit(void)
+{
+}
+
+module_init(test_string_init);
+module_exit(test_string_exit);
+MODULE_DESCRIPTION("NEON string routine self-test and benchmark");
+MODULE_LICENSE("GPL");
@@ -20,6 +20,12 @@
 
 typedef struct smd_channel smd_channel_t;
 
+/* A range of bytes in a channel fifo; the second part is used if it wraps */
+struct smd_buf_vec {
+	void *ptr[2];
+	unsigned len[2];
+};
+
 #define SMD_MAX_CH_NAME_LEN 20 /* includes null char at end */
 
 #define SMD_EVENT_DATA 1
@@ -78,6 +84,28 @@ int smd_write_user_buffer(smd_channel_t *ch, const void *data, int len);
 int smd_write_avail(smd_channel_t *ch);
 int smd_read_avail(smd_channel_t *ch);
 
+/* Zero-copy access to the channel fifos.
+ *
+ * smd_read_reserve() describes up to @len readable bytes in @vec without
+ * consuming them, for packet channels only bytes of the current packet.
+ * smd_read_commit() then consumes the first @len of those. Don't call
+ * smd_read_commit() on a packet channel from the notify callback.
+ *
+ * smd_write_reserve() describes up to @len bytes of free space in @vec;
+ * for packet channels the whole packet must fit or -ENOMEM is returned.
+ * Fill it in and call smd_write_commit() with the number of bytes
+ * written, which sends them (as one packet on packet channels). Nothing
+ * is sent if the reservation is simply not committed.
+ *
+ * Both reserve calls return the number of bytes described, commit calls
+ * the number of bytes committed, or a negative error code. The caller
+ * serializes reads and writes like it does for smd_read()/smd_write().
+ */
+int smd_read_reserve(smd_channel_t *ch, struct smd_buf_vec *vec, int len);
+int smd_read_commit(smd_channel_t *ch, int len);
+int smd_write_reserve(smd_channel_t *ch, struct smd_buf_vec *vec, int len);
+int smd_write_commit(smd_channel_t *ch, int len);
+
 /* Returns the total size of the current packet being read.
 ** Returns 0 if no packets available or a stream channel.
 */
@@ -119,6 +147,17 @@ void smd_enable_read_intr(smd_channel_t *ch);
  */
 void smd_disable_read_intr(smd_channel_t *ch);
 
+/* Enables or disables transmit interrupt coalescing on a channel.
+ *
+ * When enabled, the other side is not interrupted after every write but
+ * once enough data is pending or shortly after the first pending write;
+ * the amount adapts to the rate data is written at. Meant for bulk data
+ * channels where a little added latency is acceptable. Disabling it
+ * sends any pending notification right away. Off by default and reset
+ * to off when the channel is opened.
+ */
+int smd_tx_coalesce(smd_channel_t *ch, int enable);
+
 /* Starts a packet transaction.  The size of the packet may exceed the total
  * size of the smd ring buffer.
  *
@@ -236,6 +275,28 @@ static inline int smd_cur_packet_size(smd_channel_t *ch)
 	return -ENODEV;
 }
 
+static inline int
+smd_read_reserve(smd_channel_t *ch, struct smd_buf_vec *vec, int len)
+{
+	return -ENODEV;
+}
+
+static inline int smd_read_commit(smd_channel_t *ch, int len)
+{
+	return -ENODEV;
+}
+
+static inline int
+smd_write_reserve(smd_channel_t *ch, struct smd_buf_vec *vec, int len)
+{
+	return -ENODEV;
+}
+
+static inline int smd_write_commit(smd_channel_t *ch, int len)
+{
+	return -ENODEV;
+}
+
 static inline int smd_tiocmget(smd_channel_t *ch)
 {
 	return -ENODEV;
@@ -268,6 +329,11 @@ static inline void smd_disable_read_intr(smd_channel_t *ch)
 {
 }
 
+static inline int smd_tx_coalesce(smd_channel_t *ch, int enable)
+{
+	return -ENODEV;
+}
+
 static inline int smd_write_start(smd_channel_t *ch, int len)
 {
 	return -ENODEV;
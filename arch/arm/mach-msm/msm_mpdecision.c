@@ -26,9 +26,13 @@
 #include <asm-generic/cputime.h>
 #include <linux/hrtimer.h>
 #include <linux/delay.h>
+#include <linux/tick.h>
 #include "acpuclock.h"
 #include <linux/rq_stats.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/mpdecision.h>
+
 #define DEFAULT_RQ_POLL_JIFFIES		1
 #define DEFAULT_DEF_TIMER_JIFFIES	5
 
@@ -37,6 +41,13 @@
 #define MSM_MPDEC_DELAY			100
 #define MSM_MPDEC_PAUSE			10000
 
+/* predictive mode defaults */
+#define MSM_MPDEC_EWMA_ALPHA		50
+#define MSM_MPDEC_TREND_BETA		30
+#define MSM_MPDEC_UP_LOAD		80
+#define MSM_MPDEC_DOWN_LOAD		60
+#define MSM_MPDEC_MIN_OFFLINE		1000
+
 struct global_attr {
 	struct attribute attr;
 	ssize_t (*show)(struct kobject *kobj,
@@ -57,6 +68,8 @@ struct msm_mpdec_cpudata_t {
 	struct mutex hotplug_mutex;
 	int online;
 	long long unsigned int times_cpu_hotplugged;
+	u64 prev_idle;
+	u64 prev_wall;
 };
 static DEFINE_PER_CPU(struct msm_mpdec_cpudata_t, msm_mpdec_cpudata);
 
@@ -70,12 +83,24 @@ static struct msm_mpdec_tuners {
 	bool scroff_single_core;
 	unsigned int max_cpus;
 	unsigned int min_cpus;
+	bool predictive;
+	unsigned int ewma_alpha;
+	unsigned int trend_beta;
+	unsigned int up_load;
+	unsigned int down_load;
+	unsigned int min_offline_ms;
 } msm_mpdec_tuners_ins = {
 	.delay = MSM_MPDEC_DELAY,
 	.pause = MSM_MPDEC_PAUSE,
 	.scroff_single_core = true,
 	.max_cpus = CONFIG_NR_CPUS,
 	.min_cpus = 1,
+	.predictive = true,
+	.ewma_alpha = MSM_MPDEC_EWMA_ALPHA,
+	.trend_beta = MSM_MPDEC_TREND_BETA,
+	.up_load = MSM_MPDEC_UP_LOAD,
+	.down_load = MSM_MPDEC_DOWN_LOAD,
+	.min_offline_ms = MSM_MPDEC_MIN_OFFLINE,
 };
 
 /* limit arrays: 1_up, 2_down, 2_up, 3_down, 3_up, 4_down, ...
@@ -90,6 +115,38 @@ static cputime64_t total_time = 0;
 static cputime64_t last_time;
 static int enabled = 1;
 
+/*
+ * Predictive mode
+ *
+ * Demand is the busy time of the online cpus plus whatever runnable
+ * tasks they had no room for, in percent of one cpu. It is smoothed with
+ * an EWMA of its level and an EWMA of its trend, and extrapolated: far
+ * enough ahead to cover cpu_up() when deciding to bring a cpu up, and
+ * over min_offline_ms (or ten times the cost of a down/up round trip,
+ * if that is longer) when deciding to take one down. A cpu only goes
+ * down when neither the forecast nor any sample in the recent history
+ * needs it, so periodic bursts keep it online instead of bouncing it.
+ *
+ * tools/mpdecision/mpdec-sim.c has a copy of mpdec_predict(); keep the
+ * two in sync.
+ */
+#define MPDEC_HIST_LEN			8
+#define MPDEC_FP_SHIFT			8
+#define MPDEC_INIT_COST_US		10000
+
+static struct msm_mpdec_pred {
+	unsigned int hist[MPDEC_HIST_LEN];
+	unsigned int hist_idx;
+	int level;		/* demand << MPDEC_FP_SHIFT */
+	int trend;		/* per sample, << MPDEC_FP_SHIFT */
+	bool primed;
+	unsigned int up_cost_us;
+	unsigned int down_cost_us;
+} mpdec_pred = {
+	.up_cost_us = MPDEC_INIT_COST_US,
+	.down_cost_us = MPDEC_INIT_COST_US,
+};
+
 unsigned int get_rq_avg(void) {
 	unsigned long flags = 0;
 	unsigned int rq = 0;
@@ -131,8 +188,18 @@ static bool mpdec_cpu_down(int cpu) {
 
 	ret = cpu_online(cpu);
 	if (ret) {
+		ktime_t start;
+		unsigned int cost;
+
 		mutex_lock(&per_cpu(msm_mpdec_cpudata, cpu).hotplug_mutex);
-		cpu_down(cpu);
+		/* time the transition itself, and only one that happened */
+		start = ktime_get();
+		if (!cpu_down(cpu)) {
+			cost = ktime_to_us(ktime_sub(ktime_get(), start));
+			mpdec_pred.down_cost_us =
+				(3 * mpdec_pred.down_cost_us + cost) / 4;
+			trace_mpdec_hotplug(cpu, 0, cost);
+		}
 		per_cpu(msm_mpdec_cpudata, cpu).online = false;
 		pr_info(MPDEC_TAG"CPU[%d] on->off | Mask=[%d%d]\n",
 			cpu, cpu_online(0), cpu_online(1));
@@ -146,9 +213,18 @@ static bool mpdec_cpu_up(int cpu) {
 
 	ret = !cpu_online(cpu);
 	if (ret) {
+		ktime_t start;
+		unsigned int cost;
+
 		mutex_lock(&per_cpu(msm_mpdec_cpudata, cpu).hotplug_mutex);
-		cpu_up(cpu);
-		per_cpu(msm_mpdec_cpudata, cpu).online = true;		
+		start = ktime_get();
+		if (!cpu_up(cpu)) {
+			cost = ktime_to_us(ktime_sub(ktime_get(), start));
+			mpdec_pred.up_cost_us =
+				(3 * mpdec_pred.up_cost_us + cost) / 4;
+			trace_mpdec_hotplug(cpu, 1, cost);
+		}
+		per_cpu(msm_mpdec_cpudata, cpu).online = true;
 		per_cpu(msm_mpdec_cpudata, cpu).times_cpu_hotplugged += 1;
 		pr_info(MPDEC_TAG"CPU[%d] off->on | Mask=[%d%d]\n",
 			cpu, cpu_online(0), cpu_online(1));
@@ -157,6 +233,119 @@ static bool mpdec_cpu_up(int cpu) {
 	return ret;
 }
 
+/* returns 1 if a cpu was brought up */
+static int mpdec_up_one(void) {
+	int cpu = 1;
+
+#if CONFIG_NR_CPUS > 2
+	cpu = cpumask_next_zero(0, cpu_online_mask);
+#endif
+	if (per_cpu(msm_mpdec_cpudata, cpu).online == true)
+		return 0;
+	if (mpdec_cpu_up(cpu))
+		return 1;
+	mpdec_pause(cpu);
+	return 0;
+}
+
+/* returns 1 if a cpu was taken down */
+static int mpdec_down_one(void) {
+	int cpu = 1;
+
+#if CONFIG_NR_CPUS > 2
+	cpu = get_slowest_cpu();
+#endif
+	if (per_cpu(msm_mpdec_cpudata, cpu).online == false)
+		return 0;
+	if (mpdec_cpu_down(cpu))
+		return 1;
+	mpdec_pause(cpu);
+	return 0;
+}
+
+/* busy time of the online cpus since the last call, in % of one cpu */
+static unsigned int mpdec_get_load(void) {
+	struct msm_mpdec_cpudata_t *pcpu;
+	unsigned int cpu, load = 0;
+	u64 idle, wall;
+
+	for_each_possible_cpu(cpu) {
+		pcpu = &per_cpu(msm_mpdec_cpudata, cpu);
+		if (!cpu_online(cpu)) {
+			pcpu->prev_wall = 0;
+			continue;
+		}
+		idle = get_cpu_idle_time_us(cpu, &wall);
+		if (idle == -1ULL)
+			return 0;
+		if (pcpu->prev_wall && wall > pcpu->prev_wall) {
+			unsigned int w = (unsigned int)(wall - pcpu->prev_wall);
+			unsigned int i = (unsigned int)(idle - pcpu->prev_idle);
+
+			if (i < w)
+				load += 100 * (w - i) / w;
+		}
+		pcpu->prev_idle = idle;
+		pcpu->prev_wall = wall;
+	}
+	return load;
+}
+
+static int mpdec_extrapolate(int samples) {
+	int f = mpdec_pred.level + samples * mpdec_pred.trend;
+
+	return f > 0 ? f >> MPDEC_FP_SHIFT : 0;
+}
+
+/*
+ * Feed one demand sample to the predictor and decide.
+ * Returns 1 to bring a cpu up, -1 to take one down, 0 to stay.
+ */
+static int mpdec_predict(unsigned int demand, unsigned int online,
+			 int *forecast) {
+	struct msm_mpdec_pred *p = &mpdec_pred;
+	struct msm_mpdec_tuners *t = &msm_mpdec_tuners_ins;
+	unsigned int alpha = min(t->ewma_alpha, 100U);
+	unsigned int beta = min(t->trend_beta, 100U);
+	unsigned int delay_us = max(t->delay, 1U) * 1000;
+	unsigned int i, hist_max = 0, down_ms, cap;
+	int x = demand << MPDEC_FP_SHIFT, prev, f_up, f_down;
+
+	p->hist[p->hist_idx] = demand;
+	p->hist_idx = (p->hist_idx + 1) % MPDEC_HIST_LEN;
+	for (i = 0; i < MPDEC_HIST_LEN; i++)
+		hist_max = max(hist_max, p->hist[i]);
+
+	if (!p->primed) {
+		p->level = x;
+		p->trend = 0;
+		p->primed = true;
+	} else {
+		prev = p->level;
+		p->level = ((int)alpha * x +
+			    (100 - (int)alpha) * (p->level + p->trend)) / 100;
+		p->trend = ((int)beta * (p->level - prev) +
+			    (100 - (int)beta) * p->trend) / 100;
+	}
+
+	f_up = mpdec_extrapolate(1 + p->up_cost_us / delay_us);
+	down_ms = max(t->min_offline_ms,
+		      10 * (p->up_cost_us + p->down_cost_us) / 1000);
+	f_down = mpdec_extrapolate(down_ms * 1000 / delay_us);
+	*forecast = f_up;
+
+	if (online < t->max_cpus &&
+	    max_t(int, demand, f_up) > online * t->up_load)
+		return 1;
+
+	if (online > t->min_cpus) {
+		cap = (online - 1) * t->down_load;
+		if (hist_max < cap && f_up < cap && f_down < cap)
+			return -1;
+	}
+	return 0;
+}
+
 static void rq_work_fn(struct work_struct *work) {
 	int64_t diff, now;
 
@@ -172,7 +361,8 @@ static void msm_mpdec_work_thread(struct work_struct *work) {
 	unsigned int cpu;
 	int nr_cpu_online;
 	int index;
-	unsigned int rq_avg;
+	unsigned int rq_avg, load, demand;
+	int forecast = -1, action = 0;
 	cputime64_t current_time;
 
 	current_time = ktime_to_ms(ktime_get());
@@ -193,38 +383,43 @@ static void msm_mpdec_work_thread(struct work_struct *work) {
 		}
 	}
 
-	cpu = 1;
 	rq_avg = get_rq_avg();
 	nr_cpu_online = num_online_cpus();
+	load = mpdec_get_load();
+	/* runnable tasks beyond one per online cpu had to wait */
+	demand = load;
+	if (rq_avg * 10 > nr_cpu_online * 100)
+		demand += rq_avg * 10 - nr_cpu_online * 100;
+
+	if (msm_mpdec_tuners_ins.predictive) {
+		action = mpdec_predict(demand, nr_cpu_online, &forecast);
+		if (action > 0)
+			action = mpdec_up_one();
+		else if (action < 0)
+			action = -mpdec_down_one();
+		goto trace;
+	}
+
 	index = 2*nr_cpu_online - 2;
 
 	if ((nr_cpu_online < msm_mpdec_tuners_ins.max_cpus) && 
 	    (rq_avg >= load_limit[index])) {
 		if (total_time >= time_limit[index]) {
-#if CONFIG_NR_CPUS > 2
-			cpu = cpumask_next_zero(0, cpu_online_mask);
-#endif
-			if (per_cpu(msm_mpdec_cpudata, cpu).online == false) {
-				if (mpdec_cpu_up(cpu))
-					total_time = 0;
-				else
-					mpdec_pause(cpu);
-			}
+			action = mpdec_up_one();
+			if (action)
+				total_time = 0;
 		}
 	} else if ((nr_cpu_online > msm_mpdec_tuners_ins.min_cpus) &&
 		   (rq_avg <= load_limit[index-1])) {
 		if (total_time >= time_limit[index-1]) {
-#if CONFIG_NR_CPUS > 2
-			cpu = get_slowest_cpu();
-#endif
-			if (per_cpu(msm_mpdec_cpudata, cpu).online == true) {
-				if (mpdec_cpu_down(cpu))
-					total_time = 0;
-				else
-					mpdec_pause(cpu);
-			}
+			action = -mpdec_down_one();
+			if (action)
+				total_time = 0;
 		}
 	}
+trace:
+	trace_mpdec_decision(rq_avg, load, demand, forecast, nr_cpu_online,
+			     action);
 out:
 	last_time = current_time;
 	if (enabled)
@@ -320,6 +515,12 @@ show_one(pause, pause);
 show_one(scroff_single_core, scroff_single_core);
 show_one(min_cpus, min_cpus);
 show_one(max_cpus, max_cpus);
+show_one(predictive, predictive);
+show_one(ewma_alpha, ewma_alpha);
+show_one(trend_beta, trend_beta);
+show_one(up_load, up_load);
+show_one(down_load, down_load);
+show_one(min_offline_ms, min_offline_ms);
 
 #define store_one(file_name, object)					\
 static ssize_t store_##file_name					\
@@ -339,6 +540,12 @@ store_one(pause, pause);
 store_one(scroff_single_core, scroff_single_core);
 store_one(max_cpus, max_cpus);
 store_one(min_cpus, min_cpus);
+store_one(predictive, predictive);
+store_one(ewma_alpha, ewma_alpha);
+store_one(trend_beta, trend_beta);
+store_one(up_load, up_load);
+store_one(down_load, down_load);
+store_one(min_offline_ms, min_offline_ms);
 
 #define show_one_tlim(file_name, arraypos)				\
 static ssize_t show_##file_name						\
@@ -400,6 +607,12 @@ static struct attribute *msm_mpdec_attributes[] = {
 	&time_limit_1.attr,
 	&load_limit_0.attr,
 	&load_limit_1.attr,
+	&predictive.attr,
+	&ewma_alpha.attr,
+	&trend_beta.attr,
+	&up_load.attr,
+	&down_load.attr,
+	&min_offline_ms.attr,
 	NULL
 };
 
@@ -421,8 +634,19 @@ static ssize_t show_times_cpus_hotplugged(struct kobject *a,
 }
 define_one_global_ro(times_cpus_hotplugged);
 
+static ssize_t show_predictor(struct kobject *a,
+			struct attribute *b, char *buf) {
+	return sprintf(buf, "level %d\ntrend %d\nup_cost_us %u\n"
+		       "down_cost_us %u\n",
+		       mpdec_pred.level >> MPDEC_FP_SHIFT,
+		       mpdec_pred.trend / (1 << MPDEC_FP_SHIFT),
+		       mpdec_pred.up_cost_us, mpdec_pred.down_cost_us);
+}
+define_one_global_ro(predictor);
+
 static struct attribute *msm_mpdec_stats_attributes[] = {
 	&times_cpus_hotplugged.attr,
+	&predictor.attr,
 	NULL
 };
 
@@ -33,6 +33,8 @@
 #include <linux/uaccess.h>
 #include <linux/kfifo.h>
 #include <linux/wakelock.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
 #include <mach/msm_smd.h>
 #include <mach/msm_iomap.h>
 #include <mach/system.h>
@@ -508,8 +510,28 @@ struct smd_channel {
 	int pending_pkt_sz;
 
 	char is_pkt_ch;
+
+	/* tx interrupt coalescing, see smd_tx_notify() */
+	spinlock_t coalesce_lock;
+	struct hrtimer coalesce_timer;
+	int coalesce;
+	unsigned coalesce_thresh;	/* bytes pending before we notify */
+	unsigned pending_bytes;		/* written since the last notify */
+	unsigned pending_pkts;
+	struct smd_tx_stats tx_stats;
 };
 
+/*
+ * With coalescing on, the remote side is notified of written data once
+ * coalesce_thresh bytes or SMD_COALESCE_MAX_PKTS writes are pending, the
+ * fifo is half full, or SMD_COALESCE_DELAY_NS after the first pending
+ * write, whichever comes first. The threshold doubles whenever it is hit
+ * and halves whenever the timer has to flush, tracking the write rate.
+ */
+#define SMD_COALESCE_DELAY_NS	(500 * NSEC_PER_USEC)
+#define SMD_COALESCE_MIN_BYTES	256
+#define SMD_COALESCE_MAX_PKTS	32
+
 struct edge_to_pid {
 	uint32_t	local_pid;
 	uint32_t	remote_pid;
@@ -951,6 +973,99 @@ static void ch_set_state(struct smd_channel *ch, unsigned n)
 	ch->notify_other_cpu();
 }
 
+static enum hrtimer_restart smd_coalesce_timer_fn(struct hrtimer *timer)
+{
+	struct smd_channel *ch = container_of(timer, struct smd_channel,
+					      coalesce_timer);
+	unsigned long flags;
+	int notify = 0;
+
+	spin_lock_irqsave(&ch->coalesce_lock, flags);
+	if (ch->pending_bytes) {
+		ch->tx_stats.notify++;
+		ch->tx_stats.timer_flush++;
+		ch->pending_bytes = 0;
+		ch->pending_pkts = 0;
+		if (ch->coalesce_thresh / 2 >= SMD_COALESCE_MIN_BYTES)
+			ch->coalesce_thresh /= 2;
+		notify = 1;
+	}
+	spin_unlock_irqrestore(&ch->coalesce_lock, flags);
+
+	if (notify)
+		ch->notify_other_cpu();
+	return HRTIMER_NORESTART;
+}
+
+/* tell the other side about everything written so far */
+static void smd_tx_flush(struct smd_channel *ch)
+{
+	unsigned long flags;
+	int notify = 0;
+
+	spin_lock_irqsave(&ch->coalesce_lock, flags);
+	if (ch->pending_bytes) {
+		ch->tx_stats.notify++;
+		ch->pending_bytes = 0;
+		ch->pending_pkts = 0;
+		hrtimer_try_to_cancel(&ch->coalesce_timer);
+		notify = 1;
+	}
+	spin_unlock_irqrestore(&ch->coalesce_lock, flags);
+
+	if (notify)
+		ch->notify_other_cpu();
+}
+
+/* called after 'count' bytes have been written to the fifo */
+static void smd_tx_notify(struct smd_channel *ch, unsigned count)
+{
+	unsigned long flags;
+	int notify = 1;
+
+	spin_lock_irqsave(&ch->coalesce_lock, flags);
+	ch->tx_stats.bytes += count;
+	ch->tx_stats.writes++;
+	if (ch->coalesce) {
+		ch->pending_bytes += count;
+		ch->pending_pkts++;
+		if (ch->pending_bytes >= ch->coalesce_thresh) {
+			if (ch->coalesce_thresh * 2 <= ch->fifo_size / 4)
+				ch->coalesce_thresh *= 2;
+		} else if (ch->pending_pkts < SMD_COALESCE_MAX_PKTS &&
+			   smd_stream_write_avail(ch) >= ch->fifo_size / 2) {
+			notify = 0;
+		}
+
+		if (notify) {
+			ch->pending_bytes = 0;
+			ch->pending_pkts = 0;
+			hrtimer_try_to_cancel(&ch->coalesce_timer);
+		} else if (!hrtimer_is_queued(&ch->coalesce_timer)) {
+			/*
+			 * Not hrtimer_active(): that is also true while the
+			 * callback runs, after it has taken pending_bytes.
+			 */
+			hrtimer_start(&ch->coalesce_timer,
+				      ktime_set(0, SMD_COALESCE_DELAY_NS),
+				      HRTIMER_MODE_REL);
+		}
+	}
+	if (notify)
+		ch->tx_stats.notify++;
+	spin_unlock_irqrestore(&ch->coalesce_lock, flags);
+
+	if (notify)
+		ch->notify_other_cpu();
+}
+
+static void smd_coalesce_init(struct smd_channel *ch)
+{
+	spin_lock_init(&ch->coalesce_lock);
+	hrtimer_init(&ch->coalesce_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ch->coalesce_timer.function = smd_coalesce_timer_fn;
+}
+
 static void do_smd_probe(void)
 {
 	struct smem_shared *shared = (void *) MSM_SHARED_RAM_BASE;
@@ -1188,8 +1303,9 @@ static int smd_is_packet(struct smd_alloc_elm *alloc_elm)
 		return 0;
 }
 
-static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
-				int user_buf)
+/* copy data into the fifo without notifying the other side */
+static int ch_write(smd_channel_t *ch, const void *_data, int len,
+		    int user_buf)
 {
 	void *ptr;
 	const unsigned char *buf = _data;
@@ -1197,12 +1313,6 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 	int orig_len = len;
 	int r = 0;
 
-	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
-	if (len < 0)
-		return -EINVAL;
-	else if (len == 0)
-		return 0;
-
 	while ((xfer = ch_write_buffer(ch, &ptr)) != 0) {
 		if (!ch_is_open(ch))
 			break;
@@ -1226,12 +1336,27 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 			break;
 	}
 
-	if (orig_len - len)
-		ch->notify_other_cpu();
-
 	return orig_len - len;
 }
 
+static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
+				int user_buf)
+{
+	int r;
+
+	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
+	if (len < 0)
+		return -EINVAL;
+	else if (len == 0)
+		return 0;
+
+	r = ch_write(ch, _data, len, user_buf);
+	if (r)
+		smd_tx_notify(ch, r);
+
+	return r;
+}
+
 static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 				int user_buf)
 {
@@ -1251,15 +1376,19 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
 
-	ret = smd_stream_write(ch, hdr, sizeof(hdr), 0);
+	ret = ch_write(ch, hdr, sizeof(hdr), 0);
 	if (ret < 0 || ret != sizeof(hdr)) {
 		SMD_DBG("%s failed to write pkt header: "
 			"%d returned\n", __func__, ret);
+		if (ret > 0)
+			smd_tx_notify(ch, ret);
 		return -1;
 	}
 
 
-	ret = smd_stream_write(ch, _data, len, user_buf);
+	ret = ch_write(ch, _data, len, user_buf);
+	/* one notification for header and payload */
+	smd_tx_notify(ch, sizeof(hdr) + max(ret, 0));
 	if (ret < 0 || ret != len) {
 		SMD_DBG("%s failed to write pkt data: "
 			"%d returned\n", __func__, ret);
@@ -1401,6 +1530,7 @@ static int smd_alloc_channel(struct smd_alloc_elm *alloc_elm)
 		return -1;
 	}
 	ch->n = alloc_elm->cid;
+	smd_coalesce_init(ch);
 
 	if (smd_alloc_v2(ch) && smd_alloc_v1(ch)) {
 		kfree(ch);
@@ -1485,6 +1615,7 @@ static int smd_alloc_loopback_channel(void)
 		return -1;
 	}
 	ch->n = SMD_LOOPBACK_CID;
+	smd_coalesce_init(ch);
 
 	ch->send = &smd_loopback_ctl;
 	ch->recv = &smd_loopback_ctl;
@@ -1613,6 +1744,11 @@ int smd_named_open_on_edge(const char *name, uint32_t edge,
 	ch->last_state = SMD_SS_CLOSED;
 	ch->priv = priv;
 
+	ch->coalesce = 0;
+	ch->pending_bytes = 0;
+	ch->pending_pkts = 0;
+	memset(&ch->tx_stats, 0, sizeof(ch->tx_stats));
+
 	if (edge == SMD_LOOPBACK_TYPE) {
 		ch->last_state = SMD_SS_OPENED;
 		ch->send->state = SMD_SS_OPENED;
@@ -1673,6 +1809,9 @@ int smd_close(smd_channel_t *ch)
 
 	SMD_INFO("smd_close(%s)+\n", ch->name);
 
+	smd_tx_flush(ch);
+	hrtimer_cancel(&ch->coalesce_timer);
+
 	spin_lock_irqsave(&smd_lock, flags);
 	list_del(&ch->ch_list);
 	if (ch->n == SMD_LOOPBACK_CID) {
@@ -1791,6 +1930,128 @@ int smd_write_end(smd_channel_t *ch)
 }
 EXPORT_SYMBOL(smd_write_end);
 
+/* describe 'len' bytes of a fifo starting at 'offset', split where it wraps */
+static void ch_fifo_vec(struct smd_channel *ch, unsigned char *fifo,
+			unsigned offset, unsigned len, struct smd_buf_vec *vec)
+{
+	unsigned first = min(len, ch->fifo_size - offset);
+
+	vec->ptr[0] = fifo + offset;
+	vec->len[0] = first;
+	vec->ptr[1] = fifo;
+	vec->len[1] = len - first;
+}
+
+int smd_read_reserve(smd_channel_t *ch, struct smd_buf_vec *vec, int len)
+{
+	int avail;
+
+	if (!ch || !vec)
+		return -ENODEV;
+	if (len < 0)
+		return -EINVAL;
+
+	avail = ch->read_avail(ch);
+	if (len > avail)
+		len = avail;
+
+	ch_fifo_vec(ch, ch->recv_data, ch->recv->tail, len, vec);
+	return len;
+}
+EXPORT_SYMBOL(smd_read_reserve);
+
+int smd_read_commit(smd_channel_t *ch, int len)
+{
+	unsigned long flags;
+
+	if (!ch)
+		return -ENODEV;
+	if (len < 0 || len > ch->read_avail(ch))
+		return -EINVAL;
+	if (len == 0)
+		return 0;
+
+	ch_read_done(ch, len);
+	if (!read_intr_blocked(ch))
+		ch->notify_other_cpu();
+
+	if (ch->is_pkt_ch) {
+		spin_lock_irqsave(&smd_lock, flags);
+		ch->current_packet -= len;
+		update_packet_state(ch);
+		spin_unlock_irqrestore(&smd_lock, flags);
+	}
+
+	return len;
+}
+EXPORT_SYMBOL(smd_read_commit);
+
+int smd_write_reserve(smd_channel_t *ch, struct smd_buf_vec *vec, int len)
+{
+	unsigned offset;
+
+	if (!ch || !vec)
+		return -ENODEV;
+	if (len < 0)
+		return -EINVAL;
+	if (ch->pending_pkt_sz)
+		return -EBUSY;
+	if (!ch_is_open(ch))
+		return 0;
+
+	offset = ch->send->head;
+	if (ch->is_pkt_ch) {
+		/* the header goes in front, it is filled in on commit */
+		if (len == 0 || smd_packet_write_avail(ch) < len)
+			return -ENOMEM;
+		offset = (offset + SMD_HEADER_SIZE) & ch->fifo_mask;
+	} else if (len > smd_stream_write_avail(ch)) {
+		len = smd_stream_write_avail(ch);
+	}
+
+	ch_fifo_vec(ch, ch->send_data, offset, len, vec);
+	return len;
+}
+EXPORT_SYMBOL(smd_write_reserve);
+
+int smd_write_commit(smd_channel_t *ch, int len)
+{
+	unsigned hdr[5];
+	struct smd_buf_vec vec;
+
+	if (!ch)
+		return -ENODEV;
+	if (len < 0)
+		return -EINVAL;
+	if (len == 0)
+		return 0;
+
+	if (ch->is_pkt_ch) {
+		if (smd_packet_write_avail(ch) < len)
+			return -EINVAL;
+
+		hdr[0] = len;
+		hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
+		ch_fifo_vec(ch, ch->send_data, ch->send->head,
+			    SMD_HEADER_SIZE, &vec);
+		memcpy(vec.ptr[0], hdr, vec.len[0]);
+		memcpy(vec.ptr[1], (char *)hdr + vec.len[0], vec.len[1]);
+
+		/* header and payload become visible to the reader at once */
+		ch_write_done(ch, SMD_HEADER_SIZE + len);
+	} else {
+		if (smd_stream_write_avail(ch) < len)
+			return -EINVAL;
+		ch_write_done(ch, len);
+		smd_tx_notify(ch, len);
+		return len;
+	}
+
+	smd_tx_notify(ch, SMD_HEADER_SIZE + len);
+	return len;
+}
+EXPORT_SYMBOL(smd_write_commit);
+
 int smd_read(smd_channel_t *ch, void *data, int len)
 {
 	return ch->read(ch, data, len, 0);
@@ -1835,11 +2096,81 @@ EXPORT_SYMBOL(smd_write_avail);
 
 void smd_enable_read_intr(smd_channel_t *ch)
 {
-	if (ch)
+	if (ch) {
 		ch->send->fBLOCKREADINTR = 0;
+		/* the writer is waiting for room, get the reader going */
+		smd_tx_flush(ch);
+	}
 }
 EXPORT_SYMBOL(smd_enable_read_intr);
 
+int smd_tx_coalesce(smd_channel_t *ch, int enable)
+{
+	unsigned long flags;
+
+	if (!ch)
+		return -ENODEV;
+
+	spin_lock_irqsave(&ch->coalesce_lock, flags);
+	ch->coalesce = !!enable;
+	if (!ch->coalesce_thresh)
+		ch->coalesce_thresh = SMD_COALESCE_MIN_BYTES;
+	spin_unlock_irqrestore(&ch->coalesce_lock, flags);
+
+	if (!enable)
+		smd_tx_flush(ch);
+	return 0;
+}
+EXPORT_SYMBOL(smd_tx_coalesce);
+
+void smd_tx_get_stats(smd_channel_t *ch, struct smd_tx_stats *stats)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ch->coalesce_lock, flags);
+	*stats = ch->tx_stats;
+	spin_unlock_irqrestore(&ch->coalesce_lock, flags);
+}
+
+static int dump_tx_stats(struct list_head *list, char *buf, int max)
+{
+	struct smd_channel *ch;
+	struct smd_tx_stats st;
+	int i = 0;
+
+	list_for_each_entry(ch, list, ch_list) {
+		smd_tx_get_stats(ch, &st);
+		i += scnprintf(buf + i, max - i,
+			"%-20s %3s %6u %12llu %10lu %10lu %10lu %10lu\n",
+			ch->name, ch->coalesce ? "on" : "off",
+			ch->coalesce_thresh, st.bytes, st.writes, st.notify,
+			st.timer_flush, st.bytes ? (unsigned long)
+			div64_u64((u64)st.notify << 20, st.bytes) : 0);
+	}
+
+	return i;
+}
+
+int smd_tx_stats_dump(char *buf, int max)
+{
+	unsigned long flags;
+	int i;
+
+	i = scnprintf(buf, max, "%-20s %3s %6s %12s %10s %10s %10s %10s\n",
+		      "channel", "coa", "thresh", "bytes", "writes", "irqs",
+		      "timer", "irqs/MB");
+
+	spin_lock_irqsave(&smd_lock, flags);
+	i += dump_tx_stats(&smd_ch_list_modem, buf + i, max - i);
+	i += dump_tx_stats(&smd_ch_list_dsp, buf + i, max - i);
+	i += dump_tx_stats(&smd_ch_list_dsps, buf + i, max - i);
+	i += dump_tx_stats(&smd_ch_list_wcnss, buf + i, max - i);
+	i += dump_tx_stats(&smd_ch_list_loopback, buf + i, max - i);
+	spin_unlock_irqrestore(&smd_lock, flags);
+
+	return i;
+}
+
 void smd_disable_read_intr(smd_channel_t *ch)
 {
 	if (ch)
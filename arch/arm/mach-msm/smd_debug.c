@@ -19,8 +19,12 @@
 #include <linux/list.h>
 #include <linux/ctype.h>
 #include <linux/jiffies.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
 
 #include <mach/msm_iomap.h>
+#include <mach/msm_smd.h>
 
 #include "smd_private.h"
 
@@ -459,6 +463,118 @@ static int debug_test_smsm(char *buf, int max)
 	return i;
 }
 
+#define LOOPBACK_BENCH_BYTES	(4 * 1024 * 1024)
+
+/*
+ * Push LOOPBACK_BENCH_BYTES through the loopback channel in 'chunk' sized
+ * pieces and check them on the way out. With 'zero_copy' the data is
+ * written and checked in place in the fifo, otherwise it goes through
+ * smd_write() and smd_read() and a bounce buffer. Returns the time taken
+ * in ns, or a negative error code.
+ *
+ * The loopback "interrupt" just calls the local notify callbacks, so the
+ * interrupt counts reported are those a remote processor would get.
+ */
+static s64 loopback_bench_run(smd_channel_t *ch, const char *src, char *dst,
+			      int chunk, int zero_copy)
+{
+	struct smd_buf_vec vec;
+	ktime_t start;
+	int done, n;
+
+	start = ktime_get();
+	for (done = 0; done < LOOPBACK_BENCH_BYTES; done += chunk) {
+		if (zero_copy) {
+			n = smd_write_reserve(ch, &vec, chunk);
+			if (n != chunk)
+				return -ENOSPC;
+			memcpy(vec.ptr[0], src, vec.len[0]);
+			memcpy(vec.ptr[1], src + vec.len[0], vec.len[1]);
+			smd_write_commit(ch, chunk);
+
+			n = smd_read_reserve(ch, &vec, chunk);
+			if (n != chunk ||
+			    memcmp(vec.ptr[0], src, vec.len[0]) ||
+			    memcmp(vec.ptr[1], src + vec.len[0], vec.len[1]))
+				return -EIO;
+			smd_read_commit(ch, chunk);
+		} else {
+			if (smd_write(ch, src, chunk) != chunk)
+				return -ENOSPC;
+			if (smd_read(ch, dst, chunk) != chunk ||
+			    memcmp(dst, src, chunk))
+				return -EIO;
+		}
+	}
+
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static const char * const loopback_bench_modes[] = {
+	"copy", "in-place", "coalesced",
+};
+
+static int debug_loopback_bench(char *buf, int max)
+{
+	static const int chunks[] = { 64, 512, 2048, 4096 };
+	struct smd_tx_stats before, after;
+	smd_channel_t *ch;
+	char *src, *dst;
+	int i = 0;
+	int c, mode, ret;
+
+	src = kmalloc(2 * 4096, GFP_KERNEL);
+	if (!src)
+		return scnprintf(buf, max, "out of memory\n");
+	dst = src + 4096;
+	for (c = 0; c < 4096; c++)
+		src[c] = c * 7;
+
+	ret = smd_named_open_on_edge("local_loopback", SMD_LOOPBACK_TYPE,
+				     &ch, NULL, NULL);
+	if (ret) {
+		kfree(src);
+		return scnprintf(buf, max, "can't open loopback channel: %d\n",
+				 ret);
+	}
+
+	i += scnprintf(buf + i, max - i, "%d bytes per run\n",
+		       LOOPBACK_BENCH_BYTES);
+	i += scnprintf(buf + i, max - i, "%10s %6s %10s %10s\n",
+		       "mode", "chunk", "MB/s", "irqs/MB");
+	for (mode = 0; mode < ARRAY_SIZE(loopback_bench_modes); mode++) {
+		smd_tx_coalesce(ch, mode == 2);
+		for (c = 0; c < ARRAY_SIZE(chunks); c++) {
+			s64 ns;
+
+			smd_tx_get_stats(ch, &before);
+			ns = loopback_bench_run(ch, src, dst, chunks[c],
+						mode != 0);
+			smd_tx_get_stats(ch, &after);
+
+			i += scnprintf(buf + i, max - i, "%10s %6d",
+				       loopback_bench_modes[mode], chunks[c]);
+			if (ns < 0)
+				i += scnprintf(buf + i, max - i, " %10s\n",
+					       ns == -EIO ? "corrupt" : "error");
+			else
+				i += scnprintf(buf + i, max - i,
+					" %10lld %10lu\n",
+					div64_s64((s64)LOOPBACK_BENCH_BYTES *
+						  1000, max_t(s64, ns, 1)),
+					(after.notify - before.notify) /
+					(LOOPBACK_BENCH_BYTES >> 20));
+			/* drop whatever a failed run left behind */
+			smd_read(ch, NULL, smd_read_avail(ch));
+		}
+	}
+	smd_tx_coalesce(ch, 0);
+
+	smd_close(ch);
+	kfree(src);
+	return i;
+}
+
 static int debug_read_mem(char *buf, int max)
 {
 	unsigned n;
@@ -701,6 +817,8 @@ static int __init smd_debugfs_init(void)
 	debug_create("modem_err_f3", 0444, dent, debug_modem_err_f3);
 	debug_create("print_diag", 0444, dent, debug_diag);
 	debug_create("print_f3", 0444, dent, debug_f3);
+	debug_create("loopback_bench", 0444, dent, debug_loopback_bench);
+	debug_create("tx_stats", 0444, dent, smd_tx_stats_dump);
 
 	/* NNV: this is google only stuff */
 	debug_create("build", 0444, dent, debug_read_build_id);
@@ -292,6 +292,30 @@ static long smd_pkt_ioctl(struct file *file, unsigned int cmd,
 	return ret;
 }
 
+/*
+ * Copy up to 'count' bytes of the current packet from the fifo straight
+ * to userspace. Only what was copied is consumed.
+ */
+static int smd_pkt_read_fifo(smd_channel_t *ch, char __user *buf, int count)
+{
+	struct smd_buf_vec vec;
+	int r, left, copied;
+
+	r = smd_read_reserve(ch, &vec, count);
+	if (r <= 0)
+		return r;
+
+	left = copy_to_user(buf, vec.ptr[0], vec.len[0]);
+	copied = vec.len[0] - left;
+	if (!left && vec.len[1]) {
+		left = copy_to_user(buf + vec.len[0], vec.ptr[1], vec.len[1]);
+		copied += vec.len[1] - left;
+	}
+
+	r = smd_read_commit(ch, copied);
+	return left ? -EFAULT : r;
+}
+
 ssize_t smd_pkt_read(struct file *file,
 		       char __user *buf,
 		       size_t count,
@@ -377,9 +401,8 @@ wait_for_packet:
 
 	bytes_read = 0;
 	do {
-		r = smd_read_user_buffer(smd_pkt_devp->ch,
-					 (buf + bytes_read),
-					 (pkt_size - bytes_read));
+		r = smd_pkt_read_fifo(smd_pkt_devp->ch, buf + bytes_read,
+				      pkt_size - bytes_read);
 		if (r < 0) {
 			mutex_unlock(&smd_pkt_devp->rx_lock);
 			if (smd_pkt_devp->has_reset) {
@@ -425,6 +448,29 @@ wait_for_packet:
 	return bytes_read;
 }
 
+/*
+ * Copy a whole packet of 'count' bytes from userspace straight into the
+ * fifo and send it. Returns -ENOMEM if it doesn't fit right now.
+ */
+static int smd_pkt_write_fifo(smd_channel_t *ch, const char __user *buf,
+			      int count)
+{
+	struct smd_buf_vec vec;
+	int r;
+
+	r = smd_write_reserve(ch, &vec, count);
+	if (r < 0)
+		return r;
+	if (r != count)
+		return -ENOMEM;
+
+	if (copy_from_user(vec.ptr[0], buf, vec.len[0]) ||
+	    copy_from_user(vec.ptr[1], buf + vec.len[0], vec.len[1]))
+		return -EFAULT;
+
+	return smd_write_commit(ch, count);
+}
+
 ssize_t smd_pkt_write(struct file *file,
 		       const char __user *buf,
 		       size_t count,
@@ -465,6 +511,21 @@ ssize_t smd_pkt_write(struct file *file,
 		}
 	}
 
+	/* packets that fit in the fifo are copied there in one go */
+	r = smd_pkt_write_fifo(smd_pkt_devp->ch, buf, count);
+	if (r != -ENOMEM) {
+		mutex_unlock(&smd_pkt_devp->tx_lock);
+		if (r < 0) {
+			pr_err("%s on smd_pkt_dev id:%d failed r:%d\n",
+				__func__, smd_pkt_devp->i, r);
+			return r;
+		}
+		D_WRITE_DUMP_BUFFER("Write: ", (r > 16 ? 16 : r), buf);
+		D_WRITE("Finished %s on smd_pkt_dev id:%d %d bytes\n",
+			__func__, smd_pkt_devp->i, count);
+		return count;
+	}
+
 	r = smd_write_start(smd_pkt_devp->ch, count);
 	if (r < 0) {
 		mutex_unlock(&smd_pkt_devp->tx_lock);
@@ -18,6 +18,7 @@
 
 #include <linux/types.h>
 #include <linux/spinlock.h>
+#include <mach/msm_smd.h>
 #include <mach/msm_smsm.h>
 
 #define PC_APPS  0
@@ -208,4 +209,15 @@ extern spinlock_t smem_lock;
 
 int smd_diag(void);
 
+/* per channel transmit statistics, reset on open */
+struct smd_tx_stats {
+	u64 bytes;			/* written to the fifo */
+	unsigned long writes;		/* write or commit calls */
+	unsigned long notify;		/* interrupts sent for them */
+	unsigned long timer_flush;	/* of which sent by the timer */
+};
+
+void smd_tx_get_stats(smd_channel_t *ch, struct smd_tx_stats *stats);
+int smd_tx_stats_dump(char *buf, int max);
+
 #endif
@@ -118,8 +118,8 @@ static void buf_req_retry(unsigned long param)
 
 static void smd_tty_read(unsigned long param)
 {
-	unsigned char *ptr;
-	int avail;
+	struct smd_buf_vec vec;
+	int avail, n;
 	struct smd_tty_info *info = (struct smd_tty_info *)param;
 	struct tty_struct *tty = info->tty;
 
@@ -135,27 +135,22 @@ static void smd_tty_read(unsigned long param)
 		}
 
 		if (test_bit(TTY_THROTTLED, &tty->flags)) break;
-		avail = smd_read_avail(info->ch);
-		if (avail == 0)
+		avail = smd_read_reserve(info->ch, &vec, MAX_TTY_BUF_SIZE);
+		if (avail <= 0)
 			break;
 
-		if (avail > MAX_TTY_BUF_SIZE)
-			avail = MAX_TTY_BUF_SIZE;
-
-		avail = tty_prepare_flip_string(tty, &ptr, avail);
-		if (avail <= 0) {
+		/* copy straight out of the fifo, consume what the tty took */
+		n = tty_insert_flip_string(tty, vec.ptr[0], vec.len[0]);
+		if (n == vec.len[0] && vec.len[1])
+			n += tty_insert_flip_string(tty, vec.ptr[1],
+						    vec.len[1]);
+		if (n <= 0) {
 			mod_timer(&info->buf_req_timer,
 					jiffies + msecs_to_jiffies(30));
 			return;
 		}
 
-		if (smd_read(info->ch, ptr, avail) != avail) {
-			/* shouldn't be possible since we're in interrupt
-			** context here and nobody else could 'steal' our
-			** characters.
-			*/
-			printk(KERN_ERR "OOPS - smd_tty_buffer mismatch?!");
-		}
+		smd_read_commit(info->ch, n);
 
 		wake_lock_timeout(&info->wake_lock, HZ / 2);
 		tty_flip_buffer_push(tty);
@@ -368,6 +363,7 @@ static void smd_tty_close(struct tty_struct *tty, struct file *f)
 static int smd_tty_write(struct tty_struct *tty, const unsigned char *buf, int len)
 {
 	struct smd_tty_info *info = tty->driver_data;
+	struct smd_buf_vec vec;
 	int avail;
 
 	/* if we're writing to a packet channel we will
@@ -388,7 +384,13 @@ static int smd_tty_write(struct tty_struct *tty, const unsigned char *buf, int l
 	if (len > avail)
 		len = avail;
 
-	return smd_write(info->ch, buf, len);
+	len = smd_write_reserve(info->ch, &vec, len);
+	if (len <= 0)
+		return len;
+
+	memcpy(vec.ptr[0], buf, vec.len[0]);
+	memcpy(vec.ptr[1], buf + vec.len[0], vec.len[1]);
+	return smd_write_commit(info->ch, len);
 }
 
 static int smd_tty_write_room(struct tty_struct *tty)
@@ -19,6 +19,7 @@
 #include <linux/init.h>
 
 #include <asm/cputype.h>
+#include <asm/neon.h>
 #include <asm/thread_notify.h>
 #include <asm/vfp.h>
 
@@ -528,6 +529,72 @@ void vfp_flush_hwstate(struct thread_info *thread)
 	put_cpu();
 }
 
+#ifdef CONFIG_KERNEL_MODE_NEON
+
+static DEFINE_PER_CPU(bool, kernel_neon_active);
+
+/*
+ * Kernel-side NEON support functions. Kernel mode NEON is only allowed
+ * outside of interrupt context with preemption disabled, so the kernel
+ * mode register contents never need to be preserved, and sections do
+ * not nest: callers that may run inside one check kernel_neon_busy().
+ */
+void kernel_neon_begin(void)
+{
+	struct thread_info *thread = current_thread_info();
+	unsigned int cpu;
+	u32 fpexc;
+
+	BUG_ON(in_interrupt());
+	cpu = get_cpu();
+	BUG_ON(per_cpu(kernel_neon_active, cpu));
+
+	fpexc = fmrx(FPEXC) | FPEXC_EN;
+	fmxr(FPEXC, fpexc);
+
+	/*
+	 * Save the VFP state still live in the registers. On SMP only our
+	 * own can be, every other thread saved its state when it was
+	 * switched out; on UP it belongs to the last thread to use the VFP.
+	 */
+#ifdef CONFIG_SMP
+	if (last_VFP_context[cpu] == &thread->vfpstate) {
+		vfp_save_state(&thread->vfpstate, fpexc);
+		thread->vfpstate.hard.cpu = cpu;
+	}
+#else
+	if (last_VFP_context[cpu])
+		vfp_save_state(last_VFP_context[cpu], fpexc);
+#endif
+	/* the registers are about to be clobbered, force a reload */
+	last_VFP_context[cpu] = NULL;
+	per_cpu(kernel_neon_active, cpu) = true;
+}
+EXPORT_SYMBOL(kernel_neon_begin);
+
+void kernel_neon_end(void)
+{
+	__get_cpu_var(kernel_neon_active) = false;
+
+	/* Disable the NEON/VFP unit. */
+	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
+	put_cpu();
+}
+EXPORT_SYMBOL(kernel_neon_end);
+
+/*
+ * True if the caller is inside a kernel_neon_begin() section. Sections
+ * run with preemption disabled, so a section open on this CPU can only
+ * be the caller's own.
+ */
+bool kernel_neon_busy(void)
+{
+	return __this_cpu_read(kernel_neon_active);
+}
+EXPORT_SYMBOL(kernel_neon_busy);
+
+#endif /* CONFIG_KERNEL_MODE_NEON */
+
 /*
  * VFP hardware can lose all context when a CPU goes offline.
  * As we will be running in SMP mode with CPU hotplug, we will save the
@@ -635,4 +702,8 @@ static int __init vfp_init(void)
 	return 0;
 }
 
-late_initcall(vfp_init);
+/*
+ * core_initcall, so that the NEON users choosing an implementation at
+ * boot (xor_blocks, raid6) see HWCAP_NEON.
+ */
+core_initcall(vfp_init);
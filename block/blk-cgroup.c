@@ -119,6 +119,22 @@ struct blkio_cgroup *task_blkio_cgroup(struct task_struct *tsk)
 }
 EXPORT_SYMBOL_GPL(task_blkio_cgroup);
 
+/*
+ * Read latency target of the cgroup @tsk is in, in usec, 0 if it has none.
+ * Used by I/O schedulers to tell foreground reads from background ones.
+ */
+unsigned int blkcg_task_read_lat_target(struct task_struct *tsk)
+{
+	unsigned int target;
+
+	rcu_read_lock();
+	target = ACCESS_ONCE(task_blkio_cgroup(tsk)->read_lat_target);
+	rcu_read_unlock();
+
+	return target;
+}
+EXPORT_SYMBOL_GPL(blkcg_task_read_lat_target);
+
 static inline void
 blkio_update_group_weight(struct blkio_group *blkg, unsigned int weight)
 {
@@ -1334,6 +1350,8 @@ static u64 blkiocg_file_read_u64 (struct cgroup *cgrp, struct cftype *cft) {
 		switch(name) {
 		case BLKIO_PROP_weight:
 			return (u64)blkcg->weight;
+		case BLKIO_PROP_read_latency_target_us:
+			return (u64)blkcg->read_lat_target;
 		}
 		break;
 	default:
@@ -1356,6 +1374,11 @@ blkiocg_file_write_u64(struct cgroup *cgrp, struct cftype *cft, u64 val)
 		switch(name) {
 		case BLKIO_PROP_weight:
 			return blkio_weight_write(blkcg, val);
+		case BLKIO_PROP_read_latency_target_us:
+			if (val > UINT_MAX)
+				return -EINVAL;
+			blkcg->read_lat_target = (unsigned int)val;
+			return 0;
 		}
 		break;
 	default:
@@ -1381,6 +1404,13 @@ struct cftype blkio_files[] = {
 		.read_u64 = blkiocg_file_read_u64,
 		.write_u64 = blkiocg_file_write_u64,
 	},
+	{
+		.name = "read_latency_target_us",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_PROP,
+				BLKIO_PROP_read_latency_target_us),
+		.read_u64 = blkiocg_file_read_u64,
+		.write_u64 = blkiocg_file_write_u64,
+	},
 	{
 		.name = "time",
 		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_PROP,
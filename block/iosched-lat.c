@@ -0,0 +1,143 @@
+/*
+ * Request latency histograms for I/O schedulers
+ *
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bitops.h>
+#include <linux/math64.h>
+#include <linux/string.h>
+
+#include "iosched-lat.h"
+
+static void iosched_lat_add(struct iosched_lat_hist *h, unsigned long since)
+{
+	unsigned long us = iosched_lat_now() - since;
+	int b = fls(us);
+
+	if (b >= IOSCHED_LAT_BUCKETS)
+		b = IOSCHED_LAT_BUCKETS - 1;
+	h->bucket[b]++;
+	h->count++;
+	h->sum_us += us;
+	if (us > h->max_us)
+		h->max_us = us;
+}
+
+void iosched_lat_dispatch(struct iosched_lat *lat, struct request *rq)
+{
+	unsigned long inserted = (unsigned long)rq->elevator_private[1];
+
+	/* a request reinserted by the driver is counted at each dispatch */
+	if (inserted)
+		iosched_lat_add(&lat->dispatch, inserted);
+}
+EXPORT_SYMBOL_GPL(iosched_lat_dispatch);
+
+void iosched_lat_complete(struct iosched_lat *lat, struct request *rq)
+{
+	unsigned long inserted = (unsigned long)rq->elevator_private[1];
+
+	if (!inserted)
+		return;
+	rq->elevator_private[1] = NULL;
+	iosched_lat_add(&lat->complete, inserted);
+}
+EXPORT_SYMBOL_GPL(iosched_lat_complete);
+
+/* caller holds the queue lock */
+void iosched_lat_reset(struct iosched_lat *lat, int nr)
+{
+	memset(lat, 0, nr * sizeof(*lat));
+}
+EXPORT_SYMBOL_GPL(iosched_lat_reset);
+
+/*
+ * Upper bound, in usec, of the bucket holding the pct-th percentile.
+ * The histogram is read without the queue lock so the counts may be
+ * slightly off against each other; that is fine for statistics.
+ */
+static u32 iosched_lat_pct(const struct iosched_lat_hist *h, int pct)
+{
+	u32 want = div_u64((u64)h->count * pct + 99, 100);
+	u32 seen = 0;
+	int i;
+
+	for (i = 0; i < IOSCHED_LAT_BUCKETS - 1; i++) {
+		seen += h->bucket[i];
+		if (seen >= want)
+			return min_t(u32, (1U << i) - 1, h->max_us);
+	}
+	return h->max_us;
+}
+
+static const char * const iosched_lat_stage[] = { "dispatch", "complete" };
+
+static const struct iosched_lat_hist *
+iosched_lat_stage_hist(const struct iosched_lat *lat, int stage)
+{
+	return stage ? &lat->complete : &lat->dispatch;
+}
+
+ssize_t iosched_lat_hist_show(const struct iosched_lat *lat,
+			      const char * const *names, int nr, char *page)
+{
+	const struct iosched_lat_hist *h;
+	ssize_t len;
+	int i, s, b;
+
+	len = scnprintf(page, PAGE_SIZE, "# usec <");
+	for (b = 0; b < IOSCHED_LAT_BUCKETS - 1; b++)
+		len += scnprintf(page + len, PAGE_SIZE - len, " %u", 1U << b);
+	len += scnprintf(page + len, PAGE_SIZE - len, " inf\n");
+
+	for (i = 0; i < nr; i++) {
+		for (s = 0; s < ARRAY_SIZE(iosched_lat_stage); s++) {
+			h = iosched_lat_stage_hist(&lat[i], s);
+			len += scnprintf(page + len, PAGE_SIZE - len, "%s %s",
+					 names[i], iosched_lat_stage[s]);
+			for (b = 0; b < IOSCHED_LAT_BUCKETS; b++)
+				len += scnprintf(page + len, PAGE_SIZE - len,
+						 " %u", h->bucket[b]);
+			len += scnprintf(page + len, PAGE_SIZE - len, "\n");
+		}
+	}
+	return len;
+}
+EXPORT_SYMBOL_GPL(iosched_lat_hist_show);
+
+ssize_t iosched_lat_pct_show(const struct iosched_lat *lat,
+			     const char * const *names, int nr, char *page)
+{
+	const struct iosched_lat_hist *h;
+	ssize_t len;
+	int i, s;
+
+	len = scnprintf(page, PAGE_SIZE,
+			"# class stage count mean_us p50_us p90_us p99_us max_us\n");
+	for (i = 0; i < nr; i++) {
+		for (s = 0; s < ARRAY_SIZE(iosched_lat_stage); s++) {
+			h = iosched_lat_stage_hist(&lat[i], s);
+			len += scnprintf(page + len, PAGE_SIZE - len,
+				"%s %s %u %llu %u %u %u %u\n",
+				names[i], iosched_lat_stage[s], h->count,
+				(unsigned long long)(h->count ?
+					div_u64(h->sum_us, h->count) : 0),
+				iosched_lat_pct(h, 50), iosched_lat_pct(h, 90),
+				iosched_lat_pct(h, 99), h->max_us);
+		}
+	}
+	return len;
+}
+EXPORT_SYMBOL_GPL(iosched_lat_pct_show);
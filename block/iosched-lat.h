@@ -0,0 +1,69 @@
+#ifndef BLK_IOSCHED_LAT_H
+#define BLK_IOSCHED_LAT_H
+
+/*
+ * Per queue class request latency histograms for I/O schedulers.
+ *
+ * A scheduler keeps one struct iosched_lat per queue class and calls
+ * iosched_lat_insert() from its add_req hook, iosched_lat_dispatch() when
+ * it moves the request to the dispatch list and iosched_lat_complete()
+ * from its completed_req hook. All three run under the queue lock.
+ *
+ * The insertion time is kept in rq->elevator_private[1], so a scheduler
+ * using this must leave that slot alone.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/hrtimer.h>
+
+/* bucket i counts latencies of [2^(i-1), 2^i) usec, the last one the rest */
+#define IOSCHED_LAT_BUCKETS	24
+
+struct iosched_lat_hist {
+	u32	count;
+	u32	max_us;
+	u64	sum_us;
+	u32	bucket[IOSCHED_LAT_BUCKETS];
+};
+
+/**
+ * struct iosched_lat - latency histograms of one queue class
+ * @dispatch:	time from insertion until the request was dispatched
+ * @complete:	time from insertion until the request completed
+ */
+struct iosched_lat {
+	struct iosched_lat_hist	dispatch;
+	struct iosched_lat_hist	complete;
+};
+
+#ifdef CONFIG_IOSCHED_LAT_HIST
+
+/* usec stamp; never 0 so that 0 can mean "not stamped" */
+static inline unsigned long iosched_lat_now(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get()) | 1;
+}
+
+static inline void iosched_lat_insert(struct request *rq)
+{
+	rq->elevator_private[1] = (void *)iosched_lat_now();
+}
+
+void iosched_lat_dispatch(struct iosched_lat *lat, struct request *rq);
+void iosched_lat_complete(struct iosched_lat *lat, struct request *rq);
+void iosched_lat_reset(struct iosched_lat *lat, int nr);
+ssize_t iosched_lat_hist_show(const struct iosched_lat *lat,
+			      const char * const *names, int nr, char *page);
+ssize_t iosched_lat_pct_show(const struct iosched_lat *lat,
+			     const char * const *names, int nr, char *page);
+
+#else
+
+/* macros, so that callers need not have the histograms compiled in */
+#define iosched_lat_insert(rq)			do { } while (0)
+#define iosched_lat_dispatch(lat, rq)		do { } while (0)
+#define iosched_lat_complete(lat, rq)		do { } while (0)
+
+#endif /* CONFIG_IOSCHED_LAT_HIST */
+
+#endif /* BLK_IOSCHED_LAT_H */
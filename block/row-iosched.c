@@ -26,6 +26,11 @@
 #include <linux/compiler.h>
 #include <linux/blktrace_api.h>
 #include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+
+#include "blk-cgroup.h"
+#include "iosched-lat.h"
 
 /*
  * enum row_queue_prio - Priorities of the ROW queues
@@ -171,6 +176,43 @@ struct starvation_data {
 	int				starvation_counter;
 };
 
+/* Default values for foreground read latency targets */
+#define ROW_FG_ACTIVE_MSEC	100
+#define ROW_BG_LIMIT_MAX	8
+
+/**
+ * struct row_fg_data - data for blkio cgroup read latency targets
+ * @nr_reads:		number of queued reads that have a deadline
+ * @active_until:	jiffies until which foreground counts as active,
+ *			set on every foreground read
+ * @active_ms:		how long foreground stays active after a read
+ * @bg_in_flight:	background requests dispatched and not completed
+ * @bg_limit:		max background requests in flight while
+ *			foreground is active. Halved when a foreground read
+ *			misses its deadline, grows by one when one makes it
+ * @bg_limit_max:	upper bound of @bg_limit
+ * @svc_us:		average service time of foreground reads (usec)
+ * @met:		foreground reads completed before their deadline
+ * @missed:		foreground reads completed after their deadline
+ *
+ * Requests of a blkio cgroup with a read_latency_target_us are
+ * "foreground", all others are "background". A foreground read is
+ * dispatched ahead of everything else once waiting any longer would make
+ * it miss its deadline, and may preempt the request in flight (see
+ * row_urgent_pending()).
+ */
+struct row_fg_data {
+	unsigned int			nr_reads;
+	unsigned long			active_until;
+	int				active_ms;
+	int				bg_in_flight;
+	int				bg_limit;
+	int				bg_limit_max;
+	unsigned long			svc_us;
+	unsigned long			met;
+	unsigned long			missed;
+};
+
 /**
  * struct row_queue - Per block device rqueue structure
  * @dispatch_queue:	dispatch rqueue
@@ -187,6 +229,8 @@ struct starvation_data {
  * @reg_prio_starvation: starvation data for REGULAR priority queues
  * @low_prio_starvation: starvation data for LOW priority queues
  * @cycle_flags:	used for marking unserved queueus
+ * @fg:			foreground read latency data
+ * @lat:		latency histograms, one per ROW queue
  *
  */
 struct row_data {
@@ -206,10 +250,27 @@ struct row_data {
 	struct starvation_data		low_prio_starvation;
 
 	unsigned int			cycle_flags;
+
+	struct row_fg_data		fg;
+
+#ifdef CONFIG_IOSCHED_LAT_HIST
+	struct iosched_lat		lat[ROWQ_MAX_PRIO];
+#endif
 };
 
 #define RQ_ROWQ(rq) ((struct row_queue *) ((rq)->elevator_private[0]))
 
+/*
+ * elevator_private[2] holds the foreground state of a request: for
+ * requests of a cgroup with a read latency target, the time (usec, made
+ * odd) by which it should complete. Dispatched background requests are
+ * marked ROW_RQ_BG_INFLIGHT while they count in fg.bg_in_flight.
+ */
+#define ROW_RQ_BG_INFLIGHT	2UL
+#define RQ_ROW_FG(rq)		((unsigned long)((rq)->elevator_private[2]))
+#define RQ_ROW_IS_FG(rq)	(RQ_ROW_FG(rq) & 1)
+#define RQ_ROW_FG_READ(rq)	(RQ_ROW_IS_FG(rq) && rq_data_dir(rq) == READ)
+
 #define row_log(q, fmt, args...)   \
 	blk_add_trace_msg(q, "%s():" fmt , __func__, ##args)
 #define row_log_rowq(rdata, rowq_id, fmt, args...)		\
@@ -246,6 +307,116 @@ static inline void __maybe_unused row_dump_queues_stat(struct row_data *rd)
 			rd->row_queues[i].nr_req);
 }
 
+static inline unsigned long row_now_us(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get());
+}
+
+static inline bool row_fg_active(struct row_data *rd)
+{
+	return time_before(jiffies, rd->fg.active_until);
+}
+
+/*
+ * row_fg_next_read() - Find the foreground read with the earliest deadline
+ * @rd:		pointer to struct row_data
+ * @at_risk:	only return it if it will miss the deadline unless
+ *		dispatched now
+ *
+ */
+static struct request *row_fg_next_read(struct row_data *rd, bool at_risk)
+{
+	static const enum row_queue_prio read_queues[] = {
+		ROWQ_PRIO_HIGH_READ, ROWQ_PRIO_REG_READ, ROWQ_PRIO_LOW_READ,
+	};
+	unsigned long done = row_now_us() + rd->fg.svc_us;
+	struct request *rq, *first = NULL;
+	long slack, min_slack = LONG_MAX;
+	int i;
+
+	if (!rd->fg.nr_reads)
+		return NULL;
+
+	for (i = 0; i < ARRAY_SIZE(read_queues); i++) {
+		list_for_each_entry(rq, &rd->row_queues[read_queues[i]].fifo,
+				    queuelist) {
+			if (!RQ_ROW_IS_FG(rq))
+				continue;
+			slack = (long)(RQ_ROW_FG(rq) - done);
+			if (slack < min_slack) {
+				min_slack = slack;
+				first = rq;
+			}
+		}
+	}
+	if (at_risk && min_slack > 0)
+		return NULL;
+	return first;
+}
+
+/*
+ * row_bg_throttled() - Check whether a background request has to wait
+ * @rd:		pointer to struct row_data
+ * @rq:		the request about to be dispatched
+ *
+ */
+static bool row_bg_throttled(struct row_data *rd, struct request *rq)
+{
+	struct request_queue *q = rd->dispatch_queue;
+
+	if (RQ_ROW_IS_FG(rq) || !row_fg_active(rd) ||
+	    rd->fg.bg_in_flight < rd->fg.bg_limit)
+		return false;
+
+	/*
+	 * Nothing outstanding would run the queue again. A request that
+	 * left without completing must have been lost from the count.
+	 */
+	if (!q->in_flight[0] && !q->in_flight[1] &&
+	    list_empty(&q->queue_head)) {
+		rd->fg.bg_in_flight = 0;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * row_fg_completed() - Account a completed request
+ * @rd:		pointer to struct row_data
+ * @rq:		the completed request
+ *
+ * Adapts the background limit to whether foreground reads make their
+ * deadline, additive increase and multiplicative decrease.
+ */
+static void row_fg_completed(struct row_data *rd, struct request *rq)
+{
+	unsigned long deadline = RQ_ROW_FG(rq);
+	u64 start = rq_io_start_time_ns(rq), now_ns;
+
+	if (deadline == ROW_RQ_BG_INFLIGHT) {
+		rd->fg.bg_in_flight--;
+		return;
+	}
+	if (!RQ_ROW_FG_READ(rq))
+		return;
+
+	now_ns = sched_clock();
+	if (start && now_ns > start)
+		rd->fg.svc_us = (7 * rd->fg.svc_us +
+			(unsigned long)div_u64(now_ns - start, NSEC_PER_USEC)) / 8;
+
+	if ((long)(row_now_us() - deadline) > 0) {
+		rd->fg.missed++;
+		rd->fg.bg_limit = max(rd->fg.bg_limit / 2, 1);
+		row_log(rd->dispatch_queue, "fg read missed, bg_limit=%d",
+			rd->fg.bg_limit);
+	} else {
+		rd->fg.met++;
+		rd->fg.bg_limit = min(rd->fg.bg_limit + 1,
+				      rd->fg.bg_limit_max);
+	}
+}
+
 /******************** Static helper functions ***********************/
 static void kick_queue(struct work_struct *work)
 {
@@ -340,6 +511,12 @@ static void row_add_request(struct request_queue *q,
 	rd->nr_reqs[rq_data_dir(rq)]++;
 	rqueue->nr_req++;
 	rq_set_fifo_time(rq, jiffies); /* for statistics*/
+	iosched_lat_insert(rq);
+	if (RQ_ROW_FG_READ(rq)) {
+		rd->fg.nr_reads++;
+		rd->fg.active_until = jiffies +
+			msecs_to_jiffies(rd->fg.active_ms);
+	}
 
 	if (rq->cmd_flags & REQ_URGENT) {
 		WARN_ON(1);
@@ -425,6 +602,12 @@ static int row_reinsert_req(struct request_queue *q,
 	list_add(&rq->queuelist, &rqueue->fifo);
 	rd->nr_reqs[rq_data_dir(rq)]++;
 	rqueue->nr_req++;
+	if (RQ_ROW_FG_READ(rq)) {
+		rd->fg.nr_reads++;
+	} else if (RQ_ROW_FG(rq) == ROW_RQ_BG_INFLIGHT) {
+		rd->fg.bg_in_flight--;
+		rq->elevator_private[2] = NULL;
+	}
 
 	row_log_rowq(rd, rqueue->prio,
 		"%s request reinserted (total on queue=%d)",
@@ -459,6 +642,8 @@ static void row_completed_req(struct request_queue *q, struct request *rq)
 {
 	struct row_data *rd = q->elevator->elevator_data;
 
+	iosched_lat_complete(&rd->lat[RQ_ROWQ(rq)->prio], rq);
+	row_fg_completed(rd, rq);
 	 if (rq->cmd_flags & REQ_URGENT) {
 		if (!rd->urgent_in_flight) {
 			WARN_ON(1);
@@ -481,6 +666,7 @@ static void row_completed_req(struct request_queue *q, struct request *rq)
 static bool row_urgent_pending(struct request_queue *q)
 {
 	struct row_data *rd = q->elevator->elevator_data;
+	struct request *rq;
 
 	if (rd->urgent_in_flight) {
 		row_log(rd->dispatch_queue, "%d urgent requests in flight",
@@ -493,6 +679,15 @@ static bool row_urgent_pending(struct request_queue *q)
 		return true;
 	}
 
+	/* A foreground read about to miss its deadline preempts */
+	rq = row_fg_next_read(rd, true);
+	if (rq) {
+		row_log(rd->dispatch_queue, "fg read at risk, urgent");
+		rq->cmd_flags |= REQ_URGENT;
+		rd->pending_urgent_rq = rq;
+		return true;
+	}
+
 	row_log(rd->dispatch_queue, "no urgent request pending/in flight");
 	return false;
 }
@@ -531,6 +726,13 @@ static void row_dispatch_insert(struct row_data *rd, struct request *rq)
 
 	row_remove_request(rd, rq);
 	elv_dispatch_sort(rd->dispatch_queue, rq);
+	iosched_lat_dispatch(&rd->lat[rqueue->prio], rq);
+	if (RQ_ROW_FG_READ(rq)) {
+		rd->fg.nr_reads--;
+	} else if (!RQ_ROW_IS_FG(rq)) {
+		rq->elevator_private[2] = (void *)ROW_RQ_BG_INFLIGHT;
+		rd->fg.bg_in_flight++;
+	}
 	if (rq->cmd_flags & REQ_URGENT) {
 		WARN_ON(rd->urgent_in_flight);
 		rd->urgent_in_flight = true;
@@ -726,6 +928,7 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 {
 	struct row_data *rd = (struct row_data *)q->elevator->elevator_data;
 	int ret = 0, currq, ioprio_class_to_serve, start_idx, end_idx;
+	struct request *rq;
 
 	if (force && hrtimer_active(&rd->rd_idle_data.hr_timer)) {
 		if (hrtimer_try_to_cancel(&rd->rd_idle_data.hr_timer) >= 0) {
@@ -743,6 +946,15 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 		goto done;
 	}
 
+	rq = row_fg_next_read(rd, true);
+	if (rq) {
+		row_log_rowq(rd, RQ_ROWQ(rq)->prio,
+			"dispatching fg read before its deadline");
+		row_dispatch_insert(rd, rq);
+		ret = 1;
+		goto done;
+	}
+
 	ioprio_class_to_serve = row_get_ioprio_class_to_serve(rd, force);
 	row_log(rd->dispatch_queue, "Dispatching from %d priority class",
 		ioprio_class_to_serve);
@@ -772,8 +984,18 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 
 	/* Dispatch */
 	if (currq >= 0) {
-		row_dispatch_insert(rd,
-			rq_entry_fifo(rd->row_queues[currq].fifo.next));
+		rq = rq_entry_fifo(rd->row_queues[currq].fifo.next);
+		if (!force && row_bg_throttled(rd, rq)) {
+			/* let foreground reads through if there are any */
+			rq = row_fg_next_read(rd, false);
+			if (!rq) {
+				row_log(rd->dispatch_queue,
+					"bg throttled, %d in flight",
+					rd->fg.bg_in_flight);
+				goto done;
+			}
+		}
+		row_dispatch_insert(rd, rq);
 		ret = 1;
 	}
 done:
@@ -830,6 +1052,11 @@ static void *row_init_queue(struct request_queue *q)
 	rdata->rd_idle_data.idling_queue_idx = ROWQ_MAX_PRIO;
 	rdata->dispatch_queue = q;
 
+	rdata->fg.active_until = jiffies;
+	rdata->fg.active_ms = ROW_FG_ACTIVE_MSEC;
+	rdata->fg.bg_limit = ROW_BG_LIMIT_MAX;
+	rdata->fg.bg_limit_max = ROW_BG_LIMIT_MAX;
+
 	return rdata;
 }
 
@@ -864,6 +1091,18 @@ static void row_merged_requests(struct request_queue *q, struct request *rq,
 
 	list_del_init(&next->queuelist);
 	rqueue->nr_req--;
+	/* rq takes over the earlier deadline of the two */
+	if (RQ_ROW_IS_FG(next)) {
+		if (!RQ_ROW_IS_FG(rq)) {
+			rq->elevator_private[2] = next->elevator_private[2];
+		} else {
+			if (RQ_ROW_FG_READ(next))
+				rqueue->rdata->fg.nr_reads--;
+			if ((long)(RQ_ROW_FG(next) - RQ_ROW_FG(rq)) < 0)
+				rq->elevator_private[2] =
+					next->elevator_private[2];
+		}
+	}
 	if (rqueue->rdata->pending_urgent_rq == next) {
 		pr_err("\n\nROW_WARNING: merging pending urgent!");
 		rqueue->rdata->pending_urgent_rq = rq;
@@ -928,6 +1167,21 @@ static enum row_queue_prio row_get_queue_prio(struct request *rq,
 	return q_type;
 }
 
+/*
+ * row_read_lat_target() - Read latency target of the submitting task
+ *
+ * Returns the read_latency_target_us of the task's blkio cgroup, 0 when
+ * it has none.
+ */
+static inline unsigned int row_read_lat_target(void)
+{
+#ifdef CONFIG_IOSCHED_ROW_CGROUP
+	return blkcg_task_read_lat_target(current);
+#else
+	return 0;
+#endif
+}
+
 /*
  * row_set_request() - Set ROW data structures associated with this request.
  * @q:		requests queue
@@ -939,11 +1193,14 @@ static int
 row_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
 {
 	struct row_data *rd = (struct row_data *)q->elevator->elevator_data;
+	unsigned int target = row_read_lat_target();
 	unsigned long flags;
 
 	spin_lock_irqsave(q->queue_lock, flags);
 	rq->elevator_private[0] =
 		(void *)(&rd->row_queues[row_get_queue_prio(rq, rd)]);
+	rq->elevator_private[2] = target ?
+		(void *)((row_now_us() + target) | 1) : NULL;
 	spin_unlock_irqrestore(q->queue_lock, flags);
 
 	return 0;
@@ -990,6 +1247,8 @@ SHOW_FUNCTION(row_reg_starv_limit_show,
 	rowd->reg_prio_starvation.starvation_limit);
 SHOW_FUNCTION(row_low_starv_limit_show,
 	rowd->low_prio_starvation.starvation_limit);
+SHOW_FUNCTION(row_fg_active_ms_show, rowd->fg.active_ms);
+SHOW_FUNCTION(row_bg_limit_max_show, rowd->fg.bg_limit_max);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX)			\
@@ -1036,9 +1295,60 @@ STORE_FUNCTION(row_reg_starv_limit_store,
 STORE_FUNCTION(row_low_starv_limit_store,
 			&rowd->low_prio_starvation.starvation_limit,
 			1, INT_MAX);
+STORE_FUNCTION(row_fg_active_ms_store, &rowd->fg.active_ms, 1, INT_MAX);
+STORE_FUNCTION(row_bg_limit_max_store, &rowd->fg.bg_limit_max, 1, INT_MAX);
 
 #undef STORE_FUNCTION
 
+static ssize_t row_fg_stats_show(struct elevator_queue *e, char *page)
+{
+	struct row_data *rowd = e->elevator_data;
+
+	return snprintf(page, PAGE_SIZE,
+		"met %lu\nmissed %lu\nbg_limit %d\nbg_in_flight %d\n"
+		"svc_us %lu\n", rowd->fg.met, rowd->fg.missed,
+		rowd->fg.bg_limit, rowd->fg.bg_in_flight, rowd->fg.svc_us);
+}
+
+#ifdef CONFIG_IOSCHED_LAT_HIST
+/* in enum row_queue_prio order */
+static const char * const row_lat_names[ROWQ_MAX_PRIO] = {
+	"hp_read", "hp_swrite", "rp_read", "rp_swrite", "rp_write",
+	"lp_read", "lp_swrite",
+};
+
+static ssize_t row_lat_hist_show(struct elevator_queue *e, char *page)
+{
+	struct row_data *rowd = e->elevator_data;
+
+	return iosched_lat_hist_show(rowd->lat, row_lat_names,
+				     ROWQ_MAX_PRIO, page);
+}
+
+static ssize_t row_lat_pct_show(struct elevator_queue *e, char *page)
+{
+	struct row_data *rowd = e->elevator_data;
+
+	return iosched_lat_pct_show(rowd->lat, row_lat_names,
+				    ROWQ_MAX_PRIO, page);
+}
+
+/* writing anything to either file clears the histograms */
+static ssize_t row_lat_reset_store(struct elevator_queue *e,
+		const char *page, size_t count)
+{
+	struct row_data *rowd = e->elevator_data;
+	struct request_queue *q = rowd->dispatch_queue;
+
+	spin_lock_irq(q->queue_lock);
+	iosched_lat_reset(rowd->lat, ROWQ_MAX_PRIO);
+	spin_unlock_irq(q->queue_lock);
+	return count;
+}
+#define row_lat_hist_store	row_lat_reset_store
+#define row_lat_pct_store	row_lat_reset_store
+#endif
+
 #define ROW_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
 				      row_##name##_store)
@@ -1055,6 +1365,13 @@ static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(rd_idle_data_freq),
 	ROW_ATTR(reg_starv_limit),
 	ROW_ATTR(low_starv_limit),
+	ROW_ATTR(fg_active_ms),
+	ROW_ATTR(bg_limit_max),
+	__ATTR(fg_stats, S_IRUGO, row_fg_stats_show, NULL),
+#ifdef CONFIG_IOSCHED_LAT_HIST
+	ROW_ATTR(lat_hist),
+	ROW_ATTR(lat_pct),
+#endif
 	__ATTR_NULL
 };
 
@@ -20,6 +20,8 @@
 #include <linux/init.h>
 #include <linux/version.h>
 
+#include "iosched-lat.h"
+
 enum { ASYNC, SYNC };
 
 /* Tunables */
@@ -46,6 +48,12 @@ struct sio_data {
 	int fifo_expire[2][2];
 	int fifo_batch;
 	int writes_starved;
+
+#ifdef CONFIG_IOSCHED_LAT_HIST
+	/* Latency histograms, indexed [sync][data_dir] */
+	struct request_queue *queue;
+	struct iosched_lat lat[2][2];
+#endif
 };
 
 static void
@@ -80,8 +88,19 @@ sio_add_request(struct request_queue *q, struct request *rq)
 	 */
 	rq_set_fifo_time(rq, jiffies + sd->fifo_expire[sync][data_dir]);
 	list_add_tail(&rq->queuelist, &sd->fifo_list[sync][data_dir]);
+	iosched_lat_insert(rq);
 }
 
+#ifdef CONFIG_IOSCHED_LAT_HIST
+static void
+sio_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct sio_data *sd = q->elevator->elevator_data;
+
+	iosched_lat_complete(&sd->lat[rq_is_sync(rq)][rq_data_dir(rq)], rq);
+}
+#endif
+
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,38)
 static int
 sio_queue_empty(struct request_queue *q)
@@ -173,6 +192,7 @@ sio_dispatch_request(struct sio_data *sd, struct request *rq)
 	 */
 	rq_fifo_clear(rq);
 	elv_dispatch_add_tail(rq->q, rq);
+	iosched_lat_dispatch(&sd->lat[rq_is_sync(rq)][rq_data_dir(rq)], rq);
 
 	sd->batched++;
 
@@ -265,6 +285,10 @@ sio_init_queue(struct request_queue *q)
 	sd->fifo_expire[ASYNC][READ] = async_read_expire;
 	sd->fifo_expire[ASYNC][WRITE] = async_write_expire;
 	sd->fifo_batch = fifo_batch;
+#ifdef CONFIG_IOSCHED_LAT_HIST
+	sd->queue = q;
+	iosched_lat_reset(&sd->lat[0][0], 4);
+#endif
 
 	return sd;
 }
@@ -343,6 +367,41 @@ STORE_FUNCTION(sio_fifo_batch_store, &sd->fifo_batch, 0, INT_MAX, 0);
 STORE_FUNCTION(sio_writes_starved_store, &sd->writes_starved, 0, INT_MAX, 0);
 #undef STORE_FUNCTION
 
+#ifdef CONFIG_IOSCHED_LAT_HIST
+/* in sio_data.lat[sync][data_dir] order */
+static const char * const sio_lat_names[4] = {
+	"async_read", "async_write", "sync_read", "sync_write",
+};
+
+static ssize_t sio_lat_hist_show(struct elevator_queue *e, char *page)
+{
+	struct sio_data *sd = e->elevator_data;
+
+	return iosched_lat_hist_show(&sd->lat[0][0], sio_lat_names, 4, page);
+}
+
+static ssize_t sio_lat_pct_show(struct elevator_queue *e, char *page)
+{
+	struct sio_data *sd = e->elevator_data;
+
+	return iosched_lat_pct_show(&sd->lat[0][0], sio_lat_names, 4, page);
+}
+
+/* Writing anything to either file clears the histograms */
+static ssize_t
+sio_lat_reset_store(struct elevator_queue *e, const char *page, size_t count)
+{
+	struct sio_data *sd = e->elevator_data;
+
+	spin_lock_irq(sd->queue->queue_lock);
+	iosched_lat_reset(&sd->lat[0][0], 4);
+	spin_unlock_irq(sd->queue->queue_lock);
+	return count;
+}
+#define sio_lat_hist_store	sio_lat_reset_store
+#define sio_lat_pct_store	sio_lat_reset_store
+#endif
+
 #define DD_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, sio_##name##_show, \
 				      sio_##name##_store)
@@ -354,6 +413,10 @@ static struct elv_fs_entry sio_attrs[] = {
 	DD_ATTR(async_write_expire),
 	DD_ATTR(fifo_batch),
 	DD_ATTR(writes_starved),
+#ifdef CONFIG_IOSCHED_LAT_HIST
+	DD_ATTR(lat_hist),
+	DD_ATTR(lat_pct),
+#endif
 	__ATTR_NULL
 };
 
@@ -362,6 +425,9 @@ static struct elevator_type iosched_sio = {
 		.elevator_merge_req_fn		= sio_merged_requests,
 		.elevator_dispatch_fn		= sio_dispatch_requests,
 		.elevator_add_req_fn		= sio_add_request,
+#ifdef CONFIG_IOSCHED_LAT_HIST
+		.elevator_completed_req_fn	= sio_completed_request,
+#endif
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,38)
 		.elevator_queue_empty_fn	= sio_queue_empty,
 #endif
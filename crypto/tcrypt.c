@@ -1079,6 +1079,30 @@ static int do_test(int m)
 				  speed_template_16_32);
 		break;
 
+	case 207:
+		/*
+		 * The disk encryption modes, as registered (e.g. the NEON
+		 * bit sliced ones) and as built by the templates over the
+		 * single block aes-asm cipher.
+		 */
+		test_cipher_speed("cbc(aes)", DECRYPT, sec, NULL, 0,
+				speed_template_16_32);
+		test_cipher_speed("cbc(aes-asm)", DECRYPT, sec, NULL, 0,
+				speed_template_16_32);
+		test_cipher_speed("xts(aes)", ENCRYPT, sec, NULL, 0,
+				speed_template_32_64);
+		test_cipher_speed("xts(aes-asm)", ENCRYPT, sec, NULL, 0,
+				speed_template_32_64);
+		test_cipher_speed("xts(aes)", DECRYPT, sec, NULL, 0,
+				speed_template_32_64);
+		test_cipher_speed("xts(aes-asm)", DECRYPT, sec, NULL, 0,
+				speed_template_32_64);
+		test_cipher_speed("ctr(aes)", ENCRYPT, sec, NULL, 0,
+				speed_template_16_32);
+		test_cipher_speed("ctr(aes-asm)", ENCRYPT, sec, NULL, 0,
+				speed_template_16_32);
+		break;
+
 	case 300:
 		/* fall through */
 
@@ -2972,14 +2972,14 @@ static struct cipher_testvec cast6_dec_tv_template[] = {
  */
 #define AES_ENC_TEST_VECTORS 3
 #define AES_DEC_TEST_VECTORS 3
-#define AES_CBC_ENC_TEST_VECTORS 4
-#define AES_CBC_DEC_TEST_VECTORS 4
+#define AES_CBC_ENC_TEST_VECTORS 5
+#define AES_CBC_DEC_TEST_VECTORS 5
 #define AES_LRW_ENC_TEST_VECTORS 8
 #define AES_LRW_DEC_TEST_VECTORS 8
-#define AES_XTS_ENC_TEST_VECTORS 4
-#define AES_XTS_DEC_TEST_VECTORS 4
-#define AES_CTR_ENC_TEST_VECTORS 3
-#define AES_CTR_DEC_TEST_VECTORS 3
+#define AES_XTS_ENC_TEST_VECTORS 5
+#define AES_XTS_DEC_TEST_VECTORS 5
+#define AES_CTR_ENC_TEST_VECTORS 4
+#define AES_CTR_DEC_TEST_VECTORS 4
 #define AES_OFB_ENC_TEST_VECTORS 1
 #define AES_OFB_DEC_TEST_VECTORS 1
 #define AES_CTR_3686_ENC_TEST_VECTORS 7
@@ -3146,7 +3146,71 @@ static struct cipher_testvec aes_cbc_enc_tv_template[] = {
 			  "\xb2\xeb\x05\xe2\xc3\x9b\xe9\xfc"
 			  "\xda\x6c\x19\x07\x8c\x6a\x9d\x1b",
 		.rlen	= 64,
-	},
+	}, { /* Generated with OpenSSL, 13 blocks split mid-block */
+		.key	= "\x60\x67\x6e\x75\x7c\x83\x8a\x91"
+			  "\x98\x9f\xa6\xad\xb4\xbb\xc2\xc9"
+			  "\xd0\xd7\xde\xe5\xec\xf3\xfa\x01"
+			  "\x08\x0f\x16\x1d\x24\x2b\x32\x39",
+		.klen	= 32,
+		.iv	= "\xf0\xfd\xea\xd7\xc4\xb1\xbe\xab"
+			  "\x98\x85\x72\x7f\x6c\x59\x46\x33",
+		.input	= "\x01\x04\x07\x0a\x0d\x10\x13\x16"
+			  "\x19\x1c\x1f\x22\x25\x28\x2b\x2e"
+			  "\x31\x34\x37\x3a\x3d\x40\x43\x46"
+			  "\x49\x4c\x4f\x52\x55\x58\x5b\x5e"
+			  "\x61\x64\x67\x6a\x6d\x70\x73\x76"
+			  "\x79\x7c\x7f\x82\x85\x88\x8b\x8e"
+			  "\x91\x94\x97\x9a\x9d\xa0\xa3\xa6"
+			  "\xa9\xac\xaf\xb2\xb5\xb8\xbb\xbe"
+			  "\xc1\xc4\xc7\xca\xcd\xd0\xd3\xd6"
+			  "\xd9\xdc\xdf\xe2\xe5\xe8\xeb\xee"
+			  "\xf1\xf4\xf7\xfa\xfd\x00\x03\x06"
+			  "\x09\x0c\x0f\x12\x15\x18\x1b\x1e"
+			  "\x21\x24\x27\x2a\x2d\x30\x33\x36"
+			  "\x39\x3c\x3f\x42\x45\x48\x4b\x4e"
+			  "\x51\x54\x57\x5a\x5d\x60\x63\x66"
+			  "\x69\x6c\x6f\x72\x75\x78\x7b\x7e"
+			  "\x81\x84\x87\x8a\x8d\x90\x93\x96"
+			  "\x99\x9c\x9f\xa2\xa5\xa8\xab\xae"
+			  "\xb1\xb4\xb7\xba\xbd\xc0\xc3\xc6"
+			  "\xc9\xcc\xcf\xd2\xd5\xd8\xdb\xde"
+			  "\xe1\xe4\xe7\xea\xed\xf0\xf3\xf6"
+			  "\xf9\xfc\xff\x02\x05\x08\x0b\x0e"
+			  "\x11\x14\x17\x1a\x1d\x20\x23\x26"
+			  "\x29\x2c\x2f\x32\x35\x38\x3b\x3e"
+			  "\x41\x44\x47\x4a\x4d\x50\x53\x56"
+			  "\x59\x5c\x5f\x62\x65\x68\x6b\x6e",
+		.ilen	= 208,
+		.result	= "\x5a\xff\x17\x59\xf8\x38\x65\x44"
+			  "\x0b\xb8\x0d\xa0\x62\x65\x70\x12"
+			  "\xf8\xa7\xf4\x85\x05\x9c\x51\x1f"
+			  "\x38\x50\x05\x29\x1d\xc0\xc3\xf4"
+			  "\x94\xe3\x70\xc8\x6d\x9c\x76\x7f"
+			  "\xc8\x25\xe0\xc6\xe6\xdb\x52\xe5"
+			  "\x99\xae\xd7\x2e\xe4\xd4\xdb\xca"
+			  "\x54\x9d\xa3\x4d\x5c\xc6\xb6\x70"
+			  "\x16\x49\xe1\x5f\x23\x1c\x09\xb4"
+			  "\x45\xaf\x9e\x32\xf3\x8c\x48\xef"
+			  "\xc8\xea\xa3\xe8\x6f\xc1\x91\x5f"
+			  "\xba\x3c\x5c\x52\x16\x0c\x32\xbc"
+			  "\xbc\xdc\x48\xa1\x1b\xfc\x58\x7f"
+			  "\xf8\x80\x0b\x94\x09\xa1\x12\x76"
+			  "\x79\xda\x55\x3b\x3e\xc8\xd8\x20"
+			  "\x12\x6e\xb6\x86\xae\x1e\xc1\x51"
+			  "\x8a\x34\x81\xdd\x25\x58\xef\x7b"
+			  "\x62\x49\x59\xb7\x41\xc7\x1b\x65"
+			  "\xa5\x85\xc5\x87\x27\x62\x50\x23"
+			  "\x02\xb7\x81\x66\x73\xfa\xc4\x0a"
+			  "\x76\x29\xd8\x28\x41\x06\xbc\x29"
+			  "\x80\xc0\x11\xcc\x9b\xae\xbe\x21"
+			  "\xf9\x45\x16\xe2\xdf\x4e\x0a\xcb"
+			  "\xfa\xb8\x51\x8a\x20\xb4\xa6\xe0"
+			  "\x91\x36\x8e\x31\x6f\xa0\x40\x08"
+			  "\x1d\xf6\xa9\x5a\x98\x13\x61\xe5",
+		.rlen	= 208,
+		.np	= 2,
+		.tap	= { 104, 104 },
+	}
 };
 
 static struct cipher_testvec aes_cbc_dec_tv_template[] = {
@@ -3228,7 +3292,71 @@ static struct cipher_testvec aes_cbc_dec_tv_template[] = {
 			  "\xf6\x9f\x24\x45\xdf\x4f\x9b\x17"
 			  "\xad\x2b\x41\x7b\xe6\x6c\x37\x10",
 		.rlen	= 64,
-	},
+	}, { /* Generated with OpenSSL, 13 blocks split mid-block */
+		.key	= "\x60\x67\x6e\x75\x7c\x83\x8a\x91"
+			  "\x98\x9f\xa6\xad\xb4\xbb\xc2\xc9"
+			  "\xd0\xd7\xde\xe5\xec\xf3\xfa\x01"
+			  "\x08\x0f\x16\x1d\x24\x2b\x32\x39",
+		.klen	= 32,
+		.iv	= "\xf0\xfd\xea\xd7\xc4\xb1\xbe\xab"
+			  "\x98\x85\x72\x7f\x6c\x59\x46\x33",
+		.input	= "\x5a\xff\x17\x59\xf8\x38\x65\x44"
+			  "\x0b\xb8\x0d\xa0\x62\x65\x70\x12"
+			  "\xf8\xa7\xf4\x85\x05\x9c\x51\x1f"
+			  "\x38\x50\x05\x29\x1d\xc0\xc3\xf4"
+			  "\x94\xe3\x70\xc8\x6d\x9c\x76\x7f"
+			  "\xc8\x25\xe0\xc6\xe6\xdb\x52\xe5"
+			  "\x99\xae\xd7\x2e\xe4\xd4\xdb\xca"
+			  "\x54\x9d\xa3\x4d\x5c\xc6\xb6\x70"
+			  "\x16\x49\xe1\x5f\x23\x1c\x09\xb4"
+			  "\x45\xaf\x9e\x32\xf3\x8c\x48\xef"
+			  "\xc8\xea\xa3\xe8\x6f\xc1\x91\x5f"
+			  "\xba\x3c\x5c\x52\x16\x0c\x32\xbc"
+			  "\xbc\xdc\x48\xa1\x1b\xfc\x58\x7f"
+			  "\xf8\x80\x0b\x94\x09\xa1\x12\x76"
+			  "\x79\xda\x55\x3b\x3e\xc8\xd8\x20"
+			  "\x12\x6e\xb6\x86\xae\x1e\xc1\x51"
+			  "\x8a\x34\x81\xdd\x25\x58\xef\x7b"
+			  "\x62\x49\x59\xb7\x41\xc7\x1b\x65"
+			  "\xa5\x85\xc5\x87\x27\x62\x50\x23"
+			  "\x02\xb7\x81\x66\x73\xfa\xc4\x0a"
+			  "\x76\x29\xd8\x28\x41\x06\xbc\x29"
+			  "\x80\xc0\x11\xcc\x9b\xae\xbe\x21"
+			  "\xf9\x45\x16\xe2\xdf\x4e\x0a\xcb"
+			  "\xfa\xb8\x51\x8a\x20\xb4\xa6\xe0"
+			  "\x91\x36\x8e\x31\x6f\xa0\x40\x08"
+			  "\x1d\xf6\xa9\x5a\x98\x13\x61\xe5",
+		.ilen	= 208,
+		.result	= "\x01\x04\x07\x0a\x0d\x10\x13\x16"
+			  "\x19\x1c\x1f\x22\x25\x28\x2b\x2e"
+			  "\x31\x34\x37\x3a\x3d\x40\x43\x46"
+			  "\x49\x4c\x4f\x52\x55\x58\x5b\x5e"
+			  "\x61\x64\x67\x6a\x6d\x70\x73\x76"
+			  "\x79\x7c\x7f\x82\x85\x88\x8b\x8e"
+			  "\x91\x94\x97\x9a\x9d\xa0\xa3\xa6"
+			  "\xa9\xac\xaf\xb2\xb5\xb8\xbb\xbe"
+			  "\xc1\xc4\xc7\xca\xcd\xd0\xd3\xd6"
+			  "\xd9\xdc\xdf\xe2\xe5\xe8\xeb\xee"
+			  "\xf1\xf4\xf7\xfa\xfd\x00\x03\x06"
+			  "\x09\x0c\x0f\x12\x15\x18\x1b\x1e"
+			  "\x21\x24\x27\x2a\x2d\x30\x33\x36"
+			  "\x39\x3c\x3f\x42\x45\x48\x4b\x4e"
+			  "\x51\x54\x57\x5a\x5d\x60\x63\x66"
+			  "\x69\x6c\x6f\x72\x75\x78\x7b\x7e"
+			  "\x81\x84\x87\x8a\x8d\x90\x93\x96"
+			  "\x99\x9c\x9f\xa2\xa5\xa8\xab\xae"
+			  "\xb1\xb4\xb7\xba\xbd\xc0\xc3\xc6"
+			  "\xc9\xcc\xcf\xd2\xd5\xd8\xdb\xde"
+			  "\xe1\xe4\xe7\xea\xed\xf0\xf3\xf6"
+			  "\xf9\xfc\xff\x02\x05\x08\x0b\x0e"
+			  "\x11\x14\x17\x1a\x1d\x20\x23\x26"
+			  "\x29\x2c\x2f\x32\x35\x38\x3b\x3e"
+			  "\x41\x44\x47\x4a\x4d\x50\x53\x56"
+			  "\x59\x5c\x5f\x62\x65\x68\x6b\x6e",
+		.rlen	= 208,
+		.np	= 2,
+		.tap	= { 104, 104 },
+	}
 };
 
 static struct cipher_testvec aes_lrw_enc_tv_template[] = {
@@ -3926,6 +4054,148 @@ static struct cipher_testvec aes_xts_enc_tv_template[] = {
 			  "\x0a\x28\x2d\xf9\x20\x14\x7b\xea"
 			  "\xbe\x42\x1e\xe5\x31\x9d\x05\x68",
 		.rlen   = 512,
+	}, { /* XTS-AES 10, XTS-AES-256, data unit 512 bytes */
+		.key	= "\x27\x18\x28\x18\x28\x45\x90\x45"
+			  "\x23\x53\x60\x28\x74\x71\x35\x26"
+			  "\x62\x49\x77\x57\x24\x70\x93\x69"
+			  "\x99\x59\x57\x49\x66\x96\x76\x27"
+			  "\x31\x41\x59\x26\x53\x58\x97\x93"
+			  "\x23\x84\x62\x64\x33\x83\x27\x95"
+			  "\x02\x88\x41\x97\x16\x93\x99\x37"
+			  "\x51\x05\x82\x09\x74\x94\x45\x92",
+		.klen	= 64,
+		.iv	= "\xff\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00",
+		.input	= "\x00\x01\x02\x03\x04\x05\x06\x07"
+			  "\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+			  "\x10\x11\x12\x13\x14\x15\x16\x17"
+			  "\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f"
+			  "\x20\x21\x22\x23\x24\x25\x26\x27"
+			  "\x28\x29\x2a\x2b\x2c\x2d\x2e\x2f"
+			  "\x30\x31\x32\x33\x34\x35\x36\x37"
+			  "\x38\x39\x3a\x3b\x3c\x3d\x3e\x3f"
+			  "\x40\x41\x42\x43\x44\x45\x46\x47"
+			  "\x48\x49\x4a\x4b\x4c\x4d\x4e\x4f"
+			  "\x50\x51\x52\x53\x54\x55\x56\x57"
+			  "\x58\x59\x5a\x5b\x5c\x5d\x5e\x5f"
+			  "\x60\x61\x62\x63\x64\x65\x66\x67"
+			  "\x68\x69\x6a\x6b\x6c\x6d\x6e\x6f"
+			  "\x70\x71\x72\x73\x74\x75\x76\x77"
+			  "\x78\x79\x7a\x7b\x7c\x7d\x7e\x7f"
+			  "\x80\x81\x82\x83\x84\x85\x86\x87"
+			  "\x88\x89\x8a\x8b\x8c\x8d\x8e\x8f"
+			  "\x90\x91\x92\x93\x94\x95\x96\x97"
+			  "\x98\x99\x9a\x9b\x9c\x9d\x9e\x9f"
+			  "\xa0\xa1\xa2\xa3\xa4\xa5\xa6\xa7"
+			  "\xa8\xa9\xaa\xab\xac\xad\xae\xaf"
+			  "\xb0\xb1\xb2\xb3\xb4\xb5\xb6\xb7"
+			  "\xb8\xb9\xba\xbb\xbc\xbd\xbe\xbf"
+			  "\xc0\xc1\xc2\xc3\xc4\xc5\xc6\xc7"
+			  "\xc8\xc9\xca\xcb\xcc\xcd\xce\xcf"
+			  "\xd0\xd1\xd2\xd3\xd4\xd5\xd6\xd7"
+			  "\xd8\xd9\xda\xdb\xdc\xdd\xde\xdf"
+			  "\xe0\xe1\xe2\xe3\xe4\xe5\xe6\xe7"
+			  "\xe8\xe9\xea\xeb\xec\xed\xee\xef"
+			  "\xf0\xf1\xf2\xf3\xf4\xf5\xf6\xf7"
+			  "\xf8\xf9\xfa\xfb\xfc\xfd\xfe\xff"
+			  "\x00\x01\x02\x03\x04\x05\x06\x07"
+			  "\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+			  "\x10\x11\x12\x13\x14\x15\x16\x17"
+			  "\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f"
+			  "\x20\x21\x22\x23\x24\x25\x26\x27"
+			  "\x28\x29\x2a\x2b\x2c\x2d\x2e\x2f"
+			  "\x30\x31\x32\x33\x34\x35\x36\x37"
+			  "\x38\x39\x3a\x3b\x3c\x3d\x3e\x3f"
+			  "\x40\x41\x42\x43\x44\x45\x46\x47"
+			  "\x48\x49\x4a\x4b\x4c\x4d\x4e\x4f"
+			  "\x50\x51\x52\x53\x54\x55\x56\x57"
+			  "\x58\x59\x5a\x5b\x5c\x5d\x5e\x5f"
+			  "\x60\x61\x62\x63\x64\x65\x66\x67"
+			  "\x68\x69\x6a\x6b\x6c\x6d\x6e\x6f"
+			  "\x70\x71\x72\x73\x74\x75\x76\x77"
+			  "\x78\x79\x7a\x7b\x7c\x7d\x7e\x7f"
+			  "\x80\x81\x82\x83\x84\x85\x86\x87"
+			  "\x88\x89\x8a\x8b\x8c\x8d\x8e\x8f"
+			  "\x90\x91\x92\x93\x94\x95\x96\x97"
+			  "\x98\x99\x9a\x9b\x9c\x9d\x9e\x9f"
+			  "\xa0\xa1\xa2\xa3\xa4\xa5\xa6\xa7"
+			  "\xa8\xa9\xaa\xab\xac\xad\xae\xaf"
+			  "\xb0\xb1\xb2\xb3\xb4\xb5\xb6\xb7"
+			  "\xb8\xb9\xba\xbb\xbc\xbd\xbe\xbf"
+			  "\xc0\xc1\xc2\xc3\xc4\xc5\xc6\xc7"
+			  "\xc8\xc9\xca\xcb\xcc\xcd\xce\xcf"
+			  "\xd0\xd1\xd2\xd3\xd4\xd5\xd6\xd7"
+			  "\xd8\xd9\xda\xdb\xdc\xdd\xde\xdf"
+			  "\xe0\xe1\xe2\xe3\xe4\xe5\xe6\xe7"
+			  "\xe8\xe9\xea\xeb\xec\xed\xee\xef"
+			  "\xf0\xf1\xf2\xf3\xf4\xf5\xf6\xf7"
+			  "\xf8\xf9\xfa\xfb\xfc\xfd\xfe\xff",
+		.ilen	= 512,
+		.result	= "\x1c\x3b\x3a\x10\x2f\x77\x03\x86"
+			  "\xe4\x83\x6c\x99\xe3\x70\xcf\x9b"
+			  "\xea\x00\x80\x3f\x5e\x48\x23\x57"
+			  "\xa4\xae\x12\xd4\x14\xa3\xe6\x3b"
+			  "\x5d\x31\xe2\x76\xf8\xfe\x4a\x8d"
+			  "\x66\xb3\x17\xf9\xac\x68\x3f\x44"
+			  "\x68\x0a\x86\xac\x35\xad\xfc\x33"
+			  "\x45\xbe\xfe\xcb\x4b\xb1\x88\xfd"
+			  "\x57\x76\x92\x6c\x49\xa3\x09\x5e"
+			  "\xb1\x08\xfd\x10\x98\xba\xec\x70"
+			  "\xaa\xa6\x69\x99\xa7\x2a\x82\xf2"
+			  "\x7d\x84\x8b\x21\xd4\xa7\x41\xb0"
+			  "\xc5\xcd\x4d\x5f\xff\x9d\xac\x89"
+			  "\xae\xba\x12\x29\x61\xd0\x3a\x75"
+			  "\x71\x23\xe9\x87\x0f\x8a\xcf\x10"
+			  "\x00\x02\x08\x87\x89\x14\x29\xca"
+			  "\x2a\x3e\x7a\x7d\x7d\xf7\xb1\x03"
+			  "\x55\x16\x5c\x8b\x9a\x6d\x0a\x7d"
+			  "\xe8\xb0\x62\xc4\x50\x0d\xc4\xcd"
+			  "\x12\x0c\x0f\x74\x18\xda\xe3\xd0"
+			  "\xb5\x78\x1c\x34\x80\x3f\xa7\x54"
+			  "\x21\xc7\x90\xdf\xe1\xde\x18\x34"
+			  "\xf2\x80\xd7\x66\x7b\x32\x7f\x6c"
+			  "\x8c\xd7\x55\x7e\x12\xac\x3a\x0f"
+			  "\x93\xec\x05\xc5\x2e\x04\x93\xef"
+			  "\x31\xa1\x2d\x3d\x92\x60\xf7\x9a"
+			  "\x28\x9d\x6a\x37\x9b\xc7\x0c\x50"
+			  "\x84\x14\x73\xd1\xa8\xcc\x81\xec"
+			  "\x58\x3e\x96\x45\xe0\x7b\x8d\x96"
+			  "\x70\x65\x5b\xa5\xbb\xcf\xec\xc6"
+			  "\xdc\x39\x66\x38\x0a\xd8\xfe\xcb"
+			  "\x17\xb6\xba\x02\x46\x9a\x02\x0a"
+			  "\x84\xe1\x8e\x8f\x84\x25\x20\x70"
+			  "\xc1\x3e\x9f\x1f\x28\x9b\xe5\x4f"
+			  "\xbc\x48\x14\x57\x77\x8f\x61\x60"
+			  "\x15\xe1\x32\x7a\x02\xb1\x40\xf1"
+			  "\x50\x5e\xb3\x09\x32\x6d\x68\x37"
+			  "\x8f\x83\x74\x59\x5c\x84\x9d\x84"
+			  "\xf4\xc3\x33\xec\x44\x23\x88\x51"
+			  "\x43\xcb\x47\xbd\x71\xc5\xed\xae"
+			  "\x9b\xe6\x9a\x2f\xfe\xce\xb1\xbe"
+			  "\xc9\xde\x24\x4f\xbe\x15\x99\x2b"
+			  "\x11\xb7\x7c\x04\x0f\x12\xbd\x8f"
+			  "\x6a\x97\x5a\x44\xa0\xf9\x0c\x29"
+			  "\xa9\xab\xc3\xd4\xd8\x93\x92\x72"
+			  "\x84\xc5\x87\x54\xcc\xe2\x94\x52"
+			  "\x9f\x86\x14\xdc\xd2\xab\xa9\x91"
+			  "\x92\x5f\xed\xc4\xae\x74\xff\xac"
+			  "\x6e\x33\x3b\x93\xeb\x4a\xff\x04"
+			  "\x79\xda\x9a\x41\x0e\x44\x50\xe0"
+			  "\xdd\x7a\xe4\xc6\xe2\x91\x09\x00"
+			  "\x57\x5d\xa4\x01\xfc\x07\x05\x9f"
+			  "\x64\x5e\x8b\x7e\x9b\xfd\xef\x33"
+			  "\x94\x30\x54\xff\x84\x01\x14\x93"
+			  "\xc2\x7b\x34\x29\xea\xed\xb4\xed"
+			  "\x53\x76\x44\x1a\x77\xed\x43\x85"
+			  "\x1a\xd7\x7f\x16\xf5\x41\xdf\xd2"
+			  "\x69\xd5\x0d\x6a\x5f\x14\xfb\x0a"
+			  "\xab\x1c\xbb\x4c\x15\x50\xbe\x97"
+			  "\xf7\xab\x40\x66\x19\x3c\x4c\xaa"
+			  "\x77\x3d\xad\x38\x01\x4b\xd2\x09"
+			  "\x2f\xa7\x55\xc8\x24\xbb\x5e\x54"
+			  "\xc4\xf3\x6f\xfd\xa9\xfc\xea\x70"
+			  "\xb9\xc6\xe6\x93\xe1\x48\xc1\x51",
+		.rlen	= 512,
 	}
 };
 
@@ -4123,6 +4393,148 @@ static struct cipher_testvec aes_xts_dec_tv_template[] = {
 			  "\xf0\xf1\xf2\xf3\xf4\xf5\xf6\xf7"
 			  "\xf8\xf9\xfa\xfb\xfc\xfd\xfe\xff",
 		.rlen   = 512,
+	}, { /* XTS-AES 10, XTS-AES-256, data unit 512 bytes */
+		.key	= "\x27\x18\x28\x18\x28\x45\x90\x45"
+			  "\x23\x53\x60\x28\x74\x71\x35\x26"
+			  "\x62\x49\x77\x57\x24\x70\x93\x69"
+			  "\x99\x59\x57\x49\x66\x96\x76\x27"
+			  "\x31\x41\x59\x26\x53\x58\x97\x93"
+			  "\x23\x84\x62\x64\x33\x83\x27\x95"
+			  "\x02\x88\x41\x97\x16\x93\x99\x37"
+			  "\x51\x05\x82\x09\x74\x94\x45\x92",
+		.klen	= 64,
+		.iv	= "\xff\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00",
+		.input	= "\x1c\x3b\x3a\x10\x2f\x77\x03\x86"
+			  "\xe4\x83\x6c\x99\xe3\x70\xcf\x9b"
+			  "\xea\x00\x80\x3f\x5e\x48\x23\x57"
+			  "\xa4\xae\x12\xd4\x14\xa3\xe6\x3b"
+			  "\x5d\x31\xe2\x76\xf8\xfe\x4a\x8d"
+			  "\x66\xb3\x17\xf9\xac\x68\x3f\x44"
+			  "\x68\x0a\x86\xac\x35\xad\xfc\x33"
+			  "\x45\xbe\xfe\xcb\x4b\xb1\x88\xfd"
+			  "\x57\x76\x92\x6c\x49\xa3\x09\x5e"
+			  "\xb1\x08\xfd\x10\x98\xba\xec\x70"
+			  "\xaa\xa6\x69\x99\xa7\x2a\x82\xf2"
+			  "\x7d\x84\x8b\x21\xd4\xa7\x41\xb0"
+			  "\xc5\xcd\x4d\x5f\xff\x9d\xac\x89"
+			  "\xae\xba\x12\x29\x61\xd0\x3a\x75"
+			  "\x71\x23\xe9\x87\x0f\x8a\xcf\x10"
+			  "\x00\x02\x08\x87\x89\x14\x29\xca"
+			  "\x2a\x3e\x7a\x7d\x7d\xf7\xb1\x03"
+			  "\x55\x16\x5c\x8b\x9a\x6d\x0a\x7d"
+			  "\xe8\xb0\x62\xc4\x50\x0d\xc4\xcd"
+			  "\x12\x0c\x0f\x74\x18\xda\xe3\xd0"
+			  "\xb5\x78\x1c\x34\x80\x3f\xa7\x54"
+			  "\x21\xc7\x90\xdf\xe1\xde\x18\x34"
+			  "\xf2\x80\xd7\x66\x7b\x32\x7f\x6c"
+			  "\x8c\xd7\x55\x7e\x12\xac\x3a\x0f"
+			  "\x93\xec\x05\xc5\x2e\x04\x93\xef"
+			  "\x31\xa1\x2d\x3d\x92\x60\xf7\x9a"
+			  "\x28\x9d\x6a\x37\x9b\xc7\x0c\x50"
+			  "\x84\x14\x73\xd1\xa8\xcc\x81\xec"
+			  "\x58\x3e\x96\x45\xe0\x7b\x8d\x96"
+			  "\x70\x65\x5b\xa5\xbb\xcf\xec\xc6"
+			  "\xdc\x39\x66\x38\x0a\xd8\xfe\xcb"
+			  "\x17\xb6\xba\x02\x46\x9a\x02\x0a"
+			  "\x84\xe1\x8e\x8f\x84\x25\x20\x70"
+			  "\xc1\x3e\x9f\x1f\x28\x9b\xe5\x4f"
+			  "\xbc\x48\x14\x57\x77\x8f\x61\x60"
+			  "\x15\xe1\x32\x7a\x02\xb1\x40\xf1"
+			  "\x50\x5e\xb3\x09\x32\x6d\x68\x37"
+			  "\x8f\x83\x74\x59\x5c\x84\x9d\x84"
+			  "\xf4\xc3\x33\xec\x44\x23\x88\x51"
+			  "\x43\xcb\x47\xbd\x71\xc5\xed\xae"
+			  "\x9b\xe6\x9a\x2f\xfe\xce\xb1\xbe"
+			  "\xc9\xde\x24\x4f\xbe\x15\x99\x2b"
+			  "\x11\xb7\x7c\x04\x0f\x12\xbd\x8f"
+			  "\x6a\x97\x5a\x44\xa0\xf9\x0c\x29"
+			  "\xa9\xab\xc3\xd4\xd8\x93\x92\x72"
+			  "\x84\xc5\x87\x54\xcc\xe2\x94\x52"
+			  "\x9f\x86\x14\xdc\xd2\xab\xa9\x91"
+			  "\x92\x5f\xed\xc4\xae\x74\xff\xac"
+			  "\x6e\x33\x3b\x93\xeb\x4a\xff\x04"
+			  "\x79\xda\x9a\x41\x0e\x44\x50\xe0"
+			  "\xdd\x7a\xe4\xc6\xe2\x91\x09\x00"
+			  "\x57\x5d\xa4\x01\xfc\x07\x05\x9f"
+			  "\x64\x5e\x8b\x7e\x9b\xfd\xef\x33"
+			  "\x94\x30\x54\xff\x84\x01\x14\x93"
+			  "\xc2\x7b\x34\x29\xea\xed\xb4\xed"
+			  "\x53\x76\x44\x1a\x77\xed\x43\x85"
+			  "\x1a\xd7\x7f\x16\xf5\x41\xdf\xd2"
+			  "\x69\xd5\x0d\x6a\x5f\x14\xfb\x0a"
+			  "\xab\x1c\xbb\x4c\x15\x50\xbe\x97"
+			  "\xf7\xab\x40\x66\x19\x3c\x4c\xaa"
+			  "\x77\x3d\xad\x38\x01\x4b\xd2\x09"
+			  "\x2f\xa7\x55\xc8\x24\xbb\x5e\x54"
+			  "\xc4\xf3\x6f\xfd\xa9\xfc\xea\x70"
+			  "\xb9\xc6\xe6\x93\xe1\x48\xc1\x51",
+		.ilen	= 512,
+		.result	= "\x00\x01\x02\x03\x04\x05\x06\x07"
+			  "\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+			  "\x10\x11\x12\x13\x14\x15\x16\x17"
+			  "\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f"
+			  "\x20\x21\x22\x23\x24\x25\x26\x27"
+			  "\x28\x29\x2a\x2b\x2c\x2d\x2e\x2f"
+			  "\x30\x31\x32\x33\x34\x35\x36\x37"
+			  "\x38\x39\x3a\x3b\x3c\x3d\x3e\x3f"
+			  "\x40\x41\x42\x43\x44\x45\x46\x47"
+			  "\x48\x49\x4a\x4b\x4c\x4d\x4e\x4f"
+			  "\x50\x51\x52\x53\x54\x55\x56\x57"
+			  "\x58\x59\x5a\x5b\x5c\x5d\x5e\x5f"
+			  "\x60\x61\x62\x63\x64\x65\x66\x67"
+			  "\x68\x69\x6a\x6b\x6c\x6d\x6e\x6f"
+			  "\x70\x71\x72\x73\x74\x75\x76\x77"
+			  "\x78\x79\x7a\x7b\x7c\x7d\x7e\x7f"
+			  "\x80\x81\x82\x83\x84\x85\x86\x87"
+			  "\x88\x89\x8a\x8b\x8c\x8d\x8e\x8f"
+			  "\x90\x91\x92\x93\x94\x95\x96\x97"
+			  "\x98\x99\x9a\x9b\x9c\x9d\x9e\x9f"
+			  "\xa0\xa1\xa2\xa3\xa4\xa5\xa6\xa7"
+			  "\xa8\xa9\xaa\xab\xac\xad\xae\xaf"
+			  "\xb0\xb1\xb2\xb3\xb4\xb5\xb6\xb7"
+			  "\xb8\xb9\xba\xbb\xbc\xbd\xbe\xbf"
+			  "\xc0\xc1\xc2\xc3\xc4\xc5\xc6\xc7"
+			  "\xc8\xc9\xca\xcb\xcc\xcd\xce\xcf"
+			  "\xd0\xd1\xd2\xd3\xd4\xd5\xd6\xd7"
+			  "\xd8\xd9\xda\xdb\xdc\xdd\xde\xdf"
+			  "\xe0\xe1\xe2\xe3\xe4\xe5\xe6\xe7"
+			  "\xe8\xe9\xea\xeb\xec\xed\xee\xef"
+			  "\xf0\xf1\xf2\xf3\xf4\xf5\xf6\xf7"
+			  "\xf8\xf9\xfa\xfb\xfc\xfd\xfe\xff"
+			  "\x00\x01\x02\x03\x04\x05\x06\x07"
+			  "\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+			  "\x10\x11\x12\x13\x14\x15\x16\x17"
+			  "\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f"
+			  "\x20\x21\x22\x23\x24\x25\x26\x27"
+			  "\x28\x29\x2a\x2b\x2c\x2d\x2e\x2f"
+			  "\x30\x31\x32\x33\x34\x35\x36\x37"
+			  "\x38\x39\x3a\x3b\x3c\x3d\x3e\x3f"
+			  "\x40\x41\x42\x43\x44\x45\x46\x47"
+			  "\x48\x49\x4a\x4b\x4c\x4d\x4e\x4f"
+			  "\x50\x51\x52\x53\x54\x55\x56\x57"
+			  "\x58\x59\x5a\x5b\x5c\x5d\x5e\x5f"
+			  "\x60\x61\x62\x63\x64\x65\x66\x67"
+			  "\x68\x69\x6a\x6b\x6c\x6d\x6e\x6f"
+			  "\x70\x71\x72\x73\x74\x75\x76\x77"
+			  "\x78\x79\x7a\x7b\x7c\x7d\x7e\x7f"
+			  "\x80\x81\x82\x83\x84\x85\x86\x87"
+			  "\x88\x89\x8a\x8b\x8c\x8d\x8e\x8f"
+			  "\x90\x91\x92\x93\x94\x95\x96\x97"
+			  "\x98\x99\x9a\x9b\x9c\x9d\x9e\x9f"
+			  "\xa0\xa1\xa2\xa3\xa4\xa5\xa6\xa7"
+			  "\xa8\xa9\xaa\xab\xac\xad\xae\xaf"
+			  "\xb0\xb1\xb2\xb3\xb4\xb5\xb6\xb7"
+			  "\xb8\xb9\xba\xbb\xbc\xbd\xbe\xbf"
+			  "\xc0\xc1\xc2\xc3\xc4\xc5\xc6\xc7"
+			  "\xc8\xc9\xca\xcb\xcc\xcd\xce\xcf"
+			  "\xd0\xd1\xd2\xd3\xd4\xd5\xd6\xd7"
+			  "\xd8\xd9\xda\xdb\xdc\xdd\xde\xdf"
+			  "\xe0\xe1\xe2\xe3\xe4\xe5\xe6\xe7"
+			  "\xe8\xe9\xea\xeb\xec\xed\xee\xef"
+			  "\xf0\xf1\xf2\xf3\xf4\xf5\xf6\xf7"
+			  "\xf8\xf9\xfa\xfb\xfc\xfd\xfe\xff",
+		.rlen	= 512,
 	}
 };
 
@@ -4203,6 +4615,70 @@ static struct cipher_testvec aes_ctr_enc_tv_template[] = {
 			  "\xdf\xc9\xc5\x8d\xb6\x7a\xad\xa6"
 			  "\x13\xc2\xdd\x08\x45\x79\x41\xa6",
 		.rlen	= 64,
+	}, { /* Generated with OpenSSL, 13 blocks and a tail, the counter carrying */
+		.key	= "\x21\x42\x63\x84\xa5\xc6\xe7\x08"
+			  "\x29\x4a\x6b\x8c\xad\xce\xef\x10",
+		.klen	= 16,
+		.iv	= "\x10\x11\x12\x13\x14\x15\x16\x17"
+			  "\x18\x19\x1a\x1b\xff\xff\xff\xfa",
+		.input	= "\xff\xfe\xfd\xfc\xfb\xfa\xf9\xf8"
+			  "\xf7\xf6\xf5\xf4\xf3\xf2\xf1\xf0"
+			  "\xef\xee\xed\xec\xeb\xea\xe9\xe8"
+			  "\xe7\xe6\xe5\xe4\xe3\xe2\xe1\xe0"
+			  "\xdf\xde\xdd\xdc\xdb\xda\xd9\xd8"
+			  "\xd7\xd6\xd5\xd4\xd3\xd2\xd1\xd0"
+			  "\xcf\xce\xcd\xcc\xcb\xca\xc9\xc8"
+			  "\xc7\xc6\xc5\xc4\xc3\xc2\xc1\xc0"
+			  "\xbf\xbe\xbd\xbc\xbb\xba\xb9\xb8"
+			  "\xb7\xb6\xb5\xb4\xb3\xb2\xb1\xb0"
+			  "\xaf\xae\xad\xac\xab\xaa\xa9\xa8"
+			  "\xa7\xa6\xa5\xa4\xa3\xa2\xa1\xa0"
+			  "\x9f\x9e\x9d\x9c\x9b\x9a\x99\x98"
+			  "\x97\x96\x95\x94\x93\x92\x91\x90"
+			  "\x8f\x8e\x8d\x8c\x8b\x8a\x89\x88"
+			  "\x87\x86\x85\x84\x83\x82\x81\x80"
+			  "\x7f\x7e\x7d\x7c\x7b\x7a\x79\x78"
+			  "\x77\x76\x75\x74\x73\x72\x71\x70"
+			  "\x6f\x6e\x6d\x6c\x6b\x6a\x69\x68"
+			  "\x67\x66\x65\x64\x63\x62\x61\x60"
+			  "\x5f\x5e\x5d\x5c\x5b\x5a\x59\x58"
+			  "\x57\x56\x55\x54\x53\x52\x51\x50"
+			  "\x4f\x4e\x4d\x4c\x4b\x4a\x49\x48"
+			  "\x47\x46\x45\x44\x43\x42\x41\x40"
+			  "\x3f\x3e\x3d\x3c\x3b\x3a\x39\x38"
+			  "\x37\x36\x35\x34\x33\x32\x31\x30"
+			  "\x2f\x2e\x2d\x2c\x2b",
+		.ilen	= 213,
+		.result	= "\xef\xd3\x32\x5d\xae\x06\x61\x9e"
+			  "\x60\xbe\x9e\x43\x97\x37\x89\x48"
+			  "\x19\x41\x2c\xba\xc4\x6e\x3e\x5b"
+			  "\xcb\x4e\xc9\xe0\xb8\xe8\x3b\xf3"
+			  "\x95\xcb\xad\xca\xc7\xee\x71\x27"
+			  "\xe4\xf2\x61\xa7\x4d\xf8\x5c\x9a"
+			  "\xf2\x44\x91\xff\xa9\xf3\xf2\x92"
+			  "\x39\xa3\x73\xcf\x52\x52\x80\x4f"
+			  "\x29\xbb\xbf\xcb\xad\x31\x66\x39"
+			  "\xc3\x75\x51\x99\xaf\x33\x37\x68"
+			  "\x19\xa1\xa6\x6b\xc2\x85\x28\x3e"
+			  "\xd7\x7b\x92\x79\x56\x0e\xca\xbf"
+			  "\x61\x6d\x7f\x34\xb7\x0d\x1a\xce"
+			  "\xb5\x6f\xdf\x8e\xc9\x43\x0d\x22"
+			  "\x12\x07\x49\x9e\xcf\xe5\xb8\x91"
+			  "\x53\x94\xd3\x21\x2e\x71\x0a\x80"
+			  "\x4a\x01\xb9\xbc\x5a\xcb\x0f\x33"
+			  "\xf8\xf8\x6f\x9f\x9f\x67\xc9\xb5"
+			  "\x07\x1c\x95\xfc\x2c\xe6\x8d\xea"
+			  "\xc8\xfb\x67\xcb\xb7\x72\x54\xe9"
+			  "\xe3\xb3\xb7\x80\xf4\x75\xd9\x9e"
+			  "\xc9\xb3\x13\x94\xcd\x30\xb5\x5c"
+			  "\xc8\xcc\x64\x29\xf3\x36\xe6\x9f"
+			  "\x44\x7e\xc6\x0f\xf1\x80\xae\x44"
+			  "\x96\xf7\xfb\x65\x0e\x95\x4e\x57"
+			  "\xc8\x78\x28\x4d\xc8\x08\xea\xf5"
+			  "\x60\x8f\x34\x85\x89",
+		.rlen	= 213,
+		.np	= 2,
+		.tap	= { 100, 113 },
 	}
 };
 
@@ -4282,6 +4758,70 @@ static struct cipher_testvec aes_ctr_dec_tv_template[] = {
 			  "\xf6\x9f\x24\x45\xdf\x4f\x9b\x17"
 			  "\xad\x2b\x41\x7b\xe6\x6c\x37\x10",
 		.rlen	= 64,
+	}, { /* Generated with OpenSSL, 13 blocks and a tail, the counter carrying */
+		.key	= "\x21\x42\x63\x84\xa5\xc6\xe7\x08"
+			  "\x29\x4a\x6b\x8c\xad\xce\xef\x10",
+		.klen	= 16,
+		.iv	= "\x10\x11\x12\x13\x14\x15\x16\x17"
+			  "\x18\x19\x1a\x1b\xff\xff\xff\xfa",
+		.input	= "\xef\xd3\x32\x5d\xae\x06\x61\x9e"
+			  "\x60\xbe\x9e\x43\x97\x37\x89\x48"
+			  "\x19\x41\x2c\xba\xc4\x6e\x3e\x5b"
+			  "\xcb\x4e\xc9\xe0\xb8\xe8\x3b\xf3"
+			  "\x95\xcb\xad\xca\xc7\xee\x71\x27"
+			  "\xe4\xf2\x61\xa7\x4d\xf8\x5c\x9a"
+			  "\xf2\x44\x91\xff\xa9\xf3\xf2\x92"
+			  "\x39\xa3\x73\xcf\x52\x52\x80\x4f"
+			  "\x29\xbb\xbf\xcb\xad\x31\x66\x39"
+			  "\xc3\x75\x51\x99\xaf\x33\x37\x68"
+			  "\x19\xa1\xa6\x6b\xc2\x85\x28\x3e"
+			  "\xd7\x7b\x92\x79\x56\x0e\xca\xbf"
+			  "\x61\x6d\x7f\x34\xb7\x0d\x1a\xce"
+			  "\xb5\x6f\xdf\x8e\xc9\x43\x0d\x22"
+			  "\x12\x07\x49\x9e\xcf\xe5\xb8\x91"
+			  "\x53\x94\xd3\x21\x2e\x71\x0a\x80"
+			  "\x4a\x01\xb9\xbc\x5a\xcb\x0f\x33"
+			  "\xf8\xf8\x6f\x9f\x9f\x67\xc9\xb5"
+			  "\x07\x1c\x95\xfc\x2c\xe6\x8d\xea"
+			  "\xc8\xfb\x67\xcb\xb7\x72\x54\xe9"
+			  "\xe3\xb3\xb7\x80\xf4\x75\xd9\x9e"
+			  "\xc9\xb3\x13\x94\xcd\x30\xb5\x5c"
+			  "\xc8\xcc\x64\x29\xf3\x36\xe6\x9f"
+			  "\x44\x7e\xc6\x0f\xf1\x80\xae\x44"
+			  "\x96\xf7\xfb\x65\x0e\x95\x4e\x57"
+			  "\xc8\x78\x28\x4d\xc8\x08\xea\xf5"
+			  "\x60\x8f\x34\x85\x89",
+		.ilen	= 213,
+		.result	= "\xff\xfe\xfd\xfc\xfb\xfa\xf9\xf8"
+			  "\xf7\xf6\xf5\xf4\xf3\xf2\xf1\xf0"
+			  "\xef\xee\xed\xec\xeb\xea\xe9\xe8"
+			  "\xe7\xe6\xe5\xe4\xe3\xe2\xe1\xe0"
+			  "\xdf\xde\xdd\xdc\xdb\xda\xd9\xd8"
+			  "\xd7\xd6\xd5\xd4\xd3\xd2\xd1\xd0"
+			  "\xcf\xce\xcd\xcc\xcb\xca\xc9\xc8"
+			  "\xc7\xc6\xc5\xc4\xc3\xc2\xc1\xc0"
+			  "\xbf\xbe\xbd\xbc\xbb\xba\xb9\xb8"
+			  "\xb7\xb6\xb5\xb4\xb3\xb2\xb1\xb0"
+			  "\xaf\xae\xad\xac\xab\xaa\xa9\xa8"
+			  "\xa7\xa6\xa5\xa4\xa3\xa2\xa1\xa0"
+			  "\x9f\x9e\x9d\x9c\x9b\x9a\x99\x98"
+			  "\x97\x96\x95\x94\x93\x92\x91\x90"
+			  "\x8f\x8e\x8d\x8c\x8b\x8a\x89\x88"
+			  "\x87\x86\x85\x84\x83\x82\x81\x80"
+			  "\x7f\x7e\x7d\x7c\x7b\x7a\x79\x78"
+			  "\x77\x76\x75\x74\x73\x72\x71\x70"
+			  "\x6f\x6e\x6d\x6c\x6b\x6a\x69\x68"
+			  "\x67\x66\x65\x64\x63\x62\x61\x60"
+			  "\x5f\x5e\x5d\x5c\x5b\x5a\x59\x58"
+			  "\x57\x56\x55\x54\x53\x52\x51\x50"
+			  "\x4f\x4e\x4d\x4c\x4b\x4a\x49\x48"
+			  "\x47\x46\x45\x44\x43\x42\x41\x40"
+			  "\x3f\x3e\x3d\x3c\x3b\x3a\x39\x38"
+			  "\x37\x36\x35\x34\x33\x32\x31\x30"
+			  "\x2f\x2e\x2d\x2c\x2b",
+		.rlen	= 213,
+		.np	= 2,
+		.tap	= { 100, 113 },
 	}
 };
 
@@ -1162,6 +1162,7 @@ static int __init diagchar_init(void)
 		goto fail;
 	}
 
+	diag_hdlc_test_init();
 	pr_info("diagchar initialized now");
 	return 0;
 
@@ -1177,6 +1178,7 @@ fail:
 static void __exit diagchar_exit(void)
 {
 	printk(KERN_INFO "diagchar exiting ..\n");
+	diag_hdlc_test_exit();
 	/* On Driver exit, send special pool type to
 	 ensure no memory leaks */
 	diagmem_exit(driver, POOL_TYPE_ALL);
@@ -18,6 +18,8 @@
 #include <linux/device.h>
 #include <linux/uaccess.h>
 #include <linux/crc-ccitt.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
 #include "diagchar_hdlc.h"
 
 
@@ -28,6 +30,45 @@ MODULE_LICENSE("GPL v2");
 #define CRC_16_L_STEP(xx_crc, xx_c) \
 	crc_ccitt_byte(xx_crc, xx_c)
 
+#define REPEAT_BYTE_UL(x)	((~0UL / 0xff) * (x))
+
+/* Non-zero if any byte of 'w' equals 'c' */
+static inline unsigned long word_has_byte(unsigned long w, uint8_t c)
+{
+	w ^= REPEAT_BYTE_UL(c);
+	return (w - REPEAT_BYTE_UL(0x01)) & ~w & REPEAT_BYTE_UL(0x80);
+}
+
+/*
+ * Length of the leading run of 'buf' that needs no escaping, at most
+ * 'len'. Aligned words are checked for CONTROL_CHAR and ESC_CHAR at once,
+ * only the word holding the first one is looked at byte by byte.
+ */
+static size_t diag_hdlc_span(const uint8_t *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	const uint8_t *end = buf + len;
+
+	while (p < end && ((unsigned long)p & (sizeof(long) - 1))) {
+		if (*p == CONTROL_CHAR || *p == ESC_CHAR)
+			return p - buf;
+		p++;
+	}
+
+	while (end - p >= sizeof(long)) {
+		unsigned long w = *(const unsigned long *)p;
+
+		if (word_has_byte(w, CONTROL_CHAR) | word_has_byte(w, ESC_CHAR))
+			break;
+		p += sizeof(long);
+	}
+
+	while (p < end && *p != CONTROL_CHAR && *p != ESC_CHAR)
+		p++;
+
+	return p - buf;
+}
+
 void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 		      struct diag_hdlc_dest_type *enc)
 {
@@ -39,6 +80,7 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 	unsigned char src_byte = 0;
 	enum diag_send_state_enum_type state;
 	unsigned int used = 0;
+	size_t run;
 
 	if (src_desc && enc) {
 
@@ -64,6 +106,18 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 			   of 2 dest bytes for an escaped byte */
 			while (src <= src_last && dest <= dest_last) {
 
+				/* Bulk copy bytes that need no escaping */
+				run = diag_hdlc_span(src, min(src_last - src,
+							      dest_last - dest) + 1);
+				if (run) {
+					crc = crc_ccitt(crc, src, run);
+					memcpy(dest, src, run);
+					src += run;
+					dest += run;
+					used += run;
+					continue;
+				}
+
 				src_byte = *src++;
 
 				if ((src_byte == CONTROL_CHAR) ||
@@ -169,6 +223,7 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 	unsigned int len = 0;
 	unsigned int i;
 	uint8_t src_byte;
+	size_t run;
 
 	int pkt_bnd = 0;
 
@@ -186,6 +241,20 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 
 		for (i = 0; i < src_length; i++) {
 
+			if (!hdlc->escaping) {
+				/* Bulk copy bytes that were not escaped */
+				run = diag_hdlc_span(&src_ptr[i],
+						     min(src_length - i,
+							 dest_length - len));
+				if (run) {
+					memcpy(&dest_ptr[len], &src_ptr[i], run);
+					len += run;
+					i += run;
+					if (i >= src_length || len >= dest_length)
+						break;
+				}
+			}
+
 			src_byte = src_ptr[i];
 
 			if (hdlc->escaping) {
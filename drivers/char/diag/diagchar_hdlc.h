@@ -53,6 +53,14 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 
 int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc);
 
+#ifdef CONFIG_DIAG_HDLC_TEST
+void diag_hdlc_test_init(void);
+void diag_hdlc_test_exit(void);
+#else
+static inline void diag_hdlc_test_init(void) {}
+static inline void diag_hdlc_test_exit(void) {}
+#endif
+
 #define ESC_CHAR     0x7D
 #define CONTROL_CHAR 0x7E
 #define ESC_MASK     0x20
@@ -0,0 +1,692 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Self-test and benchmark for the HDLC framing code.
+ *
+ * The byte at a time encoder and decoder the driver used to have are
+ * kept here as a reference. Both implementations are run over the same
+ * traffic, their output must match exactly, and the time each one took
+ * is reported.
+ *
+ * Traffic is a raw HDLC stream as it goes over the wire, for instance
+ * captured from the diag USB endpoint:
+ *
+ *   cat capture.bin > /sys/kernel/debug/diag_hdlc/capture
+ *   cat /sys/kernel/debug/diag_hdlc/bench
+ *
+ * Without a capture, synthetic log packets are used. Writing to
+ * 'capture' appends, truncating it first with O_TRUNC clears it. The
+ * self-test also runs once over the synthetic traffic at load time.
+ *
+ * Both implementations are also run with the source split into
+ * fragments and the destination bounded to a few bytes at a time, and
+ * must produce the same output as the reference does in one go.
+ */
+
+#include <linux/crc-ccitt.h>
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include "diagchar_hdlc.h"
+
+#define HDLC_TEST_MAX_CAPTURE	(1024 * 1024)
+#define HDLC_TEST_SYNTH_SIZE	(64 * 1024)
+#define HDLC_TEST_MAX_PKT	8192
+#define HDLC_TEST_LOOPS		16
+#define HDLC_TEST_MAX_FRAG	509
+
+static DEFINE_MUTEX(hdlc_test_mutex);
+static u8 *hdlc_capture;
+static size_t hdlc_capture_len;
+static struct dentry *hdlc_test_dent;
+
+/* Reference implementations, as they were before the word-at-a-time code */
+
+static void diag_hdlc_encode_ref(struct diag_send_desc_type *src_desc,
+				 struct diag_hdlc_dest_type *enc)
+{
+	uint8_t *dest = enc->dest;
+	uint8_t *dest_last = enc->dest_last;
+	const uint8_t *src = src_desc->pkt;
+	const uint8_t *src_last = src_desc->last;
+	enum diag_send_state_enum_type state = src_desc->state;
+	uint16_t crc;
+	unsigned char src_byte;
+
+	if (state == DIAG_STATE_START) {
+		crc = 0xFFFF;
+		state++;
+	} else {
+		crc = enc->crc;
+	}
+
+	while (src <= src_last && dest <= dest_last) {
+		src_byte = *src++;
+		if (src_byte == CONTROL_CHAR || src_byte == ESC_CHAR) {
+			if (dest == dest_last) {
+				src--;
+				break;
+			}
+			crc = crc_ccitt_byte(crc, src_byte);
+			*dest++ = ESC_CHAR;
+			*dest++ = src_byte ^ ESC_MASK;
+		} else {
+			crc = crc_ccitt_byte(crc, src_byte);
+			*dest++ = src_byte;
+		}
+	}
+
+	if (src > src_last) {
+		if (state == DIAG_STATE_BUSY) {
+			if (src_desc->terminate) {
+				crc = ~crc;
+				state++;
+			} else {
+				state = DIAG_STATE_COMPLETE;
+			}
+		}
+
+		while (dest <= dest_last && state >= DIAG_STATE_CRC1 &&
+		       state < DIAG_STATE_TERM) {
+			src_byte = crc & 0xFF;
+			if (src_byte == CONTROL_CHAR || src_byte == ESC_CHAR) {
+				if (dest == dest_last)
+					break;
+				*dest++ = ESC_CHAR;
+				*dest++ = src_byte ^ ESC_MASK;
+			} else {
+				*dest++ = src_byte;
+			}
+			crc >>= 8;
+			state++;
+		}
+
+		if (state == DIAG_STATE_TERM && dest_last >= dest) {
+			*dest++ = CONTROL_CHAR;
+			state++;
+		}
+	}
+
+	enc->dest = dest;
+	enc->crc = crc;
+	src_desc->pkt = src;
+	src_desc->state = state;
+}
+
+static int diag_hdlc_decode_ref(struct diag_hdlc_decode_type *hdlc)
+{
+	uint8_t *src_ptr = &hdlc->src_ptr[hdlc->src_idx];
+	uint8_t *dest_ptr = &hdlc->dest_ptr[hdlc->dest_idx];
+	unsigned int src_length = hdlc->src_size - hdlc->src_idx;
+	unsigned int dest_length = hdlc->dest_size - hdlc->dest_idx;
+	unsigned int len = 0;
+	unsigned int i;
+	int pkt_bnd = 0;
+
+	for (i = 0; i < src_length; i++) {
+		uint8_t src_byte = src_ptr[i];
+
+		if (hdlc->escaping) {
+			dest_ptr[len++] = src_byte ^ ESC_MASK;
+			hdlc->escaping = 0;
+		} else if (src_byte == ESC_CHAR) {
+			if (i == src_length - 1) {
+				hdlc->escaping = 1;
+				i++;
+				break;
+			}
+			dest_ptr[len++] = src_ptr[++i] ^ ESC_MASK;
+		} else if (src_byte == CONTROL_CHAR) {
+			dest_ptr[len++] = src_byte;
+			pkt_bnd = 1;
+			i++;
+			break;
+		} else {
+			dest_ptr[len++] = src_byte;
+		}
+
+		if (len >= dest_length) {
+			i++;
+			break;
+		}
+	}
+
+	hdlc->src_idx += i;
+	hdlc->dest_idx += len;
+
+	return pkt_bnd;
+}
+
+struct hdlc_test_ops {
+	const char *name;
+	void (*encode)(struct diag_send_desc_type *src_desc,
+		       struct diag_hdlc_dest_type *enc);
+	int (*decode)(struct diag_hdlc_decode_type *hdlc);
+};
+
+static const struct hdlc_test_ops hdlc_test_ops[] = {
+	{ "bytewise", diag_hdlc_encode_ref, diag_hdlc_decode_ref },
+	{ "wordwise", diag_hdlc_encode, diag_hdlc_decode },
+};
+
+/*
+ * Synthetic traffic: HDLC frames carrying log packets of 16 to 2063
+ * bytes, mostly counters and timestamps with the occasional byte that
+ * has to be escaped.
+ */
+static size_t hdlc_test_synth(u8 *out, size_t size)
+{
+	u8 *pkt = kmalloc(HDLC_TEST_MAX_PKT, GFP_KERNEL);
+	size_t used = 0;
+	u32 seed = 0x12345678;
+
+	if (!pkt)
+		return 0;
+
+	while (used + 2 * HDLC_TEST_MAX_PKT + 3 <= size) {
+		struct diag_send_desc_type send;
+		struct diag_hdlc_dest_type enc;
+		size_t len, i;
+
+		seed = seed * 1664525 + 1013904223;
+		len = 16 + (seed >> 21);
+		for (i = 0; i < len; i++) {
+			seed = seed * 1664525 + 1013904223;
+			pkt[i] = (seed >> 24) & ((seed & 0x100) ? 0xff : 0x0f);
+		}
+
+		send.pkt = pkt;
+		send.last = pkt + len - 1;
+		send.state = DIAG_STATE_START;
+		send.terminate = 1;
+		enc.dest = out + used;
+		enc.dest_last = out + used + 2 * len + 3;
+		diag_hdlc_encode_ref(&send, &enc);
+		used = (u8 *)enc.dest - out;
+	}
+
+	kfree(pkt);
+	return used;
+}
+
+struct hdlc_test_result {
+	size_t dec_len;
+	size_t enc_len;
+	u64 dec_ns;
+	u64 enc_ns;
+	u32 *ends;		/* decoded offset past each packet */
+	size_t max_ends;
+	size_t nr_ends;
+};
+
+/* Decode 'stream' into 'out', returning the number of decoded bytes */
+static size_t hdlc_test_decode(const struct hdlc_test_ops *ops,
+			       u8 *stream, size_t len, u8 *out, size_t size,
+			       struct hdlc_test_result *res)
+{
+	struct diag_hdlc_decode_type hdlc = {
+		.src_ptr = stream,
+		.src_size = len,
+		.dest_ptr = out,
+		.dest_size = size,
+	};
+
+	res->nr_ends = 0;
+	while (hdlc.src_idx < hdlc.src_size &&
+	       hdlc.dest_idx < hdlc.dest_size) {
+		if (ops->decode(&hdlc) && res->nr_ends < res->max_ends)
+			res->ends[res->nr_ends++] = hdlc.dest_idx;
+	}
+
+	return hdlc.dest_idx;
+}
+
+/*
+ * Re-encode every packet of the decoded stream 'pkts' into 'out'. Each
+ * packet ends with its two CRC bytes and CONTROL_CHAR.
+ */
+static size_t hdlc_test_encode(const struct hdlc_test_ops *ops,
+			       const u8 *pkts, u8 *out, size_t size,
+			       struct hdlc_test_result *res)
+{
+	u8 *dest = out;
+	u32 start = 0;
+	size_t i;
+
+	for (i = 0; i < res->nr_ends; start = res->ends[i++]) {
+		u32 len = res->ends[i] - start;
+		struct diag_send_desc_type send;
+		struct diag_hdlc_dest_type enc;
+
+		if (len <= 3)
+			continue;
+		if (dest + 2 * len + 3 >= out + size)
+			break;
+
+		send.pkt = pkts + start;
+		send.last = pkts + start + len - 4;
+		send.state = DIAG_STATE_START;
+		send.terminate = 1;
+		enc.dest = dest;
+		enc.dest_last = dest + 2 * len + 3;
+		ops->encode(&send, &enc);
+		dest = enc.dest;
+	}
+
+	return dest - out;
+}
+
+/* Source fragment and destination window sizes for the bounded runs */
+static const unsigned int hdlc_test_frags[] = { 2, 5, 61, HDLC_TEST_MAX_FRAG };
+
+/*
+ * As hdlc_test_decode(), feeding 'stream' in 'chunk' byte pieces and
+ * decoding into a 'window' byte destination that is moved on after
+ * every call.
+ */
+static size_t hdlc_test_decode_frag(const struct hdlc_test_ops *ops,
+				    u8 *stream, size_t len, u8 *out,
+				    unsigned int chunk, unsigned int window,
+				    struct hdlc_test_result *res)
+{
+	struct diag_hdlc_decode_type hdlc = { 0 };
+	size_t off, done = 0;
+
+	res->nr_ends = 0;
+	for (off = 0; off < len; off += hdlc.src_size) {
+		hdlc.src_ptr = stream + off;
+		hdlc.src_size = min_t(size_t, chunk, len - off);
+		hdlc.src_idx = 0;
+		while (hdlc.src_idx < hdlc.src_size) {
+			int bnd;
+
+			hdlc.dest_ptr = out + done;
+			hdlc.dest_size = window;
+			hdlc.dest_idx = 0;
+			bnd = ops->decode(&hdlc);
+			done += hdlc.dest_idx;
+			if (bnd && res->nr_ends < res->max_ends)
+				res->ends[res->nr_ends++] = done;
+		}
+	}
+
+	return done;
+}
+
+/*
+ * As hdlc_test_encode(), passing each packet in 'chunk' byte fragments,
+ * only the last of which terminates it, and encoding into a 'window'
+ * byte destination at a time.
+ */
+static size_t hdlc_test_encode_frag(const struct hdlc_test_ops *ops,
+				    const u8 *pkts, u8 *out, size_t size,
+				    unsigned int chunk, unsigned int window,
+				    struct hdlc_test_result *res)
+{
+	u8 *dest = out;
+	u32 start = 0;
+	size_t i;
+
+	for (i = 0; i < res->nr_ends; start = res->ends[i++]) {
+		u32 len = res->ends[i] - start;
+		const u8 *pkt = pkts + start, *end = pkts + start + len - 3;
+		struct diag_send_desc_type send;
+		struct diag_hdlc_dest_type enc;
+
+		if (len <= 3)
+			continue;
+		if (dest + 2 * len + 3 >= out + size)
+			break;
+
+		send.state = DIAG_STATE_START;
+		enc.dest = dest;
+		do {
+			send.pkt = pkt;
+			send.last = min(pkt + chunk, end) - 1;
+			send.terminate = send.last == end - 1;
+			/* a fragment that did not terminate leaves COMPLETE */
+			if (send.state == DIAG_STATE_COMPLETE)
+				send.state = DIAG_STATE_BUSY;
+			pkt = send.last + 1;
+			do {
+				enc.dest_last = (u8 *)enc.dest + window - 1;
+				ops->encode(&send, &enc);
+			} while (send.state != DIAG_STATE_COMPLETE);
+		} while (pkt < end);
+		dest = enc.dest;
+	}
+
+	return dest - out;
+}
+
+/*
+ * Check the fragmented and bounded paths of both implementations
+ * against the reference run over the whole of 'stream' at once.
+ */
+static int hdlc_test_fragments(u8 *stream, size_t len)
+{
+	const struct hdlc_test_ops *ref_ops = &hdlc_test_ops[0];
+	struct hdlc_test_result ref = { 0 }, res = { 0 };
+	size_t size = 2 * len + 3, n;
+	u8 *ref_dec, *ref_enc, *dec, *enc;
+	unsigned int chunk, window;
+	int i, j, k, ret = -ENOMEM;
+
+	/* windows may reach past the end of the output */
+	ref_dec = vmalloc(size + HDLC_TEST_MAX_FRAG);
+	ref_enc = vmalloc(size + HDLC_TEST_MAX_FRAG);
+	dec = vmalloc(size + HDLC_TEST_MAX_FRAG);
+	enc = vmalloc(size + HDLC_TEST_MAX_FRAG);
+	ref.max_ends = res.max_ends = len / 4 + 1;
+	ref.ends = vmalloc(ref.max_ends * sizeof(u32));
+	res.ends = vmalloc(res.max_ends * sizeof(u32));
+	if (!ref_dec || !ref_enc || !dec || !enc || !ref.ends || !res.ends)
+		goto out;
+
+	ref.dec_len = hdlc_test_decode(ref_ops, stream, len, ref_dec, size,
+				       &ref);
+	ref.enc_len = hdlc_test_encode(ref_ops, ref_dec, ref_enc, size, &ref);
+
+	ret = 0;
+	for (i = 0; i < ARRAY_SIZE(hdlc_test_ops); i++) {
+		for (j = 0; j < ARRAY_SIZE(hdlc_test_frags); j++) {
+			for (k = 0; k < ARRAY_SIZE(hdlc_test_frags); k++) {
+				chunk = hdlc_test_frags[j];
+				window = hdlc_test_frags[k];
+
+				n = hdlc_test_decode_frag(&hdlc_test_ops[i],
+						stream, len, dec, chunk,
+						window, &res);
+				if (n != ref.dec_len ||
+				    memcmp(dec, ref_dec, n) ||
+				    res.nr_ends != ref.nr_ends ||
+				    memcmp(res.ends, ref.ends,
+					   ref.nr_ends * sizeof(u32))) {
+					pr_err("diag: hdlc %s decoder mismatch, "
+					       "%u byte fragments, %u byte "
+					       "window\n",
+					       hdlc_test_ops[i].name, chunk,
+					       window);
+					ret = -EINVAL;
+				}
+
+				n = hdlc_test_encode_frag(&hdlc_test_ops[i],
+						ref_dec, enc, size, chunk,
+						window, &ref);
+				if (n != ref.enc_len ||
+				    memcmp(enc, ref_enc, n)) {
+					pr_err("diag: hdlc %s encoder mismatch, "
+					       "%u byte fragments, %u byte "
+					       "window\n",
+					       hdlc_test_ops[i].name, chunk,
+					       window);
+					ret = -EINVAL;
+				}
+			}
+		}
+	}
+out:
+	vfree(ref_dec);
+	vfree(ref_enc);
+	vfree(dec);
+	vfree(enc);
+	vfree(ref.ends);
+	vfree(res.ends);
+	return ret;
+}
+
+static void hdlc_test_run(const struct hdlc_test_ops *ops, u8 *stream,
+			  size_t len, u8 *dec, u8 *enc, size_t size,
+			  struct hdlc_test_result *res)
+{
+	ktime_t start;
+	int i;
+
+	start = ktime_get();
+	for (i = 0; i < HDLC_TEST_LOOPS; i++)
+		res->dec_len = hdlc_test_decode(ops, stream, len, dec, size,
+						res);
+	res->dec_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < HDLC_TEST_LOOPS; i++)
+		res->enc_len = hdlc_test_encode(ops, dec, enc, size, res);
+	res->enc_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/* One byte per microsecond is one MB/s */
+static unsigned long hdlc_test_mbps(size_t len, u64 ns)
+{
+	u64 bytes = (u64)len * HDLC_TEST_LOOPS;
+
+	do_div(ns, 1000);
+	if (!ns)
+		ns = 1;
+	do_div(bytes, ns);
+	return (unsigned long)bytes;
+}
+
+/*
+ * Run both implementations over 'stream' and compare their output. If
+ * 'm' is given, timings are printed to it. Returns 0 when the outputs
+ * match.
+ */
+static int hdlc_test_compare(struct seq_file *m, u8 *stream, size_t len)
+{
+	struct hdlc_test_result res[ARRAY_SIZE(hdlc_test_ops)] = { { 0 } };
+	size_t size = 2 * len + 3;
+	u8 *dec[ARRAY_SIZE(hdlc_test_ops)] = { NULL };
+	u8 *enc[ARRAY_SIZE(hdlc_test_ops)] = { NULL };
+	int i, ret = -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(hdlc_test_ops); i++) {
+		dec[i] = vmalloc(size);
+		enc[i] = vmalloc(size);
+		res[i].max_ends = len / 4 + 1;
+		res[i].ends = vmalloc(res[i].max_ends * sizeof(u32));
+		if (!dec[i] || !enc[i] || !res[i].ends)
+			goto out;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(hdlc_test_ops); i++)
+		hdlc_test_run(&hdlc_test_ops[i], stream, len, dec[i], enc[i],
+			      size, &res[i]);
+
+	ret = 0;
+	for (i = 1; i < ARRAY_SIZE(hdlc_test_ops); i++) {
+		if (res[i].dec_len != res[0].dec_len ||
+		    memcmp(dec[i], dec[0], res[0].dec_len)) {
+			pr_err("diag: hdlc %s decoder mismatch\n",
+			       hdlc_test_ops[i].name);
+			ret = -EINVAL;
+		}
+		if (res[i].enc_len != res[0].enc_len ||
+		    memcmp(enc[i], enc[0], res[0].enc_len)) {
+			pr_err("diag: hdlc %s encoder mismatch\n",
+			       hdlc_test_ops[i].name);
+			ret = -EINVAL;
+		}
+	}
+
+	/* The CRC fast path must agree with the byte at a time one too */
+	for (i = 0; i < 64 && i < res[0].dec_len; i++) {
+		size_t n = min_t(size_t, res[0].dec_len - i, PAGE_SIZE);
+		u16 crc = 0xFFFF;
+		size_t j;
+
+		for (j = 0; j < n; j++)
+			crc = crc_ccitt_byte(crc, dec[0][i + j]);
+		if (crc != crc_ccitt(0xFFFF, dec[0] + i, n)) {
+			pr_err("diag: crc_ccitt mismatch at offset %d\n", i);
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+	if (!m)
+		goto out;
+
+	seq_printf(m, "stream %zu bytes, %zu decoded, %d loops: %s\n",
+		   len, res[0].dec_len, HDLC_TEST_LOOPS, ret ? "FAIL" : "ok");
+	seq_printf(m, "%-10s %12s %10s %12s %10s\n",
+		   "", "decode_us", "MB/s", "encode_us", "MB/s");
+	for (i = 0; i < ARRAY_SIZE(hdlc_test_ops); i++) {
+		u64 dec_us = res[i].dec_ns, enc_us = res[i].enc_ns;
+
+		do_div(dec_us, 1000);
+		do_div(enc_us, 1000);
+		seq_printf(m, "%-10s %12llu %10lu %12llu %10lu\n",
+			   hdlc_test_ops[i].name,
+			   dec_us, hdlc_test_mbps(len, res[i].dec_ns),
+			   enc_us, hdlc_test_mbps(res[i].dec_len,
+						   res[i].enc_ns));
+	}
+out:
+	for (i = 0; i < ARRAY_SIZE(hdlc_test_ops); i++) {
+		vfree(dec[i]);
+		vfree(enc[i]);
+		vfree(res[i].ends);
+	}
+	return ret;
+}
+
+static int hdlc_test_bench_show(struct seq_file *m, void *unused)
+{
+	u8 *synth = NULL;
+	int ret;
+
+	mutex_lock(&hdlc_test_mutex);
+	if (hdlc_capture_len) {
+		seq_printf(m, "captured traffic\n");
+		ret = hdlc_test_compare(m, hdlc_capture, hdlc_capture_len);
+		if (ret != -ENOMEM)
+			ret = hdlc_test_fragments(hdlc_capture,
+						  hdlc_capture_len);
+	} else {
+		size_t len;
+
+		synth = vmalloc(HDLC_TEST_SYNTH_SIZE);
+		len = synth ? hdlc_test_synth(synth, HDLC_TEST_SYNTH_SIZE) : 0;
+		seq_printf(m, "synthetic traffic\n");
+		ret = len ? hdlc_test_compare(m, synth, len) : -ENOMEM;
+		if (ret != -ENOMEM)
+			ret = hdlc_test_fragments(synth, len);
+	}
+	if (ret != -ENOMEM)
+		seq_printf(m, "fragmented and bounded: %s\n",
+			   ret ? "FAIL" : "ok");
+	mutex_unlock(&hdlc_test_mutex);
+
+	vfree(synth);
+	return ret == -ENOMEM ? ret : 0;
+}
+
+static int hdlc_test_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hdlc_test_bench_show, NULL);
+}
+
+static const struct file_operations hdlc_test_bench_fops = {
+	.open		= hdlc_test_bench_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int hdlc_test_capture_open(struct inode *inode, struct file *file)
+{
+	if ((file->f_mode & FMODE_WRITE) && (file->f_flags & O_TRUNC)) {
+		mutex_lock(&hdlc_test_mutex);
+		vfree(hdlc_capture);
+		hdlc_capture = NULL;
+		hdlc_capture_len = 0;
+		mutex_unlock(&hdlc_test_mutex);
+	}
+	return 0;
+}
+
+static ssize_t hdlc_test_capture_write(struct file *file,
+				       const char __user *buf,
+				       size_t count, loff_t *ppos)
+{
+	ssize_t ret = count;
+
+	mutex_lock(&hdlc_test_mutex);
+	if (!hdlc_capture) {
+		hdlc_capture = vmalloc(HDLC_TEST_MAX_CAPTURE);
+		if (!hdlc_capture) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	if (count > HDLC_TEST_MAX_CAPTURE - hdlc_capture_len) {
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	if (copy_from_user(hdlc_capture + hdlc_capture_len, buf, count)) {
+		ret = -EFAULT;
+		goto out;
+	}
+	hdlc_capture_len += count;
+out:
+	mutex_unlock(&hdlc_test_mutex);
+	return ret;
+}
+
+static const struct file_operations hdlc_test_capture_fops = {
+	.open		= hdlc_test_capture_open,
+	.write		= hdlc_test_capture_write,
+};
+
+void diag_hdlc_test_init(void)
+{
+	u8 *synth = vmalloc(HDLC_TEST_SYNTH_SIZE);
+	size_t len;
+
+	if (synth) {
+		len = hdlc_test_synth(synth, HDLC_TEST_SYNTH_SIZE);
+		if (!len || hdlc_test_compare(NULL, synth, len) ||
+		    hdlc_test_fragments(synth, len))
+			pr_err("diag: hdlc self-test failed\n");
+		else
+			pr_info("diag: hdlc self-test passed\n");
+		vfree(synth);
+	}
+
+	hdlc_test_dent = debugfs_create_dir("diag_hdlc", NULL);
+	if (IS_ERR_OR_NULL(hdlc_test_dent))
+		return;
+
+	debugfs_create_file("bench", 0444, hdlc_test_dent, NULL,
+			    &hdlc_test_bench_fops);
+	debugfs_create_file("capture", 0200, hdlc_test_dent, NULL,
+			    &hdlc_test_capture_fops);
+}
+
+void diag_hdlc_test_exit(void)
+{
+	debugfs_remove_recursive(hdlc_test_dent);
+	vfree(hdlc_capture);
+	hdlc_capture = NULL;
+	hdlc_capture_len = 0;
+}
@@ -53,6 +53,10 @@ struct cpufreq_interactive_cpuinfo {
 	u64 hispeed_validate_time;
 	struct rw_semaphore enable_sem;
 	int governor_enabled;
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	unsigned int sched_load;
+	u64 sched_eval_time;
+#endif
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
@@ -116,6 +120,17 @@ static int timer_slack_val = DEFAULT_TIMER_SLACK;
 
 static bool io_is_busy;
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+/*
+ * Re-evaluate speed as soon as the scheduler reports work queueing on a
+ * cpu, instead of waiting for the next timer_rate sample.
+ */
+static bool sched_input;
+
+/* Do not re-evaluate on scheduler input more often than this, in usecs. */
+#define SCHED_INPUT_MIN_INTERVAL	(2 * USEC_PER_MSEC)
+#endif
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event);
 
@@ -394,6 +409,18 @@ static void cpufreq_interactive_timer(unsigned long data)
 	do_div(cputime_speedadj, delta_time);
 	loadadjfreq = (unsigned int)cputime_speedadj * 100;
 	cpu_load = loadadjfreq / pcpu->target_freq;
+
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	/*
+	 * More than one task's worth of runnable load means the cpu is busy
+	 * and work is queueing behind it, whatever the sampled load says.
+	 */
+	if (sched_input && pcpu->sched_load > 100 &&
+	    pcpu->sched_load > cpu_load) {
+		cpu_load = pcpu->sched_load;
+		loadadjfreq = cpu_load * pcpu->target_freq;
+	}
+#endif
 	boosted = boost_val || now < boostpulse_endtime;
 
 	if (cpu_load >= go_hispeed_load || boosted) {
@@ -542,6 +569,113 @@ static void cpufreq_interactive_idle_end(void)
 	up_read(&pcpu->enable_sem);
 }
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+/*
+ * Called by the scheduler on the cpu itself, from the end of schedule(),
+ * when its runnable load has changed by sched_freq_alert_delta.
+ */
+static int cpufreq_interactive_sched_notifier(struct notifier_block *nb,
+					      unsigned long load, void *data)
+{
+	int cpu = (long)data;
+	struct cpufreq_interactive_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+	unsigned int prev_load = pcpu->sched_load;
+	u64 now;
+
+	pcpu->sched_load = load;
+
+	/* only queueing that has grown can call for a faster speed */
+	if (!sched_input || load <= 100 || load <= prev_load)
+		return 0;
+
+	if (!down_read_trylock(&pcpu->enable_sem))
+		return 0;
+	if (!pcpu->governor_enabled ||
+	    pcpu->target_freq == pcpu->policy->max)
+		goto exit;
+
+	now = ktime_to_us(ktime_get());
+	if (now - pcpu->sched_eval_time < SCHED_INPUT_MIN_INTERVAL)
+		goto exit;
+	pcpu->sched_eval_time = now;
+
+	del_timer(&pcpu->cpu_timer);
+	del_timer(&pcpu->cpu_slack_timer);
+	cpufreq_interactive_timer(cpu);
+
+exit:
+	up_read(&pcpu->enable_sem);
+	return 0;
+}
+
+static struct notifier_block cpufreq_interactive_sched_nb = {
+	.notifier_call = cpufreq_interactive_sched_notifier,
+};
+
+/*
+ * Called on the destination cpu when tasks have been moved to it. The
+ * moved load was measured on the source cpu at its speed; raise the
+ * destination to what that load needs at once and hold it there for
+ * min_sample_time, as a boost does, instead of letting it show up in the
+ * destination's samples one timer_rate later.
+ */
+static int cpufreq_interactive_migration_notifier(struct notifier_block *nb,
+						  unsigned long val, void *data)
+{
+	struct sched_migration_data *md = data;
+	struct cpufreq_interactive_cpuinfo *pcpu =
+		&per_cpu(cpuinfo, md->dest_cpu);
+	struct cpufreq_interactive_cpuinfo *spcpu =
+		&per_cpu(cpuinfo, md->src_cpu);
+	unsigned int src_freq, new_freq, loadadjfreq, index;
+	unsigned long flags;
+	u64 now;
+
+	if (!sched_input)
+		return 0;
+
+	if (!down_read_trylock(&pcpu->enable_sem))
+		return 0;
+	if (!pcpu->governor_enabled)
+		goto exit;
+
+	src_freq = spcpu->target_freq ? spcpu->target_freq :
+		pcpu->policy->cur;
+	loadadjfreq = min(md->load, 100U) * src_freq;
+	new_freq = choose_freq(pcpu, loadadjfreq);
+	if (new_freq <= pcpu->target_freq)
+		goto exit;
+
+	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
+					   new_freq, CPUFREQ_RELATION_L,
+					   &index))
+		goto exit;
+	new_freq = pcpu->freq_table[index].frequency;
+
+	trace_cpufreq_interactive_target(md->dest_cpu, md->load,
+					 pcpu->target_freq, pcpu->policy->cur,
+					 new_freq);
+
+	now = ktime_to_us(ktime_get());
+	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+	pcpu->target_freq = new_freq;
+	pcpu->floor_freq = new_freq;
+	pcpu->floor_validate_time = now;
+	pcpu->hispeed_validate_time = now;
+	cpumask_set_cpu(md->dest_cpu, &speedchange_cpumask);
+	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+	wake_up_process(speedchange_task);
+
+exit:
+	up_read(&pcpu->enable_sem);
+	return 0;
+}
+
+static struct notifier_block cpufreq_interactive_migration_nb = {
+	.notifier_call = cpufreq_interactive_migration_notifier,
+};
+#endif
+
 static int cpufreq_interactive_speedchange_task(void *data)
 {
 	unsigned int cpu;
@@ -1022,6 +1156,30 @@ static ssize_t store_io_is_busy(struct kobject *kobj,
 static struct global_attr io_is_busy_attr = __ATTR(io_is_busy, 0644,
 		show_io_is_busy, store_io_is_busy);
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+static ssize_t show_sched_input(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", sched_input);
+}
+
+static ssize_t store_sched_input(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	sched_input = val;
+	return count;
+}
+
+static struct global_attr sched_input_attr = __ATTR(sched_input, 0644,
+		show_sched_input, store_sched_input);
+#endif
+
 static struct attribute *interactive_attributes[] = {
 	&target_loads_attr.attr,
 	&above_hispeed_delay_attr.attr,
@@ -1034,6 +1192,9 @@ static struct attribute *interactive_attributes[] = {
 	&boostpulse.attr,
 	&boostpulse_duration.attr,
 	&io_is_busy_attr.attr,
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	&sched_input_attr.attr,
+#endif
 	NULL,
 };
 
@@ -1115,6 +1276,11 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		}
 
 		idle_notifier_register(&cpufreq_interactive_idle_nb);
+#ifdef CONFIG_SCHED_FREQ_INPUT
+		sched_freq_notifier_register(&cpufreq_interactive_sched_nb);
+		sched_migration_notifier_register(
+			&cpufreq_interactive_migration_nb);
+#endif
 		cpufreq_register_notifier(
 			&cpufreq_notifier_block, CPUFREQ_TRANSITION_NOTIFIER);
 		mutex_unlock(&gov_lock);
@@ -1138,6 +1304,11 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 
 		cpufreq_unregister_notifier(
 			&cpufreq_notifier_block, CPUFREQ_TRANSITION_NOTIFIER);
+#ifdef CONFIG_SCHED_FREQ_INPUT
+		sched_migration_notifier_unregister(
+			&cpufreq_interactive_migration_nb);
+		sched_freq_notifier_unregister(&cpufreq_interactive_sched_nb);
+#endif
 		idle_notifier_unregister(&cpufreq_interactive_idle_nb);
 		sysfs_remove_group(cpufreq_global_kobject,
 				&interactive_attr_group);
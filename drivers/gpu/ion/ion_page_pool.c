@@ -0,0 +1,343 @@
+/*
+ * drivers/gpu/ion/ion_page_pool.c
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/highmem.h>
+#include <linux/jiffies.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <asm/cacheflush.h>
+#include "ion_priv.h"
+
+/*
+ * Chunks are split with split_page() when they come from the buddy
+ * allocator, so that every page can be mapped into userspace on its
+ * own, and go back one page at a time. In the pool a chunk is kept as
+ * its first page, linked through page->lru.
+ *
+ * Freed chunks go on the dirty list and are zeroed by the refill work,
+ * which also tops the clean list up to the reserve. An allocation takes
+ * a clean chunk if there is one, else zeroes a dirty one or a new one
+ * itself.
+ */
+
+/* how long the refill work leaves the pool alone after a shrink */
+#define ION_PAGE_POOL_BACKOFF	HZ
+
+static void ion_page_pool_zero(struct ion_page_pool *pool, struct page *page)
+{
+	phys_addr_t phys = page_to_phys(page);
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++) {
+		void *addr = kmap_atomic(page + i, KM_USER0);
+
+		clear_page(addr);
+		dmac_flush_range(addr, addr + PAGE_SIZE);
+		kunmap_atomic(addr, KM_USER0);
+	}
+	/* nothing of the last owner may be left for a device to read */
+	outer_flush_range(phys, phys + (PAGE_SIZE << pool->order));
+}
+
+static struct page *ion_page_pool_alloc_pages(struct ion_page_pool *pool,
+					      gfp_t gfp_mask)
+{
+	struct page *page = alloc_pages(gfp_mask, pool->order);
+
+	if (page && pool->order)
+		split_page(page, pool->order);
+	return page;
+}
+
+static void ion_page_pool_free_pages(struct ion_page_pool *pool,
+				     struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++)
+		__free_page(page + i);
+}
+
+static struct page *ion_page_pool_remove(struct list_head *items)
+{
+	struct page *page = list_first_entry(items, struct page, lru);
+
+	list_del(&page->lru);
+	return page;
+}
+
+static void ion_page_pool_add_clean(struct ion_page_pool *pool,
+				    struct page *page)
+{
+	spin_lock(&pool->lock);
+	list_add_tail(&page->lru, &pool->clean_items);
+	pool->clean_count++;
+	spin_unlock(&pool->lock);
+}
+
+static bool ion_page_pool_backing_off(struct ion_page_pool *pool)
+{
+	return pool->last_shrink &&
+	       time_before(jiffies, pool->last_shrink + ION_PAGE_POOL_BACKOFF);
+}
+
+static void ion_page_pool_refill_work(struct work_struct *work)
+{
+	struct ion_page_pool *pool = container_of(work, struct ion_page_pool,
+						  refill_work);
+	struct page *page;
+	bool more;
+
+	/* zero what has been freed back */
+	for (;;) {
+		spin_lock(&pool->lock);
+		page = NULL;
+		if (pool->dirty_count) {
+			page = ion_page_pool_remove(&pool->dirty_items);
+			pool->dirty_count--;
+		}
+		spin_unlock(&pool->lock);
+		if (!page)
+			break;
+
+		ion_page_pool_zero(pool, page);
+		ion_page_pool_add_clean(pool, page);
+		cond_resched();
+	}
+
+	/*
+	 * Top up the reserve without waiting on reclaim, and not at all
+	 * while the shrinker is taking pages back.
+	 */
+	for (;;) {
+		spin_lock(&pool->lock);
+		more = pool->clean_count < pool->reserve &&
+		       !ion_page_pool_backing_off(pool);
+		spin_unlock(&pool->lock);
+		if (!more)
+			break;
+
+		page = ion_page_pool_alloc_pages(pool,
+				(pool->gfp_mask | __GFP_NORETRY |
+				 __GFP_NOWARN | __GFP_NO_KSWAPD) &
+				~__GFP_WAIT);
+		if (!page)
+			break;
+
+		ion_page_pool_zero(pool, page);
+		spin_lock(&pool->lock);
+		list_add_tail(&page->lru, &pool->clean_items);
+		pool->clean_count++;
+		pool->refills++;
+		spin_unlock(&pool->lock);
+		cond_resched();
+	}
+}
+
+/**
+ * ion_page_pool_alloc - get a zeroed chunk of the pool's order
+ * @pool:		the pool
+ *
+ * Returns the first page of the chunk, or NULL when the pool is empty
+ * and the buddy allocator has nothing of this order either.
+ */
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
+{
+	struct page *page = NULL;
+	bool dirty = false;
+	bool refill;
+
+	spin_lock(&pool->lock);
+	if (pool->clean_count) {
+		page = ion_page_pool_remove(&pool->clean_items);
+		pool->clean_count--;
+		pool->hits++;
+	} else if (pool->dirty_count) {
+		page = ion_page_pool_remove(&pool->dirty_items);
+		pool->dirty_count--;
+		pool->dirty_hits++;
+		dirty = true;
+	}
+	spin_unlock(&pool->lock);
+
+	if (!page) {
+		page = ion_page_pool_alloc_pages(pool, pool->gfp_mask);
+		spin_lock(&pool->lock);
+		if (page)
+			pool->misses++;
+		else
+			pool->fails++;
+		spin_unlock(&pool->lock);
+		if (!page)
+			return NULL;
+		dirty = true;
+	}
+
+	if (dirty)
+		ion_page_pool_zero(pool, page);
+
+	spin_lock(&pool->lock);
+	refill = pool->clean_count < pool->reserve;
+	spin_unlock(&pool->lock);
+	if (refill)
+		queue_work(system_unbound_wq, &pool->refill_work);
+
+	return page;
+}
+
+/**
+ * ion_page_pool_free - give a chunk back to the pool
+ * @pool:		the pool
+ * @page:		first page of the chunk
+ *
+ * The chunk is kept for reuse, to be zeroed in the background, unless
+ * the pool already holds its limit.
+ */
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
+{
+	spin_lock(&pool->lock);
+	if (pool->clean_count + pool->dirty_count >= pool->limit) {
+		spin_unlock(&pool->lock);
+		ion_page_pool_free_pages(pool, page);
+		return;
+	}
+	list_add_tail(&page->lru, &pool->dirty_items);
+	pool->dirty_count++;
+	spin_unlock(&pool->lock);
+
+	queue_work(system_unbound_wq, &pool->refill_work);
+}
+
+/**
+ * ion_page_pool_total - pages held by the pool
+ * @pool:		the pool
+ */
+unsigned int ion_page_pool_total(struct ion_page_pool *pool)
+{
+	unsigned int count;
+
+	spin_lock(&pool->lock);
+	count = pool->clean_count + pool->dirty_count;
+	spin_unlock(&pool->lock);
+
+	return count << pool->order;
+}
+
+/**
+ * ion_page_pool_shrink - give pages back to the system
+ * @pool:		the pool
+ * @nr_to_scan:		pages to free, dirty chunks first
+ *
+ * Returns the number of pages freed.
+ */
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan)
+{
+	struct page *page;
+	int freed = 0;
+
+	while (freed < nr_to_scan) {
+		spin_lock(&pool->lock);
+		if (pool->dirty_count) {
+			page = ion_page_pool_remove(&pool->dirty_items);
+			pool->dirty_count--;
+		} else if (pool->clean_count) {
+			page = ion_page_pool_remove(&pool->clean_items);
+			pool->clean_count--;
+		} else {
+			spin_unlock(&pool->lock);
+			break;
+		}
+		pool->shrunk++;
+		pool->last_shrink = jiffies;
+		spin_unlock(&pool->lock);
+
+		ion_page_pool_free_pages(pool, page);
+		freed += 1 << pool->order;
+	}
+
+	return freed;
+}
+
+/**
+ * ion_page_pool_print - one line of pool state for debugfs
+ * @pool:		the pool
+ * @s:			seq_file to print to
+ */
+void ion_page_pool_print(struct ion_page_pool *pool, struct seq_file *s)
+{
+	unsigned int clean, dirty;
+	unsigned long hits, dirty_hits, misses, fails, refills, shrunk;
+
+	spin_lock(&pool->lock);
+	clean = pool->clean_count;
+	dirty = pool->dirty_count;
+	hits = pool->hits;
+	dirty_hits = pool->dirty_hits;
+	misses = pool->misses;
+	fails = pool->fails;
+	refills = pool->refills;
+	shrunk = pool->shrunk;
+	spin_unlock(&pool->lock);
+
+	seq_printf(s, "%5u %6u %6u %10lu %10lu %10lu %10lu %10lu %10lu\n",
+		   pool->order, clean, dirty, hits, dirty_hits, misses, fails,
+		   refills, shrunk);
+}
+
+/**
+ * ion_page_pool_create - make a pool of zeroed chunks
+ * @gfp_mask:		flags to allocate new chunks with
+ * @order:		order of the chunks
+ * @reserve:		zeroed chunks to keep ready
+ * @limit:		most chunks to hold on to
+ *
+ * The reserve is filled in the background.
+ */
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order,
+					   unsigned int reserve,
+					   unsigned int limit)
+{
+	struct ion_page_pool *pool = kzalloc(sizeof(struct ion_page_pool),
+					     GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->order = order;
+	pool->gfp_mask = gfp_mask & ~__GFP_COMP;
+	pool->reserve = min(reserve, limit);
+	pool->limit = limit;
+	INIT_LIST_HEAD(&pool->clean_items);
+	INIT_LIST_HEAD(&pool->dirty_items);
+	spin_lock_init(&pool->lock);
+	INIT_WORK(&pool->refill_work, ion_page_pool_refill_work);
+
+	if (pool->reserve)
+		queue_work(system_unbound_wq, &pool->refill_work);
+
+	return pool;
+}
+
+void ion_page_pool_destroy(struct ion_page_pool *pool)
+{
+	cancel_work_sync(&pool->refill_work);
+	ion_page_pool_shrink(pool, INT_MAX);
+	kfree(pool);
+}
@@ -24,6 +24,8 @@
 #include <linux/rbtree.h>
 #include <linux/ion.h>
 #include <linux/iommu.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 
 struct ion_mapping;
 
@@ -251,6 +253,61 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 		       unsigned long size);
 
 
+/**
+ * struct ion_page_pool - pool of zeroed chunks of one order
+ * @order:		order of the chunks
+ * @gfp_mask:		flags new chunks are allocated with
+ * @reserve:		zeroed chunks the refill work keeps ready
+ * @limit:		most chunks held, frees beyond it go straight back
+ *			to the system
+ * @clean_count:	number of chunks on @clean_items
+ * @dirty_count:	number of chunks on @dirty_items
+ * @clean_items:	zeroed chunks, ready to hand out
+ * @dirty_items:	freed chunks waiting to be zeroed
+ * @lock:		protects the lists, counts and statistics
+ * @refill_work:	zeroes @dirty_items and tops up @clean_items
+ * @last_shrink:	jiffies of the last shrink, the refill backs off
+ *			for a while after it
+ * @hits:		allocations served from @clean_items
+ * @dirty_hits:		allocations that had to zero a freed chunk
+ * @misses:		allocations that went to the buddy allocator
+ * @fails:		allocations that found no chunk of this order
+ * @refills:		chunks added by the refill work
+ * @shrunk:		chunks given back under memory pressure
+ *
+ * Lets heaps reuse physically contiguous chunks without going through
+ * the page allocator and zeroing them on the allocation path.
+ */
+struct ion_page_pool {
+	unsigned int order;
+	gfp_t gfp_mask;
+	unsigned int reserve;
+	unsigned int limit;
+	unsigned int clean_count;
+	unsigned int dirty_count;
+	struct list_head clean_items;
+	struct list_head dirty_items;
+	spinlock_t lock;
+	struct work_struct refill_work;
+	unsigned long last_shrink;
+	unsigned long hits;
+	unsigned long dirty_hits;
+	unsigned long misses;
+	unsigned long fails;
+	unsigned long refills;
+	unsigned long shrunk;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order,
+					   unsigned int reserve,
+					   unsigned int limit);
+void ion_page_pool_destroy(struct ion_page_pool *);
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+unsigned int ion_page_pool_total(struct ion_page_pool *);
+int ion_page_pool_shrink(struct ion_page_pool *, int nr_to_scan);
+void ion_page_pool_print(struct ion_page_pool *, struct seq_file *);
+
 struct ion_heap *msm_get_contiguous_heap(void);
 /**
  * The carveout/cp heap returns physical addresses, since 0 may be a valid
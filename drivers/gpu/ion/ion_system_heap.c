@@ -18,6 +18,8 @@
 #include <linux/err.h>
 #include <linux/ion.h>
 #include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
@@ -33,76 +35,217 @@ static atomic_t system_contig_heap_allocated;
 static unsigned int system_heap_has_outer_cache;
 static unsigned int system_heap_contig_has_outer_cache;
 
+/*
+ * Buffers are built from the largest chunks available, each taken from
+ * the pool of its order. High order chunks only come from pages that
+ * are free right now: rather than compact or reclaim for them, fall
+ * back to the next order down.
+ */
+static const unsigned int orders[] = { 8, 4, 0 };
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+static unsigned int pool_reserve[] = { 2, 16, 256 };
+module_param_array(pool_reserve, uint, NULL, 0444);
+MODULE_PARM_DESC(pool_reserve,
+		 "Zeroed chunks kept ready for each order (8, 4, 0)");
+
+static unsigned int pool_limit[] = { 8, 64, 1024 };
+module_param_array(pool_limit, uint, NULL, 0444);
+MODULE_PARM_DESC(pool_limit,
+		 "Most free chunks kept for each order (8, 4, 0)");
+
+struct ion_system_heap {
+	struct ion_heap heap;
+	struct ion_page_pool *pools[NUM_ORDERS];
+	struct shrinker shrinker;
+};
+
+static int order_to_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (order == orders[i])
+			return i;
+	BUG();
+	return -1;
+}
+
+static struct page *alloc_largest_available(struct ion_system_heap *heap,
+					    unsigned long size,
+					    unsigned int max_order,
+					    unsigned int *order)
+{
+	struct page *page;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < (PAGE_SIZE << orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		page = ion_page_pool_alloc(heap->pools[i]);
+		if (!page)
+			continue;
+
+		*order = orders[i];
+		return page;
+	}
+	return NULL;
+}
+
+/*
+ * ARM has no scatterlist chaining, so sg_alloc_table() cannot go past a
+ * page worth of entries; keep the list flat instead.
+ */
+static struct scatterlist *ion_system_sg_alloc(unsigned int nents)
+{
+	size_t size = nents * sizeof(struct scatterlist);
+
+	if (size <= PAGE_SIZE)
+		return kmalloc(size, GFP_KERNEL);
+	return vmalloc(size);
+}
+
+static void ion_system_sg_free(struct scatterlist *sgl)
+{
+	if (is_vmalloc_addr(sgl))
+		vfree(sgl);
+	else
+		kfree(sgl);
+}
+
 static int ion_system_heap_allocate(struct ion_heap *heap,
 				     struct ion_buffer *buffer,
 				     unsigned long size, unsigned long align,
 				     unsigned long flags)
 {
-	buffer->priv_virt = vmalloc_user(size);
-	if (!buffer->priv_virt)
-		return -ENOMEM;
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	unsigned long size_remaining = PAGE_ALIGN(size);
+	unsigned int max_order = orders[0];
+	unsigned int order;
+	unsigned int nents = 0;
+	struct sg_table *table;
+	struct scatterlist *sg;
+	struct page *page, *tmp;
+	LIST_HEAD(pages);
+
+	while (size_remaining > 0) {
+		page = alloc_largest_available(sys_heap, size_remaining,
+					       max_order, &order);
+		if (!page)
+			goto err;
+		set_page_private(page, order);
+		list_add_tail(&page->lru, &pages);
+		size_remaining -= PAGE_SIZE << order;
+		max_order = order;
+		nents++;
+	}
+
+	table = kmalloc(sizeof(struct sg_table), GFP_KERNEL);
+	if (!table)
+		goto err;
+	table->sgl = ion_system_sg_alloc(nents);
+	if (!table->sgl)
+		goto err_table;
+	table->nents = table->orig_nents = nents;
+	sg_init_table(table->sgl, nents);
+
+	sg = table->sgl;
+	list_for_each_entry_safe(page, tmp, &pages, lru) {
+		sg_set_page(sg, page, PAGE_SIZE << page_private(page), 0);
+		list_del(&page->lru);
+		set_page_private(page, 0);
+		sg = sg_next(sg);
+	}
 
-	atomic_add(size, &system_heap_allocated);
+	buffer->priv_virt = table;
+	atomic_add(PAGE_ALIGN(size), &system_heap_allocated);
 	return 0;
+
+err_table:
+	kfree(table);
+err:
+	list_for_each_entry_safe(page, tmp, &pages, lru) {
+		order = page_private(page);
+		list_del(&page->lru);
+		set_page_private(page, 0);
+		ion_page_pool_free(sys_heap->pools[order_to_index(order)], page);
+	}
+	return -ENOMEM;
 }
 
 void ion_system_heap_free(struct ion_buffer *buffer)
 {
-	vfree(buffer->priv_virt);
-	atomic_sub(buffer->size, &system_heap_allocated);
+	struct ion_system_heap *sys_heap = container_of(buffer->heap,
+							struct ion_system_heap,
+							heap);
+	struct sg_table *table = buffer->priv_virt;
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(table->sgl, sg, table->nents, i)
+		ion_page_pool_free(
+			sys_heap->pools[order_to_index(get_order(sg->length))],
+			sg_page(sg));
+
+	ion_system_sg_free(table->sgl);
+	kfree(table);
+	atomic_sub(PAGE_ALIGN(buffer->size), &system_heap_allocated);
 }
 
+/* the scatterlist is built at allocation time and lives with the buffer */
 struct scatterlist *ion_system_heap_map_dma(struct ion_heap *heap,
 					    struct ion_buffer *buffer)
 {
-	struct scatterlist *sglist;
-	struct page *page;
-	int i;
-	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
-	void *vaddr = buffer->priv_virt;
+	struct sg_table *table = buffer->priv_virt;
 
-	sglist = vmalloc(npages * sizeof(struct scatterlist));
-	if (!sglist)
-		return ERR_PTR(-ENOMEM);
-	memset(sglist, 0, npages * sizeof(struct scatterlist));
-	sg_init_table(sglist, npages);
-	for (i = 0; i < npages; i++) {
-		page = vmalloc_to_page(vaddr);
-		if (!page)
-			goto end;
-		sg_set_page(&sglist[i], page, PAGE_SIZE, 0);
-		vaddr += PAGE_SIZE;
-	}
-	/* XXX do cache maintenance for dma? */
-	return sglist;
-end:
-	vfree(sglist);
-	return NULL;
+	return table->sgl;
 }
 
 void ion_system_heap_unmap_dma(struct ion_heap *heap,
 			       struct ion_buffer *buffer)
 {
-	/* XXX undo cache maintenance for dma? */
-	if (buffer->sglist)
-		vfree(buffer->sglist);
 }
 
 void *ion_system_heap_map_kernel(struct ion_heap *heap,
 				 struct ion_buffer *buffer,
 				 unsigned long flags)
 {
-	if (ION_IS_CACHED(flags))
-		return buffer->priv_virt;
-	else {
+	struct sg_table *table = buffer->priv_virt;
+	struct scatterlist *sg;
+	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
+	struct page **pages, **tmp;
+	void *vaddr;
+	int i, j;
+
+	if (!ION_IS_CACHED(flags)) {
 		pr_err("%s: cannot map system heap uncached\n", __func__);
 		return ERR_PTR(-EINVAL);
 	}
+
+	pages = vmalloc(sizeof(struct page *) * npages);
+	if (!pages)
+		return ERR_PTR(-ENOMEM);
+
+	tmp = pages;
+	for_each_sg(table->sgl, sg, table->nents, i)
+		for (j = 0; j < sg->length / PAGE_SIZE; j++)
+			*tmp++ = sg_page(sg) + j;
+
+	vaddr = vmap(pages, npages, VM_MAP, PAGE_KERNEL);
+	vfree(pages);
+
+	return vaddr ? vaddr : ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_unmap_kernel(struct ion_heap *heap,
 				  struct ion_buffer *buffer)
 {
+	vunmap(buffer->vaddr);
 }
 
 void ion_system_heap_unmap_iommu(struct ion_iommu_map *data)
@@ -134,13 +277,41 @@ void ion_system_heap_unmap_iommu(struct ion_iommu_map *data)
 int ion_system_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			     struct vm_area_struct *vma, unsigned long flags)
 {
-	if (ION_IS_CACHED(flags))
-		return remap_vmalloc_range(vma, buffer->priv_virt,
-						vma->vm_pgoff);
-	else {
+	struct sg_table *table = buffer->priv_virt;
+	unsigned long addr = vma->vm_start;
+	unsigned long offset = vma->vm_pgoff * PAGE_SIZE;
+	struct scatterlist *sg;
+	int i, ret;
+
+	if (!ION_IS_CACHED(flags)) {
 		pr_err("%s: cannot map system heap uncached\n", __func__);
 		return -EINVAL;
 	}
+
+	for_each_sg(table->sgl, sg, table->nents, i) {
+		struct page *page = sg_page(sg);
+		unsigned long len = sg->length;
+
+		if (offset >= len) {
+			offset -= len;
+			continue;
+		}
+		page += offset / PAGE_SIZE;
+		len -= offset;
+		offset = 0;
+
+		for (; len && addr < vma->vm_end; len -= PAGE_SIZE) {
+			ret = vm_insert_page(vma, addr, page++);
+			if (ret)
+				return ret;
+			addr += PAGE_SIZE;
+		}
+		if (addr >= vma->vm_end)
+			break;
+	}
+
+	vma->vm_flags |= VM_RESERVED;
+	return 0;
 }
 
 int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
@@ -167,17 +338,14 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 	}
 
 	if (system_heap_has_outer_cache) {
-		unsigned long pstart;
-		void *vend;
-		void *vtemp;
-		unsigned long ln = 0;
-		vend = buffer->priv_virt + buffer->size;
-		vtemp = buffer->priv_virt + offset;
+		struct sg_table *table = buffer->priv_virt;
+		struct scatterlist *sg;
+		unsigned long end = offset + length;
+		unsigned long start = 0;
+		int i;
 
-		if ((vtemp+length) > vend) {
+		if (end > buffer->size) {
 			pr_err("Trying to flush outside of mapped range.\n");
-			pr_err("End of mapped range: %p, trying to flush to "
-				"address %p\n", vend, vtemp+length);
 			WARN(1, "%s: called with heap name %s, buffer size 0x%x, "
 				"vaddr 0x%p, offset 0x%x, length: 0x%x\n",
 				__func__, heap->name, buffer->size, vaddr,
@@ -185,26 +353,19 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 			return -EINVAL;
 		}
 
-		for (; ln < length && vtemp < vend;
-		      vtemp += PAGE_SIZE, ln += PAGE_SIZE) {
-			struct page *page = vmalloc_to_page(vtemp);
-			if (!page) {
-				WARN(1, "Could not find page for virt. address %p\n",
-					vtemp);
-				return -EINVAL;
-			}
-			pstart = page_to_phys(page);
-			/*
-			 * If page -> phys is returning NULL, something
-			 * has really gone wrong...
-			 */
-			if (!pstart) {
-				WARN(1, "Could not translate %p to physical address\n",
-					vtemp);
-				return -EINVAL;
-			}
+		/* the part of each chunk that falls in [offset, end) */
+		for_each_sg(table->sgl, sg, table->nents, i) {
+			unsigned long sg_end = start + sg->length;
 
-			outer_cache_op(pstart, pstart + PAGE_SIZE);
+			if (sg_end > offset) {
+				phys_addr_t phys = sg_phys(sg) - start;
+
+				outer_cache_op(phys + max(start, (unsigned long)offset),
+					       phys + min(sg_end, end));
+			}
+			start = sg_end;
+			if (start >= end)
+				break;
 		}
 	}
 	return 0;
@@ -212,9 +373,20 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 
 static int ion_system_print_debug(struct ion_heap *heap, struct seq_file *s)
 {
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	int i;
+
 	seq_printf(s, "total bytes currently allocated: %lx\n",
 			(unsigned long) atomic_read(&system_heap_allocated));
 
+	seq_printf(s, "\n%5s %6s %6s %10s %10s %10s %10s %10s %10s\n",
+		   "order", "clean", "dirty", "hits", "dirty_hits", "misses",
+		   "fails", "refills", "shrunk");
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_print(sys_heap->pools[i], s);
+
 	return 0;
 }
 
@@ -226,14 +398,11 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 				unsigned long iova_length,
 				unsigned long flags)
 {
-	int ret = 0, i;
+	int ret = 0;
 	struct iommu_domain *domain;
 	unsigned long extra;
 	unsigned long extra_iova_addr;
-	struct page *page;
-	int npages = buffer->size >> PAGE_SHIFT;
-	void *vaddr = buffer->priv_virt;
-	struct scatterlist *sglist = 0;
+	struct sg_table *table = buffer->priv_virt;
 	int prot = IOMMU_WRITE | IOMMU_READ;
 	prot |= ION_IS_CACHED(flags) ? IOMMU_CACHE : 0;
 
@@ -261,23 +430,7 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 		goto out1;
 	}
 
-
-	sglist = vmalloc(sizeof(*sglist) * npages);
-	if (!sglist) {
-		ret = -ENOMEM;
-		goto out1;
-	}
-
-	sg_init_table(sglist, npages);
-	for (i = 0; i < npages; i++) {
-		page = vmalloc_to_page(vaddr);
-		if (!page)
-			goto out1;
-		sg_set_page(&sglist[i], page, PAGE_SIZE, 0);
-		vaddr += PAGE_SIZE;
-	}
-
-	ret = iommu_map_range(domain, data->iova_addr, sglist,
+	ret = iommu_map_range(domain, data->iova_addr, table->sgl,
 			      buffer->size, prot);
 
 	if (ret) {
@@ -293,20 +446,18 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 		if (ret)
 			goto out2;
 	}
-	vfree(sglist);
 	return ret;
 
 out2:
 	iommu_unmap_range(domain, data->iova_addr, buffer->size);
 out1:
-	vfree(sglist);
 	msm_free_iova_address(data->iova_addr, domain_num, partition_num,
 				data->mapped_size);
 out:
 	return ret;
 }
 
-static struct ion_heap_ops vmalloc_ops = {
+static struct ion_heap_ops system_heap_ops = {
 	.allocate = ion_system_heap_allocate,
 	.free = ion_system_heap_free,
 	.map_dma = ion_system_heap_map_dma,
@@ -320,22 +471,77 @@ static struct ion_heap_ops vmalloc_ops = {
 	.unmap_iommu = ion_system_heap_unmap_iommu,
 };
 
+static int ion_system_heap_shrink(struct shrinker *shrinker,
+				  struct shrink_control *sc)
+{
+	struct ion_system_heap *sys_heap = container_of(shrinker,
+							struct ion_system_heap,
+							shrinker);
+	int nr_to_scan = sc->nr_to_scan;
+	int total = 0;
+	int i;
+
+	/* give back the smallest chunks first, they are the cheapest */
+	for (i = NUM_ORDERS - 1; i >= 0 && nr_to_scan > 0; i--)
+		nr_to_scan -= ion_page_pool_shrink(sys_heap->pools[i],
+						   nr_to_scan);
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		total += ion_page_pool_total(sys_heap->pools[i]);
+
+	return total;
+}
+
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *pheap)
 {
-	struct ion_heap *heap;
+	struct ion_system_heap *heap;
+	int i;
 
-	heap = kzalloc(sizeof(struct ion_heap), GFP_KERNEL);
+	heap = kzalloc(sizeof(struct ion_system_heap), GFP_KERNEL);
 	if (!heap)
 		return ERR_PTR(-ENOMEM);
-	heap->ops = &vmalloc_ops;
-	heap->type = ION_HEAP_TYPE_SYSTEM;
+	heap->heap.ops = &system_heap_ops;
+	heap->heap.type = ION_HEAP_TYPE_SYSTEM;
 	system_heap_has_outer_cache = pheap->has_outer_cache;
-	return heap;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		gfp_t gfp_flags = GFP_HIGHUSER | __GFP_NOWARN;
+
+		if (orders[i])
+			gfp_flags = (gfp_flags | __GFP_NORETRY |
+				     __GFP_NO_KSWAPD) & ~__GFP_WAIT;
+
+		heap->pools[i] = ion_page_pool_create(gfp_flags, orders[i],
+						      pool_reserve[i],
+						      pool_limit[i]);
+		if (!heap->pools[i])
+			goto err;
+	}
+
+	heap->shrinker.shrink = ion_system_heap_shrink;
+	heap->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&heap->shrinker);
+
+	return &heap->heap;
+
+err:
+	while (--i >= 0)
+		ion_page_pool_destroy(heap->pools[i]);
+	kfree(heap);
+	return ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_destroy(struct ion_heap *heap)
 {
-	kfree(heap);
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	int i;
+
+	unregister_shrinker(&sys_heap->shrinker);
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_destroy(sys_heap->pools[i]);
+	kfree(sys_heap);
 }
 
 static int ion_system_contig_heap_allocate(struct ion_heap *heap,
@@ -379,6 +585,30 @@ struct scatterlist *ion_system_contig_heap_map_dma(struct ion_heap *heap,
 	return sglist;
 }
 
+void ion_system_contig_heap_unmap_dma(struct ion_heap *heap,
+				      struct ion_buffer *buffer)
+{
+	if (buffer->sglist)
+		vfree(buffer->sglist);
+}
+
+void *ion_system_contig_heap_map_kernel(struct ion_heap *heap,
+					struct ion_buffer *buffer,
+					unsigned long flags)
+{
+	if (ION_IS_CACHED(flags))
+		return buffer->priv_virt;
+	else {
+		pr_err("%s: cannot map system heap uncached\n", __func__);
+		return ERR_PTR(-EINVAL);
+	}
+}
+
+void ion_system_contig_heap_unmap_kernel(struct ion_heap *heap,
+					 struct ion_buffer *buffer)
+{
+}
+
 int ion_system_contig_heap_map_user(struct ion_heap *heap,
 				    struct ion_buffer *buffer,
 				    struct vm_area_struct *vma,
@@ -528,9 +758,9 @@ static struct ion_heap_ops kmalloc_ops = {
 	.free = ion_system_contig_heap_free,
 	.phys = ion_system_contig_heap_phys,
 	.map_dma = ion_system_contig_heap_map_dma,
-	.unmap_dma = ion_system_heap_unmap_dma,
-	.map_kernel = ion_system_heap_map_kernel,
-	.unmap_kernel = ion_system_heap_unmap_kernel,
+	.unmap_dma = ion_system_contig_heap_unmap_dma,
+	.map_kernel = ion_system_contig_heap_map_kernel,
+	.unmap_kernel = ion_system_contig_heap_unmap_kernel,
 	.map_user = ion_system_contig_heap_map_user,
 	.cache_op = ion_system_contig_heap_cache_ops,
 	.print_debug = ion_system_contig_print_debug,
@@ -31,6 +31,7 @@
 #include "kgsl_cffdump.h"
 #include "kgsl_log.h"
 #include "kgsl_sharedmem.h"
+#include "kgsl_pool.h"
 #include "kgsl_device.h"
 #include "kgsl_trace.h"
 #include "kgsl_sync.h"
@@ -2436,11 +2437,16 @@ static void kgsl_core_exit(void)
 	}
 
 	unregister_chrdev_region(kgsl_driver.major, KGSL_DEVICE_MAX);
+
+	kgsl_pool_exit();
 }
 
 static int __init kgsl_core_init(void)
 {
 	int result = 0;
+
+	kgsl_pool_init();
+
 	/* alloc major and minor device numbers */
 	result = alloc_chrdev_region(&kgsl_driver.major, 0, KGSL_DEVICE_MAX,
 				  KGSL_NAME);
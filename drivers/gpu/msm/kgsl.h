@@ -96,6 +96,10 @@ struct kgsl_driver {
 		unsigned int mapped;
 		unsigned int mapped_max;
 		unsigned int histogram[16];
+		unsigned int pool;
+		unsigned int pool_hits;
+		unsigned int pool_misses;
+		unsigned int pool_histogram[16];
 	} stats;
 };
 
@@ -0,0 +1,414 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#include <linux/highmem.h>
+#include <linux/jiffies.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <asm/cacheflush.h>
+
+#include "kgsl.h"
+#include "kgsl_pool.h"
+
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "kgsl."
+
+/*
+ * Recycled pages for the page based (vmalloc) memdescs.
+ *
+ * Pages are kept in chunks of 1MB, 64KB and 4KB, the page sizes the
+ * IOMMU maps with, and handed out largest first so that buffers need
+ * fewer scatterlist entries and page table walks. Every chunk handed
+ * out is zeroed and flushed out of the CPU caches.
+ *
+ * Freed chunks go on a dirty list and are zeroed by a work item, which
+ * also keeps a reserve of zeroed chunks ready. Chunks beyond a limit go
+ * straight back to the page allocator, and the shrinker empties the
+ * pool under memory pressure.
+ *
+ * Chunks from the page allocator are split so that each page can be
+ * faulted into userspace with its own reference. A chunk is only
+ * recycled when nothing else holds a reference to any of its pages.
+ */
+
+#define KGSL_POOL_ORDERS	3
+
+/* how long the refill leaves the pool alone after a shrink */
+#define KGSL_POOL_BACKOFF	HZ
+
+struct kgsl_page_pool {
+	unsigned int order;
+	gfp_t gfp_mask;
+	unsigned int clean_count;
+	unsigned int dirty_count;
+	struct list_head clean_list;
+	struct list_head dirty_list;
+};
+
+static struct kgsl_page_pool kgsl_pools[KGSL_POOL_ORDERS] = {
+	{ .order = KGSL_POOL_MAX_ORDER },
+	{ .order = 4 },
+	{ .order = 0 },
+};
+
+static unsigned int pool_reserve[KGSL_POOL_ORDERS] = { 1, 8, 128 };
+module_param_array(pool_reserve, uint, NULL, 0444);
+MODULE_PARM_DESC(pool_reserve,
+"Zeroed chunks of 1MB, 64KB and 4KB kept ready for allocation");
+
+static unsigned int pool_limit[KGSL_POOL_ORDERS] = { 8, 64, 1024 };
+module_param_array(pool_limit, uint, NULL, 0444);
+MODULE_PARM_DESC(pool_limit,
+"Most free chunks of 1MB, 64KB and 4KB kept for reuse");
+
+/* Protects the pools and the pool statistics in kgsl_driver */
+static DEFINE_SPINLOCK(kgsl_pool_lock);
+static unsigned long kgsl_pool_last_shrink;
+static struct work_struct kgsl_pool_work;
+
+static void _kgsl_pool_zero(struct kgsl_page_pool *pool, struct page *page)
+{
+	unsigned int paddr = page_to_phys(page);
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++) {
+		void *addr = kmap_atomic(page + i, KM_USER0);
+
+		clear_page(addr);
+		dmac_flush_range(addr, addr + PAGE_SIZE);
+		kunmap_atomic(addr, KM_USER0);
+	}
+	outer_flush_range(paddr, paddr + (PAGE_SIZE << pool->order));
+}
+
+static struct page *_kgsl_pool_alloc_pages(struct kgsl_page_pool *pool,
+					   gfp_t gfp_mask)
+{
+	struct page *page = alloc_pages(gfp_mask, pool->order);
+
+	if (page && pool->order)
+		split_page(page, pool->order);
+	return page;
+}
+
+static void _kgsl_pool_free_pages(struct page *page, unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < (1 << order); i++)
+		__free_page(page + i);
+}
+
+/* Call with kgsl_pool_lock held */
+static void _kgsl_pool_add(struct kgsl_page_pool *pool, struct page *page,
+			   bool clean)
+{
+	if (clean) {
+		list_add_tail(&page->lru, &pool->clean_list);
+		pool->clean_count++;
+	} else {
+		list_add_tail(&page->lru, &pool->dirty_list);
+		pool->dirty_count++;
+	}
+	kgsl_driver.stats.pool += PAGE_SIZE << pool->order;
+	kgsl_driver.stats.pool_histogram[pool->order]++;
+}
+
+/* Call with kgsl_pool_lock held */
+static struct page *_kgsl_pool_take(struct kgsl_page_pool *pool, bool clean)
+{
+	struct page *page;
+
+	if (clean) {
+		if (!pool->clean_count)
+			return NULL;
+		page = list_first_entry(&pool->clean_list, struct page, lru);
+		pool->clean_count--;
+	} else {
+		if (!pool->dirty_count)
+			return NULL;
+		page = list_first_entry(&pool->dirty_list, struct page, lru);
+		pool->dirty_count--;
+	}
+
+	list_del(&page->lru);
+	kgsl_driver.stats.pool -= PAGE_SIZE << pool->order;
+	kgsl_driver.stats.pool_histogram[pool->order]--;
+	return page;
+}
+
+/* Call with kgsl_pool_lock held, for allocations: clean chunks first */
+static struct page *_kgsl_pool_remove(struct kgsl_page_pool *pool,
+				      bool *clean)
+{
+	struct page *page;
+
+	page = _kgsl_pool_take(pool, true);
+	*clean = page != NULL;
+	if (page == NULL)
+		page = _kgsl_pool_take(pool, false);
+	return page;
+}
+
+/* Call with kgsl_pool_lock held, for the shrinker: dirty chunks first */
+static struct page *_kgsl_pool_remove_dirty(struct kgsl_page_pool *pool)
+{
+	struct page *page;
+
+	page = _kgsl_pool_take(pool, false);
+	if (page == NULL)
+		page = _kgsl_pool_take(pool, true);
+	return page;
+}
+
+static bool _kgsl_pool_wants_refill(struct kgsl_page_pool *pool, int index)
+{
+	if (kgsl_pool_last_shrink &&
+	    time_before(jiffies, kgsl_pool_last_shrink + KGSL_POOL_BACKOFF))
+		return false;
+	return pool->clean_count < pool_reserve[index];
+}
+
+static void kgsl_pool_refill(struct work_struct *work)
+{
+	struct kgsl_page_pool *pool;
+	struct page *page;
+	bool more;
+	int i;
+
+	for (i = 0; i < KGSL_POOL_ORDERS; i++) {
+		pool = &kgsl_pools[i];
+
+		/* zero what has been freed back */
+		for (;;) {
+			spin_lock(&kgsl_pool_lock);
+			page = NULL;
+			if (pool->dirty_count) {
+				page = list_first_entry(&pool->dirty_list,
+							struct page, lru);
+				list_del(&page->lru);
+				pool->dirty_count--;
+			}
+			spin_unlock(&kgsl_pool_lock);
+			if (page == NULL)
+				break;
+
+			_kgsl_pool_zero(pool, page);
+
+			spin_lock(&kgsl_pool_lock);
+			list_add_tail(&page->lru, &pool->clean_list);
+			pool->clean_count++;
+			spin_unlock(&kgsl_pool_lock);
+			cond_resched();
+		}
+
+		/* and top up the reserve without waiting on reclaim */
+		for (;;) {
+			spin_lock(&kgsl_pool_lock);
+			more = _kgsl_pool_wants_refill(pool, i);
+			spin_unlock(&kgsl_pool_lock);
+			if (!more)
+				break;
+
+			page = _kgsl_pool_alloc_pages(pool,
+				(pool->gfp_mask | __GFP_NORETRY |
+				 __GFP_NOWARN | __GFP_NO_KSWAPD) &
+				~__GFP_WAIT);
+			if (page == NULL)
+				break;
+
+			_kgsl_pool_zero(pool, page);
+
+			spin_lock(&kgsl_pool_lock);
+			_kgsl_pool_add(pool, page, true);
+			spin_unlock(&kgsl_pool_lock);
+			cond_resched();
+		}
+	}
+}
+
+static struct page *_kgsl_pool_get(struct kgsl_page_pool *pool, int index)
+{
+	struct page *page;
+	bool clean = false;
+	bool refill;
+
+	spin_lock(&kgsl_pool_lock);
+	page = _kgsl_pool_remove(pool, &clean);
+	if (page)
+		kgsl_driver.stats.pool_hits++;
+	spin_unlock(&kgsl_pool_lock);
+
+	if (page == NULL) {
+		page = _kgsl_pool_alloc_pages(pool, pool->gfp_mask);
+		if (page == NULL)
+			return NULL;
+
+		spin_lock(&kgsl_pool_lock);
+		kgsl_driver.stats.pool_misses++;
+		spin_unlock(&kgsl_pool_lock);
+	}
+
+	if (!clean)
+		_kgsl_pool_zero(pool, page);
+
+	spin_lock(&kgsl_pool_lock);
+	refill = _kgsl_pool_wants_refill(pool, index);
+	spin_unlock(&kgsl_pool_lock);
+	if (refill)
+		schedule_work(&kgsl_pool_work);
+
+	return page;
+}
+
+/**
+ * kgsl_pool_alloc - Get a zeroed, cache clean chunk of pages
+ *
+ * @size - The number of bytes still needed
+ * @order - In: the largest order wanted, out: the order returned
+ *
+ * Return: the first page of the largest chunk that fits in @size, or
+ * NULL if not even a single page could be found
+ */
+struct page *kgsl_pool_alloc(size_t size, unsigned int *order)
+{
+	struct page *page;
+	int i;
+
+	for (i = 0; i < KGSL_POOL_ORDERS; i++) {
+		struct kgsl_page_pool *pool = &kgsl_pools[i];
+
+		if (pool->order > *order || size < (PAGE_SIZE << pool->order))
+			continue;
+
+		page = _kgsl_pool_get(pool, i);
+		if (page) {
+			*order = pool->order;
+			return page;
+		}
+	}
+
+	return NULL;
+}
+
+static int _kgsl_pool_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < KGSL_POOL_ORDERS; i++)
+		if (kgsl_pools[i].order == order)
+			return i;
+
+	BUG();
+	return -1;
+}
+
+/**
+ * kgsl_pool_free - Give back a chunk from kgsl_pool_alloc
+ *
+ * @page - The first page of the chunk
+ * @order - The order it was returned with
+ */
+void kgsl_pool_free(struct page *page, unsigned int order)
+{
+	int index = _kgsl_pool_index(order);
+	struct kgsl_page_pool *pool = &kgsl_pools[index];
+	int i;
+
+	/* Still mapped somewhere, let the last put_page() have it */
+	for (i = 0; i < (1 << order); i++) {
+		if (page_count(page + i) != 1) {
+			_kgsl_pool_free_pages(page, order);
+			return;
+		}
+	}
+
+	spin_lock(&kgsl_pool_lock);
+	if (pool->clean_count + pool->dirty_count >= pool_limit[index]) {
+		spin_unlock(&kgsl_pool_lock);
+		_kgsl_pool_free_pages(page, order);
+		return;
+	}
+	_kgsl_pool_add(pool, page, false);
+	spin_unlock(&kgsl_pool_lock);
+
+	schedule_work(&kgsl_pool_work);
+}
+
+static int kgsl_pool_shrink(struct shrinker *shrinker,
+			    struct shrink_control *sc)
+{
+	int nr_to_scan = sc->nr_to_scan;
+	struct page *page;
+	int i;
+
+	/* Dirty and small chunks first, they are the cheapest to lose */
+	for (i = KGSL_POOL_ORDERS - 1; i >= 0 && nr_to_scan > 0; i--) {
+		struct kgsl_page_pool *pool = &kgsl_pools[i];
+
+		while (nr_to_scan > 0) {
+			spin_lock(&kgsl_pool_lock);
+			page = _kgsl_pool_remove_dirty(pool);
+			if (page)
+				kgsl_pool_last_shrink = jiffies;
+			spin_unlock(&kgsl_pool_lock);
+			if (page == NULL)
+				break;
+
+			_kgsl_pool_free_pages(page, pool->order);
+			nr_to_scan -= 1 << pool->order;
+		}
+	}
+
+	return kgsl_driver.stats.pool >> PAGE_SHIFT;
+}
+
+static struct shrinker kgsl_pool_shrinker = {
+	.shrink = kgsl_pool_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+void kgsl_pool_init(void)
+{
+	int i;
+
+	for (i = 0; i < KGSL_POOL_ORDERS; i++) {
+		struct kgsl_page_pool *pool = &kgsl_pools[i];
+
+		pool->gfp_mask = GFP_KERNEL | __GFP_HIGHMEM | __GFP_NOWARN;
+		/* Only take high order chunks that are free right now */
+		if (pool->order)
+			pool->gfp_mask = (pool->gfp_mask | __GFP_NORETRY |
+					  __GFP_NO_KSWAPD) & ~__GFP_WAIT;
+		INIT_LIST_HEAD(&pool->clean_list);
+		INIT_LIST_HEAD(&pool->dirty_list);
+		pool_reserve[i] = min(pool_reserve[i], pool_limit[i]);
+	}
+
+	INIT_WORK(&kgsl_pool_work, kgsl_pool_refill);
+	register_shrinker(&kgsl_pool_shrinker);
+	schedule_work(&kgsl_pool_work);
+}
+
+void kgsl_pool_exit(void)
+{
+	struct shrink_control sc = { .nr_to_scan = INT_MAX };
+
+	unregister_shrinker(&kgsl_pool_shrinker);
+	cancel_work_sync(&kgsl_pool_work);
+	kgsl_pool_shrink(NULL, &sc);
+}
@@ -0,0 +1,27 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#ifndef __KGSL_POOL_H
+#define __KGSL_POOL_H
+
+#include <linux/mm_types.h>
+
+/* Largest chunk handed out, matching the 1MB IOMMU section size */
+#define KGSL_POOL_MAX_ORDER 8
+
+struct page *kgsl_pool_alloc(size_t size, unsigned int *order);
+void kgsl_pool_free(struct page *page, unsigned int order);
+
+void kgsl_pool_init(void);
+void kgsl_pool_exit(void);
+
+#endif /* __KGSL_POOL_H */
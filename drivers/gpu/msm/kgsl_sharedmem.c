@@ -18,6 +18,7 @@
 
 #include "kgsl.h"
 #include "kgsl_sharedmem.h"
+#include "kgsl_pool.h"
 #include "kgsl_cffdump.h"
 #include "kgsl_device.h"
 
@@ -211,6 +212,12 @@ static int kgsl_drv_memstat_show(struct device *dev,
 		val = kgsl_driver.stats.mapped;
 	else if (!strncmp(attr->attr.name, "mapped_max", 10))
 		val = kgsl_driver.stats.mapped_max;
+	else if (!strncmp(attr->attr.name, "pool_hits", 9))
+		val = kgsl_driver.stats.pool_hits;
+	else if (!strncmp(attr->attr.name, "pool_misses", 11))
+		val = kgsl_driver.stats.pool_misses;
+	else if (!strncmp(attr->attr.name, "pool", 4))
+		val = kgsl_driver.stats.pool;
 
 	return snprintf(buf, PAGE_SIZE, "%u\n", val);
 }
@@ -219,12 +226,17 @@ static int kgsl_drv_histogram_show(struct device *dev,
 				   struct device_attribute *attr,
 				   char *buf)
 {
+	unsigned int *histogram = kgsl_driver.stats.histogram;
 	int len = 0;
 	int i;
 
+	/* pool_histogram: free chunks held in the page pool, by order */
+	if (!strncmp(attr->attr.name, "pool_histogram", 14))
+		histogram = kgsl_driver.stats.pool_histogram;
+
 	for (i = 0; i < 16; i++)
 		len += snprintf(buf + len, PAGE_SIZE - len, "%d ",
-			kgsl_driver.stats.histogram[i]);
+			histogram[i]);
 
 	len += snprintf(buf + len, PAGE_SIZE - len, "\n");
 	return len;
@@ -237,6 +249,10 @@ DEVICE_ATTR(coherent_max, 0444, kgsl_drv_memstat_show, NULL);
 DEVICE_ATTR(mapped, 0444, kgsl_drv_memstat_show, NULL);
 DEVICE_ATTR(mapped_max, 0444, kgsl_drv_memstat_show, NULL);
 DEVICE_ATTR(histogram, 0444, kgsl_drv_histogram_show, NULL);
+DEVICE_ATTR(pool, 0444, kgsl_drv_memstat_show, NULL);
+DEVICE_ATTR(pool_hits, 0444, kgsl_drv_memstat_show, NULL);
+DEVICE_ATTR(pool_misses, 0444, kgsl_drv_memstat_show, NULL);
+DEVICE_ATTR(pool_histogram, 0444, kgsl_drv_histogram_show, NULL);
 
 static const struct device_attribute *drv_attr_list[] = {
 	&dev_attr_vmalloc,
@@ -246,6 +262,10 @@ static const struct device_attribute *drv_attr_list[] = {
 	&dev_attr_mapped,
 	&dev_attr_mapped_max,
 	&dev_attr_histogram,
+	&dev_attr_pool,
+	&dev_attr_pool_hits,
+	&dev_attr_pool_misses,
+	&dev_attr_pool_histogram,
 	NULL
 };
 
@@ -301,12 +321,10 @@ static int kgsl_vmalloc_vmfault(struct kgsl_memdesc *memdesc,
 {
 	unsigned long offset;
 	struct page *page;
-	int i;
 
 	offset = (unsigned long) vmf->virtual_address - vma->vm_start;
 
-	i = offset >> PAGE_SHIFT;
-	page = sg_page(&memdesc->sg[i]);
+	page = kgsl_memdesc_page(memdesc, offset);
 	if (page == NULL)
 		return VM_FAULT_SIGBUS;
 
@@ -330,7 +348,7 @@ static void kgsl_vmalloc_free(struct kgsl_memdesc *memdesc)
 		vunmap(memdesc->hostptr);
 	if (memdesc->sg)
 		for_each_sg(memdesc->sg, sg, memdesc->sglen, i)
-			__free_page(sg_page(sg));
+			kgsl_pool_free(sg_page(sg), get_order(sg->length));
 }
 
 static int kgsl_contiguous_vmflags(struct kgsl_memdesc *memdesc)
@@ -351,17 +369,19 @@ static int kgsl_vmalloc_map_kernel(struct kgsl_memdesc *memdesc)
 		pgprot_t page_prot = pgprot_writecombine(PAGE_KERNEL);
 		struct page **pages = NULL;
 		struct scatterlist *sg;
-		int i;
+		int npages = PAGE_ALIGN(memdesc->size) >> PAGE_SHIFT;
+		int i, j, count = 0;
 		/* create a list of pages to call vmap */
-		pages = vmalloc(memdesc->sglen * sizeof(struct page *));
+		pages = vmalloc(npages * sizeof(struct page *));
 		if (!pages) {
 			KGSL_CORE_ERR("vmalloc(%d) failed\n",
-				memdesc->sglen * sizeof(struct page *));
+				npages * sizeof(struct page *));
 			return -ENOMEM;
 		}
 		for_each_sg(memdesc->sg, sg, memdesc->sglen, i)
-			pages[i] = sg_page(sg);
-		memdesc->hostptr = vmap(pages, memdesc->sglen,
+			for (j = 0; j < sg->length >> PAGE_SHIFT; j++)
+				pages[count++] = nth_page(sg_page(sg), j);
+		memdesc->hostptr = vmap(pages, count,
 					VM_IOREMAP, page_prot);
 		vfree(pages);
 	}
@@ -455,18 +475,48 @@ _kgsl_sharedmem_vmalloc(struct kgsl_memdesc *memdesc,
 			size_t size, unsigned int protflags)
 {
 	int order, ret = 0;
-	int sglen = PAGE_ALIGN(size) / PAGE_SIZE;
-	int i;
+	size_t remaining = PAGE_ALIGN(size);
+	unsigned int chunk_order = KGSL_POOL_MAX_ORDER;
+	int sglen = 0;
+	struct scatterlist *sg;
+	struct page *page, *tmp;
+	LIST_HEAD(chunks);
 
 	memdesc->size = size;
 	memdesc->pagetable = pagetable;
 	memdesc->priv = KGSL_MEMFLAGS_CACHED;
 	memdesc->ops = &kgsl_vmalloc_ops;
 
-	memdesc->sg = kgsl_sg_alloc(sglen);
+	/*
+	 * Take the largest chunks the pool can give, never larger than the
+	 * last one. They come zeroed and clean from the CPU caches.
+	 */
+	while (remaining) {
+		page = kgsl_pool_alloc(remaining, &chunk_order);
+		if (page == NULL) {
+			ret = -ENOMEM;
+			break;
+		}
+		set_page_private(page, chunk_order);
+		list_add_tail(&page->lru, &chunks);
+		remaining -= PAGE_SIZE << chunk_order;
+		sglen++;
+	}
+
+	if (!ret) {
+		memdesc->sg = kgsl_sg_alloc(sglen);
+		if (memdesc->sg == NULL)
+			ret = -ENOMEM;
+	}
 
-	if (memdesc->sg == NULL) {
-		ret = -ENOMEM;
+	if (ret) {
+		list_for_each_entry_safe(page, tmp, &chunks, lru) {
+			unsigned int order = page_private(page);
+
+			list_del(&page->lru);
+			set_page_private(page, 0);
+			kgsl_pool_free(page, order);
+		}
 		goto done;
 	}
 
@@ -475,19 +525,13 @@ _kgsl_sharedmem_vmalloc(struct kgsl_memdesc *memdesc,
 	memdesc->sglen = sglen;
 	sg_init_table(memdesc->sg, sglen);
 
-	for (i = 0; i < memdesc->sglen; i++) {
-		struct page *page = alloc_page(GFP_KERNEL | __GFP_ZERO |
-						__GFP_HIGHMEM);
-		if (!page) {
-			ret = -ENOMEM;
-			memdesc->sglen = i;
-			goto done;
-		}
-		flush_dcache_page(page);
-		sg_set_page(&memdesc->sg[i], page, PAGE_SIZE, 0);
+	sg = memdesc->sg;
+	list_for_each_entry_safe(page, tmp, &chunks, lru) {
+		list_del(&page->lru);
+		sg_set_page(sg, page, PAGE_SIZE << page_private(page), 0);
+		set_page_private(page, 0);
+		sg = sg_next(sg);
 	}
-	outer_cache_range_op_sg(memdesc->sg, memdesc->sglen,
-				KGSL_CACHE_OP_FLUSH);
 
 	ret = kgsl_mmu_map(pagetable, memdesc, protflags);
 
@@ -740,16 +784,24 @@ kgsl_sharedmem_map_vma(struct vm_area_struct *vma,
 {
 	unsigned long addr = vma->vm_start;
 	unsigned long size = vma->vm_end - vma->vm_start;
-	int ret, i = 0;
+	struct scatterlist *sg;
+	int ret, i, j;
 
-	if (!memdesc->sg || (size != memdesc->size) ||
-		(memdesc->sglen != (size / PAGE_SIZE)))
+	if (!memdesc->sg || (size != memdesc->size))
 		return -EINVAL;
 
-	for (; addr < vma->vm_end; addr += PAGE_SIZE, i++) {
-		ret = vm_insert_page(vma, addr, sg_page(&memdesc->sg[i]));
-		if (ret)
-			return ret;
+	for_each_sg(memdesc->sg, sg, memdesc->sglen, i) {
+		/* Physically contiguous memdescs have no pages to insert */
+		if (sg_page(sg) == NULL)
+			return -EINVAL;
+
+		for (j = 0; j < sg->length >> PAGE_SHIFT; j++) {
+			ret = vm_insert_page(vma, addr,
+					     nth_page(sg_page(sg), j));
+			if (ret)
+				return ret;
+			addr += PAGE_SIZE;
+		}
 	}
 	return 0;
 }
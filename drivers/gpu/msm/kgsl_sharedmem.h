@@ -87,6 +87,28 @@ int
 kgsl_sharedmem_map_vma(struct vm_area_struct *vma,
 			const struct kgsl_memdesc *memdesc);
 
+/*
+ * Find the page at offset bytes into a page based memdesc, whose
+ * scatterlist entries may each cover several pages
+ */
+static inline struct page *
+kgsl_memdesc_page(const struct kgsl_memdesc *memdesc, unsigned int offset)
+{
+	struct scatterlist *sg;
+	int i;
+
+	/* One entry per page, as for memory imported from userspace */
+	if (memdesc->sglen == PAGE_ALIGN(memdesc->size) >> PAGE_SHIFT)
+		return sg_page(&memdesc->sg[offset >> PAGE_SHIFT]);
+
+	for_each_sg(memdesc->sg, sg, memdesc->sglen, i) {
+		if (offset < sg->length)
+			return nth_page(sg_page(sg), offset >> PAGE_SHIFT);
+		offset -= sg->length;
+	}
+	return NULL;
+}
+
 /*
  * For relatively small sglists, it is preferable to use kzalloc
  * rather than going down the vmalloc rat hole.  If the size of
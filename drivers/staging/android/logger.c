@@ -24,6 +24,7 @@
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/time.h>
 #include "logger.h"
 
@@ -34,15 +35,22 @@
  *
  * This structure lives from module insertion until module removal, so it does
  * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * spinlock 'lock'.
+ *
+ * Writers reserve their entry under the lock, which also stamps it, so
+ * entries sit in the buffer in timestamp order. The payload is then copied
+ * in with no lock held and the entry committed. Readers only get to see
+ * what lies before 'c_off', the first entry still being written.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
+	wait_queue_head_t	commit_wq; /* writers waiting for buffer space */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
+	spinlock_t		lock;	/* lock protecting offsets and readers */
 	size_t			w_off;	/* current write head offset */
+	size_t			c_off;	/* entries before this are committed */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
 };
@@ -51,14 +59,25 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. r_off is protected by log->lock, while 'mutex'
+ * serializes read() calls on the same file, which share 'buf'.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
 	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* serializes reads of this reader */
+	unsigned char		*buf;	/* bounce buffer, one entry */
 };
 
+/*
+ * State of an entry, kept in its header's __pad field while it's in the
+ * buffer. Readers are only handed committed entries, for which it is 0.
+ */
+#define LOGGER_ENTRY_COMMITTED	0	/* complete, readable */
+#define LOGGER_ENTRY_PENDING	1	/* reserved, payload being copied */
+#define LOGGER_ENTRY_DISCARDED	2	/* copy failed, readers skip it */
+
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
@@ -85,61 +104,65 @@ static inline struct logger_log *file_get_log(struct file *file)
 		return file->private_data;
 }
 
+/*
+ * do_read_log - copies 'count' bytes at offset 'off' out of the log,
+ * wrapping around the end of the buffer.
+ */
+static void do_read_log(struct logger_log *log, size_t off, void *buf,
+			size_t count)
+{
+	size_t len;
+
+	len = min(count, log->size - off);
+	memcpy(buf, log->buffer + off, len);
+
+	if (count != len)
+		memcpy(buf + len, log->buffer, count - len);
+}
+
 /*
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
 	__u16 val;
 
-	switch (log->size - off) {
-	case 1:
-		memcpy(&val, log->buffer + off, 1);
-		memcpy(((char *) &val) + 1, log->buffer, 1);
-		break;
-	default:
-		memcpy(&val, log->buffer + off, 2);
-	}
+	do_read_log(log, off, &val, sizeof(val));
 
 	return sizeof(struct logger_entry) + val;
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * get_entry_state - returns the LOGGER_ENTRY_* state of the entry at 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller needs to hold log->lock.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static __u16 get_entry_state(struct logger_log *log, size_t off)
 {
-	size_t len;
-
-	/*
-	 * We read from the log in two disjoint operations. First, we read from
-	 * the current read head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
-	 */
-	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
-		return -EFAULT;
+	__u16 val;
 
-	/*
-	 * Second, we read any remaining bytes, starting back at the head of
-	 * the log.
-	 */
-	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+	do_read_log(log, logger_offset(off +
+			offsetof(struct logger_entry, __pad)),
+		    &val, sizeof(val));
 
-	reader->r_off = logger_offset(reader->r_off + count);
+	return val;
+}
 
-	return count;
+/*
+ * skip_discarded - moves 'reader' past entries whose writers faulted.
+ *
+ * Caller needs to hold log->lock.
+ */
+static void skip_discarded(struct logger_log *log,
+			   struct logger_reader *reader)
+{
+	while (reader->r_off != log->c_off &&
+	       get_entry_state(log, reader->r_off) == LOGGER_ENTRY_DISCARDED)
+		reader->r_off = logger_offset(reader->r_off +
+					      get_entry_len(log, reader->r_off));
 }
 
 /*
@@ -159,6 +182,7 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t r_off;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
@@ -166,9 +190,10 @@ start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_lock(&log->lock);
+		skip_discarded(log, reader);
+		ret = (log->c_off == reader->r_off);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -189,26 +214,45 @@ start:
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
+	mutex_lock(&reader->mutex);
+	spin_lock(&log->lock);
 
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+	skip_discarded(log, reader);
+	if (unlikely(log->c_off == reader->r_off)) {
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
 		goto start;
 	}
 
 	/* get the size of the next entry */
 	ret = get_entry_len(log, reader->r_off);
 	if (count < ret) {
+		spin_unlock(&log->lock);
 		ret = -EINVAL;
 		goto out;
 	}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	/*
+	 * get exactly one entry from the log; it's bounced through a kernel
+	 * buffer as copy_to_user() may sleep, and we can't hold log->lock
+	 */
+	r_off = reader->r_off;
+	do_read_log(log, r_off, reader->buf, ret);
+	reader->r_off = logger_offset(r_off + ret);
+	spin_unlock(&log->lock);
+
+	if (copy_to_user(buf, reader->buf, ret)) {
+		/* leave the entry to be read again, unless we got lapped */
+		spin_lock(&log->lock);
+		if (reader->r_off == logger_offset(r_off + ret))
+			reader->r_off = r_off;
+		spin_unlock(&log->lock);
+		ret = -EFAULT;
+	}
 
 out:
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -217,7 +261,7 @@ out:
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -255,7 +299,7 @@ static inline int clock_interval(size_t a, size_t b, size_t c)
  * We do this by "pulling forward" the readers and start head to the first
  * entry after the new write head.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -272,100 +316,178 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
- *
- * The caller needs to hold log->mutex.
+ * do_write_log - writes 'count' bytes from 'buf' to 'log' at offset 'off'
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, size_t off, const void *buf,
+			 size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * do_write_log_user - writes 'count' bytes from the user-space buffer 'buf'
+ * to the log 'log' at offset 'off'
  *
- * The caller needs to hold log->mutex.
+ * Runs without log->lock, 'off' must lie in the caller's reservation.
  *
  * Returns 'count' on success, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t off,
 				      const void __user *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
-
 	return count;
 }
 
+/*
+ * logger_has_room - can an entry of 'len' bytes be reserved without
+ * overwriting one still being written?
+ */
+static inline int logger_has_room(struct logger_log *log, size_t len)
+{
+	return logger_offset(log->w_off - log->c_off) + len < log->size;
+}
+
+/*
+ * logger_reserve - reserves and stamps room for 'header' and its payload,
+ * returning the offset of the entry.
+ *
+ * Sleeps only in the unlikely case the whole buffer is taken by entries
+ * that are still being copied in.
+ */
+static size_t logger_reserve(struct logger_log *log,
+			     struct logger_entry *header)
+{
+	size_t len = sizeof(struct logger_entry) + header->len;
+	struct timespec now;
+	size_t off;
+
+	spin_lock(&log->lock);
+	while (unlikely(!logger_has_room(log, len))) {
+		spin_unlock(&log->lock);
+		wait_event(log->commit_wq, logger_has_room(log, len));
+		spin_lock(&log->lock);
+	}
+
+	/* stamped under the lock, so the buffer stays in timestamp order */
+	now = current_kernel_time();
+	header->sec = now.tv_sec;
+	header->nsec = now.tv_nsec;
+	header->__pad = LOGGER_ENTRY_PENDING;
+
+	/*
+	 * Fix up any readers, pulling them forward to the first readable
+	 * entry after (what will be) the new write offset.
+	 */
+	fix_up_readers(log, len);
+
+	off = log->w_off;
+	log->w_off = logger_offset(off + len);
+
+	/* the header goes in now, get_next_entry() may walk over it */
+	do_write_log(log, off, header, sizeof(struct logger_entry));
+	spin_unlock(&log->lock);
+
+	return off;
+}
+
+/*
+ * logger_commit - makes the entry at 'off' visible to readers once all
+ * entries reserved before it are committed too. A failed entry is
+ * given back if nothing was reserved after it, else marked to be skipped.
+ */
+static void logger_commit(struct logger_log *log, size_t off, size_t len,
+			  int failed)
+{
+	__u16 state = LOGGER_ENTRY_COMMITTED;
+	size_t old_c_off, new_c_off;
+
+	spin_lock(&log->lock);
+	if (failed) {
+		if (log->w_off == logger_offset(off + len)) {
+			log->w_off = off;
+			spin_unlock(&log->lock);
+			/* the room given back may be what a writer waits for */
+			wake_up(&log->commit_wq);
+			return;
+		}
+		state = LOGGER_ENTRY_DISCARDED;
+	}
+	do_write_log(log, logger_offset(off +
+			offsetof(struct logger_entry, __pad)),
+		     &state, sizeof(state));
+
+	old_c_off = log->c_off;
+	while (log->c_off != log->w_off &&
+	       get_entry_state(log, log->c_off) != LOGGER_ENTRY_PENDING)
+		log->c_off = logger_offset(log->c_off +
+					   get_entry_len(log, log->c_off));
+	new_c_off = log->c_off;
+	spin_unlock(&log->lock);
+
+	if (new_c_off != old_c_off) {
+		/* wake up any blocked readers */
+		wake_up_interruptible(&log->wq);
+		if (waitqueue_active(&log->commit_wq))
+			wake_up(&log->commit_wq);
+	}
+}
+
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * log->lock is only held to reserve and to commit the entry, so writers on
+ * different CPUs copy their payloads in parallel.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
-	struct timespec now;
+	size_t off, len;
 	ssize_t ret = 0;
 
-	now = current_kernel_time();
-
 	header.pid = current->tgid;
 	header.tid = current->pid;
-	header.sec = now.tv_sec;
-	header.nsec = now.tv_nsec;
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
 
 	/* null writes succeed, return zero */
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
-	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
-	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
-
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	off = logger_reserve(log, &header);
+	len = sizeof(struct logger_entry) + header.len;
 
 	while (nr_segs-- > 0) {
-		size_t len;
+		size_t seg_len;
 		ssize_t nr;
 
 		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
+		seg_len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log, logger_offset(off +
+				sizeof(struct logger_entry) + ret),
+				iov->iov_base, seg_len);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
+			logger_commit(log, off, len, 1);
 			return nr;
 		}
 
@@ -373,10 +495,7 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		ret += nr;
 	}
 
-	mutex_unlock(&log->mutex);
-
-	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+	logger_commit(log, off, len, 0);
 
 	return ret;
 }
@@ -408,13 +527,20 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->buf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->buf) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
 		INIT_LIST_HEAD(&reader->list);
+		mutex_init(&reader->mutex);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -433,9 +559,10 @@ static int logger_release(struct inode *ignored, struct file *file)
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
 		struct logger_log *log = reader->log;
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		list_del(&reader->list);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
+		kfree(reader->buf);
 		kfree(reader);
 	}
 
@@ -465,10 +592,11 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (log->w_off != reader->r_off)
+	spin_lock(&log->lock);
+	skip_discarded(log, reader);
+	if (log->c_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -479,7 +607,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	struct logger_reader *reader;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -491,10 +619,10 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
+		if (log->c_off >= reader->r_off)
+			ret = log->c_off - reader->r_off;
 		else
-			ret = (log->size - reader->r_off) + log->w_off;
+			ret = (log->size - reader->r_off) + log->c_off;
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -502,7 +630,8 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off != reader->r_off)
+		skip_discarded(log, reader);
+		if (log->c_off != reader->r_off)
 			ret = get_entry_len(log, reader->r_off);
 		else
 			ret = 0;
@@ -513,13 +642,13 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+			reader->r_off = log->c_off;
+		log->head = log->c_off;
 		ret = 0;
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -551,9 +680,11 @@ static struct logger_log VAR = { \
 		.parent = NULL, \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
+	.commit_wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .commit_wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
+	.c_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
 };
@@ -58,6 +58,7 @@ static int lowmem_minfree[6] = {
 static int lowmem_minfree_size = 4;
 
 static unsigned long lowmem_deathpending_timeout;
+static unsigned long lowmem_scans_avoided;
 
 #define lowmem_print(level, x...)			\
 	do {						\
@@ -65,17 +66,213 @@ static unsigned long lowmem_deathpending_timeout;
 			pr_info(x);			\
 	} while (0)
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+#define CREATE_TRACE_POINTS
+#include "lowmemorykiller_trace.h"
+
+struct lowmem_victim {
+	struct task_struct *task;
+	int tasksize;
+	int oom_score_adj;
+};
+
+/*
+ * Consider @tsk for killing. Returns -EAGAIN if an earlier victim is
+ * still dying, 1 if @tsk replaced the victim in @v and 0 otherwise.
+ */
+static int lowmem_consider(struct task_struct *tsk, int min_score_adj,
+			   struct lowmem_victim *v)
+{
+	struct task_struct *p;
+	int oom_score_adj;
+	int tasksize;
+
+	if (tsk->flags & PF_KTHREAD)
+		return 0;
+
+	p = find_lock_task_mm(tsk);
+	if (!p)
+		return 0;
+
+	if (test_tsk_thread_flag(p, TIF_MEMDIE) &&
+	    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
+		task_unlock(p);
+		return -EAGAIN;
+	}
+	oom_score_adj = p->signal->oom_score_adj;
+	if (oom_score_adj < min_score_adj) {
+		task_unlock(p);
+		return 0;
+	}
+	tasksize = get_mm_rss(p->mm);
+	task_unlock(p);
+	if (tasksize <= 0)
+		return 0;
+	if (v->task) {
+		if (oom_score_adj < v->oom_score_adj)
+			return 0;
+		if (oom_score_adj == v->oom_score_adj &&
+		    tasksize <= v->tasksize)
+			return 0;
+	}
+	v->task = p;
+	v->tasksize = tasksize;
+	v->oom_score_adj = oom_score_adj;
+	lowmem_print(2, "select '%s' (%d), adj %d, size %d, to kill\n",
+		     p->comm, p->pid, oom_score_adj, tasksize);
+	return 1;
+}
+
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+#define LOWMEM_ADJ_BUCKETS	(OOM_SCORE_ADJ_MAX - OOM_SCORE_ADJ_MIN + 1)
+
+/*
+ * Thread group leaders hashed by oom_score_adj, kept up to date from
+ * fork, exec, exit and oom_score_adj writes. Victim selection walks
+ * down from the highest bucket and stops at the first one holding a
+ * candidate, instead of looking at every process in the system.
+ *
+ * lowmem_adj_lock nests inside tasklist_lock and siglock, and outside
+ * task_lock.
+ */
+static struct hlist_head lowmem_adj_buckets[LOWMEM_ADJ_BUCKETS];
+static DEFINE_SPINLOCK(lowmem_adj_lock);
+static int lowmem_nr_procs;
+static struct task_struct *lowmem_deathpending;
+
+static struct hlist_head *lowmem_bucket(int oom_score_adj)
+{
+	return &lowmem_adj_buckets[oom_score_adj - OOM_SCORE_ADJ_MIN];
+}
+
+static void __lowmem_task_add(struct task_struct *p)
+{
+	p->lowmem_adj = p->signal->oom_score_adj;
+	hlist_add_head(&p->lowmem_node, lowmem_bucket(p->lowmem_adj));
+}
+
+void lowmem_task_add(struct task_struct *p)
+{
+	unsigned long flags;
+
+	if (p->flags & PF_KTHREAD)
+		return;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	__lowmem_task_add(p);
+	lowmem_nr_procs++;
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+void lowmem_task_del(struct task_struct *p)
 {
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	if (!hlist_unhashed(&p->lowmem_node)) {
+		hlist_del_init(&p->lowmem_node);
+		lowmem_nr_procs--;
+	}
+	if (p == lowmem_deathpending)
+		lowmem_deathpending = NULL;
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+/* A non-leader thread exec'd and took over the thread group */
+void lowmem_task_replace(struct task_struct *old, struct task_struct *new)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	if (!hlist_unhashed(&old->lowmem_node)) {
+		hlist_del_init(&old->lowmem_node);
+		__lowmem_task_add(new);
+	}
+	if (old == lowmem_deathpending)
+		lowmem_deathpending = new;
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+/* Called after p->signal->oom_score_adj changed */
+void lowmem_task_update(struct task_struct *p)
+{
+	unsigned long flags;
+	struct task_struct *leader;
+
+	rcu_read_lock();
+	leader = p->group_leader;
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	if (!hlist_unhashed(&leader->lowmem_node) &&
+	    leader->lowmem_adj != leader->signal->oom_score_adj) {
+		hlist_del(&leader->lowmem_node);
+		__lowmem_task_add(leader);
+	}
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+	rcu_read_unlock();
+}
+
+static int lowmem_select(int min_score_adj, struct lowmem_victim *v)
+{
+	int ret = 0;
+	int oom_score_adj;
+	int nr_scanned = 0;
+	unsigned long flags;
 	struct task_struct *tsk;
-	struct task_struct *selected = NULL;
+	struct hlist_node *node;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	if (lowmem_deathpending &&
+	    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	for (oom_score_adj = OOM_SCORE_ADJ_MAX;
+	     oom_score_adj >= min_score_adj && !v->task; oom_score_adj--) {
+		hlist_for_each_entry(tsk, node, lowmem_bucket(oom_score_adj),
+				     lowmem_node) {
+			nr_scanned++;
+			if (lowmem_consider(tsk, min_score_adj, v) < 0) {
+				ret = -EAGAIN;
+				goto out;
+			}
+		}
+	}
+
+	if (v->task)
+		lowmem_deathpending = v->task->group_leader;
+	lowmem_scans_avoided += lowmem_nr_procs - nr_scanned;
+	trace_lowmem_select(min_score_adj, lowmem_nr_procs, nr_scanned,
+			    v->task, v->oom_score_adj, v->tasksize);
+out:
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+	return ret;
+}
+#else
+static int lowmem_select(int min_score_adj, struct lowmem_victim *v)
+{
+	struct task_struct *tsk;
+	int nr_procs = 0;
+
+	for_each_process(tsk) {
+		nr_procs++;
+		if (lowmem_consider(tsk, min_score_adj, v) < 0)
+			return -EAGAIN;
+	}
+
+	trace_lowmem_select(min_score_adj, nr_procs, nr_procs, v->task,
+			    v->oom_score_adj, v->tasksize);
+	return 0;
+}
+#endif
+
+static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	struct lowmem_victim victim = { NULL, 0, 0 };
+	struct task_struct *selected;
 	int rem = 0;
-	int tasksize;
 	int i;
 	int min_score_adj = OOM_SCORE_ADJ_MAX + 1;
 	int minfree = 0;
-	int selected_tasksize = 0;
-	int selected_oom_score_adj;
 	int array_size = ARRAY_SIZE(lowmem_adj);
 	int other_free = global_page_state(NR_FREE_PAGES) - totalreserve_pages;
 	int other_file = global_page_state(NR_FILE_PAGES) -
@@ -105,56 +302,21 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			     sc->nr_to_scan, sc->gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_score_adj = min_score_adj;
 
 	rcu_read_lock();
-	for_each_process(tsk) {
-		struct task_struct *p;
-		int oom_score_adj;
-
-		if (tsk->flags & PF_KTHREAD)
-			continue;
-
-		p = find_lock_task_mm(tsk);
-		if (!p)
-			continue;
-
-		if (test_tsk_thread_flag(p, TIF_MEMDIE) &&
-		    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
-			task_unlock(p);
-			rcu_read_unlock();
-			return 0;
-		}
-		oom_score_adj = p->signal->oom_score_adj;
-		if (oom_score_adj < min_score_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(p->mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_score_adj < selected_oom_score_adj)
-				continue;
-			if (oom_score_adj == selected_oom_score_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_score_adj = oom_score_adj;
-		lowmem_print(2, "select '%s' (%d), adj %d, size %d, to kill\n",
-			     p->comm, p->pid, oom_score_adj, tasksize);
+	if (lowmem_select(min_score_adj, &victim)) {
+		rcu_read_unlock();
+		return 0;
 	}
+	selected = victim.task;
 	if (selected) {
 		lowmem_print(1, "Killing '%s' (%d), adj %d,\n" \
 				"   to free %ldkB on behalf of '%s' (%d) because\n" \
 				"   cache %ldkB is below limit %ldkB for oom_score_adj %d\n" \
 				"   Free memory is %ldkB above reserved\n",
 			     selected->comm, selected->pid,
-			     selected_oom_score_adj,
-			     selected_tasksize * (long)(PAGE_SIZE / 1024),
+			     victim.oom_score_adj,
+			     victim.tasksize * (long)(PAGE_SIZE / 1024),
 			     current->comm, current->pid,
 			     other_file * (long)(PAGE_SIZE / 1024),
 			     minfree * (long)(PAGE_SIZE / 1024),
@@ -163,7 +325,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		lowmem_deathpending_timeout = jiffies + HZ;
 		send_sig(SIGKILL, selected, 0);
 		set_tsk_thread_flag(selected, TIF_MEMDIE);
-		rem -= selected_tasksize;
+		rem -= victim.tasksize;
 	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
@@ -278,6 +440,7 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(scans_avoided, lowmem_scans_avoided, ulong, S_IRUGO);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
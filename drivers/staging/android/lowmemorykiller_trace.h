@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_LOWMEMORYKILLER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _LOWMEMORYKILLER_TRACE_H
+
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(lowmem_select,
+	TP_PROTO(int min_score_adj, int nr_procs, int nr_scanned,
+		 struct task_struct *selected, int oom_score_adj,
+		 int tasksize),
+	TP_ARGS(min_score_adj, nr_procs, nr_scanned, selected, oom_score_adj,
+		tasksize),
+
+	TP_STRUCT__entry(
+		__field(int, min_score_adj)
+		__field(int, nr_procs)
+		__field(int, nr_scanned)
+		__field(pid_t, pid)
+		__array(char, comm, TASK_COMM_LEN)
+		__field(int, oom_score_adj)
+		__field(int, tasksize)
+	),
+	TP_fast_assign(
+		__entry->min_score_adj = min_score_adj;
+		__entry->nr_procs = nr_procs;
+		__entry->nr_scanned = nr_scanned;
+		if (selected) {
+			__entry->pid = selected->pid;
+			memcpy(__entry->comm, selected->comm, TASK_COMM_LEN);
+		} else {
+			__entry->pid = 0;
+			__entry->comm[0] = '\0';
+		}
+		__entry->oom_score_adj = oom_score_adj;
+		__entry->tasksize = tasksize;
+	),
+	TP_printk("min_adj=%d procs=%d scanned=%d pid=%d comm=%s adj=%d size=%d",
+		  __entry->min_score_adj, __entry->nr_procs,
+		  __entry->nr_scanned, __entry->pid, __entry->comm,
+		  __entry->oom_score_adj, __entry->tasksize)
+);
+
+#endif /* _LOWMEMORYKILLER_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE lowmemorykiller_trace
+#include <trace/define_trace.h>
@@ -280,9 +280,8 @@ static int grow_pool(struct xv_pool *pool, gfp_t flags)
 	if (unlikely(!page))
 		return -ENOMEM;
 
-	stat_inc(&pool->total_pages);
-
 	spin_lock(&pool->lock);
+	stat_inc(&pool->total_pages);
 	block = get_ptr_atomic(page, 0);
 
 	block->size = PAGE_SIZE - XV_ALIGN;
@@ -468,10 +467,10 @@ void xv_free(struct xv_pool *pool, struct page *page, u32 offset)
 	/* No used objects in this page. Free it. */
 	if (block->size == PAGE_SIZE - XV_ALIGN) {
 		put_ptr_atomic(page_start);
+		stat_dec(&pool->total_pages);
 		spin_unlock(&pool->lock);
 
 		__free_page(page);
-		stat_dec(&pool->total_pages);
 		return;
 	}
 
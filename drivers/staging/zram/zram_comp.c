@@ -0,0 +1,334 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/gfp.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/wait.h>
+
+#ifdef CONFIG_ZRAM_LZO
+#include <linux/lzo.h>
+#endif
+#ifdef CONFIG_ZRAM_LZ4
+#include <linux/lz4.h>
+#endif
+#ifdef CONFIG_ZRAM_SNAPPY
+#include "../snappy/csnappy.h" /* if built in drivers/staging */
+#endif
+
+#include "zram_drv.h"
+
+#ifdef CONFIG_ZRAM_LZO
+static const struct zram_compressor zram_lzo = {
+	.name		= "lzo",
+	.workmem_size	= LZO1X_MEM_COMPRESS,
+	.compress	= lzo1x_1_compress,
+	.decompress	= lzo1x_decompress_safe,
+};
+#endif
+
+#ifdef CONFIG_ZRAM_LZ4
+static int zram_lz4_decompress(const unsigned char *src, size_t src_len,
+			       unsigned char *dst, size_t *dst_len)
+{
+	return lz4_decompress((const char *)src, src_len, (char *)dst,
+			      dst_len);
+}
+
+static const struct zram_compressor zram_lz4 = {
+	.name		= "lz4",
+	.workmem_size	= LZ4_MEM_COMPRESS,
+	.compress	= lz4_compress,
+	.decompress	= zram_lz4_decompress,
+};
+#endif
+
+#ifdef CONFIG_ZRAM_SNAPPY
+#define WMSIZE_ORDER	((PAGE_SHIFT > 14) ? (15) : (PAGE_SHIFT+1))
+
+static int
+snappy_compress_(
+	const unsigned char *src,
+	size_t src_len,
+	unsigned char *dst,
+	size_t *dst_len,
+	void *workmem)
+{
+	const unsigned char *end = csnappy_compress_fragment(
+		src, (uint32_t)src_len, dst, workmem, WMSIZE_ORDER);
+	*dst_len = end - dst;
+	return 0;
+}
+
+static int
+snappy_decompress_(
+	const unsigned char *src,
+	size_t src_len,
+	unsigned char *dst,
+	size_t *dst_len)
+{
+	uint32_t dst_len_ = (uint32_t)*dst_len;
+	int ret = csnappy_decompress_noheader(src, src_len, dst, &dst_len_);
+	*dst_len = (size_t)dst_len_;
+	return ret;
+}
+
+static const struct zram_compressor zram_snappy = {
+	.name		= "snappy",
+	.workmem_size	= 1 << WMSIZE_ORDER,
+	.compress	= snappy_compress_,
+	.decompress	= snappy_decompress_,
+};
+#endif
+
+static const struct zram_compressor *zram_compressors[] = {
+#ifdef CONFIG_ZRAM_LZO
+	&zram_lzo,
+#endif
+#ifdef CONFIG_ZRAM_LZ4
+	&zram_lz4,
+#endif
+#ifdef CONFIG_ZRAM_SNAPPY
+	&zram_snappy,
+#endif
+	NULL
+};
+
+const struct zram_compressor *zram_comp_default(void)
+{
+#if defined(CONFIG_ZRAM_DEFAULT_LZ4)
+	return &zram_lz4;
+#elif defined(CONFIG_ZRAM_DEFAULT_SNAPPY)
+	return &zram_snappy;
+#elif defined(CONFIG_ZRAM_DEFAULT_LZO)
+	return &zram_lzo;
+#else
+#error at least one of CONFIG_ZRAM_LZO, CONFIG_ZRAM_LZ4 or CONFIG_ZRAM_SNAPPY must be defined
+#endif
+}
+
+const struct zram_compressor *zram_comp_find(const char *name)
+{
+	int i;
+
+	for (i = 0; zram_compressors[i]; i++) {
+		if (sysfs_streq(name, zram_compressors[i]->name))
+			return zram_compressors[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * List all built-in backends, with the one currently selected
+ * in brackets: "lzo [lz4]".
+ */
+ssize_t zram_comp_list(const struct zram_compressor *cur, char *buf)
+{
+	int i;
+	ssize_t sz = 0;
+
+	for (i = 0; zram_compressors[i]; i++) {
+		const char *fmt = zram_compressors[i] == cur ? "[%s] " : "%s ";
+
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz, fmt,
+				zram_compressors[i]->name);
+	}
+
+	/* Replace the trailing space */
+	if (sz)
+		sz--;
+	sz += scnprintf(buf + sz, PAGE_SIZE - sz, "\n");
+
+	return sz;
+}
+
+/*
+ * Allocate max_strm compression streams for the device's compressor.
+ * Called from zram_init_device() with init_lock held.
+ */
+int zram_strm_init(struct zram *zram)
+{
+	unsigned int i;
+
+	zram->strm = kcalloc(zram->max_strm, sizeof(*zram->strm), GFP_KERNEL);
+	if (!zram->strm)
+		return -ENOMEM;
+
+	for (i = 0; i < zram->max_strm; i++) {
+		struct zram_strm *strm = &zram->strm[i];
+
+		strm->workmem = kzalloc(zram->comp->workmem_size, GFP_KERNEL);
+		/*
+		 * Allocate 2 pages: the compressor may write past PAGE_SIZE
+		 * for incompressible input before we get to look at clen.
+		 */
+		strm->buffer = (void *)__get_free_pages(GFP_KERNEL |
+							__GFP_ZERO, 1);
+		if (!strm->workmem || !strm->buffer) {
+			zram_strm_destroy(zram);
+			return -ENOMEM;
+		}
+
+		list_add_tail(&strm->list, &zram->idle_strm);
+	}
+
+	return 0;
+}
+
+void zram_strm_destroy(struct zram *zram)
+{
+	unsigned int i;
+
+	if (!zram->strm)
+		return;
+
+	for (i = 0; i < zram->max_strm; i++) {
+		kfree(zram->strm[i].workmem);
+		free_pages((unsigned long)zram->strm[i].buffer, 1);
+	}
+
+	kfree(zram->strm);
+	zram->strm = NULL;
+	INIT_LIST_HEAD(&zram->idle_strm);
+}
+
+/*
+ * Take an idle stream, sleeping until one is returned if all of them
+ * are busy. Waits are charged to the stream the waiter ends up with.
+ */
+struct zram_strm *zram_strm_get(struct zram *zram)
+{
+	struct zram_strm *strm;
+	ktime_t start = ktime_set(0, 0);
+	int waited = 0;
+
+	spin_lock(&zram->strm_lock);
+	while (list_empty(&zram->idle_strm)) {
+		spin_unlock(&zram->strm_lock);
+		if (!waited) {
+			start = ktime_get();
+			waited = 1;
+		}
+		wait_event(zram->strm_wait, !list_empty(&zram->idle_strm));
+		spin_lock(&zram->strm_lock);
+	}
+
+	strm = list_first_entry(&zram->idle_strm, struct zram_strm, list);
+	list_del(&strm->list);
+
+	strm->nr_uses++;
+	if (waited) {
+		strm->nr_waits++;
+		strm->wait_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	}
+	spin_unlock(&zram->strm_lock);
+
+	return strm;
+}
+
+void zram_strm_put(struct zram *zram, struct zram_strm *strm)
+{
+	spin_lock(&zram->strm_lock);
+	list_add(&strm->list, &zram->idle_strm);
+	spin_unlock(&zram->strm_lock);
+
+	wake_up(&zram->strm_wait);
+}
+
+/*
+ * Run every backend over the same set of sample pages, timing the
+ * compression and decompression of each page and checking that the
+ * round trip gives back the original data.
+ *
+ * Returns number of entries filled in @res or a negative error.
+ */
+int zram_comp_bench(const void *samples, unsigned int nr_pages,
+			struct zram_bench_result *res)
+{
+	int i, ret;
+	void *workmem = NULL;
+	unsigned char *dst, *out;
+
+	dst = (unsigned char *)__get_free_pages(GFP_KERNEL, 1);
+	out = (unsigned char *)__get_free_page(GFP_KERNEL);
+	if (!dst || !out) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; zram_compressors[i]; i++) {
+		const struct zram_compressor *comp = zram_compressors[i];
+		struct zram_bench_result *r = &res[i];
+		unsigned int n;
+
+		memset(r, 0, sizeof(*r));
+		r->name = comp->name;
+
+		workmem = kzalloc(comp->workmem_size, GFP_KERNEL);
+		if (!workmem) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		for (n = 0; n < nr_pages; n++) {
+			const unsigned char *src = samples + n * PAGE_SIZE;
+			size_t clen, dlen = PAGE_SIZE;
+			ktime_t start;
+			int err;
+
+			start = ktime_get();
+			err = comp->compress(src, PAGE_SIZE, dst, &clen,
+					workmem);
+			r->compress_ns += ktime_to_ns(ktime_sub(ktime_get(),
+							start));
+			if (err) {
+				r->errors++;
+				continue;
+			}
+
+			start = ktime_get();
+			err = comp->decompress(dst, clen, out, &dlen);
+			r->decompress_ns += ktime_to_ns(ktime_sub(ktime_get(),
+							start));
+			if (err || dlen != PAGE_SIZE ||
+			    memcmp(src, out, PAGE_SIZE)) {
+				r->errors++;
+				continue;
+			}
+
+			r->orig_size += PAGE_SIZE;
+			r->compr_size += clen;
+			cond_resched();
+		}
+
+		kfree(workmem);
+		workmem = NULL;
+	}
+	ret = i;
+
+out:
+	kfree(workmem);
+	free_page((unsigned long)out);
+	free_pages((unsigned long)dst, 1);
+	return ret;
+}
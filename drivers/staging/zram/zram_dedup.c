@@ -0,0 +1,185 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+/* Bounds on the number of index buckets per device */
+#define ZRAM_HASH_SIZE_MIN	16
+#define ZRAM_HASH_SIZE_MAX	4096
+
+/* One bucket per this many pages of disksize */
+#define ZRAM_HASH_PAGES_SHIFT	6
+
+static struct zram_hash *zram_dedup_bucket(struct zram *zram, u32 checksum)
+{
+	return &zram->hash[checksum & (zram->hash_size - 1)];
+}
+
+/*
+ * Allocate the content index. Called from zram_init_device() with
+ * init_lock held; does nothing unless dedup was enabled through sysfs.
+ */
+int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	size_t i;
+
+	if (!zram->use_dedup)
+		return 0;
+
+	zram->hash_size = clamp_t(size_t, num_pages >> ZRAM_HASH_PAGES_SHIFT,
+				ZRAM_HASH_SIZE_MIN, ZRAM_HASH_SIZE_MAX);
+	zram->hash_size = roundup_pow_of_two(zram->hash_size);
+	zram->hash = vzalloc(zram->hash_size * sizeof(*zram->hash));
+	if (!zram->hash) {
+		zram->hash_size = 0;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < zram->hash_size; i++) {
+		spin_lock_init(&zram->hash[i].lock);
+		zram->hash[i].rb_root = RB_ROOT;
+	}
+
+	return 0;
+}
+
+/* All entries must have been released by the caller */
+void zram_dedup_fini(struct zram *zram)
+{
+	vfree(zram->hash);
+	zram->hash = NULL;
+	zram->hash_size = 0;
+}
+
+u32 zram_dedup_checksum(const unsigned char *mem)
+{
+	return jhash2((const u32 *)mem, PAGE_SIZE / sizeof(u32), 0);
+}
+
+/*
+ * Decompress @entry into @buf and compare it with @mem.
+ * Called with the entry's bucket lock held, which keeps it alive.
+ */
+static int zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+			const unsigned char *mem, void *buf)
+{
+	int ret;
+	size_t clen = PAGE_SIZE;
+	unsigned char *cmem;
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	ret = zram->comp->decompress(cmem, entry->len, buf, &clen);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return !ret && clen == PAGE_SIZE && !memcmp(mem, buf, PAGE_SIZE);
+}
+
+/*
+ * Look for a stored page with the same content as @mem and take a
+ * reference on it. @buf is PAGE_SIZE of scratch space used to verify
+ * the match. Only the first entry found for @checksum is compared: a
+ * true hash collision just means the page gets stored again.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram,
+			const unsigned char *mem, u32 checksum, void *buf)
+{
+	struct rb_node *node;
+	struct zram_entry *entry = NULL;
+	struct zram_hash *hash = zram_dedup_bucket(zram, checksum);
+
+	spin_lock(&hash->lock);
+	node = hash->rb_root.rb_node;
+	while (node) {
+		struct zram_entry *cur = rb_entry(node, struct zram_entry,
+						rb_node);
+
+		if (checksum == cur->checksum) {
+			if (zram_dedup_match(zram, cur, mem, buf)) {
+				cur->refcount++;
+				entry = cur;
+			}
+			break;
+		}
+
+		node = checksum < cur->checksum ? node->rb_left :
+						node->rb_right;
+	}
+	spin_unlock(&hash->lock);
+
+	return entry;
+}
+
+/* Make a freshly stored @entry visible to zram_dedup_find() */
+void zram_dedup_insert(struct zram *zram, struct zram_entry *entry,
+			u32 checksum)
+{
+	struct rb_node **rb_node, *parent = NULL;
+	struct zram_hash *hash = zram_dedup_bucket(zram, checksum);
+
+	entry->checksum = checksum;
+
+	spin_lock(&hash->lock);
+	rb_node = &hash->rb_root.rb_node;
+	while (*rb_node) {
+		struct zram_entry *cur;
+
+		parent = *rb_node;
+		cur = rb_entry(parent, struct zram_entry, rb_node);
+		if (checksum < cur->checksum)
+			rb_node = &parent->rb_left;
+		else
+			rb_node = &parent->rb_right;
+	}
+
+	rb_link_node(&entry->rb_node, parent, rb_node);
+	rb_insert_color(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+}
+
+/*
+ * Drop one reference and return how many are left. The last one
+ * unlinks the entry from the index; the caller then frees it.
+ */
+unsigned long zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	unsigned long refcount;
+	struct zram_hash *hash;
+
+	if (!zram->use_dedup || RB_EMPTY_NODE(&entry->rb_node))
+		return --entry->refcount;
+
+	hash = zram_dedup_bucket(zram, entry->checksum);
+
+	spin_lock(&hash->lock);
+	refcount = --entry->refcount;
+	if (!refcount) {
+		rb_erase(&entry->rb_node, &hash->rb_root);
+		RB_CLEAR_NODE(&entry->rb_node);
+	}
+	spin_unlock(&hash->lock);
+
+	return refcount;
+}
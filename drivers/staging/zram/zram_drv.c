@@ -22,6 +22,7 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/bio.h>
+#include <linux/bit_spinlock.h>
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
@@ -34,66 +35,26 @@
 
 #include "zram_drv.h"
 
-#if defined(CONFIG_ZRAM_LZO)
-#include <linux/lzo.h>
-#define WMSIZE		LZO1X_MEM_COMPRESS
-#define COMPRESS(s, sl, d, dl, wm)	\
-	lzo1x_1_compress(s, sl, d, dl, wm)
-#define DECOMPRESS(s, sl, d, dl)	\
-	lzo1x_decompress_safe(s, sl, d, dl)
-#elif defined(CONFIG_ZRAM_SNAPPY)
-#include "../snappy/csnappy.h" /* if built in drivers/staging */
-#define WMSIZE_ORDER	((PAGE_SHIFT > 14) ? (15) : (PAGE_SHIFT+1))
-#define WMSIZE		(1 << WMSIZE_ORDER)
-static int
-snappy_compress_(
-	const unsigned char *src,
-	size_t src_len,
-	unsigned char *dst,
-	size_t *dst_len,
-	void *workmem)
-{
-	const unsigned char *end = csnappy_compress_fragment(
-		src, (uint32_t)src_len, dst, workmem, WMSIZE_ORDER);
-	*dst_len = end - dst;
-	return 0;
-}
-static int
-snappy_decompress_(
-	const unsigned char *src,
-	size_t src_len,
-	unsigned char *dst,
-	size_t *dst_len)
-{
-	uint32_t dst_len_ = (uint32_t)*dst_len;
-	int ret = csnappy_decompress_noheader(src, src_len, dst, &dst_len_);
-	*dst_len = (size_t)dst_len_;
-	return ret;
-}
-#define COMPRESS(s, sl, d, dl, wm)	\
-	snappy_compress_(s, sl, d, dl, wm)
-#define DECOMPRESS(s, sl, d, dl)	\
-	snappy_decompress_(s, sl, d, dl)
-#else
-#error either CONFIG_ZRAM_LZO or CONFIG_ZRAM_SNAPPY must be defined
-#endif
-
-
 /* Globals */
 static int zram_major;
 struct zram *zram_devices;
+static struct kmem_cache *zram_entry_cache;
+#ifdef CONFIG_ZRAM_WRITEBACK
+static struct workqueue_struct *zram_wb_wq;
+static struct workqueue_struct *zram_rd_wq;
+#endif
 
 /* Module params (documentation at end) */
 unsigned int zram_num_devices;
 
-static void zram_stat_inc(u32 *v)
+static void zram_stat_inc(atomic_t *v)
 {
-	*v = *v + 1;
+	atomic_inc(v);
 }
 
-static void zram_stat_dec(u32 *v)
+static void zram_stat_dec(atomic_t *v)
 {
-	*v = *v - 1;
+	atomic_dec(v);
 }
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
@@ -133,6 +94,20 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
+/*
+ * Each table entry carries its own lock bit, so I/O to different
+ * slots never contends. Held only across non-sleeping work.
+ */
+static void zram_lock_slot(struct zram *zram, u32 index)
+{
+	bit_spin_lock(ZRAM_ACCESS, &zram->table[index].flags);
+}
+
+static void zram_unlock_slot(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &zram->table[index].flags);
+}
+
 static int page_zero_filled(void *ptr)
 {
 	unsigned int pos;
@@ -163,183 +138,281 @@ static void zram_set_disksize(struct zram *zram, u64 size_bytes)
 	set_capacity(zram->disk, size_bytes >> SECTOR_SHIFT);
 }
 
-static void zram_free_page(struct zram *zram, size_t index)
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void zram_reset_bdev(struct zram *zram)
 {
-	u32 clen;
-	void *obj;
+	if (!zram->bdev)
+		return;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	zram->bdev = NULL;
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+	zram->nr_pages = 0;
+	kfree(zram->backing_dev);
+	zram->backing_dev = NULL;
+}
 
-	if (unlikely(!page)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
-		}
-		return;
+/* Returns 0 when the backing device is full */
+static unsigned long zram_bdev_alloc_blk(struct zram *zram)
+{
+	unsigned long blk;
+
+	spin_lock(&zram->bitmap_lock);
+	/* Skip block 0 so a valid block is never 0 */
+	blk = find_next_zero_bit(zram->bitmap, zram->nr_pages, 1);
+	if (blk < zram->nr_pages)
+		__set_bit(blk, zram->bitmap);
+	else
+		blk = 0;
+	spin_unlock(&zram->bitmap_lock);
+
+	return blk;
+}
+
+static void zram_bdev_free_blk(struct zram *zram, unsigned long blk)
+{
+	spin_lock(&zram->bitmap_lock);
+	WARN_ON_ONCE(!test_bit(blk, zram->bitmap));
+	__clear_bit(blk, zram->bitmap);
+	spin_unlock(&zram->bitmap_lock);
+}
+
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/* Synchronously read or write one page at block @blk */
+static int zram_bdev_rw(struct zram *zram, struct page *page,
+			unsigned long blk, int rw)
+{
+	int ret = 0;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->bdev;
+	bio->bi_end_io = zram_bdev_end_io;
+	bio->bi_private = &done;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
 	}
 
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		clen = PAGE_SIZE;
-		__free_page(page);
-		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_dec(&zram->stats.pages_expand);
-		goto out;
+	submit_bio(rw, bio);
+	wait_for_completion(&done);
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		ret = -EIO;
+	bio_put(bio);
+
+	if (!ret) {
+		if (rw & WRITE)
+			zram_stat64_inc(zram, &zram->stats.bd_writes);
+		else
+			zram_stat64_inc(zram, &zram->stats.bd_reads);
 	}
 
-	obj = kmap_atomic(page) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj);
+	return ret;
+}
 
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
+struct zram_bdev_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int ret;
+};
 
-out:
-	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
-	zram_stat_dec(&zram->stats.pages_stored);
+static void zram_bdev_read_work(struct work_struct *work)
+{
+	struct zram_bdev_work *rw = container_of(work, struct zram_bdev_work,
+						 work);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	rw->ret = zram_bdev_rw(rw->zram, rw->page, rw->blk, READ_SYNC);
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+/*
+ * Reads are issued from zram_make_request(), where generic_make_request()
+ * only parks a nested bio on current->bio_list until we return, so it
+ * would never complete while we wait for it. Submit it from a worker.
+ */
+static int zram_bdev_read(struct zram *zram, struct page *page,
+			unsigned long blk)
 {
-	struct page *page = bvec->bv_page;
-	void *user_mem;
+	struct zram_bdev_work rw;
 
-	user_mem = kmap_atomic(page);
-	memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
-	kunmap_atomic(user_mem);
+	rw.zram = zram;
+	rw.page = page;
+	rw.blk = blk;
+	INIT_WORK_ONSTACK(&rw.work, zram_bdev_read_work);
+	queue_work(zram_rd_wq, &rw.work);
+	flush_work(&rw.work);
+	destroy_work_on_stack(&rw.work);
 
-	flush_dcache_page(page);
+	return rw.ret;
 }
 
-static void handle_uncompressed_page(struct zram *zram, struct bio_vec *bvec,
-				     u32 index, int offset)
+/* As zram_bdev_read(), into a PAGE_SIZE buffer */
+static int zram_bdev_read_mem(struct zram *zram, void *mem,
+			unsigned long blk)
 {
-	struct page *page = bvec->bv_page;
-	unsigned char *user_mem, *cmem;
+	int ret;
+	void *src;
+	struct page *page;
 
-	user_mem = kmap_atomic(page);
-	cmem = kmap_atomic(zram->table[index].page);
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
 
-	memcpy(user_mem + bvec->bv_offset, cmem + offset, bvec->bv_len);
-	kunmap_atomic(cmem);
-	kunmap_atomic(user_mem);
+	ret = zram_bdev_read(zram, page, blk);
+	if (!ret) {
+		src = kmap_atomic(page);
+		memcpy(mem, src, PAGE_SIZE);
+		kunmap_atomic(src);
+	}
+	__free_page(page);
 
-	flush_dcache_page(page);
+	return ret;
 }
-
-static inline int is_partial_io(struct bio_vec *bvec)
+#else
+static inline void zram_reset_bdev(struct zram *zram) { }
+static inline void zram_bdev_free_blk(struct zram *zram, unsigned long blk)
 {
-	return bvec->bv_len != PAGE_SIZE;
 }
+static inline int zram_bdev_read(struct zram *zram, struct page *page,
+			unsigned long blk)
+{
+	return -EIO;
+}
+static inline int zram_bdev_read_mem(struct zram *zram, void *mem,
+			unsigned long blk)
+{
+	return -EIO;
+}
+#endif
 
-static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
-			  u32 index, int offset, struct bio *bio)
+static struct zram_entry *zram_entry_alloc(struct zram *zram,
+			unsigned long handle, unsigned int len)
 {
-	int ret;
-	size_t clen;
-	struct page *page;
-	struct zobj_header *zheader;
-	unsigned char *user_mem, *cmem, *uncmem = NULL;
+	struct zram_entry *entry;
 
-	page = bvec->bv_page;
+	entry = kmem_cache_alloc(zram_entry_cache, GFP_NOIO);
+	if (!entry)
+		return NULL;
 
-	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-		handle_zero_page(bvec);
-		return 0;
-	}
+	RB_CLEAR_NODE(&entry->rb_node);
+	entry->len = len;
+	entry->checksum = 0;
+	entry->refcount = 1;
+	entry->handle = handle;
 
-	/* Requested page is not present in compressed area */
-	if (unlikely(!zram->table[index].page)) {
-		pr_debug("Read before write: sector=%lu, size=%u",
-			 (ulong)(bio->bi_sector), bio->bi_size);
-		handle_zero_page(bvec);
-		return 0;
-	}
+	return entry;
+}
 
-	/* Page is stored uncompressed since it's incompressible */
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		handle_uncompressed_page(zram, bvec, index, offset);
-		return 0;
-	}
+/* Drop a slot's reference, freeing the object along with the last one */
+static void zram_entry_put(struct zram *zram, struct zram_entry *entry)
+{
+	u32 len = entry->len;
 
-	if (is_partial_io(bvec)) {
-		/* Use  a temporary buffer to decompress the page */
-		uncmem = kmalloc(PAGE_SIZE, GFP_KERNEL);
-		if (!uncmem) {
-			pr_info("Error allocating temp memory!\n");
-			return -ENOMEM;
-		}
+	if (zram_dedup_put(zram, entry)) {
+		zram_stat_dec(&zram->stats.pages_dedup);
+		zram_stat64_sub(zram, &zram->stats.dedup_size, len);
+		return;
 	}
 
-	user_mem = kmap_atomic(page);
-	if (!is_partial_io(bvec))
-		uncmem = user_mem;
-	clen = PAGE_SIZE;
+	zs_free(zram->mem_pool, entry->handle);
+	kmem_cache_free(zram_entry_cache, entry);
+	zram_stat64_sub(zram, &zram->stats.compr_size, len);
+}
 
-	cmem = kmap_atomic(zram->table[index].page) +
-		zram->table[index].offset;
+/* Caller must hold the slot lock */
+static void zram_free_page(struct zram *zram, size_t index)
+{
+	u32 clen;
+	struct zram_entry *entry = zram->table[index].entry;
 
-	ret = DECOMPRESS(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			uncmem, &clen);
+	/* Any writeback in flight for this slot is now stale */
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
 
-	if (is_partial_io(bvec)) {
-		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
-		       bvec->bv_len);
-		kfree(uncmem);
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		zram_bdev_free_blk(zram, zram->table[index].element);
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_stat_dec(&zram->stats.pages_wb);
+		goto out;
 	}
 
-	kunmap_atomic(cmem);
-	kunmap_atomic(user_mem);
+	if (unlikely(!entry)) {
+		/*
+		 * No memory is allocated for zero filled pages.
+		 * Simply clear zero page flag.
+		 */
+		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+			zram_clear_flag(zram, index, ZRAM_ZERO);
+			zram_stat_dec(&zram->stats.pages_zero);
+		}
+		return;
+	}
 
-	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret)) {
-		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
-		zram_stat64_inc(zram, &zram->stats.failed_reads);
-		return ret;
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		__free_page(zram->table[index].page);
+		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_stat_dec(&zram->stats.pages_expand);
+		zram_stat64_sub(zram, &zram->stats.compr_size, PAGE_SIZE);
+		goto out;
 	}
 
-	flush_dcache_page(page);
+	clen = zram->table[index].size;
+	zram_entry_put(zram, entry);
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_dec(&zram->stats.good_compress);
 
-	return 0;
+out:
+	zram_stat_dec(&zram->stats.pages_stored);
+
+	zram->table[index].entry = NULL;
+	zram->table[index].size = 0;
 }
 
-static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
+static inline int is_partial_io(struct bio_vec *bvec)
+{
+	return bvec->bv_len != PAGE_SIZE;
+}
+
+/*
+ * Decompress (or copy) the page stored in slot @index into @mem.
+ * Unwritten and zero filled slots read back as zeros.
+ * Caller must hold the slot lock, and handle ZRAM_WB slots itself.
+ */
+static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 {
 	int ret;
 	size_t clen = PAGE_SIZE;
-	struct zobj_header *zheader;
 	unsigned char *cmem;
+	struct zram_entry *entry = zram->table[index].entry;
 
-	if (zram_test_flag(zram, index, ZRAM_ZERO) ||
-	    !zram->table[index].page) {
+	if (zram_test_flag(zram, index, ZRAM_ZERO) || !entry) {
 		memset(mem, 0, PAGE_SIZE);
 		return 0;
 	}
 
-	cmem = kmap_atomic(zram->table[index].page) +
-		zram->table[index].offset;
-
 	/* Page is stored uncompressed since it's incompressible */
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		cmem = kmap_atomic(zram->table[index].page);
 		memcpy(mem, cmem, PAGE_SIZE);
 		kunmap_atomic(cmem);
 		return 0;
 	}
 
-	ret = DECOMPRESS(cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			mem, &clen);
-	kunmap_atomic(cmem);
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	ret = zram->comp->decompress(cmem, entry->len, mem, &clen);
+	zs_unmap_object(zram->mem_pool, entry->handle);
 
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret)) {
@@ -351,70 +424,156 @@ static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
 	return 0;
 }
 
+static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
+			  u32 index, int offset, struct bio *bio)
+{
+	int ret;
+	struct page *page;
+	unsigned char *user_mem, *uncmem = NULL;
+
+	page = bvec->bv_page;
+
+	if (is_partial_io(bvec)) {
+		/* Use  a temporary buffer to decompress the page */
+		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
+		if (!uncmem) {
+			pr_info("Error allocating temp memory!\n");
+			return -ENOMEM;
+		}
+	}
+
+	zram_lock_slot(zram, index);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+
+	/* Backing device reads sleep, so they run without the slot lock */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		unsigned long blk = zram->table[index].element;
+
+		zram_unlock_slot(zram, index);
+		if (!is_partial_io(bvec)) {
+			ret = zram_bdev_read(zram, page, blk);
+			goto out;
+		}
+
+		ret = zram_bdev_read_mem(zram, uncmem, blk);
+		if (!ret) {
+			user_mem = kmap_atomic(page);
+			memcpy(user_mem + bvec->bv_offset, uncmem + offset,
+			       bvec->bv_len);
+			kunmap_atomic(user_mem);
+		}
+		goto out;
+	}
+
+	user_mem = kmap_atomic(page);
+	ret = zram_decompress_page(zram,
+			is_partial_io(bvec) ? uncmem : user_mem, index);
+	zram_unlock_slot(zram, index);
+
+	if (is_partial_io(bvec) && !ret)
+		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
+		       bvec->bv_len);
+
+	kunmap_atomic(user_mem);
+
+out:
+	kfree(uncmem);
+	if (unlikely(ret))
+		return ret;
+
+	flush_dcache_page(page);
+
+	return 0;
+}
+
 static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			   int offset)
 {
-	int ret;
-	u32 store_offset;
+	int ret = 0;
+	int incompressible = 0;
+	unsigned long handle;
+	u32 checksum = 0;
 	size_t clen;
-	struct zobj_header *zheader;
-	struct page *page, *page_store;
+	struct zram_strm *strm = NULL;
+	struct zram_entry *entry = NULL;
+	struct page *page, *page_store = NULL;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 
 	page = bvec->bv_page;
-	src = zram->compress_buffer;
 
 	if (is_partial_io(bvec)) {
 		/*
 		 * This is a partial IO. We need to read the full page
 		 * before to write the changes.
 		 */
-		uncmem = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
 		if (!uncmem) {
 			pr_info("Error allocating temp memory!\n");
 			ret = -ENOMEM;
 			goto out;
 		}
-		ret = zram_read_before_write(zram, uncmem, index);
-		if (ret) {
-			kfree(uncmem);
-			goto out;
+		zram_lock_slot(zram, index);
+		if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+			unsigned long blk = zram->table[index].element;
+
+			zram_unlock_slot(zram, index);
+			ret = zram_bdev_read_mem(zram, uncmem, blk);
+		} else {
+			ret = zram_decompress_page(zram, uncmem, index);
+			zram_unlock_slot(zram, index);
 		}
+		if (ret)
+			goto out;
 	}
 
-	/*
-	 * System overwrites unused sectors. Free memory associated
-	 * with this sector now.
-	 */
-	if (zram->table[index].page ||
-	    zram_test_flag(zram, index, ZRAM_ZERO))
-		zram_free_page(zram, index);
+	/* May sleep until another writer gives back its stream */
+	strm = zram_strm_get(zram);
 
 	user_mem = kmap_atomic(page);
 
-	if (is_partial_io(bvec))
+	if (is_partial_io(bvec)) {
 		memcpy(uncmem + offset, user_mem + bvec->bv_offset,
 		       bvec->bv_len);
-	else
-		uncmem = user_mem;
+		src = uncmem;
+	} else
+		src = user_mem;
 
-	if (page_zero_filled(uncmem)) {
+	if (page_zero_filled(src)) {
 		kunmap_atomic(user_mem);
-		if (is_partial_io(bvec))
-			kfree(uncmem);
-		zram_stat_inc(&zram->stats.pages_zero);
+
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now.
+		 */
+		zram_lock_slot(zram, index);
+		zram_free_page(zram, index);
 		zram_set_flag(zram, index, ZRAM_ZERO);
-		ret = 0;
+		zram_unlock_slot(zram, index);
+
+		zram_stat_inc(&zram->stats.pages_zero);
 		goto out;
 	}
 
-	COMPRESS(uncmem, PAGE_SIZE, src, &clen,
-		zram->compress_workmem);
-	ret = 0;
+	/*
+	 * An identical page may already be stored. The stream buffer is
+	 * free until we compress, so use it to check candidates.
+	 */
+	if (zram->use_dedup) {
+		checksum = zram_dedup_checksum(src);
+		entry = zram_dedup_find(zram, src, checksum, strm->buffer);
+		if (entry) {
+			kunmap_atomic(user_mem);
+			clen = entry->len;
+			zram_stat_inc(&zram->stats.pages_dedup);
+			zram_stat64_add(zram, &zram->stats.dedup_size, clen);
+			goto store;
+		}
+	}
+
+	ret = zram->comp->compress(src, PAGE_SIZE, strm->buffer, &clen,
+			strm->workmem);
 
 	kunmap_atomic(user_mem);
-	if (is_partial_io(bvec))
-			kfree(uncmem);
 
 	if (unlikely(ret != 0)) {
 		pr_err("Compression failed! err=%d\n", ret);
@@ -435,54 +594,72 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			ret = -ENOMEM;
 			goto out;
 		}
+		incompressible = 1;
 
-		store_offset = 0;
-		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_inc(&zram->stats.pages_expand);
-		zram->table[index].page = page_store;
-		src = kmap_atomic(page);
-		goto memstore;
-	}
-
-	if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-		      &zram->table[index].page, &store_offset,
-		      GFP_NOIO | __GFP_HIGHMEM)) {
-		pr_info("Error allocating memory for compressed "
-			"page: %u, size=%zu\n", index, clen);
-		ret = -ENOMEM;
-		goto out;
-	}
+		src = is_partial_io(bvec) ? uncmem : kmap_atomic(page);
+		cmem = kmap_atomic(page_store);
+		memcpy(cmem, src, clen);
+		kunmap_atomic(cmem);
+		if (!is_partial_io(bvec))
+			kunmap_atomic(src);
+	} else {
+		handle = zs_malloc(zram->mem_pool, clen);
+		if (!handle) {
+			pr_info("Error allocating memory for compressed "
+				"page: %u, size=%zu\n", index, clen);
+			ret = -ENOMEM;
+			goto out;
+		}
 
-memstore:
-	zram->table[index].offset = store_offset;
+		entry = zram_entry_alloc(zram, handle, clen);
+		if (!entry) {
+			zs_free(zram->mem_pool, handle);
+			pr_info("Error allocating entry for compressed "
+				"page: %u\n", index);
+			ret = -ENOMEM;
+			goto out;
+		}
 
-	cmem = kmap_atomic(zram->table[index].page) +
-		zram->table[index].offset;
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+		memcpy(cmem, strm->buffer, clen);
+		zs_unmap_object(zram->mem_pool, handle);
 
-#if 0
-	/* Back-reference needed for memory defragmentation */
-	if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-		zheader = (struct zobj_header *)cmem;
-		zheader->table_idx = index;
-		cmem += sizeof(*zheader);
+		if (zram->use_dedup)
+			zram_dedup_insert(zram, entry, checksum);
 	}
-#endif
 
-	memcpy(cmem, src, clen);
+	zram_stat64_add(zram, &zram->stats.compr_size, clen);
 
-	kunmap_atomic(cmem);
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-		kunmap_atomic(src);
+store:
+	zram_strm_put(zram, strm);
+	strm = NULL;
+
+	/*
+	 * Swap the new object into the slot. Whatever the slot held
+	 * before is freed under the same lock so concurrent readers
+	 * never see a half updated entry.
+	 */
+	zram_lock_slot(zram, index);
+	zram_free_page(zram, index);
+	if (incompressible) {
+		zram->table[index].page = page_store;
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+	} else
+		zram->table[index].entry = entry;
+	zram->table[index].size = clen;
+	zram_unlock_slot(zram, index);
 
 	/* Update stats */
-	zram_stat64_add(zram, &zram->stats.compr_size, clen);
 	zram_stat_inc(&zram->stats.pages_stored);
-	if (clen <= PAGE_SIZE / 2)
+	if (incompressible)
+		zram_stat_inc(&zram->stats.pages_expand);
+	else if (clen <= PAGE_SIZE / 2)
 		zram_stat_inc(&zram->stats.good_compress);
 
-	return 0;
-
 out:
+	if (strm)
+		zram_strm_put(zram, strm);
+	kfree(uncmem);
 	if (ret)
 		zram_stat64_inc(zram, &zram->stats.failed_writes);
 	return ret;
@@ -491,19 +668,10 @@ out:
 static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 			int offset, struct bio *bio, int rw)
 {
-	int ret;
-
-	if (rw == READ) {
-		down_read(&zram->lock);
-		ret = zram_bvec_read(zram, bvec, index, offset, bio);
-		up_read(&zram->lock);
-	} else {
-		down_write(&zram->lock);
-		ret = zram_bvec_write(zram, bvec, index, offset);
-		up_write(&zram->lock);
-	}
+	if (rw == READ)
+		return zram_bvec_read(zram, bvec, index, offset, bio);
 
-	return ret;
+	return zram_bvec_write(zram, bvec, index, offset);
 }
 
 static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
@@ -623,33 +791,30 @@ void __zram_reset_device(struct zram *zram)
 	zram->init_done = 0;
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	zram_strm_destroy(zram);
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
+		struct zram_entry *entry = zram->table[index].entry;
 
-		if (!page)
+		/* Backing device blocks go away with the bitmap */
+		if (!entry || zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
+			__free_page(zram->table[index].page);
 		else
-			xv_free(zram->mem_pool, page, offset);
+			zram_entry_put(zram, entry);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	zram_dedup_fini(zram);
+	zram_reset_bdev(zram);
+
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
@@ -677,18 +842,9 @@ int zram_init_device(struct zram *zram)
 		return 0;
 	}
 
-	zram->compress_workmem = kzalloc(WMSIZE, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail_no_table;
-	}
-
-	zram->compress_buffer =
-		(void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	ret = zram_strm_init(zram);
+	if (ret) {
+		pr_err("Error allocating compression streams\n");
 		goto fail_no_table;
 	}
 
@@ -700,10 +856,17 @@ int zram_init_device(struct zram *zram)
 		goto fail_no_table;
 	}
 
+	ret = zram_dedup_init(zram, num_pages);
+	if (ret) {
+		pr_err("Error allocating dedup index\n");
+		goto fail;
+	}
+
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name,
+					GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -713,7 +876,8 @@ int zram_init_device(struct zram *zram)
 	zram->init_done = 1;
 	up_write(&zram->init_lock);
 
-	pr_debug("Initialization done!\n");
+	pr_debug("Initialization done, using %s with %u streams\n",
+		 zram->comp->name, zram->max_strm);
 	return 0;
 
 fail_no_table:
@@ -726,13 +890,265 @@ fail:
 	return ret;
 }
 
+/*
+ * Decompress up to @max_pages stored pages into a private buffer and
+ * measure every compression backend against them.
+ */
+int zram_bench(struct zram *zram, unsigned int max_pages)
+{
+	int ret = 0;
+	size_t index;
+	unsigned int nr_pages = 0;
+	void *samples;
+	struct zram_bench_result res[ZRAM_MAX_COMPRESSORS];
+
+	max_pages = min_t(unsigned int, max_pages, ZRAM_BENCH_MAX_PAGES);
+	samples = vmalloc(max_pages * PAGE_SIZE);
+	if (!samples)
+		return -ENOMEM;
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done) {
+		up_read(&zram->init_lock);
+		ret = -ENODEV;
+		goto out;
+	}
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT &&
+			nr_pages < max_pages; index++) {
+		zram_lock_slot(zram, index);
+		if (zram->table[index].entry &&
+		    !zram_test_flag(zram, index, ZRAM_WB)) {
+			ret = zram_decompress_page(zram,
+					samples + nr_pages * PAGE_SIZE, index);
+			nr_pages++;
+		}
+		zram_unlock_slot(zram, index);
+		if (ret)
+			break;
+	}
+	up_read(&zram->init_lock);
+
+	if (ret)
+		goto out;
+
+	if (!nr_pages) {
+		ret = -ENODATA;
+		goto out;
+	}
+
+	ret = zram_comp_bench(samples, nr_pages, res);
+	if (ret < 0)
+		goto out;
+
+	spin_lock(&zram->stat64_lock);
+	memset(zram->bench, 0, sizeof(zram->bench));
+	memcpy(zram->bench, res, ret * sizeof(res[0]));
+	zram->bench_nr_pages = nr_pages;
+	spin_unlock(&zram->stat64_lock);
+	ret = 0;
+
+out:
+	vfree(samples);
+	return ret;
+}
+
+/*
+ * Run a zsmalloc compaction pass over the device's pool and return
+ * the number of pages it gave back.
+ */
+unsigned long zram_compact(struct zram *zram)
+{
+	unsigned long pages_freed = 0;
+
+	down_read(&zram->init_lock);
+	if (zram->init_done) {
+		pages_freed = zs_compact(zram->mem_pool);
+		zram_stat64_add(zram, &zram->stats.pages_compacted,
+				pages_freed);
+	}
+	up_read(&zram->init_lock);
+
+	return pages_freed;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Open @path as the device's backing device. Caller holds init_lock
+ * for writing and the device is not initialized yet.
+ */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	int ret;
+	unsigned long nr_pages;
+	struct block_device *bdev;
+
+	if (zram->bdev)
+		return -EBUSY;
+
+	bdev = blkdev_get_by_path(path, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				zram);
+	if (IS_ERR(bdev))
+		return PTR_ERR(bdev);
+
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (nr_pages < 2) {
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	zram->bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	zram->backing_dev = kstrdup(path, GFP_KERNEL);
+	if (!zram->bitmap || !zram->backing_dev) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	zram->bdev = bdev;
+	zram->nr_pages = nr_pages;
+	pr_info("%s: using %s as backing device, %lu pages\n",
+		zram->disk->disk_name, zram->backing_dev, nr_pages);
+
+	return 0;
+
+fail:
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+	kfree(zram->backing_dev);
+	zram->backing_dev = NULL;
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	return ret;
+}
+
+/* Mark every page held in memory idle; any access clears the mark */
+int zram_mark_idle(struct zram *zram)
+{
+	size_t index;
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done) {
+		up_read(&zram->init_lock);
+		return -ENODEV;
+	}
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		zram_lock_slot(zram, index);
+		if (zram->table[index].entry &&
+		    !zram_test_flag(zram, index, ZRAM_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		zram_unlock_slot(zram, index);
+	}
+	up_read(&zram->init_lock);
+
+	return 0;
+}
+
+static int zram_wb_wanted(struct zram *zram, u32 index, unsigned long mode)
+{
+	if (!zram->table[index].entry ||
+	    zram_test_flag(zram, index, ZRAM_WB) ||
+	    zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		return 0;
+
+	if (test_bit(ZRAM_WB_HUGE, &mode) &&
+	    zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))
+		return 1;
+
+	return test_bit(ZRAM_WB_IDLE, &mode) &&
+		zram_test_flag(zram, index, ZRAM_IDLE);
+}
+
+/*
+ * Move the slots selected by the pending modes to the backing device.
+ * Each page is decompressed under its slot lock, written out without
+ * it, and only then swapped in for the in-memory copy, unless the slot
+ * was rewritten or freed meanwhile (which clears ZRAM_UNDER_WB).
+ */
+static void zram_writeback_work(struct work_struct *work)
+{
+	int ret;
+	size_t index;
+	unsigned long mode, blk;
+	struct page *page;
+	struct zram *zram = container_of(work, struct zram, wb_work);
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return;
+
+	down_read(&zram->init_lock);
+	mode = xchg(&zram->wb_pending, 0);
+	if (!zram->init_done || !zram->bdev || !mode)
+		goto out;
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		void *mem;
+
+		zram_lock_slot(zram, index);
+		if (!zram_wb_wanted(zram, index, mode)) {
+			zram_unlock_slot(zram, index);
+			continue;
+		}
+
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		mem = kmap_atomic(page);
+		ret = zram_decompress_page(zram, mem, index);
+		kunmap_atomic(mem);
+		zram_unlock_slot(zram, index);
+
+		blk = 0;
+		if (!ret) {
+			blk = zram_bdev_alloc_blk(zram);
+			if (blk)
+				ret = zram_bdev_rw(zram, page, blk, WRITE);
+		}
+
+		zram_lock_slot(zram, index);
+		if (!blk || ret ||
+		    !zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_unlock_slot(zram, index);
+			if (blk)
+				zram_bdev_free_blk(zram, blk);
+			/* Backing device full, nothing more to do */
+			if (!blk && !ret)
+				break;
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram->table[index].element = blk;
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_unlock_slot(zram, index);
+
+		/* zram_free_page() accounted the page as gone */
+		zram_stat_inc(&zram->stats.pages_stored);
+		zram_stat_inc(&zram->stats.pages_wb);
+
+		cond_resched();
+	}
+out:
+	up_read(&zram->init_lock);
+	__free_page(page);
+}
+
+/* Queue a writeback pass; passes requested while one runs are merged */
+void zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	set_bit(mode, &zram->wb_pending);
+	queue_work(zram_wb_wq, &zram->wb_work);
+}
+#endif
+
 static void zram_slot_free_notify(struct block_device *bdev,
 				unsigned long index)
 {
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	zram_lock_slot(zram, index);
 	zram_free_page(zram, index);
+	zram_unlock_slot(zram, index);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -745,9 +1161,20 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	init_rwsem(&zram->lock);
 	init_rwsem(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	spin_lock_init(&zram->strm_lock);
+	INIT_LIST_HEAD(&zram->idle_strm);
+	init_waitqueue_head(&zram->strm_wait);
+	zram->comp = zram_comp_default();
+	zram->max_strm = num_possible_cpus();
+#ifdef CONFIG_ZRAM_DEDUP
+	zram->use_dedup = 1;
+#endif
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bitmap_lock);
+	INIT_WORK(&zram->wb_work, zram_writeback_work);
+#endif
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -854,12 +1281,33 @@ static int __init zram_init(void)
 		zram_num_devices = 1;
 	}
 
+	zram_entry_cache = kmem_cache_create("zram_entry",
+				sizeof(struct zram_entry), 0, 0, NULL);
+	if (!zram_entry_cache) {
+		ret = -ENOMEM;
+		goto unregister;
+	}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_wb_wq = alloc_workqueue("zram_wb", WQ_MEM_RECLAIM, 1);
+	if (!zram_wb_wq) {
+		ret = -ENOMEM;
+		goto free_cache;
+	}
+	zram_rd_wq = alloc_workqueue("zram_rd", WQ_MEM_RECLAIM, 0);
+	if (!zram_rd_wq) {
+		destroy_workqueue(zram_wb_wq);
+		ret = -ENOMEM;
+		goto free_cache;
+	}
+#endif
+
 	/* Allocate the device array and initialize each one */
 	pr_info("Creating %u devices ...\n", zram_num_devices);
 	zram_devices = kzalloc(zram_num_devices * sizeof(struct zram), GFP_KERNEL);
 	if (!zram_devices) {
 		ret = -ENOMEM;
-		goto unregister;
+		goto free_wq;
 	}
 
 	for (dev_id = 0; dev_id < zram_num_devices; dev_id++) {
@@ -874,6 +1322,13 @@ free_devices:
 	while (dev_id)
 		destroy_device(&zram_devices[--dev_id]);
 	kfree(zram_devices);
+free_wq:
+#ifdef CONFIG_ZRAM_WRITEBACK
+	destroy_workqueue(zram_rd_wq);
+	destroy_workqueue(zram_wb_wq);
+free_cache:
+#endif
+	kmem_cache_destroy(zram_entry_cache);
 unregister:
 	unregister_blkdev(zram_major, "zram");
 out:
@@ -895,7 +1350,12 @@ static void __exit zram_exit(void)
 
 	unregister_blkdev(zram_major, "zram");
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	destroy_workqueue(zram_rd_wq);
+	destroy_workqueue(zram_wb_wq);
+#endif
 	kfree(zram_devices);
+	kmem_cache_destroy(zram_entry_cache);
 	pr_debug("Cleanup done!\n");
 }
 
@@ -17,8 +17,12 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/rbtree.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +30,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -51,8 +43,8 @@ static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -74,18 +66,79 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
 
+	/* Slot lock, see zram_lock_slot() */
+	ZRAM_ACCESS,
+
+	/* Page lives on the backing device */
+	ZRAM_WB,
+
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
+
+	/* Not accessed since the last "echo all > idle" */
+	ZRAM_IDLE,
+
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/* Compression backend, selectable per device through sysfs */
+struct zram_compressor {
+	const char *name;
+	size_t workmem_size;	/* bytes of scratch memory for compress */
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *workmem);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len);
+};
+
+/* Upper bound on the number of compiled-in backends */
+#define ZRAM_MAX_COMPRESSORS	3
+
+/* Pages sampled from a device by one compr_bench run, at most */
+#define ZRAM_BENCH_MAX_PAGES	1024
+
+/* Result of running one backend over the compr_bench samples */
+struct zram_bench_result {
+	const char *name;
+	u64 orig_size;		/* bytes fed to the compressor */
+	u64 compr_size;		/* bytes it produced */
+	u64 compress_ns;
+	u64 decompress_ns;
+	u32 errors;		/* failed or mismatching round trips */
+};
+
+/*
+ * A compressed object in the pool. With dedup enabled, slots holding
+ * identical pages share one entry, which is also linked into the
+ * device's content index under its checksum.
+ */
+struct zram_entry {
+	struct rb_node rb_node;
+	u32 len;		/* compressed size */
+	u32 checksum;		/* of the uncompressed page */
+	unsigned long refcount;	/* slots using it, see zram_dedup_put() */
+	unsigned long handle;	/* zsmalloc handle */
+};
+
+/* One bucket of the dedup index, entries sorted by checksum */
+struct zram_hash {
+	spinlock_t lock;
+	struct rb_root rb_root;
+};
+
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	union {
+		struct zram_entry *entry;
+		struct page *page;	/* for ZRAM_UNCOMPRESSED entries */
+		unsigned long element;	/* backing device block, ZRAM_WB */
+	};
+	u16 size;	/* object size (excluding header) */
 	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
-} __attribute__((aligned(4)));
+	unsigned long flags;	/* word sized for bit_spin_lock() */
+};
 
 struct zram_stats {
 	u64 compr_size;		/* compressed size of pages stored */
@@ -95,20 +148,62 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	u64 pages_compacted;	/* pages freed by compaction */
+	u64 dedup_size;		/* compressed bytes saved by dedup */
+	u64 bd_reads;		/* pages read from the backing device */
+	u64 bd_writes;		/* pages written to the backing device */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+	atomic_t pages_dedup;	/* no. of pages sharing a stored copy */
+	atomic_t pages_wb;	/* no. of pages on the backing device */
+};
+
+/*
+ * Scratch memory for one in-flight compression. Writers borrow a
+ * stream from the device's idle list, so up to max_strm pages can be
+ * compressed in parallel.
+ */
+struct zram_strm {
+	void *workmem;
+	void *buffer;		/* compressed data, 2 pages */
+	struct list_head list;
+	/* Contention stats, protected by zram->strm_lock */
+	u64 nr_uses;		/* writes served by this stream */
+	u64 nr_waits;		/* of which had to wait for a free stream */
+	u64 wait_ns;		/* total time those writers waited */
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
-	struct table *table;
+	struct zs_pool *mem_pool;
+	const struct zram_compressor *comp;
+	struct table *table;	/* entries protected by zram_lock_slot() */
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers and table
-				   * against concurrent read and writes */
+
+	/* Compression streams */
+	struct zram_strm *strm;
+	unsigned int max_strm;
+	struct list_head idle_strm;
+	spinlock_t strm_lock;
+	wait_queue_head_t strm_wait;
+
+	/* Content index for dedup, hash_size buckets */
+	struct zram_hash *hash;
+	size_t hash_size;
+	int use_dedup;
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Backing device, set up through sysfs before init */
+	struct block_device *bdev;
+	char *backing_dev;	/* path it was opened by */
+	unsigned long *bitmap;	/* blocks in use, block 0 is reserved */
+	unsigned long nr_pages;
+	spinlock_t bitmap_lock;
+	struct work_struct wb_work;
+	unsigned long wb_pending;	/* ZRAM_WB_* requests for wb_work */
+#endif
+
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -121,6 +216,10 @@ struct zram {
 	u64 disksize;	/* bytes */
 
 	struct zram_stats stats;
+
+	/* Last compr_bench run, protected by stat64_lock */
+	struct zram_bench_result bench[ZRAM_MAX_COMPRESSORS];
+	unsigned int bench_nr_pages;
 };
 
 extern struct zram *zram_devices;
@@ -131,5 +230,65 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void __zram_reset_device(struct zram *zram);
+extern int zram_bench(struct zram *zram, unsigned int max_pages);
+extern unsigned long zram_compact(struct zram *zram);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Slots picked by a writeback pass, bit numbers in zram->wb_pending */
+enum zram_wb_mode {
+	ZRAM_WB_HUGE,		/* stored uncompressed */
+	ZRAM_WB_IDLE,		/* marked ZRAM_IDLE */
+};
+
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+extern int zram_mark_idle(struct zram *zram);
+#endif
+
+/* zram_comp.c */
+extern int zram_strm_init(struct zram *zram);
+extern void zram_strm_destroy(struct zram *zram);
+extern struct zram_strm *zram_strm_get(struct zram *zram);
+extern void zram_strm_put(struct zram *zram, struct zram_strm *strm);
+extern const struct zram_compressor *zram_comp_default(void);
+extern const struct zram_compressor *zram_comp_find(const char *name);
+extern ssize_t zram_comp_list(const struct zram_compressor *cur, char *buf);
+extern int zram_comp_bench(const void *samples, unsigned int nr_pages,
+			struct zram_bench_result *res);
+
+/* zram_dedup.c */
+#ifdef CONFIG_ZRAM_DEDUP
+extern int zram_dedup_init(struct zram *zram, size_t num_pages);
+extern void zram_dedup_fini(struct zram *zram);
+extern u32 zram_dedup_checksum(const unsigned char *mem);
+extern struct zram_entry *zram_dedup_find(struct zram *zram,
+			const unsigned char *mem, u32 checksum, void *buf);
+extern void zram_dedup_insert(struct zram *zram, struct zram_entry *entry,
+			u32 checksum);
+extern unsigned long zram_dedup_put(struct zram *zram,
+			struct zram_entry *entry);
+#else
+static inline int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	return 0;
+}
+static inline void zram_dedup_fini(struct zram *zram) { }
+static inline u32 zram_dedup_checksum(const unsigned char *mem)
+{
+	return 0;
+}
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+			const unsigned char *mem, u32 checksum, void *buf)
+{
+	return NULL;
+}
+static inline void zram_dedup_insert(struct zram *zram,
+			struct zram_entry *entry, u32 checksum) { }
+static inline unsigned long zram_dedup_put(struct zram *zram,
+			struct zram_entry *entry)
+{
+	return --entry->refcount;
+}
+#endif
 
 #endif
@@ -14,7 +14,10 @@
 
 #include <linux/device.h>
 #include <linux/genhd.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
 
 #include "zram_drv.h"
 
@@ -118,6 +121,313 @@ static ssize_t reset_store(struct device *dev,
 	return len;
 }
 
+static ssize_t comp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return zram_comp_list(zram->comp, buf);
+}
+
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	const struct zram_compressor *comp;
+	struct zram *zram = dev_to_zram(dev);
+
+	comp = zram_comp_find(buf);
+	if (!comp)
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		pr_info("Cannot change compressor for initialized device\n");
+		return -EBUSY;
+	}
+
+	zram->comp = comp;
+	up_write(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t max_comp_streams_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", zram->max_strm);
+}
+
+static ssize_t max_comp_streams_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned int num;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = kstrtouint(buf, 10, &num);
+	if (ret)
+		return ret;
+
+	if (!num)
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		pr_info("Cannot change max_comp_streams for initialized "
+			"device\n");
+		return -EBUSY;
+	}
+
+	zram->max_strm = num;
+	up_write(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%d\n", zram->use_dedup);
+}
+
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned short val;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = kstrtou16(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		pr_info("Cannot change use_dedup for initialized device\n");
+		return -EBUSY;
+	}
+
+	zram->use_dedup = !!val;
+	up_write(&zram->init_lock);
+
+	return len;
+}
+#else
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	return -EINVAL;
+}
+#endif
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	ssize_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = sprintf(buf, "%s\n",
+		zram->backing_dev ? zram->backing_dev : "none");
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	char *path;
+	struct zram *zram = dev_to_zram(dev);
+
+	path = kstrndup(buf, PATH_MAX, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+	strim(path);
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		kfree(path);
+		pr_info("Cannot change backing_dev for initialized device\n");
+		return -EBUSY;
+	}
+
+	ret = zram_set_backing_dev(zram, path);
+	up_write(&zram->init_lock);
+	kfree(path);
+
+	return ret ? ret : len;
+}
+
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	ret = zram_mark_idle(zram);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	if (!zram->init_done || !zram->bdev)
+		return -ENODEV;
+
+	if (sysfs_streq(buf, "huge"))
+		zram_writeback(zram, ZRAM_WB_HUGE);
+	else if (sysfs_streq(buf, "idle"))
+		zram_writeback(zram, ZRAM_WB_IDLE);
+	else
+		return -EINVAL;
+
+	return len;
+}
+
+static ssize_t wb_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", atomic_read(&zram->stats.pages_wb));
+}
+
+static ssize_t bd_reads_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.bd_reads));
+}
+
+static ssize_t bd_writes_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.bd_writes));
+}
+#endif
+
+/*
+ * One line per compression stream: writes served, how many of those
+ * had to wait for a free stream, and the total time spent waiting.
+ */
+static ssize_t comp_streams_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	unsigned int i;
+	ssize_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	sz = scnprintf(buf, PAGE_SIZE, "%-6s %12s %12s %12s\n", "stream",
+			"uses", "waits", "wait_us");
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done)
+		goto out;
+
+	for (i = 0; i < zram->max_strm; i++) {
+		struct zram_strm *strm = &zram->strm[i];
+		u64 uses, waits, wait_ns;
+
+		spin_lock(&zram->strm_lock);
+		uses = strm->nr_uses;
+		waits = strm->nr_waits;
+		wait_ns = strm->wait_ns;
+		spin_unlock(&zram->strm_lock);
+
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz,
+				"%-6u %12llu %12llu %12llu\n", i, uses, waits,
+				div_u64(wait_ns, NSEC_PER_USEC));
+	}
+out:
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+/* Bytes per nanosecond, scaled to MB/s */
+static u64 zram_bench_rate(u64 bytes, u64 ns)
+{
+	return ns ? div64_u64(bytes * 1000, ns) : 0;
+}
+
+static ssize_t compr_bench_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int i;
+	ssize_t sz;
+	unsigned int nr_pages;
+	struct zram_bench_result res[ZRAM_MAX_COMPRESSORS];
+	struct zram *zram = dev_to_zram(dev);
+
+	spin_lock(&zram->stat64_lock);
+	memcpy(res, zram->bench, sizeof(res));
+	nr_pages = zram->bench_nr_pages;
+	spin_unlock(&zram->stat64_lock);
+
+	sz = scnprintf(buf, PAGE_SIZE, "pages: %u\n", nr_pages);
+	sz += scnprintf(buf + sz, PAGE_SIZE - sz,
+			"%-8s %12s %12s %8s %8s\n", "algo", "comp_MB/s",
+			"decomp_MB/s", "ratio%", "errors");
+
+	for (i = 0; i < ZRAM_MAX_COMPRESSORS && res[i].name; i++) {
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz,
+			"%-8s %12llu %12llu %8llu %8u\n", res[i].name,
+			zram_bench_rate(res[i].orig_size, res[i].compress_ns),
+			zram_bench_rate(res[i].orig_size, res[i].decompress_ns),
+			res[i].orig_size ? div64_u64(res[i].compr_size * 100,
+						res[i].orig_size) : 0,
+			res[i].errors);
+	}
+
+	return sz;
+}
+
+static ssize_t compr_bench_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned int max_pages;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = kstrtouint(buf, 10, &max_pages);
+	if (ret)
+		return ret;
+
+	if (!max_pages)
+		return -EINVAL;
+
+	ret = zram_bench(zram, max_pages);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
 static ssize_t num_reads_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -159,7 +469,24 @@ static ssize_t zero_pages_show(struct device *dev,
 {
 	struct zram *zram = dev_to_zram(dev);
 
-	return sprintf(buf, "%u\n", zram->stats.pages_zero);
+	return sprintf(buf, "%u\n", atomic_read(&zram->stats.pages_zero));
+}
+
+static ssize_t dedup_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", atomic_read(&zram->stats.pages_dedup));
+}
+
+static ssize_t dedup_data_size_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.dedup_size));
 }
 
 static ssize_t orig_data_size_show(struct device *dev,
@@ -168,7 +495,7 @@ static ssize_t orig_data_size_show(struct device *dev,
 	struct zram *zram = dev_to_zram(dev);
 
 	return sprintf(buf, "%llu\n",
-		(u64)(zram->stats.pages_stored) << PAGE_SHIFT);
+		(u64)atomic_read(&zram->stats.pages_stored) << PAGE_SHIFT);
 }
 
 static ssize_t compr_data_size_show(struct device *dev,
@@ -187,38 +514,155 @@ static ssize_t mem_used_total_show(struct device *dev,
 	struct zram *zram = dev_to_zram(dev);
 
 	if (zram->init_done) {
-		val = xv_get_total_size_bytes(zram->mem_pool) +
-			((u64)(zram->stats.pages_expand) << PAGE_SHIFT);
+		val = zs_get_total_size_bytes(zram->mem_pool) +
+			((u64)atomic_read(&zram->stats.pages_expand)
+				<< PAGE_SHIFT);
 	}
 
 	return sprintf(buf, "%llu\n", val);
 }
 
+static ssize_t compact_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned short do_compact;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = kstrtou16(buf, 10, &do_compact);
+	if (ret)
+		return ret;
+
+	if (!do_compact)
+		return -EINVAL;
+
+	zram_compact(zram);
+
+	return len;
+}
+
+static ssize_t pages_compacted_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.pages_compacted));
+}
+
+/*
+ * Per size class occupancy of the compressed object allocator,
+ * followed by how many pages it pins per MB of compressed data.
+ */
+static ssize_t alloc_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int i;
+	ssize_t sz;
+	u64 compr, used = 0, objs = 0, inuse = 0;
+	struct zs_class_stats cs;
+	struct zram *zram = dev_to_zram(dev);
+
+	sz = scnprintf(buf, PAGE_SIZE, "%5s %6s %6s %8s %8s %8s\n",
+			"size", "pages", "objs", "zspages", "alloced",
+			"inuse");
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done)
+		goto out;
+
+	for (i = 0; !zs_get_class_stats(zram->mem_pool, i, &cs); i++) {
+		if (!cs.nr_zspages)
+			continue;
+
+		used += (u64)cs.nr_zspages * cs.pages_per_zspage;
+		objs += (u64)cs.nr_zspages * cs.objs_per_zspage;
+		inuse += cs.objs_inuse;
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz,
+				"%5u %6u %6u %8u %8u %8u\n", cs.size,
+				cs.pages_per_zspage, cs.objs_per_zspage,
+				cs.nr_zspages,
+				cs.nr_zspages * cs.objs_per_zspage,
+				cs.objs_inuse);
+	}
+
+	compr = zram_stat64_read(zram, &zram->stats.compr_size);
+	sz += scnprintf(buf + sz, PAGE_SIZE - sz,
+			"total: %llu pages, %llu/%llu objs in use, "
+			"%llu pages per MB compressed\n", used, inuse, objs,
+			compr ? div64_u64(used << 20, compr) : 0);
+out:
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
 static DEVICE_ATTR(disksize, S_IRUGO | S_IWUSR,
 		disksize_show, disksize_store);
 static DEVICE_ATTR(initstate, S_IRUGO, initstate_show, NULL);
 static DEVICE_ATTR(reset, S_IWUSR, NULL, reset_store);
+static DEVICE_ATTR(comp_algorithm, S_IRUGO | S_IWUSR,
+		comp_algorithm_show, comp_algorithm_store);
+static DEVICE_ATTR(compr_bench, S_IRUGO | S_IWUSR,
+		compr_bench_show, compr_bench_store);
+static DEVICE_ATTR(max_comp_streams, S_IRUGO | S_IWUSR,
+		max_comp_streams_show, max_comp_streams_store);
+static DEVICE_ATTR(comp_streams, S_IRUGO, comp_streams_show, NULL);
+static DEVICE_ATTR(use_dedup, S_IRUGO | S_IWUSR,
+		use_dedup_show, use_dedup_store);
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR(backing_dev, S_IRUGO | S_IWUSR,
+		backing_dev_show, backing_dev_store);
+static DEVICE_ATTR(idle, S_IWUSR, NULL, idle_store);
+static DEVICE_ATTR(writeback, S_IWUSR, NULL, writeback_store);
+static DEVICE_ATTR(wb_pages, S_IRUGO, wb_pages_show, NULL);
+static DEVICE_ATTR(bd_reads, S_IRUGO, bd_reads_show, NULL);
+static DEVICE_ATTR(bd_writes, S_IRUGO, bd_writes_show, NULL);
+#endif
 static DEVICE_ATTR(num_reads, S_IRUGO, num_reads_show, NULL);
 static DEVICE_ATTR(num_writes, S_IRUGO, num_writes_show, NULL);
 static DEVICE_ATTR(invalid_io, S_IRUGO, invalid_io_show, NULL);
 static DEVICE_ATTR(notify_free, S_IRUGO, notify_free_show, NULL);
 static DEVICE_ATTR(zero_pages, S_IRUGO, zero_pages_show, NULL);
+static DEVICE_ATTR(dedup_pages, S_IRUGO, dedup_pages_show, NULL);
+static DEVICE_ATTR(dedup_data_size, S_IRUGO, dedup_data_size_show, NULL);
 static DEVICE_ATTR(orig_data_size, S_IRUGO, orig_data_size_show, NULL);
 static DEVICE_ATTR(compr_data_size, S_IRUGO, compr_data_size_show, NULL);
 static DEVICE_ATTR(mem_used_total, S_IRUGO, mem_used_total_show, NULL);
+static DEVICE_ATTR(compact, S_IWUSR, NULL, compact_store);
+static DEVICE_ATTR(pages_compacted, S_IRUGO, pages_compacted_show, NULL);
+static DEVICE_ATTR(alloc_stats, S_IRUGO, alloc_stats_show, NULL);
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
 	&dev_attr_initstate.attr,
 	&dev_attr_reset.attr,
+	&dev_attr_comp_algorithm.attr,
+	&dev_attr_compr_bench.attr,
+	&dev_attr_max_comp_streams.attr,
+	&dev_attr_comp_streams.attr,
+	&dev_attr_use_dedup.attr,
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_idle.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_wb_pages.attr,
+	&dev_attr_bd_reads.attr,
+	&dev_attr_bd_writes.attr,
+#endif
 	&dev_attr_num_reads.attr,
 	&dev_attr_num_writes.attr,
 	&dev_attr_invalid_io.attr,
 	&dev_attr_notify_free.attr,
 	&dev_attr_zero_pages.attr,
+	&dev_attr_dedup_pages.attr,
+	&dev_attr_dedup_data_size.attr,
 	&dev_attr_orig_data_size.attr,
 	&dev_attr_compr_data_size.attr,
 	&dev_attr_mem_used_total.attr,
+	&dev_attr_compact.attr,
+	&dev_attr_pages_compacted.attr,
+	&dev_attr_alloc_stats.attr,
 	NULL,
 };
 
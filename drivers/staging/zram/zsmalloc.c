@@ -0,0 +1,781 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * zsmalloc is a size class allocator for compressed pages. Objects of
+ * similar size are packed into zspages: groups of 1..4 order-0 (possibly
+ * highmem) pages, sized so the tail waste of each class is minimal.
+ * Unlike xvmalloc, whose free space fragments into unusable holes once
+ * the object size mix shifts, a zspage is returned to the system as
+ * soon as its last object is freed, and zs_compact() moves objects out
+ * of sparsely used zspages to make that happen.
+ *
+ * Objects are addressed through handles (see zsmalloc_int.h) and must
+ * be mapped with zs_map_object() to be accessed.
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bit_spinlock.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static struct kmem_cache *zs_handle_cache;
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * Pick the zspage size (in pages) that wastes the smallest fraction
+ * of memory for the given object size.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size = i * PAGE_SIZE;
+		int waste = zspage_size % class_size;
+		int usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static struct zspage *get_zspage(struct page *page)
+{
+	return (struct zspage *)page_private(page);
+}
+
+static unsigned long location_to_obj(struct zspage *zspage,
+				unsigned int idx)
+{
+	unsigned long obj;
+
+	obj = page_to_pfn(zspage->pages[0]) << OBJ_INDEX_BITS;
+	obj |= idx & OBJ_INDEX_MASK;
+
+	return obj << OBJ_TAG_BITS;
+}
+
+static void obj_to_location(unsigned long obj, struct zspage **zspage,
+				unsigned int *idx)
+{
+	obj >>= OBJ_TAG_BITS;
+	*zspage = get_zspage(pfn_to_page(obj >> OBJ_INDEX_BITS));
+	*idx = obj & OBJ_INDEX_MASK;
+}
+
+static unsigned long handle_to_obj(unsigned long handle)
+{
+	return *(unsigned long *)handle & ~BIT(HANDLE_PIN_BIT);
+}
+
+static void pin_tag(unsigned long handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(unsigned long handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_tag(unsigned long handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+/* Locate object @idx of @zspage as <page, offset in page> */
+static struct page *obj_page(struct size_class *class, struct zspage *zspage,
+				unsigned int idx, unsigned int *off)
+{
+	unsigned long zsoff = (unsigned long)idx * class->size;
+
+	*off = zsoff & ~PAGE_MASK;
+	return zspage->pages[zsoff >> PAGE_SHIFT];
+}
+
+/*
+ * Object headers never straddle pages: every object offset is a
+ * multiple of ZS_SIZE_CLASS_DELTA, which is a multiple of the header
+ * size.
+ */
+static unsigned long get_obj_head(struct size_class *class,
+				struct zspage *zspage, unsigned int idx)
+{
+	unsigned int off;
+	unsigned long head;
+	void *addr;
+
+	addr = kmap_atomic(obj_page(class, zspage, idx, &off));
+	head = *(unsigned long *)(addr + off);
+	kunmap_atomic(addr);
+
+	return head;
+}
+
+static void set_obj_head(struct size_class *class, struct zspage *zspage,
+				unsigned int idx, unsigned long head)
+{
+	unsigned int off;
+	void *addr;
+
+	addr = kmap_atomic(obj_page(class, zspage, idx, &off));
+	*(unsigned long *)(addr + off) = head;
+	kunmap_atomic(addr);
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+	unsigned int max_objects = class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max_objects)
+		return ZS_FULL;
+	if (inuse <= max_objects * ZS_ALMOST_FULL_NUM / ZS_ALMOST_FULL_DEN)
+		return ZS_ALMOST_EMPTY;
+
+	return ZS_ALMOST_FULL;
+}
+
+static void insert_zspage(struct size_class *class, struct zspage *zspage,
+				enum fullness_group fullness)
+{
+	zspage->fullness = fullness;
+	if (fullness < _ZS_NR_FULLNESS_GROUPS)
+		list_add_tail(&zspage->list, &class->fullness_list[fullness]);
+}
+
+static void remove_zspage(struct size_class *class, struct zspage *zspage)
+{
+	if (zspage->fullness < _ZS_NR_FULLNESS_GROUPS)
+		list_del_init(&zspage->list);
+	zspage->fullness = ZS_FULL;
+}
+
+static void free_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *zspage)
+{
+	int i;
+
+	BUG_ON(zspage->inuse);
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		set_page_private(zspage->pages[i], 0);
+		__free_page(zspage->pages[i]);
+	}
+	kfree(zspage);
+
+	class->nr_zspages--;
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+}
+
+/*
+ * Allocate a zspage and thread all of its objects on the free list.
+ * Called without the class lock; may sleep depending on pool->flags.
+ */
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+				struct size_class *class)
+{
+	int i;
+	unsigned int idx;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage), pool->flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		struct page *page = alloc_page(pool->flags);
+
+		if (!page)
+			goto fail;
+		set_page_private(page, (unsigned long)zspage);
+		zspage->pages[i] = page;
+	}
+
+	for (idx = 0; idx < class->objs_per_zspage; idx++) {
+		unsigned long next = 0;
+
+		if (idx + 1 < class->objs_per_zspage)
+			next = (idx + 2) << OBJ_TAG_BITS;
+		set_obj_head(class, zspage, idx, next);
+	}
+	zspage->freeobj = 0;
+
+	return zspage;
+
+fail:
+	while (i--) {
+		set_page_private(zspage->pages[i], 0);
+		__free_page(zspage->pages[i]);
+	}
+	kfree(zspage);
+	return NULL;
+}
+
+/* Take a free object off @zspage's free list. Class lock held. */
+static unsigned int obj_alloc(struct size_class *class, struct zspage *zspage)
+{
+	unsigned int idx = zspage->freeobj;
+	unsigned long head;
+
+	BUG_ON(zspage->freeobj < 0);
+
+	head = get_obj_head(class, zspage, idx);
+	zspage->freeobj = (int)(head >> OBJ_TAG_BITS) - 1;
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	return idx;
+}
+
+/* Put object @idx back on @zspage's free list. Class lock held. */
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int idx)
+{
+	set_obj_head(class, zspage, idx,
+			(unsigned long)(zspage->freeobj + 1) << OBJ_TAG_BITS);
+	zspage->freeobj = idx;
+	zspage->inuse--;
+	class->objs_inuse--;
+}
+
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int i;
+	struct zspage *zspage;
+
+	for (i = 0; i < _ZS_NR_FULLNESS_GROUPS; i++) {
+		if (list_empty(&class->fullness_list[i]))
+			continue;
+
+		zspage = list_first_entry(&class->fullness_list[i],
+					struct zspage, list);
+		remove_zspage(class, zspage);
+		return zspage;
+	}
+
+	return NULL;
+}
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @name: name of the pool to be created
+ * @flags: allocation flags used when growing pool
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
+{
+	int i, j;
+	struct zs_pool *pool;
+
+	pool = vzalloc(sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+						PAGE_SIZE / class->size;
+		spin_lock_init(&class->lock);
+		for (j = 0; j < _ZS_NR_FULLNESS_GROUPS; j++)
+			INIT_LIST_HEAD(&class->fullness_list[j]);
+	}
+
+	pool->name = name;
+	pool->flags = flags;
+	atomic_long_set(&pool->pages_allocated, 0);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		if (pool->size_class[i].nr_zspages)
+			pr_info("Freeing non-empty class with size %db\n",
+				pool->size_class[i].size);
+	}
+
+	vfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * will fail.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size)
+{
+	unsigned int idx;
+	unsigned long handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	size += ZS_HANDLE_SIZE;
+	if (unlikely(size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	handle = (unsigned long)kmem_cache_alloc(zs_handle_cache,
+					pool->flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	class = &pool->size_class[get_size_class_index(size)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(pool, class);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(zs_handle_cache, (void *)handle);
+			return 0;
+		}
+
+		spin_lock(&class->lock);
+		class->nr_zspages++;
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+	}
+
+	idx = obj_alloc(class, zspage);
+	set_obj_head(class, zspage, idx, handle | OBJ_ALLOCATED_TAG);
+	*(unsigned long *)handle = location_to_obj(zspage, idx);
+
+	insert_zspage(class, zspage, get_fullness_group(class, zspage));
+	spin_unlock(&class->lock);
+
+	return handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned int idx;
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fullness;
+
+	if (unlikely(!handle))
+		return;
+
+	/* A pinned object cannot be moved, so its zspage is stable */
+	pin_tag(handle);
+	obj_to_location(handle_to_obj(handle), &zspage, &idx);
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	remove_zspage(class, zspage);
+	obj_free(class, zspage, idx);
+
+	fullness = get_fullness_group(class, zspage);
+	if (fullness == ZS_EMPTY)
+		free_zspage(pool, class, zspage);
+	else
+		insert_zspage(class, zspage, fullness);
+	spin_unlock(&class->lock);
+
+	unpin_tag(handle);
+	kmem_cache_free(zs_handle_cache, (void *)handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: how the returned memory is going to be accessed
+ *
+ * The object is pinned until zs_unmap_object() so compaction cannot
+ * move it. Like kmap_atomic(), this disables preemption and only one
+ * object may be mapped at a time on each CPU.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	unsigned int idx, off;
+	struct size_class *class;
+	struct zspage *zspage;
+	struct mapping_area *area;
+	struct page *page;
+	unsigned int first;
+
+	pin_tag(handle);
+	obj_to_location(handle_to_obj(handle), &zspage, &idx);
+	class = zspage->class;
+	page = obj_page(class, zspage, idx, &off);
+
+	area = &get_cpu_var(zs_map_area);
+	area->vm_mm = mm;
+
+	if (off + class->size <= PAGE_SIZE) {
+		/* This object lies within a single page */
+		area->vm_addr = kmap_atomic(page);
+		return area->vm_addr + off + ZS_HANDLE_SIZE;
+	}
+
+	/* Bounce the two halves through the per-cpu buffer */
+	area->vm_addr = NULL;
+	area->pages[0] = page;
+	area->pages[1] = zspage->pages[((unsigned long)idx * class->size >>
+					PAGE_SHIFT) + 1];
+	area->off = off;
+	area->size = class->size;
+
+	first = PAGE_SIZE - off;
+	if (mm != ZS_MM_WO) {
+		void *addr;
+
+		addr = kmap_atomic(area->pages[0]);
+		memcpy(area->vm_buf, addr + off, first);
+		kunmap_atomic(addr);
+		addr = kmap_atomic(area->pages[1]);
+		memcpy(area->vm_buf + first, addr, class->size - first);
+		kunmap_atomic(addr);
+	}
+
+	return area->vm_buf + ZS_HANDLE_SIZE;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct mapping_area *area;
+
+	area = &__get_cpu_var(zs_map_area);
+	if (area->vm_addr) {
+		kunmap_atomic(area->vm_addr);
+		area->vm_addr = NULL;
+	} else if (area->vm_mm != ZS_MM_RO) {
+		unsigned int first = PAGE_SIZE - area->off;
+		void *addr;
+
+		/*
+		 * The header was not part of what the caller was given
+		 * (and is not even copied in for ZS_MM_WO), so copy back
+		 * only the payload. It never straddles, see get_obj_head().
+		 */
+		addr = kmap_atomic(area->pages[0]);
+		memcpy(addr + area->off + ZS_HANDLE_SIZE,
+			area->vm_buf + ZS_HANDLE_SIZE, first - ZS_HANDLE_SIZE);
+		kunmap_atomic(addr);
+		addr = kmap_atomic(area->pages[1]);
+		memcpy(addr, area->vm_buf + first, area->size - first);
+		kunmap_atomic(addr);
+	}
+	put_cpu_var(zs_map_area);
+
+	unpin_tag(handle);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/* Copy object @sidx of @src over object @didx of @dst, header included */
+static void zs_object_copy(struct size_class *class,
+			struct zspage *dst, unsigned int didx,
+			struct zspage *src, unsigned int sidx)
+{
+	unsigned long soff = (unsigned long)sidx * class->size;
+	unsigned long doff = (unsigned long)didx * class->size;
+	unsigned int left = class->size;
+
+	while (left) {
+		unsigned int s = soff & ~PAGE_MASK;
+		unsigned int d = doff & ~PAGE_MASK;
+		unsigned int len = min3(left, (unsigned int)PAGE_SIZE - s,
+					(unsigned int)PAGE_SIZE - d);
+		void *saddr, *daddr;
+
+		saddr = kmap_atomic(src->pages[soff >> PAGE_SHIFT]);
+		daddr = kmap_atomic(dst->pages[doff >> PAGE_SHIFT]);
+		memcpy(daddr + d, saddr + s, len);
+		kunmap_atomic(daddr);
+		kunmap_atomic(saddr);
+
+		soff += len;
+		doff += len;
+		left -= len;
+	}
+}
+
+/* Number of zspages compaction could give back in this class */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_wasted;
+
+	obj_wasted = class->nr_zspages * class->objs_per_zspage -
+			class->objs_inuse;
+
+	return obj_wasted / class->objs_per_zspage;
+}
+
+/*
+ * Move allocated objects of @src, starting at *@idx, into free slots of
+ * @dst. Pinned (mapped or being freed) objects are skipped. Returns
+ * -ENOSPC with *@idx updated if @dst fills up first. Class lock held.
+ */
+static int migrate_zspage(struct size_class *class, struct zspage *src,
+			struct zspage *dst, unsigned int *idx)
+{
+	for (; *idx < class->objs_per_zspage; (*idx)++) {
+		unsigned long head, handle;
+		unsigned int didx;
+
+		if (src->inuse == 0)
+			break;
+
+		head = get_obj_head(class, src, *idx);
+		if (!(head & OBJ_ALLOCATED_TAG))
+			continue;
+
+		if (dst->inuse == class->objs_per_zspage)
+			return -ENOSPC;
+
+		handle = head & ~OBJ_ALLOCATED_TAG;
+		if (!trypin_tag(handle))
+			continue;
+
+		didx = obj_alloc(class, dst);
+		zs_object_copy(class, dst, didx, src, *idx);
+		/* Keep the pin bit as is, unpin_tag() drops it */
+		*(unsigned long *)handle = location_to_obj(dst, didx) |
+			(*(unsigned long *)handle & BIT(HANDLE_PIN_BIT));
+		obj_free(class, src, *idx);
+		unpin_tag(handle);
+	}
+
+	return 0;
+}
+
+/*
+ * Take a zspage off the partial lists: sources are picked from the
+ * sparsest group first, destinations from the fullest.
+ */
+static struct zspage *isolate_zspage(struct size_class *class, int source)
+{
+	int i;
+	struct zspage *zspage;
+	enum fullness_group fg[2] = { ZS_ALMOST_EMPTY, ZS_ALMOST_FULL };
+
+	if (!source) {
+		fg[0] = ZS_ALMOST_FULL;
+		fg[1] = ZS_ALMOST_EMPTY;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (list_empty(&class->fullness_list[fg[i]]))
+			continue;
+
+		zspage = list_first_entry(&class->fullness_list[fg[i]],
+					struct zspage, list);
+		remove_zspage(class, zspage);
+		return zspage;
+	}
+
+	return NULL;
+}
+
+static void putback_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *zspage)
+{
+	enum fullness_group fullness = get_fullness_group(class, zspage);
+
+	if (fullness == ZS_EMPTY)
+		free_zspage(pool, class, zspage);
+	else
+		insert_zspage(class, zspage, fullness);
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				struct size_class *class)
+{
+	unsigned long pages_freed = 0;
+	unsigned int nr_to_scan;
+	struct zspage *src, *dst;
+
+	spin_lock(&class->lock);
+
+	/* Each zspage is tried as a source at most once per pass */
+	nr_to_scan = class->nr_zspages;
+	while (nr_to_scan-- && zs_can_compact(class)) {
+		unsigned int idx = 0;
+
+		src = isolate_zspage(class, 1);
+		if (!src)
+			break;
+
+		while ((dst = isolate_zspage(class, 0))) {
+			int ret = migrate_zspage(class, src, dst, &idx);
+
+			putback_zspage(pool, class, dst);
+			if (!ret)
+				break;
+		}
+
+		if (src->inuse == 0)
+			pages_freed += class->pages_per_zspage;
+		putback_zspage(pool, class, src);
+
+		/* Nowhere left to move objects to */
+		if (!dst)
+			break;
+
+		spin_unlock(&class->lock);
+		cond_resched();
+		spin_lock(&class->lock);
+	}
+
+	spin_unlock(&class->lock);
+
+	return pages_freed;
+}
+
+/**
+ * zs_compact - Move objects out of sparsely used zspages
+ * @pool: pool to compact
+ *
+ * Returns the number of pages given back to the system.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages_freed = 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++)
+		pages_freed += zs_compact_class(pool, &pool->size_class[i]);
+
+	return pages_freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/*
+ * Returns total memory used by allocator (userdata + metadata)
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+int zs_get_class_stats(struct zs_pool *pool, int index,
+			struct zs_class_stats *stats)
+{
+	struct size_class *class;
+
+	if (index < 0 || index >= ZS_SIZE_CLASSES)
+		return -EINVAL;
+
+	class = &pool->size_class[index];
+
+	spin_lock(&class->lock);
+	stats->size = class->size;
+	stats->pages_per_zspage = class->pages_per_zspage;
+	stats->objs_per_zspage = class->objs_per_zspage;
+	stats->nr_zspages = class->nr_zspages;
+	stats->objs_inuse = class->objs_inuse;
+	spin_unlock(&class->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(zs_get_class_stats);
+
+static void zs_cleanup(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zs_map_area, cpu).vm_buf);
+		per_cpu(zs_map_area, cpu).vm_buf = NULL;
+	}
+
+	if (zs_handle_cache)
+		kmem_cache_destroy(zs_handle_cache);
+}
+
+static int __init zs_init(void)
+{
+	int cpu;
+
+	/* Aligned so that bit 0 is free for OBJ_ALLOCATED_TAG */
+	zs_handle_cache = kmem_cache_create("zs_handle", ZS_HANDLE_SIZE,
+					ZS_HANDLE_SIZE, 0, NULL);
+	if (!zs_handle_cache)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		char *buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+
+		if (!buf) {
+			zs_cleanup();
+			return -ENOMEM;
+		}
+		per_cpu(zs_map_area, cpu).vm_buf = buf;
+	}
+
+	return 0;
+}
+module_init(zs_init);
@@ -0,0 +1,56 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_H_
+#define _ZS_MALLOC_H_
+
+#include <linux/types.h>
+
+/*
+ * How a mapped object is going to be accessed. Objects that straddle
+ * two pages are bounced through a per-cpu buffer; the mode tells
+ * zs_unmap_object() whether that buffer has to be copied back.
+ */
+enum zs_mapmode {
+	ZS_MM_RW,	/* normal read-write mapping */
+	ZS_MM_RO,	/* read-only (no copy-out at unmap time) */
+	ZS_MM_WO	/* write-only */
+};
+
+/* Per size class snapshot, see zs_get_class_stats() */
+struct zs_class_stats {
+	u32 size;		/* object size, including the handle header */
+	u32 pages_per_zspage;
+	u32 objs_per_zspage;
+	u32 nr_zspages;		/* zspages currently allocated */
+	u32 objs_inuse;		/* objects handed out */
+};
+
+struct zs_pool;
+
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags);
+void zs_destroy_pool(struct zs_pool *pool);
+
+unsigned long zs_malloc(struct zs_pool *pool, size_t size);
+void zs_free(struct zs_pool *pool, unsigned long handle);
+
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm);
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle);
+
+unsigned long zs_compact(struct zs_pool *pool);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool);
+int zs_get_class_stats(struct zs_pool *pool, int index,
+			struct zs_class_stats *stats);
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/* User configurable params */
+
+/*
+ * A zspage is a group of up to ZS_MAX_PAGES_PER_ZSPAGE order-0 pages
+ * that are carved into equally sized objects. Objects may straddle the
+ * boundary between two pages of the same zspage.
+ */
+#define ZS_MAX_ZSPAGE_ORDER	2
+#define ZS_MAX_PAGES_PER_ZSPAGE	(1 << ZS_MAX_ZSPAGE_ORDER)
+
+/* Must be a multiple of sizeof(unsigned long) */
+#define ZS_MIN_ALLOC_SHIFT	5
+#define ZS_MIN_ALLOC_SIZE	(1 << ZS_MIN_ALLOC_SHIFT)
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/*
+ * Size classes are separated by ZS_SIZE_CLASS_DELTA bytes,
+ * 16 bytes for 4k pages.
+ */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) \
+					/ ZS_SIZE_CLASS_DELTA + 1)
+
+/*
+ * A zspage becomes "almost empty" once at most this fraction of its
+ * objects are in use, which makes it a compaction source.
+ */
+#define ZS_ALMOST_FULL_NUM	3
+#define ZS_ALMOST_FULL_DEN	4
+
+/* End of user params */
+
+/*
+ * Every object starts with a header word. For allocated objects it is
+ * the handle, tagged with OBJ_ALLOCATED_TAG; this back-reference lets
+ * compaction find and update the handle when the object moves. Free
+ * objects instead hold (index of next free object + 1) << OBJ_TAG_BITS,
+ * 0 terminating the free list.
+ */
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+#define OBJ_ALLOCATED_TAG	1UL
+#define OBJ_TAG_BITS		1
+
+/*
+ * A handle points to a word holding the encoded object location:
+ * (pfn of the zspage's first page, object index) << OBJ_TAG_BITS.
+ * Bit 0 of that word is the pin lock held while the object is mapped
+ * or being freed, which keeps compaction from moving it.
+ */
+#define HANDLE_PIN_BIT		0
+#define OBJ_INDEX_BITS		(PAGE_SHIFT + ZS_MAX_ZSPAGE_ORDER - \
+					ZS_MIN_ALLOC_SHIFT)
+#define OBJ_INDEX_MASK		((1UL << OBJ_INDEX_BITS) - 1)
+
+enum fullness_group {
+	ZS_ALMOST_FULL,
+	ZS_ALMOST_EMPTY,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY,
+	ZS_FULL
+};
+
+struct size_class;
+
+struct zspage {
+	struct list_head list;		/* in class->fullness_list */
+	struct size_class *class;
+	unsigned int inuse;		/* objects in use */
+	int freeobj;			/* first free object, -1 if none */
+	enum fullness_group fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+struct size_class {
+	spinlock_t lock;
+	/* zspages with free objects; full ones are not on any list */
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	u32 size;			/* object size, including header */
+	u32 pages_per_zspage;
+	u32 objs_per_zspage;
+
+	/* stats, protected by lock */
+	u32 nr_zspages;
+	u32 objs_inuse;
+};
+
+struct zs_pool {
+	const char *name;
+	gfp_t flags;			/* for page allocations */
+	atomic_long_t pages_allocated;
+	struct size_class size_class[ZS_SIZE_CLASSES];
+};
+
+/* Per-cpu bounce buffer for objects that straddle two pages */
+struct mapping_area {
+	char *vm_buf;			/* PAGE_SIZE bytes */
+	char *vm_addr;			/* kmap address, NULL when bounced */
+	struct page *pages[2];		/* pages of the bounced object */
+	unsigned int off;		/* object offset in pages[0] */
+	unsigned int size;		/* object size */
+	enum zs_mapmode vm_mm;
+};
+
+#endif
@@ -54,6 +54,10 @@
 #define RX_REQ_MAX 2
 #define INTR_REQ_MAX 5
 
+/* most bulk requests that can be asked for with the parameters below */
+#define MTP_TX_REQS_LIMIT 32
+#define MTP_RX_REQS_LIMIT 32
+
 /* ID for Microsoft MTP OS String */
 #define MTP_OS_STRING_ID   0xEE
 
@@ -69,6 +73,29 @@
 
 static const char mtp_shortname[] = "mtp_usb";
 
+/*
+ * Size and number of the bulk requests used for file transfers, applied
+ * when the function is bound. With several large requests queued the
+ * controller keeps moving data while the file is read or written. If
+ * the buffers cannot be allocated, TX_REQ_MAX/RX_REQ_MAX requests of
+ * MTP_BULK_BUFFER_SIZE are used as before.
+ */
+static unsigned int mtp_tx_req_len = 65536;
+module_param(mtp_tx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_req_len, "Size of the MTP IN requests");
+
+static unsigned int mtp_tx_reqs = 8;
+module_param(mtp_tx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_reqs, "Number of MTP IN requests");
+
+static unsigned int mtp_rx_req_len = 65536;
+module_param(mtp_rx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_req_len, "Size of the MTP OUT requests");
+
+static unsigned int mtp_rx_reqs = 4;
+module_param(mtp_rx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_reqs, "Number of MTP OUT requests");
+
 struct mtp_dev {
 	struct usb_function function;
 	struct usb_composite_dev *cdev;
@@ -91,8 +118,13 @@ struct mtp_dev {
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
 	wait_queue_head_t intr_wq;
-	struct usb_request *rx_req[RX_REQ_MAX];
+	struct usb_request *rx_req[MTP_RX_REQS_LIMIT];
+	/* OUT requests completed, in queue order */
 	int rx_done;
+	unsigned rx_reqs;
+
+	unsigned tx_req_len;
+	unsigned rx_req_len;
 
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
@@ -361,7 +393,7 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
 
-	dev->rx_done = 1;
+	dev->rx_done++;
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
@@ -388,6 +420,7 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	struct usb_composite_dev *cdev = dev->cdev;
 	struct usb_request *req;
 	struct usb_ep *ep;
+	unsigned tx_reqs;
 	int i;
 
 	DBG(cdev, "create_bulk_endpoints dev: %p\n", dev);
@@ -420,17 +453,40 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	dev->ep_intr = ep;
 
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+	tx_reqs = clamp_t(unsigned, mtp_tx_reqs, 2, MTP_TX_REQS_LIMIT);
+	dev->tx_req_len = ALIGN(max_t(unsigned, mtp_tx_req_len,
+				      MTP_BULK_BUFFER_SIZE), PAGE_SIZE);
+retry_tx_alloc:
+	for (i = 0; i < tx_reqs; i++) {
+		req = mtp_request_new(dev->ep_in, dev->tx_req_len);
+		if (!req) {
+			if (dev->tx_req_len == MTP_BULK_BUFFER_SIZE)
+				goto fail;
+			while ((req = mtp_req_get(dev, &dev->tx_idle)))
+				mtp_request_free(req, dev->ep_in);
+			dev->tx_req_len = MTP_BULK_BUFFER_SIZE;
+			tx_reqs = TX_REQ_MAX;
+			goto retry_tx_alloc;
+		}
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+
+	dev->rx_reqs = clamp_t(unsigned, mtp_rx_reqs, 2, MTP_RX_REQS_LIMIT);
+	dev->rx_req_len = ALIGN(max_t(unsigned, mtp_rx_req_len,
+				      MTP_BULK_BUFFER_SIZE), PAGE_SIZE);
+retry_rx_alloc:
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = mtp_request_new(dev->ep_out, dev->rx_req_len);
+		if (!req) {
+			if (dev->rx_req_len == MTP_BULK_BUFFER_SIZE)
+				goto fail;
+			while (--i >= 0)
+				mtp_request_free(dev->rx_req[i], dev->ep_out);
+			dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
+			dev->rx_reqs = RX_REQ_MAX;
+			goto retry_rx_alloc;
+		}
 		req->complete = mtp_complete_out;
 		dev->rx_req[i] = req;
 	}
@@ -460,7 +516,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "mtp_read(%d)\n", count);
 
-	if (count > MTP_BULK_BUFFER_SIZE)
+	if (count > dev->rx_req_len)
 		return -EINVAL;
 
 	/* we will block until we're online */
@@ -590,8 +646,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -682,8 +738,8 @@ static void send_file_work(struct work_struct *data) {
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -729,16 +785,40 @@ static void send_file_work(struct work_struct *data) {
 	smp_wmb();
 }
 
-/* read from USB and write to a local file */
+/* take back the OUT requests still queued, newest first */
+static void mtp_rx_flush(struct mtp_dev *dev, int head, int inflight,
+			 int completed)
+{
+	int i;
+
+	for (i = inflight - 1; i >= 0; i--)
+		usb_ep_dequeue(dev->ep_out,
+			dev->rx_req[(head + i) % dev->rx_reqs]);
+
+	/* they must be ours again before the next transfer queues them */
+	wait_event_timeout(dev->read_wq, dev->rx_done >= completed + inflight,
+			   msecs_to_jiffies(1000));
+}
+
+/* read from USB and write to a local file
+ *
+ * Up to rx_reqs OUT requests are kept queued, so the controller goes on
+ * receiving while the last buffer is written out. When the length is not
+ * known (0xFFFFFFFF, for files over 4 gig) only one request is queued at
+ * a time, since the short packet ending the transfer may come in any of
+ * them and the next one would take data from the following transaction.
+ */
 static void receive_file_work(struct work_struct *data)
 {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
 	loff_t offset;
-	int64_t count;
-	int ret, cur_buf = 0;
+	int64_t count, to_queue;
+	int head = 0, tail = 0, inflight = 0, completed = 0;
+	unsigned depth;
+	int ret;
 	int r = 0;
 
 	/* read our parameters */
@@ -749,64 +829,71 @@ static void receive_file_work(struct work_struct *data)
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
+	depth = count == 0xFFFFFFFF ? 1 : dev->rx_reqs;
+	to_queue = count;
+	dev->rx_done = 0;
 
-			read_req->length = (count > MTP_BULK_BUFFER_SIZE
-					? MTP_BULK_BUFFER_SIZE : count);
-			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
+	while (count > 0) {
+		/* keep the controller queue full */
+		while (to_queue > 0 && inflight < depth) {
+			req = dev->rx_req[tail];
+			req->length = (to_queue > dev->rx_req_len
+					? dev->rx_req_len : to_queue);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 			if (ret < 0) {
 				r = -EIO;
 				if (dev->state != STATE_OFFLINE)
 					dev->state = STATE_ERROR;
-				break;
+				goto out;
 			}
+			tail = (tail + 1) % dev->rx_reqs;
+			inflight++;
+			if (count != 0xFFFFFFFF)
+				to_queue -= req->length;
 		}
 
-		if (write_req) {
-			DBG(cdev, "rx %p %d\n", write_req, write_req->actual);
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			DBG(cdev, "vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
-				r = -EIO;
-				if (dev->state != STATE_OFFLINE)
-					dev->state = STATE_ERROR;
-				break;
-			}
-			write_req = NULL;
+		/* wait for the oldest one to complete */
+		req = dev->rx_req[head];
+		ret = wait_event_interruptible(dev->read_wq,
+			dev->rx_done > completed || dev->state != STATE_BUSY);
+		if (dev->state == STATE_CANCELED) {
+			r = -ECANCELED;
+			goto out;
 		}
+		if (ret < 0 || dev->state != STATE_BUSY) {
+			r = ret < 0 ? ret : -EIO;
+			goto out;
+		}
+		head = (head + 1) % dev->rx_reqs;
+		inflight--;
+		completed++;
 
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			/* if xfer_file_length is 0xFFFFFFFF, then we read until
-			 * we get a zero length packet
-			 */
-			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/* short packet is used to signal EOF for sizes > 4 gig */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
+		/* if xfer_file_length is 0xFFFFFFFF, then we read until
+		 * we get a zero length packet
+		 */
+		if (count != 0xFFFFFFFF)
+			count -= req->actual;
+		if (req->actual < req->length) {
+			/* short packet is used to signal EOF for sizes > 4 gig */
+			DBG(cdev, "got short packet\n");
+			count = 0;
+		}
 
-			write_req = read_req;
-			read_req = NULL;
+		DBG(cdev, "rx %p %d\n", req, req->actual);
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		DBG(cdev, "vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			if (dev->state != STATE_OFFLINE)
+				dev->state = STATE_ERROR;
+			goto out;
 		}
 	}
 
+out:
+	if (inflight)
+		mtp_rx_flush(dev, head, inflight, completed);
+
 	DBG(cdev, "receive_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -1121,7 +1208,7 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < dev->rx_reqs; i++)
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
@@ -100,6 +100,17 @@ struct f_rndis {
 	atomic_t			notify_count;
 };
 
+/* packet messages per transfer, IN up to the host's MaxTransferSize */
+static unsigned int rndis_dl_max_pkt_per_xfer = 3;
+module_param(rndis_dl_max_pkt_per_xfer, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rndis_dl_max_pkt_per_xfer,
+	"Maximum packets per transfer for DL aggregation");
+
+static unsigned int rndis_ul_max_pkt_per_xfer = 3;
+module_param(rndis_ul_max_pkt_per_xfer, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rndis_ul_max_pkt_per_xfer,
+	"Maximum packets per transfer for UL aggregation");
+
 static inline struct f_rndis *func_to_rndis(struct usb_function *f)
 {
 	return container_of(f, struct f_rndis, port.func);
@@ -402,15 +413,12 @@ static void rndis_command_complete(struct usb_ep *ep, struct usb_request *req)
 
 	buf = (rndis_init_msg_type *)req->buf;
 
-	if (buf->MessageType == REMOTE_NDIS_INITIALIZE_MSG) {
-		if (buf->MaxTransferSize > 2048)
-			rndis->port.multi_pkt_xfer = 1;
-		else
-			rndis->port.multi_pkt_xfer = 0;
-		DBG(cdev, "%s: MaxTransferSize: %d : Multi_pkt_txr: %s\n",
-				__func__, buf->MaxTransferSize,
-				rndis->port.multi_pkt_xfer ? "enabled" :
-							    "disabled");
+	/* the host's limit on the transfers we send it */
+	if (buf->MessageType == cpu_to_le32(REMOTE_NDIS_INITIALIZE_MSG)) {
+		rndis->port.dl_max_xfer_size =
+			le32_to_cpu(buf->MaxTransferSize);
+		DBG(cdev, "%s: MaxTransferSize: %d\n", __func__,
+				rndis->port.dl_max_xfer_size);
 	}
 //	spin_unlock(&dev->lock);
 }
@@ -721,6 +729,7 @@ rndis_bind(struct usb_configuration *c, struct usb_function *f)
 
 	rndis_set_param_medium(rndis->config, NDIS_MEDIUM_802_3, 0);
 	rndis_set_host_mac(rndis->config, rndis->ethaddr);
+	rndis_set_max_pkt_xfer(rndis->config, rndis->port.ul_max_pkts_per_xfer);
 
 	if (rndis_set_param_vendor(rndis->config, rndis->vendorID,
 				   rndis->manufacturer))
@@ -857,6 +866,11 @@ rndis_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN],
 	rndis->port.header_len = sizeof(struct rndis_packet_msg_type);
 	rndis->port.wrap = rndis_add_header;
 	rndis->port.unwrap = rndis_rm_hdr;
+	/* what the host is told must match what u_ether does */
+	rndis->port.dl_max_pkts_per_xfer = clamp_t(u32,
+		rndis_dl_max_pkt_per_xfer, 1, RNDIS_MAX_PKTS_PER_XFER);
+	rndis->port.ul_max_pkts_per_xfer = clamp_t(u32,
+		rndis_ul_max_pkt_per_xfer, 1, RNDIS_MAX_PKTS_PER_XFER);
 
 	rndis->port.func.name = "rndis";
 	rndis->port.func.strings = rndis_strings;
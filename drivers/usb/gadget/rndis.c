@@ -605,8 +605,8 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 	resp->MinorVersion = cpu_to_le32(RNDIS_MINOR_VERSION);
 	resp->DeviceFlags = cpu_to_le32(RNDIS_DF_CONNECTIONLESS);
 	resp->Medium = cpu_to_le32(RNDIS_MEDIUM_802_3);
-	resp->MaxPacketsPerTransfer = cpu_to_le32(TX_SKB_HOLD_THRESHOLD);
-	resp->MaxTransferSize = cpu_to_le32(TX_SKB_HOLD_THRESHOLD *
+	resp->MaxPacketsPerTransfer = cpu_to_le32(params->max_pkt_per_xfer);
+	resp->MaxTransferSize = cpu_to_le32(params->max_pkt_per_xfer *
 		(params->dev->mtu
 		+ sizeof(struct ethhdr)
 		+ sizeof(struct rndis_packet_msg_type)
@@ -920,6 +920,7 @@ int rndis_register(void (*resp_avail)(void *v), void *v)
 	for (i = 0; i < RNDIS_MAX_CONFIGS; i++) {
 		if (!rndis_per_dev_params[i].used) {
 			rndis_per_dev_params[i].used = 1;
+			rndis_per_dev_params[i].max_pkt_per_xfer = 1;
 			rndis_per_dev_params[i].resp_avail = resp_avail;
 			rndis_per_dev_params[i].v = v;
 			pr_debug("%s: configNr = %d\n", __func__, i);
@@ -975,6 +976,15 @@ int rndis_set_param_medium(u8 configNr, u32 medium, u32 speed)
 	return 0;
 }
 
+void rndis_set_max_pkt_xfer(u8 configNr, u32 max_pkt_per_xfer)
+{
+	pr_debug("%s: %u\n", __func__, max_pkt_per_xfer);
+	if (configNr >= RNDIS_MAX_CONFIGS) return;
+
+	rndis_per_dev_params[configNr].max_pkt_per_xfer =
+		clamp_t(u32, max_pkt_per_xfer, 1, RNDIS_MAX_PKTS_PER_XFER);
+}
+
 void rndis_add_hdr(struct sk_buff *skb)
 {
 	struct rndis_packet_msg_type *header;
@@ -1043,30 +1053,63 @@ static rndis_resp_t *rndis_add_response(int configNr, u32 length)
 	return r;
 }
 
+/*
+ * A transfer may hold up to max_pkt_per_xfer packet messages back to
+ * back; each but the last is passed up as a clone of the transfer.
+ */
 int rndis_rm_hdr(struct gether *port,
 			struct sk_buff *skb,
 			struct sk_buff_head *list)
 {
-	/* tmp points to a struct rndis_packet_msg_type */
-	__le32 *tmp = (void *)skb->data;
+	struct sk_buff	*skb2;
+	bool		first = true;
+
+	for (;;) {
+		/* tmp points to a struct rndis_packet_msg_type */
+		__le32	*tmp = (void *)skb->data;
+		u32	msg_len, data_offset, data_len;
+
+		/* a short packet may end in a byte of padding */
+		if (skb->len < sizeof(struct rndis_packet_msg_type)) {
+			dev_kfree_skb_any(skb);
+			return first ? -EINVAL : 0;
+		}
 
-	/* MessageType, MessageLength */
-	if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
-			!= get_unaligned(tmp++)) {
-		dev_kfree_skb_any(skb);
-		return -EINVAL;
-	}
-	tmp++;
+		/* MessageType, MessageLength */
+		if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
+				!= get_unaligned(tmp++)) {
+			dev_kfree_skb_any(skb);
+			return -EINVAL;
+		}
+		msg_len = get_unaligned_le32(tmp++);
+
+		/* DataOffset, DataLength */
+		data_offset = get_unaligned_le32(tmp++) + 8;
+		data_len = get_unaligned_le32(tmp++);
+		if (data_offset > skb->len || data_len > skb->len - data_offset) {
+			dev_kfree_skb_any(skb);
+			return -EOVERFLOW;
+		}
 
-	/* DataOffset, DataLength */
-	if (!skb_pull(skb, get_unaligned_le32(tmp++) + 8)) {
-		dev_kfree_skb_any(skb);
-		return -EOVERFLOW;
-	}
-	skb_trim(skb, get_unaligned_le32(tmp++));
+		if (msg_len >= skb->len || msg_len < data_offset + data_len) {
+			skb_pull(skb, data_offset);
+			skb_trim(skb, data_len);
+			skb_queue_tail(list, skb);
+			return 0;
+		}
 
-	skb_queue_tail(list, skb);
-	return 0;
+		skb2 = skb_clone(skb, GFP_ATOMIC);
+		if (!skb2) {
+			dev_kfree_skb_any(skb);
+			return -ENOMEM;
+		}
+		skb_pull(skb2, data_offset);
+		skb_trim(skb2, data_len);
+		skb_queue_tail(list, skb2);
+
+		skb_pull(skb, msg_len);
+		first = false;
+	}
 }
 
 #ifdef CONFIG_USB_GADGET_DEBUG_FILES
@@ -72,9 +72,13 @@ struct eth_dev {
 #define TX_REQ_THRESHOLD	5
 	int			no_tx_req_used;
 	int			tx_skb_hold_count;
+	/* size of each TX request's own buffer when aggregating, else 0 */
 	u32			tx_req_bufsize;
 
+	/* completed OUT transfers, and the frames unwrapped from them */
+	struct sk_buff_head	rx_done;
 	struct sk_buff_head	rx_frames;
+	struct napi_struct	napi;
 
 	unsigned		header_len;
 	struct sk_buff		*(*wrap)(struct gether *, struct sk_buff *skb);
@@ -108,6 +112,10 @@ MODULE_PARM_DESC(qmult, "queue length multiplier at high speed");
 #define qmult		1
 #endif
 
+static unsigned rx_budget = 64;
+module_param(rx_budget, uint, S_IRUGO);
+MODULE_PARM_DESC(rx_budget, "frames passed up per NAPI poll");
+
 /* for dual-speed hardware, use deeper queues at highspeed */
 static inline int qlen(struct usb_gadget *gadget)
 {
@@ -216,11 +224,13 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	size_t		size = 0;
 	struct usb_ep	*out;
 	unsigned long	flags;
+	u32		max_pkts = 1;
 
 	spin_lock_irqsave(&dev->lock, flags);
-	if (dev->port_usb)
+	if (dev->port_usb) {
 		out = dev->port_usb->out_ep;
-	else
+		max_pkts = max_t(u32, dev->port_usb->ul_max_pkts_per_xfer, 1);
+	} else
 		out = NULL;
 	spin_unlock_irqrestore(&dev->lock, flags);
 
@@ -242,6 +252,7 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	 */
 	size += sizeof(struct ethhdr) + dev->net->mtu + RX_EXTRA;
 	size += dev->port_usb->header_len;
+	size *= max_pkts;
 	size += out->maxpacket - 1;
 	size -= size % out->maxpacket;
 
@@ -282,56 +293,18 @@ enomem:
 
 static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 {
-	struct sk_buff	*skb = req->context, *skb2;
+	struct sk_buff	*skb = req->context;
 	struct eth_dev	*dev = ep->driver_data;
 	int		status = req->status;
 
 	switch (status) {
 
-	/* normal completion */
+	/* normal completion; eth_poll() unwraps and passes it up */
 	case 0:
 		skb_put(skb, req->actual);
-
-		if (dev->unwrap) {
-			unsigned long	flags;
-
-			spin_lock_irqsave(&dev->lock, flags);
-			if (dev->port_usb) {
-				status = dev->unwrap(dev->port_usb,
-							skb,
-							&dev->rx_frames);
-			} else {
-				dev_kfree_skb_any(skb);
-				status = -ENOTCONN;
-			}
-			spin_unlock_irqrestore(&dev->lock, flags);
-		} else {
-			skb_queue_tail(&dev->rx_frames, skb);
-		}
+		skb_queue_tail(&dev->rx_done, skb);
+		napi_schedule(&dev->napi);
 		skb = NULL;
-
-		skb2 = skb_dequeue(&dev->rx_frames);
-		while (skb2) {
-			if (status < 0
-					|| ETH_HLEN > skb2->len
-					|| skb2->len > ETH_FRAME_LEN) {
-				dev->net->stats.rx_errors++;
-				dev->net->stats.rx_length_errors++;
-				DBG(dev, "rx length %d\n", skb2->len);
-				dev_kfree_skb_any(skb2);
-				goto next_frame;
-			}
-			skb2->protocol = eth_type_trans(skb2, dev->net);
-			dev->net->stats.rx_packets++;
-			dev->net->stats.rx_bytes += skb2->len;
-
-			/* no buffer copies needed, unless hardware can't
-			 * use skb buffers.
-			 */
-			status = netif_rx(skb2);
-next_frame:
-			skb2 = skb_dequeue(&dev->rx_frames);
-		}
 		break;
 
 	/* software-driven interface shutdown */
@@ -361,7 +334,12 @@ quiesce:
 
 	if (skb)
 		dev_kfree_skb_any(skb);
-	if (!netif_running(dev->net)) {
+
+	/* with a queue's worth of transfers not yet polled, let eth_poll()
+	 * catch up and requeue the request itself
+	 */
+	if (!netif_running(dev->net) ||
+			skb_queue_len(&dev->rx_done) > qlen(dev->gadget)) {
 clean:
 		spin_lock(&dev->req_lock);
 		list_add(&req->list, &dev->rx_reqs);
@@ -453,6 +431,74 @@ static void rx_fill(struct eth_dev *dev, gfp_t gfp_flags)
 	spin_unlock_irqrestore(&dev->req_lock, flags);
 }
 
+static int eth_poll(struct napi_struct *napi, int budget)
+{
+	struct eth_dev	*dev = container_of(napi, struct eth_dev, napi);
+	struct sk_buff	*skb;
+	unsigned long	flags;
+	int		status;
+	int		work = 0;
+
+	while (work < budget) {
+		skb = skb_dequeue(&dev->rx_frames);
+		if (!skb) {
+			/* split the next transfer into frames */
+			skb = skb_dequeue(&dev->rx_done);
+			if (!skb)
+				break;
+
+			if (!dev->unwrap) {
+				skb_queue_tail(&dev->rx_frames, skb);
+				continue;
+			}
+
+			spin_lock_irqsave(&dev->lock, flags);
+			if (dev->port_usb) {
+				status = dev->unwrap(dev->port_usb,
+							skb,
+							&dev->rx_frames);
+			} else {
+				dev_kfree_skb_any(skb);
+				status = -ENOTCONN;
+			}
+			spin_unlock_irqrestore(&dev->lock, flags);
+			if (status < 0) {
+				dev->net->stats.rx_errors++;
+				DBG(dev, "rx unwrap %d\n", status);
+			}
+			continue;
+		}
+
+		if (ETH_HLEN > skb->len || skb->len > ETH_FRAME_LEN) {
+			dev->net->stats.rx_errors++;
+			dev->net->stats.rx_length_errors++;
+			DBG(dev, "rx length %d\n", skb->len);
+			dev_kfree_skb_any(skb);
+			continue;
+		}
+		skb->protocol = eth_type_trans(skb, dev->net);
+		dev->net->stats.rx_packets++;
+		dev->net->stats.rx_bytes += skb->len;
+
+		/* no buffer copies needed, unless hardware can't
+		 * use skb buffers.
+		 */
+		netif_receive_skb(skb);
+		work++;
+	}
+
+	/* requeue what rx_complete() held back while we were behind */
+	if (netif_running(dev->net))
+		rx_fill(dev, GFP_ATOMIC);
+
+	if (work < budget) {
+		napi_complete(napi);
+		if (!skb_queue_empty(&dev->rx_done))
+			napi_schedule(napi);
+	}
+	return work;
+}
+
 static void eth_work(struct work_struct *work)
 {
 	struct eth_dev	*dev = container_of(work, struct eth_dev, work);
@@ -466,15 +512,37 @@ static void eth_work(struct work_struct *work)
 		DBG(dev, "work done, flags = 0x%lx\n", dev->todo);
 }
 
+/* set up the length of an IN transfer, following the framing's zlp rules */
+static void tx_set_length(struct eth_dev *dev, struct gether *port,
+		struct usb_ep *in, struct usb_request *req, int length)
+{
+	/* NCM requires no zlp if transfer is dwNtbInMaxSize */
+	if (port->is_fixed &&
+	    length == port->fixed_in_len &&
+	    (length % in->maxpacket) == 0)
+		req->zero = 0;
+	else
+		req->zero = 1;
+
+	/* use zlp framing on tx for strict CDC-Ether conformance,
+	 * though any robust network rx path ignores extra padding.
+	 * and some hardware doesn't like to write zlps.
+	 */
+	if (req->zero && !dev->zlp && (length % in->maxpacket) == 0) {
+		req->zero = 0;
+		length++;
+	}
+
+	req->length = length;
+}
+
 static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct sk_buff	*skb = req->context;
 	struct eth_dev	*dev = ep->driver_data;
-	struct net_device *net = dev->net;
-	struct usb_request *new_req;
-	struct usb_ep *in;
-	int length;
-	int retval;
+	struct usb_request *held = NULL;
+	struct gether	*port;
+	int		retval;
 
 	switch (req->status) {
 	default:
@@ -485,72 +553,60 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 	case -ESHUTDOWN:		/* disconnect etc */
 		break;
 	case 0:
-		if (!req->zero)
-			dev->net->stats.tx_bytes += req->length-1;
-		else
-			dev->net->stats.tx_bytes += req->length;
+		/* aggregated frames were counted as they were copied */
+		if (skb)
+			dev->net->stats.tx_bytes += skb->len;
 	}
-	dev->net->stats.tx_packets++;
+	if (skb)
+		dev->net->stats.tx_packets++;
 
 	spin_lock(&dev->req_lock);
-	list_add_tail(&req->list, &dev->tx_reqs);
-
-	if (dev->port_usb->multi_pkt_xfer) {
+	if (!skb) {
 		dev->no_tx_req_used--;
 		req->length = 0;
-		in = dev->port_usb->in_ep;
 
+		/* a request eth_start_xmit() is gathering frames in waits
+		 * at the head of the freelist for a completion to send it
+		 */
 		if (!list_empty(&dev->tx_reqs)) {
-			new_req = container_of(dev->tx_reqs.next,
+			held = container_of(dev->tx_reqs.next,
 					struct usb_request, list);
-			list_del(&new_req->list);
-			spin_unlock(&dev->req_lock);
-			if (new_req->length > 0) {
-				length = new_req->length;
-
-				/* NCM requires no zlp if transfer is
-				 * dwNtbInMaxSize */
-				if (dev->port_usb->is_fixed &&
-					length == dev->port_usb->fixed_in_len &&
-					(length % in->maxpacket) == 0)
-					new_req->zero = 0;
-				else
-					new_req->zero = 1;
-
-				/* use zlp framing on tx for strict CDC-Ether
-				 * conformance, though any robust network rx
-				 * path ignores extra padding. and some hardware
-				 * doesn't like to write zlps.
-				 */
-				if (new_req->zero && !dev->zlp &&
-						(length % in->maxpacket) == 0) {
-					new_req->zero = 0;
-					length++;
-				}
-
-				new_req->length = length;
-				retval = usb_ep_queue(in, new_req, GFP_ATOMIC);
-				switch (retval) {
-				default:
-					DBG(dev, "tx queue err %d\n", retval);
-					break;
-				case 0:
-					spin_lock(&dev->req_lock);
-					dev->no_tx_req_used++;
-					spin_unlock(&dev->req_lock);
-					net->trans_start = jiffies;
-				}
+			if (held->length) {
+				list_del(&held->list);
+				dev->tx_skb_hold_count = 0;
+				dev->no_tx_req_used++;
 			} else {
-				spin_lock(&dev->req_lock);
-				list_add(&new_req->list, &dev->tx_reqs);
-				spin_unlock(&dev->req_lock);
+				held = NULL;
 			}
-		} else {
-			spin_unlock(&dev->req_lock);
 		}
-	} else {
-		spin_unlock(&dev->req_lock);
+	}
+	list_add_tail(&req->list, &dev->tx_reqs);
+	spin_unlock(&dev->req_lock);
+
+	if (skb)
 		dev_kfree_skb_any(skb);
+
+	if (held) {
+		spin_lock(&dev->lock);
+		port = dev->port_usb;
+		spin_unlock(&dev->lock);
+
+		retval = -ENOTCONN;
+		if (port) {
+			tx_set_length(dev, port, ep, held, held->length);
+			retval = usb_ep_queue(ep, held, GFP_ATOMIC);
+		}
+		if (retval) {
+			DBG(dev, "tx queue err %d\n", retval);
+			dev->net->stats.tx_dropped++;
+			spin_lock(&dev->req_lock);
+			dev->no_tx_req_used--;
+			held->length = 0;
+			list_add_tail(&held->list, &dev->tx_reqs);
+			spin_unlock(&dev->req_lock);
+		} else {
+			dev->net->trans_start = jiffies;
+		}
 	}
 
 	if (netif_carrier_ok(dev->net))
@@ -562,24 +618,42 @@ static inline int is_promisc(u16 cdc_filter)
 	return cdc_filter & USB_CDC_PACKET_TYPE_PROMISCUOUS;
 }
 
-static void alloc_tx_buffer(struct eth_dev *dev)
+static void free_tx_buffer(struct eth_dev *dev)
 {
-	struct list_head	*act;
 	struct usb_request	*req;
 
-	dev->tx_req_bufsize = (TX_SKB_HOLD_THRESHOLD *
-				(dev->net->mtu
-				+ sizeof(struct ethhdr)
-				/* size of rndis_packet_msg_type */
-				+ 44
-				+ 22));
-
-	list_for_each(act, &dev->tx_reqs) {
-		req = container_of(act, struct usb_request, list);
-		if (!req->buf)
-			req->buf = kmalloc(dev->tx_req_bufsize,
-						GFP_ATOMIC);
+	list_for_each_entry(req, &dev->tx_reqs, list) {
+		kfree(req->buf);
+		req->buf = NULL;
 	}
+	dev->tx_req_bufsize = 0;
+}
+
+/* give each TX request a buffer to gather frames in; caller holds req_lock */
+static int alloc_tx_buffer(struct eth_dev *dev, struct gether *link)
+{
+	struct usb_request	*req;
+	u32			size;
+
+	/* the largest frames the link can wrap, and a byte to pad the
+	 * transfer with in place of a zlp
+	 */
+	size = link->dl_max_pkts_per_xfer *
+		(dev->net->mtu + ETH_HLEN + link->header_len) + 1;
+
+	list_for_each_entry(req, &dev->tx_reqs, list) {
+		req->buf = NULL;
+		req->length = 0;
+	}
+	list_for_each_entry(req, &dev->tx_reqs, list) {
+		req->buf = kmalloc(size, GFP_ATOMIC);
+		if (!req->buf) {
+			free_tx_buffer(dev);
+			return -ENOMEM;
+		}
+	}
+	dev->tx_req_bufsize = size;
+	return 0;
 }
 
 static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
@@ -590,13 +664,18 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	int			retval;
 	struct usb_request	*req = NULL;
 	unsigned long		flags;
+	struct gether		*port;
 	struct usb_ep		*in;
 	u16			cdc_filter;
+	u32			max_pkts = 0, max_len = 0;
 
 	spin_lock_irqsave(&dev->lock, flags);
-	if (dev->port_usb) {
-		in = dev->port_usb->in_ep;
-		cdc_filter = dev->port_usb->cdc_filter;
+	port = dev->port_usb;
+	if (port) {
+		in = port->in_ep;
+		cdc_filter = port->cdc_filter;
+		max_pkts = port->dl_max_pkts_per_xfer;
+		max_len = port->dl_max_xfer_size;
 	} else {
 		in = NULL;
 		cdc_filter = 0;
@@ -608,10 +687,6 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		return NETDEV_TX_OK;
 	}
 
-	/* Allocate memory for tx_reqs to support multi packet transfer */
-	if (dev->port_usb->multi_pkt_xfer && !dev->tx_req_bufsize)
-		alloc_tx_buffer(dev);
-
 	/* apply outgoing CDC or RNDIS filters */
 	if (!is_promisc(cdc_filter)) {
 		u8		*dest = skb->data;
@@ -668,31 +743,42 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 			goto drop;
 	}
 
-	spin_lock_irqsave(&dev->req_lock, flags);
-	dev->tx_skb_hold_count++;
-	spin_unlock_irqrestore(&dev->req_lock, flags);
+	if (dev->tx_req_bufsize) {
+		/* the last byte is kept for padding */
+		u32	limit = dev->tx_req_bufsize - 1;
+		u32	frame = net->mtu + ETH_HLEN + dev->header_len;
+
+		if (max_len && max_len - 1 < limit)
+			limit = max_len - 1;
+
+		if (req->length + skb->len > dev->tx_req_bufsize - 1) {
+			dev_kfree_skb_any(skb);
+			goto drop;
+		}
 
-	if (dev->port_usb->multi_pkt_xfer) {
 		memcpy(req->buf + req->length, skb->data, skb->len);
-		req->length = req->length + skb->len;
-		length = req->length;
+		req->length += skb->len;
+		req->context = NULL;
+		dev->net->stats.tx_packets++;
+		dev->net->stats.tx_bytes += skb->len;
 		dev_kfree_skb_any(skb);
 
+		/* keep gathering only while enough other transfers are
+		 * queued that one of their completions will send this one
+		 */
 		spin_lock_irqsave(&dev->req_lock, flags);
-		if (dev->tx_skb_hold_count < TX_SKB_HOLD_THRESHOLD) {
-			if (dev->no_tx_req_used > TX_REQ_THRESHOLD) {
-				list_add(&req->list, &dev->tx_reqs);
-				spin_unlock_irqrestore(&dev->req_lock, flags);
-				goto success;
-			}
+		if (++dev->tx_skb_hold_count < max_pkts &&
+		    req->length + frame <= limit &&
+		    dev->no_tx_req_used > TX_REQ_THRESHOLD) {
+			list_add(&req->list, &dev->tx_reqs);
+			spin_unlock_irqrestore(&dev->req_lock, flags);
+			goto success;
 		}
-
+		dev->tx_skb_hold_count = 0;
 		dev->no_tx_req_used++;
 		spin_unlock_irqrestore(&dev->req_lock, flags);
 
-		spin_lock_irqsave(&dev->lock, flags);
-		dev->tx_skb_hold_count = 0;
-		spin_unlock_irqrestore(&dev->lock, flags);
+		length = req->length;
 	} else {
 		length = skb->len;
 		req->buf = skb->data;
@@ -700,28 +786,12 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	}
 
 	req->complete = tx_complete;
+	tx_set_length(dev, port, in, req, length);
 
-	/* NCM requires no zlp if transfer is dwNtbInMaxSize */
-	if (dev->port_usb->is_fixed &&
-	    length == dev->port_usb->fixed_in_len &&
-	    (length % in->maxpacket) == 0)
-		req->zero = 0;
-	else
-		req->zero = 1;
-
-	/* use zlp framing on tx for strict CDC-Ether conformance,
-	 * though any robust network rx path ignores extra padding.
-	 * and some hardware doesn't like to write zlps.
+	/* throttle highspeed IRQ rate back slightly; aggregated
+	 * transfers already complete at a fraction of the frame rate
 	 */
-	if (req->zero && !dev->zlp && (length % in->maxpacket) == 0) {
-		req->zero = 0;
-		length++;
-	}
-
-	req->length = length;
-
-	/* throttle highspeed IRQ rate back slightly */
-	if (gadget_is_dualspeed(dev->gadget) &&
+	if (!dev->tx_req_bufsize && gadget_is_dualspeed(dev->gadget) &&
 			 (dev->gadget->speed == USB_SPEED_HIGH)) {
 		dev->tx_qlen++;
 		if (dev->tx_qlen == (qmult/2)) {
@@ -744,8 +814,14 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	}
 
 	if (retval) {
-		if (!dev->port_usb->multi_pkt_xfer)
+		if (dev->tx_req_bufsize) {
+			req->length = 0;
+			spin_lock_irqsave(&dev->req_lock, flags);
+			dev->no_tx_req_used--;
+			spin_unlock_irqrestore(&dev->req_lock, flags);
+		} else {
 			dev_kfree_skb_any(skb);
+		}
 drop:
 		dev->net->stats.tx_dropped++;
 		spin_lock_irqsave(&dev->req_lock, flags);
@@ -778,6 +854,7 @@ static int eth_open(struct net_device *net)
 	struct gether	*link;
 
 	DBG(dev, "%s\n", __func__);
+	napi_enable(&dev->napi);
 	if (netif_carrier_ok(dev->net))
 		eth_start(dev, GFP_KERNEL);
 
@@ -797,6 +874,7 @@ static int eth_stop(struct net_device *net)
 
 	VDBG(dev, "%s\n", __func__);
 	netif_stop_queue(net);
+	napi_disable(&dev->napi);
 
 	DBG(dev, "stop stats: rx/tx %ld/%ld, errs %ld/%ld\n",
 		dev->net->stats.rx_packets, dev->net->stats.tx_packets,
@@ -830,6 +908,10 @@ static int eth_stop(struct net_device *net)
 	}
 	spin_unlock_irqrestore(&dev->lock, flags);
 
+	/* and whatever completed before the endpoints went down */
+	skb_queue_purge(&dev->rx_done);
+	skb_queue_purge(&dev->rx_frames);
+
 	return 0;
 }
 
@@ -934,7 +1016,9 @@ int gether_setup_name(struct usb_gadget *g, u8 ethaddr[ETH_ALEN],
 	INIT_LIST_HEAD(&dev->tx_reqs);
 	INIT_LIST_HEAD(&dev->rx_reqs);
 
+	skb_queue_head_init(&dev->rx_done);
 	skb_queue_head_init(&dev->rx_frames);
+	netif_napi_add(net, &dev->napi, eth_poll, rx_budget);
 
 	/* network device setup */
 	dev->net = net;
@@ -1048,10 +1132,16 @@ struct net_device *gether_connect(struct gether *link)
 		dev->unwrap = link->unwrap;
 		dev->wrap = link->wrap;
 
-		spin_lock(&dev->lock);
+		spin_lock(&dev->req_lock);
 		dev->tx_skb_hold_count = 0;
 		dev->no_tx_req_used = 0;
 		dev->tx_req_bufsize = 0;
+		if (link->dl_max_pkts_per_xfer > 1 &&
+				alloc_tx_buffer(dev, link) < 0)
+			DBG(dev, "no memory to aggregate tx\n");
+		spin_unlock(&dev->req_lock);
+
+		spin_lock(&dev->lock);
 		dev->port_usb = link;
 		link->ioport = dev;
 		if (netif_running(dev->net)) {
@@ -1117,11 +1207,12 @@ void gether_disconnect(struct gether *link)
 		list_del(&req->list);
 
 		spin_unlock(&dev->req_lock);
-		if (link->multi_pkt_xfer)
+		if (dev->tx_req_bufsize)
 			kfree(req->buf);
 		usb_ep_free_request(link->in_ep, req);
 		spin_lock(&dev->req_lock);
 	}
+	dev->tx_req_bufsize = 0;
 	spin_unlock(&dev->req_lock);
 	link->in_ep->driver_data = NULL;
 	link->in = NULL;
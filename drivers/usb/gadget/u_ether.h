@@ -66,9 +66,17 @@ struct gether {
 	bool				is_fixed;
 	u32				fixed_out_len;
 	u32				fixed_in_len;
-/* Max number of SKB packets to be used to create Multi Packet RNDIS */
-#define TX_SKB_HOLD_THRESHOLD		3
-	bool				multi_pkt_xfer;
+
+	/*
+	 * Framings that can carry several frames per transfer (RNDIS) set
+	 * these; zero or one means one frame per transfer.  While the IN
+	 * queue is busy, frames are then gathered into a buffer owned by
+	 * the request, up to dl_max_xfer_size bytes if that is set.
+	 */
+	u32				dl_max_pkts_per_xfer;
+	u32				dl_max_xfer_size;
+	u32				ul_max_pkts_per_xfer;
+
 	struct sk_buff			*(*wrap)(struct gether *port,
 						struct sk_buff *skb);
 	int				(*unwrap)(struct gether *port,
@@ -19,10 +19,28 @@
 #include <linux/sysfs.h>
 #include <linux/earlysuspend.h>
 #include <linux/mutex.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/hrtimer.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/dyn_sync_cntrl.h>
 
 #include <linux/writeback.h>
 
-#define DYN_FSYNC_VERSION 2
+#define DYN_FSYNC_VERSION 3
+
+/*
+ * DYN_FSYNC_MODE_SKIP: fsync is a no-op while the screen is on, and all
+ *	outstanding data is flushed when it goes off.
+ * DYN_FSYNC_MODE_GROUP: fsyncs on a filesystem that supports it are
+ *	batched into one filesystem commit, and return once it is durable.
+ */
+#define DYN_FSYNC_MODE_SKIP	0
+#define DYN_FSYNC_MODE_GROUP	1
+
+/* how long a group commit waits for fsyncs still writing back data */
+#define DYN_FSYNC_GROUP_WINDOW_US	2000
 
 /*
  * fsync_mutex protects dyn_fsync_active during early suspend / lat resume transitions
@@ -31,6 +49,211 @@ static DEFINE_MUTEX(fsync_mutex);
 
 bool early_suspend_active = false;
 static bool dyn_fsync_active = true;
+static unsigned int dyn_fsync_mode = DYN_FSYNC_MODE_GROUP;
+static unsigned int dyn_fsync_group_window_us = DYN_FSYNC_GROUP_WINDOW_US;
+
+/*
+ * Group commit state of one filesystem, alive while anyone is fsyncing on
+ * it. Callers write back their own data, queue on @pending and sleep; one
+ * of them at a time leads: it closes the batch, commits the filesystem
+ * once for all of it and hands the result to every member.
+ */
+struct dyn_fsync_group {
+	struct list_head	list;
+	struct super_block	*sb;
+	int			users;
+	int			flushing;	/* callers writing back data */
+	bool			leader;
+	struct list_head	pending;
+	wait_queue_head_t	wait;
+};
+
+struct dyn_fsync_waiter {
+	struct list_head	list;
+	int			err;
+	bool			done;
+};
+
+/* protects the groups and all of their fields but wait */
+static DEFINE_SPINLOCK(dyn_fsync_lock);
+static LIST_HEAD(dyn_fsync_groups);
+
+static unsigned long dyn_fsync_group_calls;
+static unsigned long dyn_fsync_group_commits;
+static unsigned int dyn_fsync_group_max_batch;
+
+bool dyn_fsync_skip(void)
+{
+	return dyn_fsync_active && dyn_fsync_mode == DYN_FSYNC_MODE_SKIP &&
+		!early_suspend_active;
+}
+
+bool dyn_fsync_group(struct file *file)
+{
+	struct super_block *sb = file->f_mapping->host->i_sb;
+
+	return dyn_fsync_active && dyn_fsync_mode == DYN_FSYNC_MODE_GROUP &&
+		(sb->s_type->fs_flags & FS_GROUP_FSYNC) &&
+		sb->s_op->sync_fs && sb->s_bdev &&
+		!(sb->s_flags & MS_RDONLY) &&
+		file->f_op && file->f_op->fsync;
+}
+
+static struct dyn_fsync_group *dyn_fsync_group_get(struct super_block *sb)
+{
+	struct dyn_fsync_group *g, *new = NULL;
+
+again:
+	spin_lock(&dyn_fsync_lock);
+	list_for_each_entry(g, &dyn_fsync_groups, list)
+		if (g->sb == sb)
+			goto found;
+	if (!new) {
+		spin_unlock(&dyn_fsync_lock);
+		new = kzalloc(sizeof(*new), GFP_KERNEL);
+		if (!new)
+			return NULL;
+		new->sb = sb;
+		INIT_LIST_HEAD(&new->pending);
+		init_waitqueue_head(&new->wait);
+		goto again;
+	}
+	g = new;
+	new = NULL;
+	list_add(&g->list, &dyn_fsync_groups);
+found:
+	g->users++;
+	g->flushing++;
+	spin_unlock(&dyn_fsync_lock);
+	kfree(new);
+	return g;
+}
+
+/* called with dyn_fsync_lock held, drops it */
+static void dyn_fsync_group_put(struct dyn_fsync_group *g)
+{
+	if (--g->users) {
+		spin_unlock(&dyn_fsync_lock);
+		return;
+	}
+	list_del(&g->list);
+	spin_unlock(&dyn_fsync_lock);
+	kfree(g);
+}
+
+/*
+ * One commit for the whole batch: every member's data is written, so a
+ * journal commit makes their metadata durable, and a cache flush covers
+ * the data in case there was nothing to commit.
+ */
+static int dyn_fsync_group_commit(struct super_block *sb)
+{
+	int ret, err;
+
+	down_read(&sb->s_umount);
+	ret = sb->s_op->sync_fs(sb, 1);
+	up_read(&sb->s_umount);
+	err = blkdev_issue_flush(sb->s_bdev, GFP_KERNEL, NULL);
+	if (err == -EOPNOTSUPP)
+		err = 0;
+	return ret ? ret : err;
+}
+
+static void dyn_fsync_group_lead(struct dyn_fsync_group *g)
+{
+	struct dyn_fsync_waiter *w, *n;
+	LIST_HEAD(batch);
+	unsigned int nr = 0;
+	int err;
+
+	/* give fsyncs still writing back their data a chance to join */
+	if (ACCESS_ONCE(g->flushing) && dyn_fsync_group_window_us) {
+		ktime_t expires = ktime_add_us(ktime_get(),
+					       dyn_fsync_group_window_us);
+		DEFINE_WAIT(wait);
+
+		for (;;) {
+			prepare_to_wait(&g->wait, &wait, TASK_UNINTERRUPTIBLE);
+			if (!ACCESS_ONCE(g->flushing))
+				break;
+			if (!schedule_hrtimeout(&expires, HRTIMER_MODE_ABS))
+				break;
+		}
+		finish_wait(&g->wait, &wait);
+	}
+
+	spin_lock(&dyn_fsync_lock);
+	list_splice_init(&g->pending, &batch);
+	spin_unlock(&dyn_fsync_lock);
+
+	err = dyn_fsync_group_commit(g->sb);
+
+	spin_lock(&dyn_fsync_lock);
+	list_for_each_entry_safe(w, n, &batch, list) {
+		list_del(&w->list);
+		w->err = err;
+		w->done = true;
+		nr++;
+	}
+	g->leader = false;
+	dyn_fsync_group_commits++;
+	if (nr > dyn_fsync_group_max_batch)
+		dyn_fsync_group_max_batch = nr;
+	spin_unlock(&dyn_fsync_lock);
+
+	wake_up_all(&g->wait);
+}
+
+/*
+ * fsync() of @file in group commit mode: write back and wait on the
+ * data, let the filesystem finish its own work on the inode, then return
+ * once a filesystem commit started after that has completed.
+ */
+int dyn_fsync_group_fsync(struct file *file, loff_t start, loff_t end)
+{
+	struct inode *inode = file->f_mapping->host;
+	struct super_block *sb = inode->i_sb;
+	struct dyn_fsync_waiter w = { .done = false };
+	struct dyn_fsync_group *g;
+	int ret, err;
+
+	g = dyn_fsync_group_get(sb);
+	if (!g)
+		return -ENOMEM;
+
+	ret = filemap_write_and_wait_range(file->f_mapping, start, end);
+	if (sb->s_op->group_fsync_prepare) {
+		mutex_lock(&inode->i_mutex);
+		err = sb->s_op->group_fsync_prepare(inode);
+		mutex_unlock(&inode->i_mutex);
+		if (!ret)
+			ret = err;
+	}
+
+	spin_lock(&dyn_fsync_lock);
+	dyn_fsync_group_calls++;
+	list_add_tail(&w.list, &g->pending);
+	if (!--g->flushing)
+		wake_up_all(&g->wait);
+
+	while (!w.done) {
+		if (!g->leader) {
+			g->leader = true;
+			spin_unlock(&dyn_fsync_lock);
+			dyn_fsync_group_lead(g);
+		} else {
+			spin_unlock(&dyn_fsync_lock);
+			wait_event(g->wait,
+				   ACCESS_ONCE(w.done) || !ACCESS_ONCE(g->leader));
+		}
+		spin_lock(&dyn_fsync_lock);
+	}
+
+	if (!ret)
+		ret = w.err;
+	dyn_fsync_group_put(g);
+	return ret;
+}
 
 static ssize_t dyn_fsync_active_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
 {
@@ -58,6 +281,48 @@ static ssize_t dyn_fsync_active_store(struct kobject *kobj, struct kobj_attribut
 	return count;
 }
 
+static ssize_t dyn_fsync_mode_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", dyn_fsync_mode);
+}
+
+static ssize_t dyn_fsync_mode_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int data;
+
+	if (sscanf(buf, "%u\n", &data) != 1 ||
+	    (data != DYN_FSYNC_MODE_SKIP && data != DYN_FSYNC_MODE_GROUP))
+		return -EINVAL;
+
+	mutex_lock(&fsync_mutex);
+	dyn_fsync_mode = data;
+	mutex_unlock(&fsync_mutex);
+	return count;
+}
+
+static ssize_t dyn_fsync_group_window_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", dyn_fsync_group_window_us);
+}
+
+static ssize_t dyn_fsync_group_window_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int data;
+
+	if (sscanf(buf, "%u\n", &data) != 1 || data > USEC_PER_SEC)
+		return -EINVAL;
+
+	dyn_fsync_group_window_us = data;
+	return count;
+}
+
+static ssize_t dyn_fsync_group_stats_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "fsyncs: %lu\ncommits: %lu\nmax batch: %u\n",
+		       dyn_fsync_group_calls, dyn_fsync_group_commits,
+		       dyn_fsync_group_max_batch);
+}
+
 static ssize_t dyn_fsync_version_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
 {
 	return sprintf(buf, "version: %u\n", DYN_FSYNC_VERSION);
@@ -71,6 +336,15 @@ static ssize_t dyn_fsync_earlysuspend_show(struct kobject *kobj, struct kobj_att
 static struct kobj_attribute dyn_fsync_active_attribute = 
 	__ATTR(Dyn_fsync_active, 0666, dyn_fsync_active_show, dyn_fsync_active_store);
 
+static struct kobj_attribute dyn_fsync_mode_attribute = 
+	__ATTR(Dyn_fsync_mode, 0644, dyn_fsync_mode_show, dyn_fsync_mode_store);
+
+static struct kobj_attribute dyn_fsync_group_window_attribute = 
+	__ATTR(Dyn_fsync_group_window_us, 0644, dyn_fsync_group_window_show, dyn_fsync_group_window_store);
+
+static struct kobj_attribute dyn_fsync_group_stats_attribute = 
+	__ATTR(Dyn_fsync_group_stats, 0444, dyn_fsync_group_stats_show, NULL);
+
 static struct kobj_attribute dyn_fsync_version_attribute = 
 	__ATTR(Dyn_fsync_version, 0444 , dyn_fsync_version_show, NULL);
 
@@ -80,6 +354,9 @@ static struct kobj_attribute dyn_fsync_earlysuspend_attribute =
 static struct attribute *dyn_fsync_active_attrs[] =
 	{
 		&dyn_fsync_active_attribute.attr,
+		&dyn_fsync_mode_attribute.attr,
+		&dyn_fsync_group_window_attribute.attr,
+		&dyn_fsync_group_stats_attribute.attr,
 		&dyn_fsync_version_attribute.attr,
 		&dyn_fsync_earlysuspend_attribute.attr,
 		NULL,
@@ -95,8 +372,8 @@ static struct kobject *dyn_fsync_kobj;
 static void dyn_fsync_early_suspend(struct early_suspend *h)
 {
 	mutex_lock(&fsync_mutex);
-	if (dyn_fsync_active) {
-		early_suspend_active = true;
+	early_suspend_active = true;
+	if (dyn_fsync_active && dyn_fsync_mode == DYN_FSYNC_MODE_SKIP) {
 #if 1
 		/* flush all outstanding buffers */
 		wakeup_flusher_threads(0);
@@ -1285,6 +1285,7 @@ static const struct super_operations ext4_sops = {
 	.evict_inode	= ext4_evict_inode,
 	.put_super	= ext4_put_super,
 	.sync_fs	= ext4_sync_fs,
+	.group_fsync_prepare = ext4_flush_completed_IO,
 	.freeze_fs	= ext4_freeze,
 	.unfreeze_fs	= ext4_unfreeze,
 	.statfs		= ext4_statfs,
@@ -4254,7 +4255,7 @@ static int ext4_sync_fs(struct super_block *sb, int wait)
 	flush_workqueue(sbi->dio_unwritten_wq);
 	if (jbd2_journal_start_commit(sbi->s_journal, &target)) {
 		if (wait)
-			jbd2_log_wait_commit(sbi->s_journal, target);
+			ret = jbd2_log_wait_commit(sbi->s_journal, target);
 	}
 	return ret;
 }
@@ -4952,7 +4953,7 @@ static struct file_system_type ext4_fs_type = {
 	.name		= "ext4",
 	.mount		= ext4_mount,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_GROUP_FSYNC,
 };
 
 static int __init ext4_init_feat_adverts(void)
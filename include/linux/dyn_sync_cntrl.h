@@ -0,0 +1,33 @@
+#ifndef _LINUX_DYN_SYNC_CNTRL_H
+#define _LINUX_DYN_SYNC_CNTRL_H
+
+#include <linux/errno.h>
+#include <linux/types.h>
+
+struct file;
+
+#ifdef CONFIG_DYNAMIC_FSYNC
+/* fsync() and friends should return at once, without syncing anything */
+extern bool dyn_fsync_skip(void);
+/* fsync() of @file should go through dyn_fsync_group_fsync() */
+extern bool dyn_fsync_group(struct file *file);
+extern int dyn_fsync_group_fsync(struct file *file, loff_t start, loff_t end);
+#else
+static inline bool dyn_fsync_skip(void)
+{
+	return false;
+}
+
+static inline bool dyn_fsync_group(struct file *file)
+{
+	return false;
+}
+
+static inline int dyn_fsync_group_fsync(struct file *file, loff_t start,
+					loff_t end)
+{
+	return -EINVAL;
+}
+#endif
+
+#endif /* _LINUX_DYN_SYNC_CNTRL_H */
@@ -1,7 +1,7 @@
 #ifndef __LZ4_H__
 #define __LZ4_H__
 /*
- * LZ4 Decompressor Kernel Interface
+ * LZ4 Kernel Interface
  *
  * Copyright (C) 2013, LG Electronics, Kyungsik Lee <kyungsik.lee@lge.com>
  * Based on LZ4 implementation by Yann Collet.
@@ -46,6 +46,29 @@
  */
 #define LZ4_COMPRESSBOUND(isize) (isize + ((isize)/255) + 16)
 
+/*
+ * LZ4_MEM_COMPRESS
+ * Size of the working memory (hash table) needed by lz4_compress()
+ */
+#define LZ4_MEM_COMPRESS	(16384)
+
+/*
+ * lz4_compress()
+ *	src     : source address of the original data
+ *	src_len : size of the original data
+ *	dst	: output buffer address of the compressed data
+ *		This requires 'dst' of size LZ4_COMPRESSBOUND(src_len).
+ *	dst_len : is the output size, which is returned after compress done
+ *	workmem : address of the working memory.
+ *		This requires 'workmem' of size LZ4_MEM_COMPRESS.
+ *	return  : Success if return 0
+ *		  Error if return (< 0)
+ *	note :  Destination buffer and workmem must be already allocated with
+ *		the defined size.
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
 /*
  * lz4_decompress()
  *	src     : source address of the compressed data
@@ -1166,6 +1166,18 @@ struct sched_statistics {
 };
 #endif
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+/*
+ * Geometrically decayed running time of a task: util_sum and period are
+ * in ~1us units, each 1ms period weighing half as much as one 32ms later.
+ */
+struct sched_avg {
+	u64			last_update;
+	u32			util_sum;
+	u32			period;
+};
+#endif
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1183,6 +1195,10 @@ struct sched_entity {
 	struct sched_statistics statistics;
 #endif
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	struct sched_avg	avg;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct sched_entity	*parent;
 	/* rq on which this entity is (to be) queued: */
@@ -1283,6 +1299,11 @@ struct task_struct {
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
 #endif
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+	/* lowmemorykiller bucket of a thread group leader */
+	struct hlist_node lowmem_node;
+	int lowmem_adj;
+#endif
 
 	struct mm_struct *mm, *active_mm;
 #ifdef CONFIG_COMPAT_BRK
@@ -2031,6 +2052,28 @@ static inline void sched_autogroup_fork(struct signal_struct *sig) { }
 static inline void sched_autogroup_exit(struct signal_struct *sig) { }
 #endif
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+extern unsigned int sysctl_sched_freq_alert_delta;
+
+extern int sched_freq_notifier_register(struct notifier_block *nb);
+extern int sched_freq_notifier_unregister(struct notifier_block *nb);
+
+/**
+ * struct sched_migration_data - fair tasks moved to a cpu
+ * @src_cpu:	cpu the (last) task came from
+ * @dest_cpu:	cpu the tasks were moved to, the one calling the notifier
+ * @load:	sum of the tasks' recent running time, in percent of @src_cpu
+ */
+struct sched_migration_data {
+	int src_cpu;
+	int dest_cpu;
+	unsigned int load;
+};
+
+extern int sched_migration_notifier_register(struct notifier_block *nb);
+extern int sched_migration_notifier_unregister(struct notifier_block *nb);
+#endif
+
 #ifdef CONFIG_RT_MUTEXES
 extern int rt_mutex_getprio(struct task_struct *p);
 extern void rt_mutex_setprio(struct task_struct *p, int prio);
@@ -0,0 +1,67 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM mpdecision
+
+#if !defined(_TRACE_MPDECISION_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_MPDECISION_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * One event per msm_mpdecision evaluation. rq_avg is in tenths of a
+ * runnable task, load and demand in percent of one CPU, forecast is -1
+ * outside of predictive mode, action is +1/-1 for a CPU brought up/down.
+ * tools/mpdecision/mpdec-sim replays these.
+ */
+TRACE_EVENT(mpdec_decision,
+	    TP_PROTO(unsigned int rq_avg, unsigned int load,
+		     unsigned int demand, int forecast,
+		     unsigned int online, int action),
+	    TP_ARGS(rq_avg, load, demand, forecast, online, action),
+
+	    TP_STRUCT__entry(
+		    __field(unsigned int, rq_avg   )
+		    __field(unsigned int, load     )
+		    __field(unsigned int, demand   )
+		    __field(int,          forecast )
+		    __field(unsigned int, online   )
+		    __field(int,          action   )
+	    ),
+
+	    TP_fast_assign(
+		    __entry->rq_avg = rq_avg;
+		    __entry->load = load;
+		    __entry->demand = demand;
+		    __entry->forecast = forecast;
+		    __entry->online = online;
+		    __entry->action = action;
+	    ),
+
+	    TP_printk("rq_avg=%u load=%u demand=%u forecast=%d online=%u action=%d",
+		      __entry->rq_avg, __entry->load, __entry->demand,
+		      __entry->forecast, __entry->online, __entry->action)
+);
+
+TRACE_EVENT(mpdec_hotplug,
+	    TP_PROTO(unsigned int cpu, int up, unsigned int cost_us),
+	    TP_ARGS(cpu, up, cost_us),
+
+	    TP_STRUCT__entry(
+		    __field(unsigned int, cpu     )
+		    __field(int,          up      )
+		    __field(unsigned int, cost_us )
+	    ),
+
+	    TP_fast_assign(
+		    __entry->cpu = cpu;
+		    __entry->up = up;
+		    __entry->cost_us = cost_us;
+	    ),
+
+	    TP_printk("cpu=%u up=%d cost_us=%u",
+		      __entry->cpu, __entry->up, __entry->cost_us)
+);
+
+#endif /* _TRACE_MPDECISION_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -530,6 +530,15 @@ struct rq {
 	u64 prev_irq_time;
 #endif
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	/* runnable CFS load, 100 per nice-0 task, for cpufreq governors */
+	unsigned int freq_load;
+	unsigned int freq_load_notified;
+	/* task load migrated here and not yet notified */
+	atomic_t freq_migrated;
+	int freq_migrated_src;
+#endif
+
 	/* calc_load related fields */
 	unsigned long calc_load_update;
 	long calc_load_active;
@@ -2219,6 +2228,7 @@ void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 	if (task_cpu(p) != new_cpu) {
 		p->se.nr_migrations++;
 		perf_sw_event(PERF_COUNT_SW_CPU_MIGRATIONS, 1, 1, NULL, 0);
+		sched_freq_migrate(p, new_cpu);
 	}
 
 	__set_task_cpu(p, new_cpu);
@@ -2813,6 +2823,10 @@ static void __sched_fork(struct task_struct *p)
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	memset(&p->se.avg, 0, sizeof(p->se.avg));
+#endif
+
 	INIT_LIST_HEAD(&p->rt.run_list);
 
 #ifdef CONFIG_PREEMPT_NOTIFIERS
@@ -4293,6 +4307,7 @@ need_resched:
 		raw_spin_unlock_irq(&rq->lock);
 
 	post_schedule(rq);
+	sched_freq_check(rq);
 
 	preempt_enable_no_resched();
 	if (need_resched())
@@ -422,6 +422,10 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 	PN(se.exec_start);
 	PN(se.vruntime);
 	PN(se.sum_exec_runtime);
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	P(se.avg.util_sum);
+	P(se.avg.period);
+#endif
 
 	nr_switches = p->nvcsw + p->nivcsw;
 
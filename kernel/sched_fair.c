@@ -574,6 +574,145 @@ __update_curr(struct cfs_rq *cfs_rq, struct sched_entity *curr,
 #endif
 }
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+/*
+ * Per task load tracking
+ *
+ * Time is accounted in 1024ns units and 1024-unit (~1ms) periods. The
+ * running time in a period n periods ago counts y^n, with y^32 = 1/2, so
+ * a task's utilization is util_sum / period over a geometric window whose
+ * most recent ~32ms carry half the weight. Only the running time of tasks
+ * is tracked, which is what cpufreq wants to know on migration.
+ */
+#define UTIL_AVG_PERIOD		32
+#define UTIL_AVG_MAX		47742	/* sum of 1024 * y^n for all n */
+#define UTIL_AVG_MAX_N		345	/* periods until the sum reaches it */
+
+/* 2^32 * y^n for n in [0, 32) */
+static const u32 util_avg_yN_inv[] = {
+	0xffffffff, 0xfa83b2da, 0xf5257d14, 0xefe4b99a, 0xeac0c6e6, 0xe5b906e6,
+	0xe0ccdeeb, 0xdbfbb796, 0xd744fcc9, 0xd2a81d91, 0xce248c14, 0xc9b9bd85,
+	0xc5672a10, 0xc12c4cc9, 0xbd08a39e, 0xb8fbaf46, 0xb504f333, 0xb123f581,
+	0xad583ee9, 0xa9a15ab4, 0xa5fed6a9, 0xa2704302, 0x9ef5325f, 0x9b8d39b9,
+	0x9837f050, 0x94f4efa8, 0x91c3d373, 0x8ea4398a, 0x8b95c1e3, 0x88980e80,
+	0x85aac367, 0x82cd8698,
+};
+
+/* sum of 1024 * y^k for k in [1, n] */
+static const u32 util_avg_yN_sum[] = {
+	    0, 1002, 1982, 2941, 3880, 4798, 5697, 6576, 7437, 8279, 9103,
+	 9909, 10698, 11470, 12226, 12966, 13690, 14398, 15091, 15769, 16433,
+	17082, 17718, 18340, 18949, 19545, 20128, 20698, 21256, 21802, 22336,
+	22859, 23371,
+};
+
+/* val * y^n */
+static u32 util_decay(u64 val, u64 n)
+{
+	unsigned int local_n;
+
+	if (!n)
+		return val;
+	if (unlikely(n > UTIL_AVG_PERIOD * 63))
+		return 0;
+
+	local_n = n;
+	if (local_n >= UTIL_AVG_PERIOD) {
+		val >>= local_n / UTIL_AVG_PERIOD;
+		local_n %= UTIL_AVG_PERIOD;
+	}
+
+	val *= util_avg_yN_inv[local_n];
+	return val >> 32;
+}
+
+/* sum of 1024 * y^k for k in [1, n] */
+static u32 util_contrib(u64 n)
+{
+	u32 contrib = 0;
+
+	if (likely(n <= UTIL_AVG_PERIOD))
+		return util_avg_yN_sum[n];
+	if (unlikely(n >= UTIL_AVG_MAX_N))
+		return UTIL_AVG_MAX;
+
+	do {
+		contrib /= 2;
+		contrib += util_avg_yN_sum[UTIL_AVG_PERIOD];
+		n -= UTIL_AVG_PERIOD;
+	} while (n > UTIL_AVG_PERIOD);
+
+	return util_decay(contrib, n) + util_avg_yN_sum[n];
+}
+
+/* account the time since the last update as running or not */
+static void __update_util_avg(struct sched_avg *sa, u64 now, int running)
+{
+	u64 delta, periods;
+	u32 delta_w;
+
+	if (!sa->last_update) {
+		sa->last_update = now;
+		return;
+	}
+
+	delta = now - sa->last_update;
+	if ((s64)delta < 0) {
+		sa->last_update = now;
+		return;
+	}
+
+	delta >>= 10;
+	if (!delta)
+		return;
+	sa->last_update = now;
+
+	delta_w = sa->period % 1024;
+	if (delta + delta_w >= 1024) {
+		/* close the current period, then decay whole ones */
+		delta_w = 1024 - delta_w;
+		if (running)
+			sa->util_sum += delta_w;
+		sa->period += delta_w;
+		delta -= delta_w;
+
+		periods = delta >> 10;
+		delta &= 1023;
+
+		sa->util_sum = util_decay(sa->util_sum, periods + 1);
+		sa->period = util_decay(sa->period, periods + 1);
+
+		if (running)
+			sa->util_sum += util_contrib(periods);
+		sa->period += util_contrib(periods);
+	}
+
+	if (running)
+		sa->util_sum += delta;
+	sa->period += delta;
+}
+
+static inline void
+update_entity_util(struct cfs_rq *cfs_rq, struct sched_entity *se, int running)
+{
+	if (entity_is_task(se))
+		__update_util_avg(&se->avg, rq_of(cfs_rq)->clock, running);
+}
+
+/* percentage of recent time @p spent running */
+static inline unsigned int task_util(struct task_struct *p)
+{
+	struct sched_avg *sa = &p->se.avg;
+
+	return sa->util_sum * 100 / (sa->period + 1);
+}
+#else
+static inline void
+update_entity_util(struct cfs_rq *cfs_rq, struct sched_entity *se, int running)
+{
+}
+#endif /* CONFIG_SCHED_FREQ_INPUT */
+
 static void update_curr(struct cfs_rq *cfs_rq)
 {
 	struct sched_entity *curr = cfs_rq->curr;
@@ -594,6 +733,7 @@ static void update_curr(struct cfs_rq *cfs_rq)
 
 	__update_curr(cfs_rq, curr, delta_exec);
 	curr->exec_start = now;
+	update_entity_util(cfs_rq, curr, 1);
 
 	if (entity_is_task(curr)) {
 		struct task_struct *curtask = task_of(curr);
@@ -1135,6 +1275,9 @@ check_preempt_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 static void
 set_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
+	/* close the time it spent waiting or asleep */
+	update_entity_util(cfs_rq, se, 0);
+
 	/* 'current' is not kept within the tree. */
 	if (se->on_rq) {
 		/*
@@ -1316,6 +1459,119 @@ static inline void hrtick_update(struct rq *rq)
 }
 #endif
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+/*
+ * Frequency input for cpufreq governors.
+ *
+ * The runnable CFS load of each runqueue is kept in rq->freq_load, 100 for
+ * every nice-0 task's worth of weight. When it has moved by at least
+ * sysctl_sched_freq_alert_delta since the last notification, the
+ * sched_freq notifier chain is called from the end of schedule() on that
+ * cpu, with the rq lock dropped, so that a governor can re-evaluate the
+ * speed right away rather than at its next sample.
+ */
+unsigned int sysctl_sched_freq_alert_delta = 100;
+
+static ATOMIC_NOTIFIER_HEAD(sched_freq_notifier_head);
+
+int sched_freq_notifier_register(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&sched_freq_notifier_head, nb);
+}
+EXPORT_SYMBOL_GPL(sched_freq_notifier_register);
+
+int sched_freq_notifier_unregister(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&sched_freq_notifier_head, nb);
+}
+EXPORT_SYMBOL_GPL(sched_freq_notifier_unregister);
+
+/*
+ * When fair tasks are moved to a cpu, the sched_migration notifier chain
+ * is called from the end of the next schedule() there, with the load they
+ * carried, so that a governor does not have to wait for the moved work to
+ * show up in its own samples of that cpu.
+ */
+static ATOMIC_NOTIFIER_HEAD(sched_migration_notifier_head);
+
+int sched_migration_notifier_register(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&sched_migration_notifier_head,
+					      nb);
+}
+EXPORT_SYMBOL_GPL(sched_migration_notifier_register);
+
+int sched_migration_notifier_unregister(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&sched_migration_notifier_head,
+						nb);
+}
+EXPORT_SYMBOL_GPL(sched_migration_notifier_unregister);
+
+static inline void update_freq_load(struct rq *rq)
+{
+	rq->freq_load = (rq->cfs.load.weight * 100) >> NICE_0_SHIFT;
+}
+
+/* called from set_task_cpu() with p->pi_lock or the task's rq->lock held */
+static void sched_freq_migrate(struct task_struct *p, int new_cpu)
+{
+	struct rq *rq = cpu_rq(new_cpu);
+	unsigned int util;
+
+	if (p->sched_class != &fair_sched_class)
+		return;
+
+	/* a waking task has been asleep since its last update */
+	if (!p->on_rq)
+		__update_util_avg(&p->se.avg,
+				  sched_clock_cpu(smp_processor_id()), 0);
+	util = task_util(p);
+	if (!util)
+		return;
+
+	rq->freq_migrated_src = task_cpu(p);
+	atomic_add(util, &rq->freq_migrated);
+}
+
+/* called by the local cpu, preemption disabled, rq->lock not held */
+static void sched_freq_check(struct rq *rq)
+{
+	unsigned int load = ACCESS_ONCE(rq->freq_load);
+	unsigned int last = rq->freq_load_notified;
+
+	if (unlikely(atomic_read(&rq->freq_migrated))) {
+		struct sched_migration_data md = {
+			.src_cpu	= rq->freq_migrated_src,
+			.dest_cpu	= cpu_of(rq),
+			.load		= atomic_xchg(&rq->freq_migrated, 0),
+		};
+
+		atomic_notifier_call_chain(&sched_migration_notifier_head, 0,
+					   &md);
+	}
+
+	if (abs((int)load - (int)last) < sysctl_sched_freq_alert_delta)
+		return;
+
+	rq->freq_load_notified = load;
+	atomic_notifier_call_chain(&sched_freq_notifier_head, load,
+				   (void *)(long)cpu_of(rq));
+}
+#else
+static inline void update_freq_load(struct rq *rq)
+{
+}
+
+static inline void sched_freq_migrate(struct task_struct *p, int new_cpu)
+{
+}
+
+static inline void sched_freq_check(struct rq *rq)
+{
+}
+#endif /* CONFIG_SCHED_FREQ_INPUT */
+
 /*
  * The enqueue_task method is called before nr_running is
  * increased. Here we update the fair scheduling stats and
@@ -1342,6 +1598,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_cfs_shares(cfs_rq);
 	}
 
+	update_freq_load(rq);
 	hrtick_update(rq);
 }
 
@@ -1382,6 +1639,7 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_cfs_shares(cfs_rq);
 	}
 
+	update_freq_load(rq);
 	hrtick_update(rq);
 }
 
@@ -0,0 +1,65 @@
+/* -*- linux-c -*- ------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ *   Boston MA 02111-1307, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * raid6/neon.c
+ *
+ * Wrappers around the NEON syndrome routines in neon$#.c, generated
+ * from neon.uc. Those are built with -mfpu=neon and use arm_neon.h, so
+ * they live in their own units and are only called from here, with the
+ * NEON unit held. Where it cannot be held, the integer code of the same
+ * unroll is used instead.
+ */
+
+#include <linux/raid/pq.h>
+
+#ifdef __KERNEL__
+#include <linux/hardirq.h>
+#include <asm/neon.h>
+/* as in the xor glue, NEON cannot be used in interrupt context or nested */
+#define raid6_neon_usable()	(!in_interrupt() && !kernel_neon_busy())
+#else
+#define kernel_neon_begin()
+#define kernel_neon_end()
+#define cpu_has_neon()		(1)
+#define raid6_neon_usable()	(1)
+#endif
+
+#define RAID6_NEON_WRAPPER(_n)						\
+	static void raid6_neon ## _n ## _gen_syndrome(int disks,	\
+					size_t bytes, void **ptrs)	\
+	{								\
+		void raid6_neon ## _n  ## _gen_syndrome_real(int,	\
+						unsigned long, void**);	\
+		if (!raid6_neon_usable()) {				\
+			raid6_intx ## _n.gen_syndrome(disks, bytes, ptrs); \
+			return;						\
+		}							\
+		kernel_neon_begin();					\
+		raid6_neon ## _n ## _gen_syndrome_real(disks,		\
+					(unsigned long)bytes, ptrs);	\
+		kernel_neon_end();					\
+	}								\
+	const struct raid6_calls raid6_neonx ## _n = {			\
+		raid6_neon ## _n ## _gen_syndrome,			\
+		raid6_have_neon,					\
+		"neonx" #_n,						\
+		0							\
+	}
+
+static int raid6_have_neon(void)
+{
+	return cpu_has_neon();
+}
+
+RAID6_NEON_WRAPPER(1);
+RAID6_NEON_WRAPPER(2);
+RAID6_NEON_WRAPPER(4);
+RAID6_NEON_WRAPPER(8);
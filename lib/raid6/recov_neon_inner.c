@@ -0,0 +1,107 @@
+/* -*- linux-c -*- ------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ *   Boston MA 02111-1307, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * raid6/recov_neon_inner.c
+ *
+ * NEON inner loops of recov_neon.c. A GF(2^8) product c * x is looked
+ * up as tbl[c][x & 15] ^ tbl[c][16 + (x >> 4)] from raid6_vgfmul, with
+ * vtbl.8 over each 16 byte half table. Built with -mfpu=neon; only
+ * arm_neon.h is included, see neon.uc.
+ */
+
+#include <arm_neon.h>
+
+static const uint8x16_t x0f = {
+	0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f,
+	0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f,
+};
+
+/* 16 entry byte lookup; ARMv7 only has the 8 byte wide vtbl */
+static inline uint8x16_t vtbl16(uint8x8x2_t tbl, uint8x16_t idx)
+{
+	return vcombine_u8(vtbl2_u8(tbl, vget_low_u8(idx)),
+			   vtbl2_u8(tbl, vget_high_u8(idx)));
+}
+
+static inline uint8x8x2_t vld_tbl(const uint8_t *tbl)
+{
+	uint8x8x2_t t;
+
+	t.val[0] = vld1_u8(tbl);
+	t.val[1] = vld1_u8(tbl + 8);
+	return t;
+}
+
+static inline uint8x16_t gfmul16(uint8x8x2_t lo, uint8x8x2_t hi,
+				 uint8x16_t x)
+{
+	return veorq_u8(vtbl16(lo, vandq_u8(x, x0f)),
+			vtbl16(hi, vshrq_n_u8(x, 4)));
+}
+
+void __raid6_2data_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dp,
+			      uint8_t *dq, const uint8_t *pbmul,
+			      const uint8_t *qmul)
+{
+	uint8x8x2_t pm0, pm1, qm0, qm1;
+	uint8x16_t px, qx, db;
+
+	qm0 = vld_tbl(qmul);
+	qm1 = vld_tbl(qmul + 16);
+	pm0 = vld_tbl(pbmul);
+	pm1 = vld_tbl(pbmul + 16);
+
+	while (bytes) {
+		/*
+		 * px = *p ^ *dp;
+		 * qx = qmul[*q ^ *dq];
+		 * *dq++ = db = pbmul[px] ^ qx;
+		 * *dp++ = db ^ px;
+		 */
+		px = veorq_u8(vld1q_u8(p), vld1q_u8(dp));
+		qx = gfmul16(qm0, qm1, veorq_u8(vld1q_u8(q), vld1q_u8(dq)));
+		db = veorq_u8(gfmul16(pm0, pm1, px), qx);
+
+		vst1q_u8(dq, db);
+		vst1q_u8(dp, veorq_u8(db, px));
+
+		bytes -= 16;
+		p += 16;
+		q += 16;
+		dp += 16;
+		dq += 16;
+	}
+}
+
+void __raid6_datap_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dq,
+			      const uint8_t *qmul)
+{
+	uint8x8x2_t qm0, qm1;
+	uint8x16_t vx;
+
+	qm0 = vld_tbl(qmul);
+	qm1 = vld_tbl(qmul + 16);
+
+	while (bytes) {
+		/*
+		 * *p++ ^= *dq = qmul[*q ^ *dq];
+		 */
+		vx = gfmul16(qm0, qm1, veorq_u8(vld1q_u8(q), vld1q_u8(dq)));
+
+		vst1q_u8(dq, vx);
+		vst1q_u8(p, veorq_u8(vx, vld1q_u8(p)));
+
+		bytes -= 16;
+		p += 16;
+		q += 16;
+		dq += 16;
+	}
+}
@@ -62,6 +62,9 @@ int test_set_oom_score_adj(int new_val)
 	}
 	spin_unlock_irq(&sighand->siglock);
 
+	if (new_val != old_val)
+		lowmem_task_update(current);
+
 	return old_val;
 }
 
@@ -0,0 +1,299 @@
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -g -o logger-bench logger-bench.c -lpthread -lrt */
+
+/*
+ * Stress test for the Android logger write path
+ *
+ * Starts N writer threads that log to one of the /dev/log devices as fast
+ * as they can, the way liblog does it: a single writev() of priority, tag
+ * and message. Each write is timed, and once all threads are done the
+ * aggregate throughput and the latency distribution are printed.
+ *
+ * With -r, a reader drains the log at the same time, as logcat would, and
+ * checks that entries come out in timestamp order.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2, as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/* from drivers/staging/android/logger.h */
+struct logger_entry {
+	uint16_t	len;
+	uint16_t	__pad;
+	int32_t		pid;
+	int32_t		tid;
+	int32_t		sec;
+	int32_t		nsec;
+	char		msg[0];
+};
+
+#define LOGGER_ENTRY_MAX_LEN	(4*1024)
+
+static const char *device = "/dev/log/main";
+static int nr_threads = 2;
+static long nr_writes = 100000;
+static int msg_size = 64;
+static int pin;
+static int with_reader;
+
+static volatile int start, stop;
+
+struct writer {
+	pthread_t thread;
+	int id;
+	int fd;
+	uint64_t *lat;		/* ns, one per write */
+	long done;
+	long errors;
+	uint64_t bytes;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (nr_cpus <= 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % nr_cpus, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		perror("sched_setaffinity");
+}
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = arg;
+	unsigned char prio = 4;	/* ANDROID_LOG_INFO */
+	char tag[16];
+	char *msg;
+	struct iovec vec[3];
+	long i;
+
+	if (pin)
+		pin_to_cpu(w->id);
+
+	snprintf(tag, sizeof(tag), "bench%d", w->id);
+	msg = malloc(msg_size);
+	if (!msg)
+		return NULL;
+	memset(msg, 'a' + w->id % 26, msg_size - 1);
+	msg[msg_size - 1] = '\0';
+
+	vec[0].iov_base = &prio;
+	vec[0].iov_len = 1;
+	vec[1].iov_base = tag;
+	vec[1].iov_len = strlen(tag) + 1;
+	vec[2].iov_base = msg;
+	vec[2].iov_len = msg_size;
+
+	while (!start)
+		sched_yield();
+
+	for (i = 0; i < nr_writes; i++) {
+		uint64_t t0 = now_ns();
+		ssize_t ret = writev(w->fd, vec, 3);
+
+		w->lat[i] = now_ns() - t0;
+		if (ret < 0)
+			w->errors++;
+		else
+			w->bytes += ret;
+	}
+	w->done = i;
+	free(msg);
+	return NULL;
+}
+
+struct reader_stats {
+	long entries;
+	long out_of_order;
+};
+
+static void *reader_fn(void *arg)
+{
+	struct reader_stats *st = arg;
+	char buf[LOGGER_ENTRY_MAX_LEN + 1];
+	struct logger_entry *e = (struct logger_entry *)buf;
+	int64_t last = 0;
+	int fd;
+
+	fd = open(device, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		perror(device);
+		return NULL;
+	}
+
+	while (!stop) {
+		ssize_t ret = read(fd, buf, LOGGER_ENTRY_MAX_LEN);
+		int64_t ts;
+
+		if (ret < 0) {
+			if (errno == EAGAIN)
+				usleep(1000);
+			continue;
+		}
+		ts = (int64_t)e->sec * 1000000000LL + e->nsec;
+		if (ts < last)
+			st->out_of_order++;
+		last = ts;
+		st->entries++;
+	}
+	close(fd);
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint64_t *v, long n, double p)
+{
+	long i = (long)(p / 100.0 * (n - 1) + 0.5);
+
+	return v[i];
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-d device] [-t threads] [-n writes] [-s size] [-p] [-r]\n"
+		"  -d  log device (default %s)\n"
+		"  -t  number of writer threads (default %d)\n"
+		"  -n  writes per thread (default %ld)\n"
+		"  -s  message size in bytes (default %d)\n"
+		"  -p  pin writer i to cpu i\n"
+		"  -r  run a reader alongside and check timestamp order\n",
+		name, device, nr_threads, nr_writes, msg_size);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct writer *w;
+	struct reader_stats rst = { 0, 0 };
+	pthread_t reader;
+	uint64_t *all, t0, elapsed, bytes = 0;
+	long total = 0, errors = 0, n;
+	int i, c;
+
+	while ((c = getopt(argc, argv, "d:t:n:s:prh")) != -1) {
+		switch (c) {
+		case 'd':
+			device = optarg;
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'n':
+			nr_writes = atol(optarg);
+			break;
+		case 's':
+			msg_size = atoi(optarg);
+			break;
+		case 'p':
+			pin = 1;
+			break;
+		case 'r':
+			with_reader = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_threads < 1 || nr_writes < 1 || msg_size < 1 ||
+	    msg_size > LOGGER_ENTRY_MAX_LEN - 64)
+		usage(argv[0]);
+
+	w = calloc(nr_threads, sizeof(*w));
+	if (!w)
+		return 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		w[i].id = i;
+		w[i].fd = open(device, O_WRONLY);
+		if (w[i].fd < 0) {
+			perror(device);
+			return 1;
+		}
+		w[i].lat = malloc(nr_writes * sizeof(uint64_t));
+		if (!w[i].lat) {
+			perror("malloc");
+			return 1;
+		}
+		/* fault the latency buffer in before timing */
+		memset(w[i].lat, 0, nr_writes * sizeof(uint64_t));
+		pthread_create(&w[i].thread, NULL, writer_fn, &w[i]);
+	}
+	if (with_reader)
+		pthread_create(&reader, NULL, reader_fn, &rst);
+
+	t0 = now_ns();
+	start = 1;
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(w[i].thread, NULL);
+	elapsed = now_ns() - t0;
+	stop = 1;
+	if (with_reader)
+		pthread_join(reader, NULL);
+
+	for (i = 0; i < nr_threads; i++) {
+		total += w[i].done;
+		errors += w[i].errors;
+		bytes += w[i].bytes;
+	}
+
+	all = malloc(total * sizeof(uint64_t));
+	if (!all) {
+		perror("malloc");
+		return 1;
+	}
+	for (i = 0, n = 0; i < nr_threads; i++) {
+		memcpy(all + n, w[i].lat, w[i].done * sizeof(uint64_t));
+		n += w[i].done;
+	}
+	qsort(all, total, sizeof(uint64_t), cmp_u64);
+
+	printf("%s: %d writers x %ld writes of %d bytes\n",
+	       device, nr_threads, nr_writes, msg_size);
+	printf("time %.3f s, %.0f writes/s, %.2f MB/s, %ld errors\n",
+	       elapsed / 1e9, total / (elapsed / 1e9),
+	       bytes / (elapsed / 1e9) / (1024 * 1024), errors);
+	printf("latency us: min %.1f p50 %.1f p90 %.1f p99 %.1f "
+	       "p99.9 %.1f max %.1f\n",
+	       all[0] / 1e3,
+	       percentile(all, total, 50) / 1e3,
+	       percentile(all, total, 90) / 1e3,
+	       percentile(all, total, 99) / 1e3,
+	       percentile(all, total, 99.9) / 1e3,
+	       all[total - 1] / 1e3);
+	if (with_reader)
+		printf("reader: %ld entries, %ld out of timestamp order\n",
+		       rst.entries, rst.out_of_order);
+
+	return 0;
+}
@@ -0,0 +1,400 @@
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -g -o iosched-replay iosched-replay.c -lpthread -lrt */
+
+/*
+ * Replay a block trace against a device once per I/O scheduler
+ *
+ * Reads the text output of blkparse, takes the requests queued by the
+ * traced applications (the 'Q' events) and issues them again on the given
+ * device with O_DIRECT, keeping the original spacing in time. This is
+ * repeated with every I/O scheduler the device offers (or the ones given
+ * with -s), and the read and write latencies seen under each are reported
+ * as p50/p99/max. When the scheduler keeps latency histograms
+ * (CONFIG_IOSCHED_LAT_HIST) its per queue class figures are printed too.
+ *
+ * The device has to be request based to have a scheduler at all; brd and
+ * loop devices are not. To replay against memory, use scsi_debug:
+ *
+ *	modprobe scsi_debug dev_size_mb=512 delay=0
+ *	blktrace -d /dev/mmcblk0 -o - | blkparse -i - > trace.txt
+ *	iosched-replay -d sdb -i trace.txt -w
+ *
+ * Offsets past the end of the device are wrapped. Writes are only issued
+ * with -w, as they destroy whatever is on the device.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2, as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#define SECTOR_SIZE	512
+#define MAX_SCHEDS	16
+
+struct io {
+	double		when;		/* seconds since the first event */
+	uint64_t	offset;
+	uint32_t	len;
+	int		write;
+	double		lat_us;
+};
+
+static struct io *ios;
+static size_t nr_ios, max_ios = 1000000;
+static uint32_t max_len;
+
+static const char *dev_name;
+static const char *trace_file = "-";
+static char action = 'Q';
+static int nr_threads = 8;
+static double speed = 1.0;
+static int allow_writes;
+
+static int fd;
+static uint64_t dev_size;
+static size_t next_io;
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct timespec start;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s -d dev [-i trace] [-s sched,...] [-t threads]\n"
+		"       [-x speed] [-a action] [-n max_ios] [-w]\n"
+		"  -d  block device, e.g. sdb\n"
+		"  -i  blkparse output (default stdin)\n"
+		"  -s  schedulers to compare (default all the device has)\n"
+		"  -t  number of I/O threads, the queue depth (default %d)\n"
+		"  -x  replay speed factor, 0 for back to back (default %.1f)\n"
+		"  -a  blkparse action to replay (default %c)\n"
+		"  -n  replay at most this many requests (default %zu)\n"
+		"  -w  replay writes too, destroying the device contents\n",
+		prog, nr_threads, speed, action, max_ios);
+	exit(1);
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double ts_diff(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/*
+ * Default blkparse line:
+ *   8,0    1       17     0.000301551  1234  Q  WS 3563520 + 8 [jbd2/sda1-8]
+ */
+static void read_trace(void)
+{
+	FILE *f = strcmp(trace_file, "-") ? fopen(trace_file, "r") : stdin;
+	char line[512], act[8], rwbs[16];
+	unsigned long long sector;
+	unsigned int sectors;
+	double t, t0 = -1;
+	size_t skipped = 0;
+
+	if (!f)
+		die(trace_file);
+	ios = calloc(max_ios, sizeof(*ios));
+	if (!ios)
+		die("calloc");
+
+	while (nr_ios < max_ios && fgets(line, sizeof(line), f)) {
+		struct io *io = &ios[nr_ios];
+
+		if (sscanf(line, "%*s %*u %*u %lf %*u %7s %15s %llu + %u",
+			   &t, act, rwbs, &sector, &sectors) != 5)
+			continue;
+		if (act[0] != action || act[1] || !sectors)
+			continue;
+		/* discards and flushes have no data to replay */
+		if (strchr(rwbs, 'D') || strchr(rwbs, 'F') ||
+		    (!strchr(rwbs, 'R') && !strchr(rwbs, 'W')))
+			continue;
+		io->write = !!strchr(rwbs, 'W');
+		if (io->write && !allow_writes) {
+			skipped++;
+			continue;
+		}
+		if (t0 < 0)
+			t0 = t;
+		io->when = t - t0;
+		io->offset = sector * SECTOR_SIZE;
+		io->len = sectors * SECTOR_SIZE;
+		if (io->len > max_len)
+			max_len = io->len;
+		nr_ios++;
+	}
+	if (f != stdin)
+		fclose(f);
+	if (!nr_ios) {
+		fprintf(stderr, "no '%c' events in %s\n", action, trace_file);
+		exit(1);
+	}
+	if (skipped)
+		fprintf(stderr, "skipped %zu writes, use -w to replay them\n",
+			skipped);
+}
+
+static void *replay_thread(void *arg)
+{
+	void *buf;
+	(void)arg;
+
+	if (posix_memalign(&buf, 4096, max_len))
+		die("posix_memalign");
+	memset(buf, 0x5a, max_len);
+
+	for (;;) {
+		struct timespec due, t1, t2;
+		struct io *io;
+		uint64_t off;
+		ssize_t ret;
+
+		pthread_mutex_lock(&next_lock);
+		io = next_io < nr_ios ? &ios[next_io++] : NULL;
+		pthread_mutex_unlock(&next_lock);
+		if (!io)
+			break;
+
+		if (speed > 0) {
+			double when = io->when / speed;
+
+			due = start;
+			due.tv_sec += (time_t)when;
+			due.tv_nsec += (long)((when - (time_t)when) * 1e9);
+			if (due.tv_nsec >= 1000000000) {
+				due.tv_sec++;
+				due.tv_nsec -= 1000000000;
+			}
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &due, NULL) == EINTR)
+				;
+		}
+
+		off = io->offset % (dev_size - io->len);
+		off &= ~(uint64_t)(SECTOR_SIZE - 1);
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (io->write)
+			ret = pwrite(fd, buf, io->len, off);
+		else
+			ret = pread(fd, buf, io->len, off);
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		if (ret != (ssize_t)io->len)
+			die(io->write ? "pwrite" : "pread");
+		io->lat_us = ts_diff(&t1, &t2) * 1e6;
+	}
+	free(buf);
+	return NULL;
+}
+
+static int sysfs_read(const char *attr, char *buf, size_t size)
+{
+	char path[256];
+	ssize_t n;
+	int f;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/queue/%s", dev_name, attr);
+	f = open(path, O_RDONLY);
+	if (f < 0)
+		return -1;
+	n = read(f, buf, size - 1);
+	close(f);
+	if (n < 0)
+		return -1;
+	buf[n] = 0;
+	return 0;
+}
+
+static int sysfs_write(const char *attr, const char *val)
+{
+	char path[256];
+	int f, ret;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/queue/%s", dev_name, attr);
+	f = open(path, O_WRONLY);
+	if (f < 0)
+		return -1;
+	ret = write(f, val, strlen(val)) < 0 ? -1 : 0;
+	close(f);
+	return ret;
+}
+
+/* "noop deadline [row] sio" -> list of names, *cur set to the active one */
+static int parse_scheds(char *s, char **names, char **cur)
+{
+	char *tok, *save;
+	int n = 0;
+
+	for (tok = strtok_r(s, " \n", &save); tok && n < MAX_SCHEDS;
+	     tok = strtok_r(NULL, " \n", &save)) {
+		if (tok[0] == '[') {
+			tok++;
+			tok[strlen(tok) - 1] = 0;
+			if (cur)
+				*cur = tok;
+		}
+		names[n++] = tok;
+	}
+	return n;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *sched, int write, double *lat)
+{
+	size_t i, n = 0;
+	double sum = 0;
+
+	for (i = 0; i < nr_ios; i++) {
+		if (ios[i].write != write)
+			continue;
+		lat[n++] = ios[i].lat_us;
+		sum += ios[i].lat_us;
+	}
+	if (!n)
+		return;
+	qsort(lat, n, sizeof(*lat), cmp_double);
+	printf("%-10s %-5s %8zu %10.0f %10.0f %10.0f %10.0f\n", sched,
+	       write ? "write" : "read", n, sum / n, lat[(n - 1) / 2],
+	       lat[(n * 99 + 99) / 100 - 1], lat[n - 1]);
+}
+
+static void run(const char *sched, double *lat)
+{
+	pthread_t threads[nr_threads];
+	struct timespec end;
+	char buf[4096];
+	int i;
+
+	if (sysfs_write("scheduler", sched)) {
+		fprintf(stderr, "cannot select %s on %s: %s\n", sched,
+			dev_name, strerror(errno));
+		return;
+	}
+	/* clears the histograms of a scheduler that keeps them */
+	sysfs_write("iosched/lat_hist", "0");
+
+	next_io = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, replay_thread, NULL))
+			die("pthread_create");
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	report(sched, 0, lat);
+	report(sched, 1, lat);
+	fprintf(stderr, "%s: %zu requests in %.2fs\n", sched, nr_ios,
+		ts_diff(&start, &end));
+
+	if (!sysfs_read("iosched/lat_pct", buf, sizeof(buf)))
+		fprintf(stderr, "%s", buf);
+}
+
+int main(int argc, char **argv)
+{
+	char avail[512], path[256], *names[MAX_SCHEDS], *cur = NULL;
+	char *sched_list = NULL, orig[64];
+	double *lat;
+	int c, i, n;
+
+	while ((c = getopt(argc, argv, "d:i:s:t:x:a:n:w")) != -1) {
+		switch (c) {
+		case 'd':
+			dev_name = optarg;
+			if (!strncmp(dev_name, "/dev/", 5))
+				dev_name += 5;
+			break;
+		case 'i':
+			trace_file = optarg;
+			break;
+		case 's':
+			sched_list = optarg;
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'x':
+			speed = atof(optarg);
+			break;
+		case 'a':
+			action = optarg[0];
+			break;
+		case 'n':
+			max_ios = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			allow_writes = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!dev_name || nr_threads < 1 || !max_ios || speed < 0)
+		usage(argv[0]);
+
+	if (sysfs_read("scheduler", avail, sizeof(avail)) ||
+	    !(n = parse_scheds(avail, names, &cur)) || !cur) {
+		fprintf(stderr, "%s has no I/O scheduler (bio based device?)\n",
+			dev_name);
+		return 1;
+	}
+	snprintf(orig, sizeof(orig), "%s", cur);
+	if (sched_list) {
+		n = 0;
+		for (names[n] = strtok(sched_list, ","); names[n] &&
+		     n < MAX_SCHEDS - 1; names[++n] = strtok(NULL, ","))
+			;
+	}
+
+	read_trace();
+
+	snprintf(path, sizeof(path), "/dev/%s", dev_name);
+	fd = open(path, (allow_writes ? O_RDWR : O_RDONLY) | O_DIRECT);
+	if (fd < 0)
+		die(path);
+	if (ioctl(fd, BLKGETSIZE64, &dev_size))
+		die("BLKGETSIZE64");
+	if (dev_size <= max_len) {
+		fprintf(stderr, "%s is too small for the trace\n", path);
+		return 1;
+	}
+
+	lat = malloc(nr_ios * sizeof(*lat));
+	if (!lat)
+		die("malloc");
+
+	printf("%-10s %-5s %8s %10s %10s %10s %10s\n", "sched", "dir",
+	       "count", "mean_us", "p50_us", "p99_us", "max_us");
+	for (i = 0; i < n; i++)
+		run(names[i], lat);
+
+	sysfs_write("scheduler", orig);
+	close(fd);
+	free(lat);
+	free(ios);
+	return 0;
+}
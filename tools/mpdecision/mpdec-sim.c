@@ -0,0 +1,406 @@
+/* cc -Wall -Wextra -O2 -g -o mpdec-sim mpdec-sim.c */
+
+/*
+ * Offline simulator for msm_mpdecision hotplug policies
+ *
+ * Replays a recorded demand trace through the legacy threshold policy
+ * and through the predictive one, and reports for each how late cores
+ * came online when demand exceeded the online capacity, and how many
+ * core-seconds were spent online without being needed.
+ *
+ * Record a trace on the device with
+ *
+ *	echo 1 > /sys/kernel/debug/tracing/events/mpdecision/enable
+ *	cat /sys/kernel/debug/tracing/trace_pipe > mpdec.trace
+ *
+ * and replay it with
+ *
+ *	mpdec-sim -n 2 mpdec.trace
+ *
+ * Lines without an mpdec_decision event are read as
+ * "<seconds> <rq_avg> <load> <online>", so other recordings of
+ * rq_stats can be fed in too.
+ *
+ * The demand recorded on the device is taken as given, whatever the
+ * simulated policy does: the model ignores that fewer cores would have
+ * made the same work take longer.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2, as published
+ * by the Free Software Foundation.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct sample {
+	double		t;		/* seconds */
+	unsigned int	rq_avg;		/* tenths of a runnable task */
+	unsigned int	demand;		/* % of one cpu */
+};
+
+static struct sample *samples;
+static size_t nr_samples;
+
+/* tunables, defaults as in msm_mpdecision.c */
+static unsigned int max_cpus = 2, min_cpus = 1;
+static unsigned int delay_ms;			/* 0: from the trace */
+static unsigned int up_cost_us = 10000, down_cost_us = 10000;
+static unsigned int ewma_alpha = 50, trend_beta = 30;
+static unsigned int up_load = 80, down_load = 60, min_offline_ms = 1000;
+static unsigned int load_limit[2] = {35, 5};
+static unsigned int time_limit[2] = {90, 450};
+
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#define min(a, b)	((a) < (b) ? (a) : (b))
+
+/* ---- copy of the predictor in arch/arm/mach-msm/msm_mpdecision.c ---- */
+
+#define MPDEC_HIST_LEN			8
+#define MPDEC_FP_SHIFT			8
+
+static struct msm_mpdec_pred {
+	unsigned int hist[MPDEC_HIST_LEN];
+	unsigned int hist_idx;
+	int level;
+	int trend;
+	bool primed;
+	unsigned int up_cost_us;
+	unsigned int down_cost_us;
+} mpdec_pred;
+
+static int mpdec_extrapolate(int samples)
+{
+	int f = mpdec_pred.level + samples * mpdec_pred.trend;
+
+	return f > 0 ? f >> MPDEC_FP_SHIFT : 0;
+}
+
+static int mpdec_predict(unsigned int demand, unsigned int online,
+			 int *forecast)
+{
+	struct msm_mpdec_pred *p = &mpdec_pred;
+	unsigned int alpha = min(ewma_alpha, 100U);
+	unsigned int beta = min(trend_beta, 100U);
+	unsigned int delay_us = max(delay_ms, 1U) * 1000;
+	unsigned int i, hist_max = 0, down_ms, cap;
+	int x = demand << MPDEC_FP_SHIFT, prev, f_up, f_down;
+
+	p->hist[p->hist_idx] = demand;
+	p->hist_idx = (p->hist_idx + 1) % MPDEC_HIST_LEN;
+	for (i = 0; i < MPDEC_HIST_LEN; i++)
+		hist_max = max(hist_max, p->hist[i]);
+
+	if (!p->primed) {
+		p->level = x;
+		p->trend = 0;
+		p->primed = true;
+	} else {
+		prev = p->level;
+		p->level = ((int)alpha * x +
+			    (100 - (int)alpha) * (p->level + p->trend)) / 100;
+		p->trend = ((int)beta * (p->level - prev) +
+			    (100 - (int)beta) * p->trend) / 100;
+	}
+
+	f_up = mpdec_extrapolate(1 + p->up_cost_us / delay_us);
+	down_ms = max(min_offline_ms,
+		      10 * (p->up_cost_us + p->down_cost_us) / 1000);
+	f_down = mpdec_extrapolate(down_ms * 1000 / delay_us);
+	*forecast = f_up;
+
+	if (online < max_cpus && (unsigned int)max((int)demand, f_up) >
+	    online * up_load)
+		return 1;
+
+	if (online > min_cpus) {
+		cap = (online - 1) * down_load;
+		if (hist_max < cap && (unsigned int)f_up < cap &&
+		    (unsigned int)f_down < cap)
+			return -1;
+	}
+	return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+
+static double legacy_total_time;
+
+/*
+ * The legacy policy, with the same two limits for every cpu count; the
+ * kernel only has limits for going between one and two cpus.
+ */
+static int legacy_decide(const struct sample *s, unsigned int online,
+			 double dt)
+{
+	legacy_total_time += dt * 1000;
+	if (online < max_cpus && s->rq_avg >= load_limit[0]) {
+		if (legacy_total_time >= time_limit[0]) {
+			legacy_total_time = 0;
+			return 1;
+		}
+	} else if (online > min_cpus && s->rq_avg <= load_limit[1]) {
+		if (legacy_total_time >= time_limit[1]) {
+			legacy_total_time = 0;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int predictive_decide(const struct sample *s, unsigned int online,
+			     double dt)
+{
+	int forecast;
+
+	(void)dt;
+	return mpdec_predict(s->demand, online, &forecast);
+}
+
+struct result {
+	unsigned int	ups, downs;
+	unsigned int	episodes;	/* demand above capacity, fixed by an up */
+	unsigned int	unserved;	/* demand above capacity, went away */
+	double		*lat;		/* time from demand to core online */
+	double		deficit_cs;	/* core-seconds of demand without a core */
+	double		wasted_cs;	/* core-seconds online without demand */
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static unsigned int needed_cpus(unsigned int demand)
+{
+	unsigned int n = (demand + 99) / 100;
+
+	return min(max(n, min_cpus), max_cpus);
+}
+
+static void simulate(const char *name,
+		     int (*decide)(const struct sample *, unsigned int, double))
+{
+	struct result r = { 0 };
+	unsigned int online = max_cpus, need;
+	double short_since = -1, up_at = -1, dt;
+	size_t i;
+
+	memset(&mpdec_pred, 0, sizeof(mpdec_pred));
+	mpdec_pred.up_cost_us = up_cost_us;
+	mpdec_pred.down_cost_us = down_cost_us;
+	legacy_total_time = 0;
+	r.lat = calloc(nr_samples, sizeof(*r.lat));
+	if (!r.lat) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (i = 0; i + 1 < nr_samples; i++) {
+		const struct sample *s = &samples[i];
+		int action;
+
+		dt = samples[i + 1].t - s->t;
+		if (dt <= 0)
+			continue;
+
+		/*
+		 * A core that was brought up is usable up_cost_us later; if
+		 * demand was already waiting for it, that is the latency.
+		 */
+		if (up_at >= 0 && s->t >= up_at) {
+			online++;
+			if (short_since >= 0)
+				r.lat[r.episodes++] = (up_at - short_since) * 1000;
+			short_since = -1;
+			up_at = -1;
+		}
+
+		need = needed_cpus(s->demand);
+		if (need > online) {
+			r.deficit_cs += (need - online) * dt;
+			if (short_since < 0)
+				short_since = s->t;
+		} else {
+			/* demand went away before a core came online */
+			if (short_since >= 0)
+				r.unserved++;
+			short_since = -1;
+			r.wasted_cs += (online - need) * dt;
+		}
+
+		action = decide(s, online + (up_at >= 0), dt);
+		if (action > 0 && up_at < 0 && online < max_cpus) {
+			r.ups++;
+			up_at = s->t + up_cost_us / 1e6;
+		} else if (action < 0 && online > min_cpus && up_at < 0) {
+			r.downs++;
+			online--;
+		}
+	}
+
+	qsort(r.lat, r.episodes, sizeof(*r.lat), cmp_double);
+	printf("%-10s %5u %5u %8u %8u %10.1f %10.1f %10.1f %10.2f %10.2f\n",
+	       name, r.ups, r.downs, r.episodes, r.unserved,
+	       r.episodes ? r.lat[(r.episodes - 1) / 2] : 0.0,
+	       r.episodes ? r.lat[(r.episodes * 95 + 99) / 100 - 1] : 0.0,
+	       r.episodes ? r.lat[r.episodes - 1] : 0.0,
+	       r.deficit_cs, r.wasted_cs);
+	free(r.lat);
+}
+
+static void read_trace(FILE *f)
+{
+	size_t alloc = 0;
+	char line[512];
+
+	while (fgets(line, sizeof(line), f)) {
+		unsigned int rq_avg, load, demand, online;
+		char *ev = strstr(line, " mpdec_decision: ");
+		double t;
+		int forecast, action;
+
+		if (ev) {
+			char *ts = ev;
+
+			/* the timestamp is the word before the event name */
+			while (ts > line && ts[-1] == ' ')
+				ts--;
+			while (ts > line && ts[-1] != ' ')
+				ts--;
+			if (sscanf(ts, "%lf", &t) != 1 ||
+			    sscanf(ev, " mpdec_decision: rq_avg=%u load=%u "
+				   "demand=%u forecast=%d online=%u action=%d",
+				   &rq_avg, &load, &demand, &forecast, &online,
+				   &action) != 6)
+				continue;
+		} else {
+			if (line[0] == '#' ||
+			    sscanf(line, "%lf %u %u %u", &t, &rq_avg, &load,
+				   &online) != 4)
+				continue;
+			demand = load;
+			if (rq_avg * 10 > online * 100)
+				demand += rq_avg * 10 - online * 100;
+		}
+
+		if (nr_samples == alloc) {
+			alloc = alloc ? 2 * alloc : 4096;
+			samples = realloc(samples, alloc * sizeof(*samples));
+			if (!samples) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		samples[nr_samples].t = t;
+		samples[nr_samples].rq_avg = rq_avg;
+		samples[nr_samples].demand = demand;
+		nr_samples++;
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options] [trace]\n"
+		"  -n cpus        number of cpus (default %u)\n"
+		"  -s ms          sampling delay (default: from the trace)\n"
+		"  -u us          cpu_up() cost (default %u)\n"
+		"  -d us          cpu_down() cost (default %u)\n"
+		"  -a pct         ewma_alpha (default %u)\n"
+		"  -b pct         trend_beta (default %u)\n"
+		"  -U pct         up_load (default %u)\n"
+		"  -D pct         down_load (default %u)\n"
+		"  -m ms          min_offline_ms (default %u)\n"
+		"  -L up,down     legacy load_limit (default %u,%u)\n"
+		"  -T up,down     legacy time_limit (default %u,%u)\n",
+		prog, max_cpus, up_cost_us, down_cost_us, ewma_alpha,
+		trend_beta, up_load, down_load, min_offline_ms,
+		load_limit[0], load_limit[1], time_limit[0], time_limit[1]);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	FILE *f = stdin;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:u:d:a:b:U:D:m:L:T:")) != -1) {
+		switch (c) {
+		case 'n':
+			max_cpus = atoi(optarg);
+			break;
+		case 's':
+			delay_ms = atoi(optarg);
+			break;
+		case 'u':
+			up_cost_us = atoi(optarg);
+			break;
+		case 'd':
+			down_cost_us = atoi(optarg);
+			break;
+		case 'a':
+			ewma_alpha = atoi(optarg);
+			break;
+		case 'b':
+			trend_beta = atoi(optarg);
+			break;
+		case 'U':
+			up_load = atoi(optarg);
+			break;
+		case 'D':
+			down_load = atoi(optarg);
+			break;
+		case 'm':
+			min_offline_ms = atoi(optarg);
+			break;
+		case 'L':
+			if (sscanf(optarg, "%u,%u", &load_limit[0],
+				   &load_limit[1]) != 2)
+				usage(argv[0]);
+			break;
+		case 'T':
+			if (sscanf(optarg, "%u,%u", &time_limit[0],
+				   &time_limit[1]) != 2)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (max_cpus < 1)
+		usage(argv[0]);
+	if (optind < argc) {
+		f = fopen(argv[optind], "r");
+		if (!f) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	read_trace(f);
+	if (nr_samples < 2) {
+		fprintf(stderr, "need at least two samples\n");
+		return 1;
+	}
+	if (!delay_ms) {
+		double span = samples[nr_samples - 1].t - samples[0].t;
+
+		delay_ms = max((unsigned int)(span * 1000 / (nr_samples - 1)),
+			       1U);
+	}
+	printf("%zu samples over %.1fs, %u ms apart, %u cpus\n", nr_samples,
+	       samples[nr_samples - 1].t - samples[0].t, delay_ms, max_cpus);
+
+	printf("%-10s %5s %5s %8s %8s %10s %10s %10s %10s %10s\n", "policy",
+	       "ups", "downs", "episodes", "unserved", "lat_p50ms",
+	       "lat_p95ms", "lat_maxms", "deficit_cs", "wasted_cs");
+	simulate("legacy", legacy_decide);
+	simulate("predictive", predictive_decide);
+	return 0;
+}
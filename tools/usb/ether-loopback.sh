@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# Loop traffic through the USB ethernet gadget on one machine.
+#
+# With dummy_hcd the gadget's network interface (usb0) and the one the
+# host side driver (rndis_host, cdc_ether, cdc_ncm) binds to it show up
+# on the same system.  The host side interface is moved into its own
+# network namespace so packets really cross the USB link, then the
+# link is exercised with ping and, if installed, iperf in both
+# directions.
+#
+#   modprobe dummy_hcd
+#   modprobe g_ether		# or the android gadget with rndis enabled
+#   sh ether-loopback.sh
+#
+# The gadget side knobs to compare runs with are the u_ether rx_budget
+# and the f_rndis rndis_{dl,ul}_max_pkt_per_xfer parameters.
+#
+# GADGET_IF, HOST_IF and DURATION may be set in the environment.
+#
+
+GADGET_IF=${GADGET_IF:-usb0}
+DURATION=${DURATION:-10}
+NS=uhost
+GADGET_IP=192.168.77.1
+HOST_IP=192.168.77.2
+
+# the host side interface is the one bound to a USB networking driver
+if [ "$HOST_IF" = "" ]; then
+	for dev in /sys/class/net/*; do
+		drv=$(basename "$(readlink $dev/device/driver)" 2>/dev/null)
+		case "$drv" in
+		rndis_host|cdc_ether|cdc_ncm|cdc_eem|cdc_subset)
+			HOST_IF=$(basename $dev)
+			break
+			;;
+		esac
+	done
+fi
+if [ "$HOST_IF" = "" ]; then
+	echo "no host side USB network interface; is the gadget bound?"
+	exit 1
+fi
+if [ ! -e /sys/class/net/$GADGET_IF ]; then
+	echo "no gadget interface $GADGET_IF"
+	exit 1
+fi
+
+echo "gadget $GADGET_IF <-> host $HOST_IF"
+
+cleanup () {
+	ip netns delete $NS 2>/dev/null
+	ip addr flush dev $GADGET_IF 2>/dev/null
+}
+trap cleanup 0
+
+ip netns add $NS || exit 1
+ip link set $HOST_IF netns $NS || exit 1
+ip netns exec $NS ip addr add $HOST_IP/24 dev $HOST_IF
+ip netns exec $NS ip link set $HOST_IF up
+ip addr add $GADGET_IP/24 dev $GADGET_IF
+ip link set $GADGET_IF up
+
+# give the host side (RNDIS in particular) time to initialize the link
+sleep 2
+
+ping -c 10 -i 0.2 $HOST_IP || exit 1
+ping -c 10 -i 0.2 -s 1472 $HOST_IP || exit 1
+
+if which iperf > /dev/null 2>&1; then
+	ip netns exec $NS iperf -s > /dev/null 2>&1 &
+	SERVER=$!
+	sleep 1
+
+	echo "gadget -> host (IN transfers)"
+	iperf -c $HOST_IP -t $DURATION
+	kill $SERVER
+
+	iperf -s > /dev/null 2>&1 &
+	SERVER=$!
+	sleep 1
+
+	echo "host -> gadget (OUT transfers)"
+	ip netns exec $NS iperf -c $GADGET_IP -t $DURATION
+	kill $SERVER
+fi
+
+ip -s link show $GADGET_IF
@@ -0,0 +1,394 @@
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -g -o mtp-xfer mtp-xfer.c -lrt */
+
+/*
+ * End to end MTP file transfer test
+ *
+ * Drives both sides of a f_mtp bulk file transfer, so that the whole
+ * path can be checked and timed on one machine with dummy_hcd: the
+ * gadget side issues MTP_SEND_FILE / MTP_RECEIVE_FILE on /dev/mtp_usb
+ * the way the MTP daemon does, and the host side streams the data
+ * through usbfs with several URBs in flight, as a desktop initiator
+ * would.
+ *
+ *   # android gadget with the mtp function, bound to dummy_udc
+ *   mtp-xfer device send big.bin &
+ *   mtp-xfer host recv /dev/bus/usb/001/002 out.bin $(stat -c %s big.bin)
+ *   cmp big.bin out.bin
+ *
+ *   mtp-xfer device recv in.bin $(stat -c %s big.bin) &
+ *   mtp-xfer host send /dev/bus/usb/001/002 big.bin
+ *
+ * Both sides print their throughput. The gadget side request sizes are
+ * the mtp_tx_req_len, mtp_tx_reqs, mtp_rx_req_len and mtp_rx_reqs
+ * parameters of the android gadget.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2, as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/usbdevice_fs.h>
+#include <linux/usb/ch9.h>
+
+/* from include/linux/usb/f_mtp.h */
+struct mtp_file_range {
+	int		fd;
+	int64_t		offset;
+	int64_t		length;
+	uint16_t	command;
+	uint32_t	transaction_id;
+};
+
+#define MTP_SEND_FILE		_IOW('M', 0, struct mtp_file_range)
+#define MTP_RECEIVE_FILE	_IOW('M', 1, struct mtp_file_range)
+
+#define MAX_URBS	64
+
+static const char *mtp_device = "/dev/mtp_usb";
+static unsigned int urb_size = 16384;
+static unsigned int nr_urbs = 16;
+static int interface = -1;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, long long bytes, double secs)
+{
+	printf("%s: %lld bytes in %.3f s, %.1f MB/s\n", what, bytes, secs,
+	       secs > 0 ? bytes / secs / (1024 * 1024) : 0.0);
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/* gadget side: hand the file to f_mtp and wait for the transfer */
+static int device_xfer(int send, const char *path, long long length)
+{
+	struct mtp_file_range mfr;
+	struct stat st;
+	double start;
+	int fd, mtp;
+
+	fd = send ? open(path, O_RDONLY) :
+		    open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die(path);
+	if (send) {
+		if (fstat(fd, &st) < 0)
+			die("fstat");
+		length = st.st_size;
+	}
+
+	mtp = open(mtp_device, O_RDWR);
+	if (mtp < 0)
+		die(mtp_device);
+
+	memset(&mfr, 0, sizeof(mfr));
+	mfr.fd = fd;
+	mfr.offset = 0;
+	mfr.length = length;
+
+	start = now();
+	if (ioctl(mtp, send ? MTP_SEND_FILE : MTP_RECEIVE_FILE, &mfr) < 0)
+		die(send ? "MTP_SEND_FILE" : "MTP_RECEIVE_FILE");
+	report(send ? "device send" : "device recv", length, now() - start);
+
+	close(mtp);
+	close(fd);
+	return 0;
+}
+
+/*
+ * Find the bulk endpoints of the MTP interface (vendor specific, or
+ * still image for PTP) in the descriptors usbfs returns on read.
+ */
+static void find_endpoints(int dev, unsigned char *ep_in,
+			   unsigned char *ep_out, unsigned int *maxpacket)
+{
+	unsigned char buf[4096];
+	int len, pos, intf = -1, found = -1;
+
+	len = read(dev, buf, sizeof(buf));
+	if (len < (int)USB_DT_DEVICE_SIZE)
+		die("read descriptors");
+
+	*ep_in = *ep_out = 0;
+	for (pos = 0; pos + 2 <= len && buf[pos]; pos += buf[pos]) {
+		struct usb_interface_descriptor *id = (void *)(buf + pos);
+		struct usb_endpoint_descriptor *ed = (void *)(buf + pos);
+
+		if (buf[pos + 1] == USB_DT_INTERFACE) {
+			intf = -1;
+			if (found >= 0)
+				break;
+			if ((interface < 0 &&
+			     (id->bInterfaceClass == USB_CLASS_VENDOR_SPEC ||
+			      id->bInterfaceClass == USB_CLASS_STILL_IMAGE)) ||
+			    id->bInterfaceNumber == interface)
+				intf = id->bInterfaceNumber;
+		} else if (buf[pos + 1] == USB_DT_ENDPOINT && intf >= 0 &&
+			   (ed->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK) ==
+			   USB_ENDPOINT_XFER_BULK) {
+			if (ed->bEndpointAddress & USB_DIR_IN)
+				*ep_in = ed->bEndpointAddress;
+			else
+				*ep_out = ed->bEndpointAddress;
+			*maxpacket = ed->wMaxPacketSize;
+			found = intf;
+		}
+	}
+
+	if (found < 0 || !*ep_in || !*ep_out) {
+		fprintf(stderr, "no MTP bulk endpoints found\n");
+		exit(1);
+	}
+	interface = found;
+	if (ioctl(dev, USBDEVFS_CLAIMINTERFACE, &interface) < 0)
+		die("USBDEVFS_CLAIMINTERFACE");
+}
+
+static struct usbdevfs_urb *reap(int dev)
+{
+	struct usbdevfs_urb *urb;
+
+	if (ioctl(dev, USBDEVFS_REAPURB, &urb) < 0)
+		die("USBDEVFS_REAPURB");
+	return urb;
+}
+
+static void submit(int dev, struct usbdevfs_urb *urb, unsigned char ep,
+		   int length)
+{
+	urb->type = USBDEVFS_URB_TYPE_BULK;
+	urb->endpoint = ep;
+	urb->buffer_length = length;
+	urb->actual_length = 0;
+	urb->status = 0;
+	if (ioctl(dev, USBDEVFS_SUBMITURB, urb) < 0)
+		die("USBDEVFS_SUBMITURB");
+}
+
+/*
+ * host side IN: keep nr_urbs reads queued; URBs complete in order, and
+ * the transfer ends with a short packet, which f_mtp makes a zero length
+ * one when the file is a multiple of the packet size
+ */
+static int host_recv(int dev, unsigned char ep, const char *path,
+		     long long length)
+{
+	struct usbdevfs_urb urbs[MAX_URBS];
+	char *bufs[MAX_URBS];
+	long long got = 0;
+	int inflight = 0, done = 0;
+	unsigned int i;
+	double start;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die(path);
+
+	start = now();
+	for (i = 0; i < nr_urbs; i++) {
+		memset(&urbs[i], 0, sizeof(urbs[i]));
+		bufs[i] = malloc(urb_size);
+		if (!bufs[i])
+			die("malloc");
+		urbs[i].buffer = bufs[i];
+		urbs[i].usercontext = (void *)(long)i;
+		submit(dev, &urbs[i], ep, urb_size);
+		inflight++;
+	}
+
+	while (inflight) {
+		struct usbdevfs_urb *urb = reap(dev);
+
+		inflight--;
+		if (done)
+			continue;
+		if (urb->status < 0) {
+			fprintf(stderr, "IN urb status %d\n", urb->status);
+			exit(1);
+		}
+		if (write(fd, urb->buffer, urb->actual_length) !=
+		    urb->actual_length)
+			die("write");
+		got += urb->actual_length;
+
+		if ((unsigned int)urb->actual_length < urb_size) {
+			/* the rest would take data of the next transfer */
+			done = 1;
+			for (i = 0; i < nr_urbs; i++)
+				if (&urbs[i] != urb)
+					ioctl(dev, USBDEVFS_DISCARDURB,
+					      &urbs[i]);
+			continue;
+		}
+		submit(dev, urb, ep, urb_size);
+		inflight++;
+	}
+	report("host recv", got, now() - start);
+
+	close(fd);
+	if (got != length) {
+		fprintf(stderr, "expected %lld bytes, got %lld\n", length, got);
+		return 1;
+	}
+	return 0;
+}
+
+/* host side OUT: keep nr_urbs writes queued until the file is sent */
+static int host_send(int dev, unsigned char ep, const char *path)
+{
+	struct usbdevfs_urb urbs[MAX_URBS];
+	char *bufs[MAX_URBS];
+	long long sent = 0;
+	int inflight = 0, eof = 0;
+	unsigned int i;
+	double start;
+	ssize_t n;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		die(path);
+
+	start = now();
+	for (i = 0; i < nr_urbs && !eof; i++) {
+		memset(&urbs[i], 0, sizeof(urbs[i]));
+		bufs[i] = malloc(urb_size);
+		if (!bufs[i])
+			die("malloc");
+		urbs[i].buffer = bufs[i];
+		n = read(fd, bufs[i], urb_size);
+		if (n < 0)
+			die("read");
+		if (n == 0) {
+			eof = 1;
+			break;
+		}
+		submit(dev, &urbs[i], ep, n);
+		inflight++;
+	}
+
+	while (inflight) {
+		struct usbdevfs_urb *urb = reap(dev);
+
+		inflight--;
+		if (urb->status < 0) {
+			fprintf(stderr, "OUT urb status %d\n", urb->status);
+			exit(1);
+		}
+		sent += urb->actual_length;
+		if (eof)
+			continue;
+
+		n = read(fd, urb->buffer, urb_size);
+		if (n < 0)
+			die("read");
+		if (n == 0) {
+			eof = 1;
+			continue;
+		}
+		submit(dev, urb, ep, n);
+		inflight++;
+	}
+	report("host send", sent, now() - start);
+
+	close(fd);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] device send FILE\n"
+		"       %s [options] device recv FILE LENGTH\n"
+		"       %s [options] host recv USBDEV FILE LENGTH\n"
+		"       %s [options] host send USBDEV FILE\n"
+		"  -m PATH   gadget side MTP device (default %s)\n"
+		"  -s BYTES  host URB size (default %u)\n"
+		"  -n COUNT  host URBs in flight (default %u, max %d)\n"
+		"  -i NUM    interface number (default: first MTP/PTP one)\n",
+		name, name, name, name, mtp_device, urb_size, nr_urbs,
+		MAX_URBS);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char ep_in, ep_out;
+	unsigned int maxpacket = 0;
+	int opt, dev, send;
+
+	while ((opt = getopt(argc, argv, "m:s:n:i:")) != -1) {
+		switch (opt) {
+		case 'm':
+			mtp_device = optarg;
+			break;
+		case 's':
+			urb_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_urbs = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			interface = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 2 || !urb_size || !nr_urbs || nr_urbs > MAX_URBS)
+		usage(argv[-optind]);
+	send = !strcmp(argv[1], "send");
+	if (!send && strcmp(argv[1], "recv"))
+		usage(argv[-optind]);
+
+	if (!strcmp(argv[0], "device")) {
+		if (argc != (send ? 3 : 4))
+			usage(argv[-optind]);
+		return device_xfer(send, argv[2],
+				   send ? 0 : strtoll(argv[3], NULL, 0));
+	}
+
+	if (strcmp(argv[0], "host") || argc != (send ? 4 : 5))
+		usage(argv[-optind]);
+
+	dev = open(argv[2], O_RDWR);
+	if (dev < 0)
+		die(argv[2]);
+	find_endpoints(dev, &ep_in, &ep_out, &maxpacket);
+	if (urb_size % maxpacket) {
+		fprintf(stderr, "URB size must be a multiple of %u\n",
+			maxpacket);
+		return 2;
+	}
+
+	if (send)
+		return host_send(dev, ep_out, argv[3]);
+	return host_recv(dev, ep_in, argv[3], strtoll(argv[4], NULL, 0));
+}